@@ -74,6 +74,19 @@ int		 sbuf_len(struct sbuf *);
 int		 sbuf_done(struct sbuf *);
 void		 sbuf_delete(struct sbuf *);
 
+#ifndef KERNEL
+/*
+ * Userland extensions: an autoextending sbuf, and a drain that a full
+ * buffer is emptied into instead of overflowing; sbuf_fd_drain writes to
+ * the file descriptor passed as arg.
+ */
+typedef int (sbuf_drain_func)(void *, const char *, int);
+
+struct sbuf	*sbuf_new_auto(void);
+void		 sbuf_set_drain(struct sbuf *, sbuf_drain_func *, void *);
+int		 sbuf_fd_drain(void *, const char *, int);
+#endif
+
 #ifdef KERNEL
 struct uio;
 struct sbuf	*sbuf_uionew(struct sbuf *, struct uio *, int *);
@@ -20,7 +20,33 @@ xpc_object_t _od_rpc_call(const char *procname, xpc_object_t payload, xpc_pipe_t
 
 xpc_object_t xpc_create_with_format(const char * format, ...);
 
+// Parse an XML or binary (bplist00) property list. Returns NULL with errno
+// set to EINVAL if the input is malformed. The _file variant maps the file
+// instead of reading it.
 xpc_object_t xpc_create_from_plist(void *data, size_t size);
+xpc_object_t xpc_create_from_plist_file(const char *path);
+
+// Serialize to a binary property list. Returns a malloc()ed buffer, or NULL
+// with errno set to EINVAL if the object holds something a property list
+// cannot represent (connections, file descriptors, ...). UUIDs become data.
+// The _file variant replaces path atomically and returns an errno value.
+void *xpc_bplist_create(xpc_object_t object, size_t *sizep);
+int xpc_bplist_write_file(xpc_object_t object, const char *path);
+
+// JSON. Data, UUIDs, dates and non-finite doubles are written as one-key
+// objects ({"$data": "<base64>"}, {"$uuid": ...}, {"$date": <ns>},
+// {"$double": "nan"}) that xpc_create_from_json() turns back into those
+// types. Output is streamed through a fixed buffer to func, which returns
+// the number of bytes it consumed or -1 with errno set; the writers return
+// 0 or an errno value. Types with no JSON form fail with EINVAL unless
+// XPC_JSON_SKIP_UNSUPPORTED is given, which writes them as null; strings
+// and keys that are not valid UTF-8 fail with EILSEQ.
+#define XPC_JSON_PRETTY			0x1
+#define XPC_JSON_SKIP_UNSUPPORTED	0x2
+typedef ssize_t (*xpc_json_write_func_t)(void *context, const void *buf, size_t len);
+int xpc_json_write(xpc_object_t object, xpc_json_write_func_t func, void *context, int flags);
+int xpc_json_write_fd(xpc_object_t object, int fd, int flags);
+xpc_object_t xpc_create_from_json(const void *data, size_t size);
 
 void xpc_dictionary_get_audit_token(xpc_object_t, audit_token_t *);
 int xpc_pipe_routine_reply(xpc_object_t);
@@ -30,6 +56,103 @@ void xpc_connection_set_target_uid(xpc_connection_t connection, uid_t uid);
 void xpc_connection_set_instance(xpc_connection_t connection, uuid_t uid);
 void xpc_dictionary_set_mach_send(xpc_object_t object, const char* key, mach_port_t port);
 
+// Flow control. Once either high watermark is reached the connection is
+// throttled until the send queue drains to both low watermarks; a watermark
+// of zero means unlimited. The send window caps the number of calls awaiting
+// a reply, and must be set before the first send; one-way messages do not
+// count against it. A call that cannot get into the window within its
+// timeout fails with XPC_ERROR_CONNECTION_INTERRUPTED.
+void xpc_connection_set_send_watermarks(xpc_connection_t connection,
+	size_t low_msgs, size_t high_msgs, size_t low_bytes, size_t high_bytes);
+void xpc_connection_set_send_window(xpc_connection_t connection, uint32_t credits);
+// Returns EAGAIN instead of blocking when the connection is throttled.
+int xpc_connection_try_send_message(xpc_connection_t connection, xpc_object_t message);
+
+// Like their counterparts without a timeout, except that if no reply has
+// arrived within timeout nanoseconds (0 means none), the handler is called
+// with XPC_ERROR_CONNECTION_INTERRUPTED instead.
+void xpc_connection_send_message_with_reply_timeout(xpc_connection_t connection,
+	xpc_object_t message, dispatch_queue_t replyq, uint64_t timeout,
+	xpc_handler_t handler);
+xpc_object_t xpc_connection_send_message_with_reply_sync_timeout(
+	xpc_connection_t connection, xpc_object_t message, uint64_t timeout);
+
+// Function pointer variants of xpc_array_apply() and xpc_dictionary_apply().
+typedef bool (*xpc_array_applier_f)(void *context, size_t index, xpc_object_t value);
+typedef bool (*xpc_dictionary_applier_f)(void *context, const char *key, xpc_object_t value);
+
+bool xpc_array_apply_f(xpc_object_t xarray, void *context, xpc_array_applier_f applier);
+bool xpc_dictionary_apply_f(xpc_object_t xdict, void *context, xpc_dictionary_applier_f applier);
+
+// Cursor over a dictionary's entries, in insertion order. The entry last
+// returned may be removed during iteration; other changes are not allowed.
+typedef struct {
+	void *xi_next;
+} xpc_dictionary_iter_t;
+
+void xpc_dictionary_iter_init(xpc_dictionary_iter_t *iter, xpc_object_t xdict);
+bool xpc_dictionary_iter_next(xpc_dictionary_iter_t *iter, const char **key, xpc_object_t *value);
+
+// Constructors that size the container up front. The _adopt variants take
+// over the caller's reference to each value instead of retaining it, and
+// xpc_dictionary_create_adopt() trusts the keys to be distinct and not
+// reserved.
+xpc_object_t xpc_array_create_with_capacity(size_t capacity);
+xpc_object_t xpc_array_create_adopt(xpc_object_t *values, size_t count);
+xpc_object_t xpc_dictionary_create_with_capacity(size_t capacity);
+xpc_object_t xpc_dictionary_create_adopt(const char * const *keys, xpc_object_t *values, size_t count);
+
+// Marks an object and everything it contains immutable. Modifying a frozen
+// object is a fatal error, and xpc_copy() of frozen objects (or of frozen
+// subtrees) shares them instead of copying.
+void xpc_object_freeze(xpc_object_t object);
+
+// Per-message priority. Each connection queues outgoing and incoming messages
+// in one lane per priority and drains them by weight (8:4:1), so interactive
+// messages overtake queued bulk traffic without starving it. Ordering is only
+// preserved between messages of the same priority. Replies inherit the
+// priority of the request.
+typedef enum {
+	XPC_MESSAGE_PRIORITY_DEFAULT = 0,
+	XPC_MESSAGE_PRIORITY_INTERACTIVE = 1,
+	XPC_MESSAGE_PRIORITY_BULK = 2,
+} xpc_message_priority_t;
+
+void xpc_message_set_priority(xpc_object_t message, xpc_message_priority_t priority);
+xpc_message_priority_t xpc_message_get_priority(xpc_object_t message);
+
+// Message templates fix the keys and value types of a message shape once.
+// Messages created from a template hold every field from the start (false,
+// 0, "", empty data or the null UUID) and are set by slot index, the
+// field's position in the template, without looking up keys. While such a
+// message keeps exactly its template's keys and types it is serialized from
+// precomputed headers. Setting a bool, int64, uint64 or uuid slot does not
+// allocate unless something else holds on to its old value. A template lives
+// until it has been released and every message created from it is gone.
+// Field types are limited to bool, int64, uint64, string, data and uuid.
+typedef struct xpc_message_template *xpc_message_template_t;
+
+typedef struct {
+	const char *key;
+	xpc_type_t type;
+} xpc_message_field_t;
+
+xpc_message_template_t xpc_message_template_create(const xpc_message_field_t *fields, size_t count);
+xpc_object_t xpc_message_template_create_message(xpc_message_template_t tmpl);
+void xpc_message_template_release(xpc_message_template_t tmpl);
+void xpc_message_set_bool(xpc_object_t message, size_t slot, bool value);
+void xpc_message_set_int64(xpc_object_t message, size_t slot, int64_t value);
+void xpc_message_set_uint64(xpc_object_t message, size_t slot, uint64_t value);
+void xpc_message_set_string(xpc_object_t message, size_t slot, const char *value);
+void xpc_message_set_data(xpc_object_t message, size_t slot, const void *bytes, size_t length);
+void xpc_message_set_uuid(xpc_object_t message, size_t slot, const uuid_t value);
+xpc_object_t xpc_message_get_value(xpc_object_t message, size_t slot);
+
+// Returns a dictionary of message/byte counters, queue depths and histograms
+// of reply latency and handler run time in nanoseconds. To keep unobserved
+// connections cheap, latencies are only sampled after the first call.
+xpc_object_t xpc_connection_copy_statistics(xpc_connection_t connection);
+
 // This must be reesonably unique, because it is tested against all
 // XPC dictionaries sent to launchd, and we want to minimize the possibility
 // of false matches. The other dictionary keys do not need to be as unique.
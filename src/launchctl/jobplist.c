@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <xpc/private.h>
+
+#include "launch.h"
+#include "launch_priv.h"
+#include "jobplist.h"
+
+#define CFTypeCheck(cf, type) (CFGetTypeID(cf) == type ## GetTypeID())
+
+static void
+myCFDictionaryApplyFunction(const void *key, const void *value, void *context)
+{
+	launch_data_t ik, iw, where = context;
+
+	ik = CF2launch_data(key);
+	iw = CF2launch_data(value);
+
+	launch_data_dict_insert(where, iw, launch_data_get_string(ik));
+	launch_data_free(ik);
+}
+
+launch_data_t
+CF2launch_data(CFTypeRef cfr)
+{
+	launch_data_t r;
+	CFTypeID cft = CFGetTypeID(cfr);
+
+	if (cft == CFStringGetTypeID()) {
+		char buf[4096];
+		CFStringGetCString(cfr, buf, sizeof(buf), kCFStringEncodingUTF8);
+		r = launch_data_alloc(LAUNCH_DATA_STRING);
+		launch_data_set_string(r, buf);
+	} else if (cft == CFBooleanGetTypeID()) {
+		r = launch_data_alloc(LAUNCH_DATA_BOOL);
+		launch_data_set_bool(r, CFBooleanGetValue(cfr));
+	} else if (cft == CFArrayGetTypeID()) {
+		CFIndex i, ac = CFArrayGetCount(cfr);
+		r = launch_data_alloc(LAUNCH_DATA_ARRAY);
+		for (i = 0; i < ac; i++) {
+			CFTypeRef v = CFArrayGetValueAtIndex(cfr, i);
+			if (v) {
+				launch_data_t iv = CF2launch_data(v);
+				launch_data_array_set_index(r, iv, i);
+			}
+		}
+	} else if (cft == CFDictionaryGetTypeID()) {
+		r = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
+		CFDictionaryApplyFunction(cfr, myCFDictionaryApplyFunction, r);
+	} else if (cft == CFDataGetTypeID()) {
+		r = launch_data_alloc(LAUNCH_DATA_OPAQUE);
+		launch_data_set_opaque(r, CFDataGetBytePtr(cfr), CFDataGetLength(cfr));
+	} else if (cft == CFNumberGetTypeID()) {
+		long long n;
+		double d;
+		CFNumberType cfnt = CFNumberGetType(cfr);
+		switch (cfnt) {
+		case kCFNumberSInt8Type:
+		case kCFNumberSInt16Type:
+		case kCFNumberSInt32Type:
+		case kCFNumberSInt64Type:
+		case kCFNumberCharType:
+		case kCFNumberShortType:
+		case kCFNumberIntType:
+		case kCFNumberLongType:
+		case kCFNumberLongLongType:
+			CFNumberGetValue(cfr, kCFNumberLongLongType, &n);
+			r = launch_data_alloc(LAUNCH_DATA_INTEGER);
+			launch_data_set_integer(r, n);
+			break;
+		case kCFNumberFloat32Type:
+		case kCFNumberFloat64Type:
+		case kCFNumberFloatType:
+		case kCFNumberDoubleType:
+			CFNumberGetValue(cfr, kCFNumberDoubleType, &d);
+			r = launch_data_alloc(LAUNCH_DATA_REAL);
+			launch_data_set_real(r, d);
+			break;
+		default:
+			r = NULL;
+			break;
+		}
+	} else {
+		r = NULL;
+	}
+	return r;
+}
+
+/*
+ * Parse a job plist straight into launch_data_t objects, without going
+ * through CoreFoundation, and apply the Disabled override from
+ * overrides_db. XML and binary plists are both understood; on any failure
+ * this returns NULL and the caller falls back to CoreFoundation.
+ */
+launch_data_t
+read_plist_file_native(const char *file, CFDictionaryRef overrides_db)
+{
+	launch_data_t r, label;
+
+	r = (launch_data_t)xpc_create_from_plist_file(file);
+	if (r == NULL) {
+		return NULL;
+	}
+
+	if (launch_data_get_type(r) != LAUNCH_DATA_DICTIONARY ||
+	    (label = launch_data_dict_lookup(r, LAUNCH_JOBKEY_LABEL)) == NULL ||
+	    launch_data_get_type(label) != LAUNCH_DATA_STRING) {
+		launch_data_free(r);
+		return NULL;
+	}
+
+	if (overrides_db) {
+		CFStringRef cflabel = CFStringCreateWithCString(NULL, launch_data_get_string(label), kCFStringEncodingUTF8);
+		if (cflabel) {
+			CFDictionaryRef overrides = CFDictionaryGetValue(overrides_db, cflabel);
+			if (overrides && CFTypeCheck(overrides, CFDictionary)) {
+				CFBooleanRef disabled = CFDictionaryGetValue(overrides, CFSTR(LAUNCH_JOBKEY_DISABLED));
+				if (disabled && CFTypeCheck(disabled, CFBoolean)) {
+					launch_data_dict_insert(r, launch_data_new_bool(CFBooleanGetValue(disabled)), LAUNCH_JOBKEY_DISABLED);
+				}
+			}
+			CFRelease(cflabel);
+		}
+	}
+
+	return r;
+}
+
+/*
+ * The JetsamProperties to give the job with this label, or NULL for none.
+ * Without any jetsam defaults every job gets a default memory limit, since
+ * the device will be otherwise unusable.
+ */
+CFDictionaryRef
+jetsam_properties_copy(CFDictionaryRef jetsam_defaults, CFStringRef label)
+{
+	CFDictionaryRef job_defaults_dict;
+
+	if (jetsam_defaults) {
+		job_defaults_dict = CFDictionaryGetValue(jetsam_defaults, label);
+		if (job_defaults_dict) {
+			CFRetain(job_defaults_dict);
+		}
+		return job_defaults_dict;
+	}
+
+	long default_limit = 0;
+	CFMutableDictionaryRef defaults = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+	CFNumberRef memory_limit = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &default_limit);
+	if (memory_limit) {
+		CFDictionaryAddValue(defaults, CFSTR(LAUNCH_JOBKEY_JETSAMMEMORYLIMIT), memory_limit);
+		CFRelease(memory_limit);
+	}
+	return defaults;
+}
+
+/* As jetsam_properties_copy(), for a job read by read_plist_file_native() */
+void
+job_set_jetsam_properties(launch_data_t job, CFDictionaryRef jetsam_defaults)
+{
+	launch_data_t label = launch_data_dict_lookup(job, LAUNCH_JOBKEY_LABEL);
+	if (label == NULL || launch_data_get_type(label) != LAUNCH_DATA_STRING) {
+		return;
+	}
+
+	CFStringRef cflabel = CFStringCreateWithCString(NULL, launch_data_get_string(label), kCFStringEncodingUTF8);
+	if (cflabel == NULL) {
+		return;
+	}
+
+	CFDictionaryRef properties = jetsam_properties_copy(jetsam_defaults, cflabel);
+	if (properties) {
+		launch_data_t ldp = CF2launch_data(properties);
+		if (ldp) {
+			launch_data_dict_insert(job, ldp, LAUNCH_JOBKEY_JETSAMPROPERTIES);
+		}
+		CFRelease(properties);
+	}
+	CFRelease(cflabel);
+}
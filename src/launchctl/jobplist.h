@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHCTL_JOBPLIST_H__
+#define __LAUNCHCTL_JOBPLIST_H__
+
+#include <CoreFoundation/CoreFoundation.h>
+#include "launch.h"
+
+/*
+ * Reading job plists into launch_data_t objects, and the keys launchctl
+ * adds to a job on its way to launchd: the Disabled override and, where
+ * jetsam defaults are read, JetsamProperties.
+ */
+launch_data_t CF2launch_data(CFTypeRef cfr);
+launch_data_t read_plist_file_native(const char *file, CFDictionaryRef overrides_db);
+CFDictionaryRef jetsam_properties_copy(CFDictionaryRef jetsam_defaults, CFStringRef label);
+void job_set_jetsam_properties(launch_data_t job, CFDictionaryRef jetsam_defaults);
+
+#endif /* __LAUNCHCTL_JOBPLIST_H__ */
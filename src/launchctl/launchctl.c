@@ -31,6 +31,7 @@
 #include "vproc_internal.h"
 #include "bootstrap_priv.h"
 #include "launch_internal.h"
+#include "jobplist.h"
 #include <xpc/private.h>
 
 #include <CoreFoundation/CoreFoundation.h>
@@ -146,7 +147,6 @@ struct load_unload_state {
 
 static void launchctl_log(int level, const char *fmt, ...);
 static void launchctl_log_CFString(int level, CFStringRef string);
-static void myCFDictionaryApplyFunction(const void *key, const void *value, void *context);
 static CFTypeRef CFTypeCreateFromLaunchData(launch_data_t obj);
 static CFArrayRef CFArrayCreateFromLaunchArray(launch_data_t arr);
 static CFDictionaryRef CFDictionaryCreateFromLaunchDictionary(launch_data_t dict);
@@ -157,7 +157,6 @@ static void distill_config_file(launch_data_t);
 static void distill_fsevents(launch_data_t);
 static void sock_dict_cb(launch_data_t what, const char *key, void *context);
 static void sock_dict_edit_entry(launch_data_t tmp, const char *key, launch_data_t fdarray, launch_data_t thejob);
-static launch_data_t CF2launch_data(CFTypeRef);
 static launch_data_t read_plist_file(const char *file, bool editondisk, bool load);
 #if TARGET_OS_EMBEDDED
 static CFPropertyListRef GetPropertyListFromCache(void);
@@ -166,7 +165,7 @@ static bool require_jobs_from_cache(void);
 #endif
 static CFPropertyListRef CreateMyPropertyListFromFile(const char *);
 static CFPropertyListRef CFPropertyListCreateFromFile(CFURLRef plistURL);
-static void WriteMyPropertyListToFile(CFPropertyListRef, const char *);
+static void WriteMyPropertyListToFile(CFPropertyListRef, const char *, CFPropertyListFormat);
 static bool path_goodness_check(const char *path, bool forceload);
 static void readpath(const char *, struct load_unload_state *);
 static void readfile(const char *, struct load_unload_state *);
@@ -865,6 +864,18 @@ read_plist_file(const char *file, bool editondisk, bool load)
 {
 	CFPropertyListRef plist;
 	launch_data_t r = NULL;
+	/* Edits have to be written back, which still goes through CoreFoundation */
+#if TARGET_OS_EMBEDDED
+	if (!editondisk && !require_jobs_from_cache() &&
+	    (r = read_plist_file_native(file, _launchctl_overrides_db)) != NULL) {
+#else
+	if (!editondisk && (r = read_plist_file_native(file, _launchctl_overrides_db)) != NULL) {
+#endif
+#if READ_JETSAM_DEFAULTS
+		job_set_jetsam_properties(r, _launchctl_jetsam_defaults);
+#endif
+		return r;
+	}
 #if TARGET_OS_EMBEDDED
 	if (require_jobs_from_cache()) {
 		plist = CreateMyPropertyListFromCachedFile(file);
@@ -913,27 +924,15 @@ read_plist_file(const char *file, bool editondisk, bool load)
 			} else {
 				CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_DISABLED), kCFBooleanTrue);
 			}
-			WriteMyPropertyListToFile(plist, file);
+			WriteMyPropertyListToFile(plist, file, kCFPropertyListXMLFormat_v1_0);
 		}
 	}
 
 #if READ_JETSAM_DEFAULTS
-	if (_launchctl_jetsam_defaults) {
-		CFDictionaryRef job_defaults_dict = CFDictionaryGetValue(_launchctl_jetsam_defaults, label);
-		if (job_defaults_dict) {
-			CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_JETSAMPROPERTIES), job_defaults_dict);
-		}
-	} else {
-		/* The plist is missing. Set a default memory limit, since the device will be otherwise unusable */
-		long default_limit = 0;
-		CFMutableDictionaryRef job_defaults_dict = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-		CFNumberRef memory_limit = CFNumberCreate(kCFAllocatorDefault, kCFNumberLongType, &default_limit);
-		if (memory_limit) {
-			CFDictionaryAddValue(job_defaults_dict, CFSTR(LAUNCH_JOBKEY_JETSAMMEMORYLIMIT), memory_limit);
-			CFRelease(memory_limit);
-		}
-		CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_JETSAMPROPERTIES), job_defaults_dict);
-		CFRelease(job_defaults_dict);
+	CFDictionaryRef jetsam_properties = jetsam_properties_copy(_launchctl_jetsam_defaults, label);
+	if (jetsam_properties) {
+		CFDictionarySetValue((CFMutableDictionaryRef)plist, CFSTR(LAUNCH_JOBKEY_JETSAMPROPERTIES), jetsam_properties);
+		CFRelease(jetsam_properties);
 	}
 #endif /* READ_JETSAM_DEFAULTS */
 
@@ -1781,7 +1780,7 @@ CreateMyPropertyListFromFile(const char *posixfile)
 }
 
 void
-WriteMyPropertyListToFile(CFPropertyListRef plist, const char *posixfile)
+WriteMyPropertyListToFile(CFPropertyListRef plist, const char *posixfile, CFPropertyListFormat format)
 {
 	CFDataRef	resourceData;
 	CFURLRef	fileURL;
@@ -1792,11 +1791,7 @@ WriteMyPropertyListToFile(CFPropertyListRef plist, const char *posixfile)
 	if (!fileURL) {
 		launchctl_log(LOG_ERR, "%s: CFURLCreateFromFileSystemRepresentation(%s) failed", getprogname(), posixfile);
 	}
-    // _sjc_ this was left here with editor placeholders! no idea what's meant to be going on here!
-//    resourceData = CFPropertyListCreateWithData(NULL, CFDataRef data, CFOptionFlags options, CFPropertyListFormat *format, CFErrorRef *error);
-    
-    // TODO: check if format is correct
-    resourceData = CFPropertyListCreateData(NULL, plist, kCFPropertyListXMLFormat_v1_0, 0, &error);
+    resourceData = CFPropertyListCreateData(NULL, plist, format, 0, &error);
     
 	if (resourceData == NULL) {
         launchctl_log(LOG_ERR, "%s: CFPropertyListCreateXMLData(%s) failed: %d", getprogname(), posixfile, CFErrorGetCode(error));
@@ -1944,84 +1939,6 @@ CFDictionaryCreateFromLaunchDictionary(launch_data_t dict)
 	return result;
 }
 
-void
-myCFDictionaryApplyFunction(const void *key, const void *value, void *context)
-{
-	launch_data_t ik, iw, where = context;
-
-	ik = CF2launch_data(key);
-	iw = CF2launch_data(value);
-
-	launch_data_dict_insert(where, iw, launch_data_get_string(ik));
-	launch_data_free(ik);
-}
-
-launch_data_t
-CF2launch_data(CFTypeRef cfr)
-{
-	launch_data_t r;
-	CFTypeID cft = CFGetTypeID(cfr);
-
-	if (cft == CFStringGetTypeID()) {
-		char buf[4096];
-		CFStringGetCString(cfr, buf, sizeof(buf), kCFStringEncodingUTF8);
-		r = launch_data_alloc(LAUNCH_DATA_STRING);
-		launch_data_set_string(r, buf);
-	} else if (cft == CFBooleanGetTypeID()) {
-		r = launch_data_alloc(LAUNCH_DATA_BOOL);
-		launch_data_set_bool(r, CFBooleanGetValue(cfr));
-	} else if (cft == CFArrayGetTypeID()) {
-		CFIndex i, ac = CFArrayGetCount(cfr);
-		r = launch_data_alloc(LAUNCH_DATA_ARRAY);
-		for (i = 0; i < ac; i++) {
-			CFTypeRef v = CFArrayGetValueAtIndex(cfr, i);
-			if (v) {
-				launch_data_t iv = CF2launch_data(v);
-				launch_data_array_set_index(r, iv, i);
-			}
-		}
-	} else if (cft == CFDictionaryGetTypeID()) {
-		r = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
-		CFDictionaryApplyFunction(cfr, myCFDictionaryApplyFunction, r);
-	} else if (cft == CFDataGetTypeID()) {
-		r = launch_data_alloc(LAUNCH_DATA_OPAQUE);
-		launch_data_set_opaque(r, CFDataGetBytePtr(cfr), CFDataGetLength(cfr));
-	} else if (cft == CFNumberGetTypeID()) {
-		long long n;
-		double d;
-		CFNumberType cfnt = CFNumberGetType(cfr);
-		switch (cfnt) {
-		case kCFNumberSInt8Type:
-		case kCFNumberSInt16Type:
-		case kCFNumberSInt32Type:
-		case kCFNumberSInt64Type:
-		case kCFNumberCharType:
-		case kCFNumberShortType:
-		case kCFNumberIntType:
-		case kCFNumberLongType:
-		case kCFNumberLongLongType:
-			CFNumberGetValue(cfr, kCFNumberLongLongType, &n);
-			r = launch_data_alloc(LAUNCH_DATA_INTEGER);
-			launch_data_set_integer(r, n);
-			break;
-		case kCFNumberFloat32Type:
-		case kCFNumberFloat64Type:
-		case kCFNumberFloatType:
-		case kCFNumberDoubleType:
-			CFNumberGetValue(cfr, kCFNumberDoubleType, &d);
-			r = launch_data_alloc(LAUNCH_DATA_REAL);
-			launch_data_set_real(r, d);
-			break;
-		default:
-			r = NULL;
-			break;
-		}
-	} else {
-		r = NULL;
-	}
-	return r;
-}
-
 int
 help_cmd(int argc, char *const argv[])
 {
@@ -2737,8 +2654,9 @@ load_and_unload_cmd(int argc, char *const argv[])
 		}
 	}
 
+	/* Nobody edits the overrides database by hand; keep it compact */
 	if (_launchctl_overrides_db_changed) {
-		WriteMyPropertyListToFile(_launchctl_overrides_db, _launchctl_job_overrides_db_path);
+		WriteMyPropertyListToFile(_launchctl_overrides_db, _launchctl_job_overrides_db_path, kCFPropertyListBinaryFormat_v1_0);
 	}
 
 	flock(dbfd, LOCK_UN);
@@ -2949,14 +2867,15 @@ list_cmd(int argc, char *const argv[])
 	launch_data_t resp, msg = NULL;
 	int r = 0;
 
-	bool plist_output = false;
+	bool plist_output = false, json_output = false;
 	char *label = NULL;	
 	if (argc > 3) {
-		launchctl_log(LOG_ERR, "usage: %s list [-x] [label]", getprogname());
+		launchctl_log(LOG_ERR, "usage: %s list [-x | -j] [label]", getprogname());
 		return 1;
 	} else if (argc >= 2) {
 		plist_output = (strncmp(argv[1], "-x", sizeof("-x")) == 0);
-		label = plist_output ? argv[2] : argv[1];
+		json_output = (strncmp(argv[1], "-j", sizeof("-j")) == 0);
+		label = (plist_output || json_output) ? argv[2] : argv[1];
 	}
 
 	if (label) {
@@ -2970,7 +2889,9 @@ list_cmd(int argc, char *const argv[])
 			launchctl_log(LOG_ERR, "launch_msg(): %s", strerror(errno));
 			r = 1;
 		} else if (launch_data_get_type(resp) == LAUNCH_DATA_DICTIONARY) {
-			if (plist_output) {
+			if (json_output) {
+				r = xpc_json_write_fd((xpc_object_t)resp, STDOUT_FILENO, XPC_JSON_PRETTY | XPC_JSON_SKIP_UNSUPPORTED) ? 1 : 0;
+			} else if (plist_output) {
 				CFDictionaryRef respDict = CFDictionaryCreateFromLaunchDictionary(resp);
 				CFStringRef plistStr = NULL;
 				if (respDict) {
@@ -3002,11 +2923,15 @@ list_cmd(int argc, char *const argv[])
 			launch_data_free(resp);
 		}
 	} else if (vproc_swap_complex(NULL, VPROC_GSK_ALLJOBS, NULL, &resp) == NULL) {
-		fprintf(stdout, "PID\tStatus\tLabel\n");
-		launch_data_dict_iterate(resp, print_jobs, NULL);
+		if (json_output) {
+			/* Streamed, so thousands of jobs do not need one big string */
+			r = xpc_json_write_fd((xpc_object_t)resp, STDOUT_FILENO, XPC_JSON_PRETTY | XPC_JSON_SKIP_UNSUPPORTED) ? 1 : 0;
+		} else {
+			fprintf(stdout, "PID\tStatus\tLabel\n");
+			launch_data_dict_iterate(resp, print_jobs, NULL);
+			r = 0;
+		}
 		launch_data_free(resp);
-
-		r = 0;
 	}
 
 	return r;
@@ -3893,6 +3818,8 @@ kill_cmd(int argc, char *const argv[]) {
 	xpc_dictionary_set_uint64(xdict, XPC_PROCESS_ROUTINE_KEY_OP, XPC_PROCESS_SERVICE_KILL);
 	xpc_dictionary_set_int64(xdict, XPC_PROCESS_ROUTINE_KEY_SIGNAL, signo);
 	xpc_dictionary_set_string(xdict, XPC_PROCESS_ROUTINE_KEY_NAME, argv[2]);
+	/* Don't queue a kill behind bulk traffic on the bootstrap connection */
+	xpc_message_set_priority(xdict, XPC_MESSAGE_PRIORITY_INTERACTIVE);
 
 	xpc_connection_t connection = xpc_connection_create_mach_service("bootstrap", dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), 0);
 	if (connection == NULL) {
@@ -145,6 +145,10 @@ extern int gL1CacheEnabled;
 
 #include "mach_excServer.h"
 
+#include "cronspec.h"
+#include "hashtable.h"
+#include "jobkeys.h"
+#include "minheap.h"
 #include "shim.h"
 
 #define POSIX_SPAWN_IOS_INTERACTIVE 0
@@ -162,6 +166,7 @@ extern int gL1CacheEnabled;
 #define LAUNCHD_DEFAULT_EXIT_TIMEOUT 20
 #define LAUNCHD_SIGKILL_TIMER 4
 #define LAUNCHD_LOG_FAILED_EXEC_FREQ 10
+#define LAUNCHD_FS_EVENT_COALESCE_MS 250
 
 #define SHUTDOWN_LOG_DIR "/var/log/shutdown"
 
@@ -169,7 +174,8 @@ extern int gL1CacheEnabled;
 #define TAKE_SUBSET_PID "TakeSubsetPID"
 #define TAKE_SUBSET_PERPID "TakeSubsetPerPID"
 
-#define IS_POWER_OF_TWO(v) (!(v & (v - 1)) && v)
+/* Number of distinct top-level keys job_export() can emit */
+#define JOB_EXPORT_MAX_KEYS 17
 
 extern char **environ;
 
@@ -184,8 +190,8 @@ static void waiting4removal_delete(job_t j, struct waiting_for_removal *w4r);
 struct machservice {
 	SLIST_ENTRY(machservice) sle;
 	SLIST_ENTRY(machservice) special_port_sle;
-	LIST_ENTRY(machservice) name_hash_sle;
-	LIST_ENTRY(machservice) port_hash_sle;
+	struct hashlink name_hash_sle;
+	struct hashlink port_hash_sle;
 	struct machservice *alias;
 	job_t job;
 	unsigned int gen_num;
@@ -215,10 +221,19 @@ struct machservice {
 // HACK: This should be per jobmgr_t
 static SLIST_HEAD(, machservice) special_ports;
 
-#define PORT_HASH_SIZE 32
-#define HASH_PORT(x) (IS_POWER_OF_TWO(PORT_HASH_SIZE) ? (MACH_PORT_INDEX(x) & (PORT_HASH_SIZE - 1)) : (MACH_PORT_INDEX(x) % PORT_HASH_SIZE))
+#define HASH_PORT(x) hashtable_inthash(MACH_PORT_INDEX(x))
 
-static LIST_HEAD(, machservice) port_hash[PORT_HASH_SIZE];
+static struct hashtable port_hash;
+
+struct ms_cache_entry {
+	struct hashlink hash_sle;
+	struct machservice *ms;
+};
+
+/* Bumped whenever a service enters or leaves any ms_hash, which invalidates
+ * every job manager's ms_cache at once.
+ */
+static uint64_t ms_hash_gen;
 
 static void machservice_setup(launch_data_t obj, const char *key, void *context);
 static void machservice_setup_options(launch_data_t obj, const char *key, void *context);
@@ -229,6 +244,8 @@ static struct machservice *machservice_new_alias(job_t aj, struct machservice *o
 static void machservice_ignore(job_t j, struct machservice *ms);
 static void machservice_watch(job_t j, struct machservice *ms);
 static void machservice_delete(job_t j, struct machservice *, bool port_died);
+static void machservice_hash_insert(jobmgr_t jm, struct machservice *ms);
+static void machservice_hash_remove(struct machservice *ms);
 static void machservice_request_notifications(struct machservice *);
 static mach_port_t machservice_port(struct machservice *);
 static job_t machservice_job(struct machservice *);
@@ -257,20 +274,22 @@ static void socketgroup_setup(launch_data_t obj, const char *key, void *context)
 static void socketgroup_kevent_mod(job_t j, struct socketgroup *sg, bool do_add);
 
 struct calendarinterval {
-	LIST_ENTRY(calendarinterval) global_sle;
+	struct minheap_node global_hn;	// keyed by when_next
 	SLIST_ENTRY(calendarinterval) sle;
 	job_t job;
-	struct tm when;
+	struct cronspec when;
 	time_t when_next;
 };
 
-static LIST_HEAD(, calendarinterval) sorted_calendar_events;
+static struct minheap sorted_calendar_events;
 
 static bool calendarinterval_new(job_t j, struct tm *w);
 static bool calendarinterval_new_from_obj(job_t j, launch_data_t obj);
 static void calendarinterval_new_from_obj_dict_walk(launch_data_t obj, const char *key, void *context);
 static void calendarinterval_delete(job_t j, struct calendarinterval *ci);
-static void calendarinterval_setalarm(job_t j, struct calendarinterval *ci);
+static bool calendarinterval_setalarm(job_t j, struct calendarinterval *ci);
+static void calendarinterval_arm(void);
+static struct calendarinterval *calendarinterval_first(void);
 static void calendarinterval_callback(void);
 static void calendarinterval_sanity_check(void);
 
@@ -317,6 +336,9 @@ typedef enum {
 
 struct semaphoreitem {
 	SLIST_ENTRY(semaphoreitem) sle;
+	/* In s_curious_semaphores, by what, for OtherJobEnabled criteria */
+	struct hashlink curious_sle;
+	job_t job;
 	semaphore_reason_t why;
 
 	union {
@@ -390,12 +412,8 @@ static struct waiting4attach *waiting4attach_new(jobmgr_t jm, const char *name,
 static void waiting4attach_delete(jobmgr_t jm, struct waiting4attach *w4a);
 static struct waiting4attach *waiting4attach_find(jobmgr_t jm, job_t j);
 
-#define ACTIVE_JOB_HASH_SIZE 32
-#define ACTIVE_JOB_HASH(x) (IS_POWER_OF_TWO(ACTIVE_JOB_HASH_SIZE) ? (x & (ACTIVE_JOB_HASH_SIZE - 1)) : (x % ACTIVE_JOB_HASH_SIZE))
+#define ACTIVE_JOB_HASH(x) hashtable_inthash(x)
 
-#define MACHSERVICE_HASH_SIZE	37
-
-#define LABEL_HASH_SIZE 53
 struct jobmgr_s {
 	kq_callback kqjobmgr_callback;
 	LIST_ENTRY(jobmgr_s) xpc_le;
@@ -409,10 +427,16 @@ struct jobmgr_s {
 	 * its own label hash that is separate from the "global" one stored in the
 	 * root job manager.
 	 */
-	LIST_HEAD(, job_s) label_hash[LABEL_HASH_SIZE];
-	LIST_HEAD(, job_s) active_jobs[ACTIVE_JOB_HASH_SIZE];
-	LIST_HEAD(, machservice) ms_hash[MACHSERVICE_HASH_SIZE];
+	struct hashtable label_hash;
+	struct hashtable active_jobs;
+	struct hashtable ms_hash;
+	/* Services that lookups from this job manager found in an ancestor's
+	 * ms_hash. Valid while ms_cache_gen matches ms_hash_gen.
+	 */
+	struct hashtable ms_cache;
+	uint64_t ms_cache_gen;
 	LIST_HEAD(, job_s) global_env_jobs;
+	struct hashlink port_hash_sle;
 	mach_port_t jm_port;
 	mach_port_t req_port;
 	jobmgr_t parentmgr;
@@ -466,13 +490,18 @@ static jobmgr_t jobmgr_find_xpc_per_user_domain(jobmgr_t jm, uid_t uid);
 static jobmgr_t jobmgr_find_xpc_per_session_domain(jobmgr_t jm, au_asid_t asid);
 static job_t jobmgr_import2(jobmgr_t jm, launch_data_t pload);
 static jobmgr_t jobmgr_parent(jobmgr_t jm);
+static jobmgr_t jobmgr_ms_namespace(jobmgr_t jm);
+static void jobmgr_ms_cache_flush(jobmgr_t jm);
+static bool jobmgr_contains(jobmgr_t jm, jobmgr_t jmi);
 static jobmgr_t jobmgr_do_garbage_collection(jobmgr_t jm);
 static bool jobmgr_label_test(jobmgr_t jm, const char *str);
 static void jobmgr_reap_bulk(jobmgr_t jm, struct kevent *kev);
 static void jobmgr_log_stray_children(jobmgr_t jm, bool kill_strays);
 static void jobmgr_kill_stray_children(jobmgr_t jm, pid_t *p, size_t np);
 static void jobmgr_remove(jobmgr_t jm);
-static void jobmgr_dispatch_all(jobmgr_t jm, bool newmounthack);
+static void jobmgr_dispatch_all(jobmgr_t jm);
+static void jobmgr_dispatch_fs_events(void);
+static bool jobmgr_shutting_down(jobmgr_t jm);
 static job_t jobmgr_init_session(jobmgr_t jm, const char *session_type, bool sflag);
 static job_t jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay);
 static job_t jobmgr_find_by_pid(jobmgr_t jm, pid_t p, bool create_anon);
@@ -500,20 +529,47 @@ struct suspended_peruser {
 	job_t j;
 };
 
+/* The properties that few jobs set and that are only needed to spawn or
+ * describe a job. They are allocated the first time one of them is set, so
+ * read them through job_cold_get(), which returns zeroes until then.
+ */
+struct job_cold {
+	LIST_HEAD(, suspended_peruser) suspended_perusers;
+	cpu_type_t *j_binpref;
+	size_t j_binpref_cnt;
+	char *rootdir;
+	char *workingdir;
+	char *stdinpath;
+	char *stdoutpath;
+	char *stderrpath;
+	char *alt_exc_handler;
+	char *cfbundleidentifier;
+#if HAVE_SANDBOX
+	char *seatbelt_profile;
+	uint64_t seatbelt_flags;
+	char *container_identifier;
+#endif
+#if HAVE_QUARANTINE
+	void *quarantine_data;
+	size_t quarantine_data_sz;
+#endif
+	int32_t main_thread_priority;
+	uuid_t expected_audit_uuid;
+};
+
 struct job_s {
 	// MUST be first element of this structure.
 	kq_callback kqjob_callback;
 	LIST_ENTRY(job_s) sle;
 	LIST_ENTRY(job_s) subjob_sle;
 	LIST_ENTRY(job_s) needing_session_sle;
-	LIST_ENTRY(job_s) jetsam_sle;
-	LIST_ENTRY(job_s) pid_hash_sle;
-	LIST_ENTRY(job_s) global_pid_hash_sle;
-	LIST_ENTRY(job_s) label_hash_sle;
+	LIST_ENTRY(job_s) start_on_mount_sle;
+	LIST_ENTRY(job_s) curious_pending_sle;
+	struct hashlink pid_hash_sle;
+	struct hashlink global_pid_hash_sle;
+	struct hashlink label_hash_sle;
+	struct hashlink port_hash_sle;
 	LIST_ENTRY(job_s) global_env_sle;
-	SLIST_ENTRY(job_s) curious_jobs_sle;
-	LIST_HEAD(, suspended_peruser) suspended_perusers;
-	LIST_HEAD(, waiting_for_exit) exit_watchers;
 	LIST_HEAD(, job_s) subjobs;
 	LIST_HEAD(, externalevent) events;
 	SLIST_HEAD(, socketgroup) sockets;
@@ -527,8 +583,7 @@ struct job_s {
 	struct waiting4attach *w4a;
 	job_t original;
 	job_t alias;
-	cpu_type_t *j_binpref;
-	size_t j_binpref_cnt;
+	struct job_cold *cold;
 	mach_port_t j_port;
 	mach_port_t exit_status_dest;
 	mach_port_t exit_status_port;
@@ -538,26 +593,10 @@ struct job_s {
 	size_t argc;
 	char **argv;
 	char *prog;
-	char *rootdir;
-	char *workingdir;
 	char *username;
 	char *groupname;
-	char *stdinpath;
-	char *stdoutpath;
-	char *stderrpath;
-	char *alt_exc_handler;
-	char *cfbundleidentifier;
 	unsigned int nruns;
 	uint64_t trt;
-#if HAVE_SANDBOX
-	char *seatbelt_profile;
-	uint64_t seatbelt_flags;
-	char *container_identifier;
-#endif
-#if HAVE_QUARANTINE
-	void *quarantine_data;
-	size_t quarantine_data_sz;
-#endif
 	pid_t p;
 	uint64_t uniqueid;
 	int last_exit_status;
@@ -568,7 +607,6 @@ struct job_s {
 	uint32_t psproctype;
 	int32_t jetsam_priority;
 	int32_t jetsam_memlimit;
-	int32_t main_thread_priority;
 	uint32_t timeout;
 	uint32_t exit_timeout;
 	uint64_t sent_signal_time;
@@ -581,7 +619,6 @@ struct job_s {
 	mode_t mask;
 	mach_port_t asport;
 	au_asid_t asid;
-	uuid_t expected_audit_uuid;
 	bool 	
 		// man launchd.plist --> Debug
 		debug:1,
@@ -674,8 +711,8 @@ struct job_s {
 		enable_transactions:1,
 		// The job was sent SIGKILL because it was clean.
 		clean_kill:1,
-		// The job has an OtherJobEnabled KeepAlive criterion.
-		nosy:1,
+		// The job is in s_curious_pending, waiting to be dispatched.
+		curious_pending:1,
 		// The job exited due to a crash.
 		crashed:1,
 		// We've received NOTE_EXIT for the job and reaped it.
@@ -763,10 +800,27 @@ struct job_s {
 	const char label[0];
 };
 
+static const struct job_cold job_cold_empty;
+
+static inline const struct job_cold *
+job_cold_get(job_t j)
+{
+	return j->cold ? j->cold : &job_cold_empty;
+}
+
 static size_t hash_label(const char *label) __attribute__((pure));
 static size_t hash_ms(const char *msstr) __attribute__((pure));
-static SLIST_HEAD(, job_s) s_curious_jobs;
-static LIST_HEAD(, job_s) managed_actives[ACTIVE_JOB_HASH_SIZE];
+/* The OtherJobEnabled semaphores of every job, by the label they watch */
+static struct hashtable s_curious_semaphores;
+/* Jobs found in s_curious_semaphores that are still to be dispatched */
+static LIST_HEAD(, job_s) s_curious_pending;
+/* Every job with a live process, anonymous or not, across all job managers */
+static struct hashtable global_actives;
+/* Every job manager's and job's bootstrap port, so that job_mig_intran() does
+ * not have to walk the job manager tree.
+ */
+static struct hashtable jobmgr_port_hash;
+static struct hashtable job_port_hash;
 
 #define job_assumes(j, e) os_assumes_ctx(job_log_bug, j, (e))
 #define job_assumes_zero(j, e) os_assumes_zero_ctx(job_log_bug, j, (e))
@@ -782,6 +836,9 @@ static void job_import_opaque(job_t j, const char *key, launch_data_t value);
 static bool job_set_global_on_demand(job_t j, bool val);
 static const char *job_active(job_t j);
 static void job_watch(job_t j);
+static struct job_cold *job_cold(job_t j);
+static void job_cold_delete(job_t j);
+static size_t job_footprint(job_t j);
 static void job_ignore(job_t j);
 static void job_reap(job_t j);
 static bool job_useless(job_t j);
@@ -867,17 +924,10 @@ static const struct {
 	{ LAUNCH_JOBKEY_RESOURCELIMIT_STACK, RLIMIT_STACK },
 };
 
-static time_t cronemu(int mon, int mday, int hour, int min);
-static time_t cronemu_wday(int wday, int hour, int min);
-static bool cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min);
-static bool cronemu_mday(struct tm *wtm, int mday, int hour, int min);
-static bool cronemu_hour(struct tm *wtm, int hour, int min);
-static bool cronemu_min(struct tm *wtm, int min);
 
 // miscellaneous file local functions
 static size_t get_kern_max_proc(void);
 static char **mach_cmd2argv(const char *string);
-static size_t our_strhash(const char *s) __attribute__((pure));
 
 void eliminate_double_reboot(void);
 
@@ -907,6 +957,11 @@ static size_t total_anon_children;
 static mach_port_t the_exception_server;
 static job_t workaround_5477111;
 static LIST_HEAD(, job_s) s_needing_sessions;
+/* Every job with StartOnMount set, so that a mount need not visit the rest */
+static LIST_HEAD(, job_s) s_start_on_mount;
+/* File system events seen since the coalescing timer was armed */
+static bool s_fs_event_pending;
+static bool s_fs_mount_pending;
 static LIST_HEAD(, eventsystem) _s_event_systems;
 static struct eventsystem *_launchd_support_system;
 static job_t _launchd_event_monitor;
@@ -1061,73 +1116,75 @@ job_stop(job_t j)
 launch_data_t
 job_export(job_t j)
 {
-	launch_data_t tmp, tmp2, tmp3, r = launch_data_alloc(LAUNCH_DATA_DICTIONARY);
-
-	if (r == NULL) {
-		return NULL;
-	}
-
-	if ((tmp = launch_data_new_string(j->label))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_LABEL);
-	}
-	if ((tmp = launch_data_new_string(j->mgr->name))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
-	}
-	if ((tmp = launch_data_new_bool(j->ondemand))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_ONDEMAND);
-	}
+	/*
+	 * The top-level dictionary is built in one go from the keys collected
+	 * below, so it is allocated at its final size and adopts the values
+	 * instead of retaining them.
+	 */
+	const char *keys[JOB_EXPORT_MAX_KEYS];
+	xpc_object_t values[JOB_EXPORT_MAX_KEYS];
+	size_t n = 0;
+	launch_data_t tmp, tmp2, tmp3;
+
+#define JOB_EXPORT_ADD(key, value) do { \
+	if ((tmp = (value)) != NULL) { \
+		keys[n] = (key); \
+		values[n++] = (xpc_object_t)tmp; \
+	} \
+} while (0)
+
+	JOB_EXPORT_ADD(LAUNCH_JOBKEY_LABEL, launch_data_new_string(j->label));
+	JOB_EXPORT_ADD(LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE, launch_data_new_string(j->mgr->name));
+	JOB_EXPORT_ADD(LAUNCH_JOBKEY_ONDEMAND, launch_data_new_bool(j->ondemand));
 
 	long long status = j->last_exit_status;
 	if (j->fpfail) {
 		status = LAUNCH_EXITSTATUS_FAIRPLAY_FAIL;
 	}
-	if ((tmp = launch_data_new_integer(status))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_LASTEXITSTATUS);
-	}
+	JOB_EXPORT_ADD(LAUNCH_JOBKEY_LASTEXITSTATUS, launch_data_new_integer(status));
 
-	if (j->p && (tmp = launch_data_new_integer(j->p))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_PID);
-	}
-	if ((tmp = launch_data_new_integer(j->timeout))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_TIMEOUT);
+	if (j->p) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_PID, launch_data_new_integer(j->p));
 	}
-	if (j->prog && (tmp = launch_data_new_string(j->prog))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_PROGRAM);
+	JOB_EXPORT_ADD(LAUNCH_JOBKEY_TIMEOUT, launch_data_new_integer(j->timeout));
+	if (j->prog) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_PROGRAM, launch_data_new_string(j->prog));
 	}
-	if (j->stdinpath && (tmp = launch_data_new_string(j->stdinpath))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_STANDARDINPATH);
+	if (job_cold_get(j)->stdinpath) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_STANDARDINPATH, launch_data_new_string(j->cold->stdinpath));
 	}
-	if (j->stdoutpath && (tmp = launch_data_new_string(j->stdoutpath))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_STANDARDOUTPATH);
+	if (job_cold_get(j)->stdoutpath) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_STANDARDOUTPATH, launch_data_new_string(j->cold->stdoutpath));
 	}
-	if (j->stderrpath && (tmp = launch_data_new_string(j->stderrpath))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_STANDARDERRORPATH);
+	if (job_cold_get(j)->stderrpath) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_STANDARDERRORPATH, launch_data_new_string(j->cold->stderrpath));
 	}
-	if (likely(j->argv) && (tmp = launch_data_alloc(LAUNCH_DATA_ARRAY))) {
-		size_t i;
+	if (likely(j->argv)) {
+		xpc_object_t args[j->argc + 1];
+		size_t i, argc = 0;
 
 		for (i = 0; i < j->argc; i++) {
 			if ((tmp2 = launch_data_new_string(j->argv[i]))) {
-				launch_data_array_set_index(tmp, tmp2, i);
+				args[argc++] = (xpc_object_t)tmp2;
 			}
 		}
 
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_PROGRAMARGUMENTS);
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_PROGRAMARGUMENTS, (launch_data_t)xpc_array_create_adopt(args, argc));
 	}
 
-	if (j->enable_transactions && (tmp = launch_data_new_bool(true))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_ENABLETRANSACTIONS);
+	if (j->enable_transactions) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_ENABLETRANSACTIONS, launch_data_new_bool(true));
 	}
 
-	if (j->session_create && (tmp = launch_data_new_bool(true))) {
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_SESSIONCREATE);
+	if (j->session_create) {
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_SESSIONCREATE, launch_data_new_bool(true));
 	}
 
 	if (j->inetcompat && (tmp = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
 		if ((tmp2 = launch_data_new_bool(j->inetcompat_wait))) {
 			launch_data_dict_insert(tmp, tmp2, LAUNCH_JOBINETDCOMPATIBILITY_WAIT);
 		}
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_INETDCOMPATIBILITY);
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_INETDCOMPATIBILITY, tmp);
 	}
 
 	if (!SLIST_EMPTY(&j->sockets) && (tmp = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
@@ -1145,7 +1202,7 @@ job_export(job_t j)
 			}
 		}
 
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_SOCKETS);
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_SOCKETS, tmp);
 	}
 
 	if (!SLIST_EMPTY(&j->machservices) && (tmp = launch_data_alloc(LAUNCH_DATA_DICTIONARY))) {
@@ -1168,14 +1225,13 @@ job_export(job_t j)
 			}
 		}
 
-		launch_data_dict_insert(r, tmp, LAUNCH_JOBKEY_MACHSERVICES);
-
-		if (tmp3) {
-			launch_data_dict_insert(r, tmp3, LAUNCH_JOBKEY_PERJOBMACHSERVICES);
-		}
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_MACHSERVICES, tmp);
+		JOB_EXPORT_ADD(LAUNCH_JOBKEY_PERJOBMACHSERVICES, tmp3);
 	}
 
-	return r;
+#undef JOB_EXPORT_ADD
+
+	return (launch_data_t)xpc_dictionary_create_adopt(keys, values, n);
 }
 
 static void
@@ -1297,6 +1353,8 @@ jobmgr_remove(jobmgr_t jm)
 	while ((ji = LIST_FIRST(&jm->jobs))) {
 		if (!ji->anonymous && ji->p != 0) {
 			job_log(ji, LOG_ERR, "Job is still active at job manager teardown.");
+			hashtable_remove(&ji->pid_hash_sle);
+			hashtable_remove(&ji->global_pid_hash_sle);
 			ji->p = 0;
 		}
 
@@ -1314,6 +1372,7 @@ jobmgr_remove(jobmgr_t jm)
 	if (jm->jm_port) {
 		(void)jobmgr_assumes_zero(jm, launchd_mport_close_recv(jm->jm_port));
 	}
+	hashtable_remove(&jm->port_hash_sle);
 
 	if (jm->req_bsport) {
 		(void)jobmgr_assumes_zero(jm, launchd_mport_deallocate(jm->req_bsport));
@@ -1377,9 +1436,104 @@ jobmgr_remove(jobmgr_t jm)
 		exit(EXIT_SUCCESS);
 	}
 
+	hashtable_destroy(&jm->label_hash);
+	hashtable_destroy(&jm->active_jobs);
+	hashtable_destroy(&jm->ms_hash);
+	jobmgr_ms_cache_flush(jm);
 	free(jm);
 }
 
+// The cold half of j, for writing. NULL if it cannot be allocated.
+struct job_cold *
+job_cold(job_t j)
+{
+	if (unlikely(j->cold == NULL)) {
+		j->cold = calloc(1, sizeof(struct job_cold));
+		(void)job_assumes(j, j->cold != NULL);
+	}
+
+	return j->cold;
+}
+
+void
+job_cold_delete(job_t j)
+{
+	struct job_cold *jc = j->cold;
+
+	if (jc == NULL) {
+		return;
+	}
+
+	free(jc->j_binpref);
+	free(jc->rootdir);
+	free(jc->workingdir);
+	free(jc->stdinpath);
+	free(jc->stdoutpath);
+	free(jc->stderrpath);
+	free(jc->alt_exc_handler);
+	free(jc->cfbundleidentifier);
+#if HAVE_SANDBOX
+	free(jc->seatbelt_profile);
+	free(jc->container_identifier);
+#endif
+#if HAVE_QUARANTINE
+	free(jc->quarantine_data);
+#endif
+	free(jc);
+	j->cold = NULL;
+}
+
+// What j and everything it owns take up on the heap.
+size_t
+job_footprint(job_t j)
+{
+	const struct job_cold *jc = job_cold_get(j);
+	struct calendarinterval *ci;
+	struct semaphoreitem *si;
+	struct socketgroup *sg;
+	struct machservice *ms;
+	struct limititem *li;
+	struct envitem *ei;
+	size_t sz;
+
+	sz = malloc_size(j) + malloc_size(j->cold);
+	sz += malloc_size(j->prog) + malloc_size(j->argv);
+	sz += malloc_size(j->username) + malloc_size(j->groupname);
+	sz += malloc_size(jc->j_binpref) + malloc_size(jc->rootdir) + malloc_size(jc->workingdir);
+	sz += malloc_size(jc->stdinpath) + malloc_size(jc->stdoutpath) + malloc_size(jc->stderrpath);
+	sz += malloc_size(jc->alt_exc_handler) + malloc_size(jc->cfbundleidentifier);
+#if HAVE_SANDBOX
+	sz += malloc_size(jc->seatbelt_profile) + malloc_size(jc->container_identifier);
+#endif
+#if HAVE_QUARANTINE
+	sz += malloc_size(jc->quarantine_data);
+#endif
+
+	SLIST_FOREACH(ms, &j->machservices, sle) {
+		sz += malloc_size(ms);
+	}
+	SLIST_FOREACH(si, &j->semaphores, sle) {
+		sz += malloc_size(si);
+	}
+	SLIST_FOREACH(ei, &j->env, sle) {
+		sz += malloc_size(ei);
+	}
+	SLIST_FOREACH(ei, &j->global_env, sle) {
+		sz += malloc_size(ei);
+	}
+	SLIST_FOREACH(li, &j->limits, sle) {
+		sz += malloc_size(li);
+	}
+	SLIST_FOREACH(sg, &j->sockets, sle) {
+		sz += malloc_size(sg) + malloc_size(sg->fds);
+	}
+	SLIST_FOREACH(ci, &j->cal_intervals, sle) {
+		sz += malloc_size(ci);
+	}
+
+	return sz;
+}
+
 void
 job_remove(job_t j)
 {
@@ -1401,7 +1555,7 @@ job_remove(job_t j)
 		}
 
 		LIST_REMOVE(j, sle);
-		LIST_REMOVE(j, label_hash_sle);
+		hashtable_remove(&j->label_hash_sle);
 		free(j);
 		return;
 	}
@@ -1469,6 +1623,7 @@ job_remove(job_t j)
 	}
 
 	if (j->j_port) {
+		hashtable_remove(&j->port_hash_sle);
 		(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
 	}
 
@@ -1515,49 +1670,12 @@ job_remove(job_t j)
 	if (j->argv) {
 		free(j->argv);
 	}
-	if (j->rootdir) {
-		free(j->rootdir);
-	}
-	if (j->workingdir) {
-		free(j->workingdir);
-	}
 	if (j->username) {
 		free(j->username);
 	}
 	if (j->groupname) {
 		free(j->groupname);
 	}
-	if (j->stdinpath) {
-		free(j->stdinpath);
-	}
-	if (j->stdoutpath) {
-		free(j->stdoutpath);
-	}
-	if (j->stderrpath) {
-		free(j->stderrpath);
-	}
-	if (j->alt_exc_handler) {
-		free(j->alt_exc_handler);
-	}
-	if (j->cfbundleidentifier) {
-		free(j->cfbundleidentifier);
-	}
-#if HAVE_SANDBOX
-	if (j->seatbelt_profile) {
-		free(j->seatbelt_profile);
-	}
-	if (j->container_identifier) {
-		free(j->container_identifier);
-	}
-#endif
-#if HAVE_QUARANTINE
-	if (j->quarantine_data) {
-		free(j->quarantine_data);
-	}
-#endif
-	if (j->j_binpref) {
-		free(j->j_binpref);
-	}
 	if (j->start_interval) {
 		runtime_del_weak_ref();
 		(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)&j->start_interval, EVFILT_TIMER, EV_DELETE, 0, 0, NULL));
@@ -1571,9 +1689,16 @@ job_remove(job_t j)
 	if (j->asport != MACH_PORT_NULL) {
 		(void)job_assumes_zero(j, launchd_mport_deallocate(j->asport));
 	}
-	if (!uuid_is_null(j->expected_audit_uuid)) {
+	if (!uuid_is_null(job_cold_get(j)->expected_audit_uuid)) {
 		LIST_REMOVE(j, needing_session_sle);
 	}
+	if (j->start_on_mount) {
+		LIST_REMOVE(j, start_on_mount_sle);
+	}
+	if (j->curious_pending) {
+		LIST_REMOVE(j, curious_pending_sle);
+	}
+	job_cold_delete(j);
 	if (j->embedded_god) {
 		_launchd_embedded_god = NULL;
 	}
@@ -1587,7 +1712,7 @@ job_remove(job_t j)
 	(void)kevent_mod((uintptr_t)j, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
 
 	LIST_REMOVE(j, sle);
-	LIST_REMOVE(j, label_hash_sle);
+	hashtable_remove(&j->label_hash_sle);
 
 	job_t ji = NULL;
 	job_t jit = NULL;
@@ -1646,7 +1771,7 @@ job_set_global_on_demand(job_t j, bool val)
 	}
 
 	if (j->mgr->global_on_demand_cnt == 0) {
-		jobmgr_dispatch_all(j->mgr, false);
+		jobmgr_dispatch_all(j->mgr);
 	}
 
 	return true;
@@ -1668,6 +1793,8 @@ job_setup_machport(job_t j)
 		goto out_bad;
 	}
 
+	hashtable_insert(&job_port_hash, &j->port_hash_sle, HASH_PORT(j->j_port));
+
 	return true;
 out_bad2:
 	(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
@@ -1825,7 +1952,8 @@ job_new_anonymous(jobmgr_t jm, pid_t anonpid)
 		jr->p = anonpid;
 
 		// Anonymous process reaping is messy.
-		LIST_INSERT_HEAD(&jm->active_jobs[ACTIVE_JOB_HASH(jr->p)], jr, pid_hash_sle);
+		hashtable_insert(&jm->active_jobs, &jr->pid_hash_sle, ACTIVE_JOB_HASH(jr->p));
+		hashtable_insert(&global_actives, &jr->global_pid_hash_sle, ACTIVE_JOB_HASH(jr->p));
 
 		if (unlikely(kevent_mod(jr->p, EVFILT_PROC, EV_ADD, proc_fflags, 0, root_jobmgr) == -1)) {
 			if (errno != ESRCH) {
@@ -1990,12 +2118,6 @@ job_new_subjob(job_t j, uuid_t identifier)
 			(void)job_assumes_zero(nj, errno);
 		}
 
-		if (j->rootdir) {
-			nj->rootdir = strdup(j->rootdir);
-		}
-		if (j->workingdir) {
-			nj->workingdir = strdup(j->workingdir);
-		}
 		if (j->username) {
 			nj->username = strdup(j->username);
 		}
@@ -2003,47 +2125,62 @@ job_new_subjob(job_t j, uuid_t identifier)
 			nj->groupname = strdup(j->groupname);
 		}
 
-		/* FIXME: We shouldn't redirect all the output from these jobs to the
-		 * same file. We should uniquify the file names. But this hasn't shown
-		 * to be a problem in practice.
-		 */
-		if (j->stdinpath) {
-			nj->stdinpath = strdup(j->stdinpath);
-		}
-		if (j->stdoutpath) {
-			nj->stdoutpath = strdup(j->stdinpath);
-		}
-		if (j->stderrpath) {
-			nj->stderrpath = strdup(j->stderrpath);
-		}
-		if (j->alt_exc_handler) {
-			nj->alt_exc_handler = strdup(j->alt_exc_handler);
-		}
-		if (j->cfbundleidentifier) {
-			nj->cfbundleidentifier = strdup(j->cfbundleidentifier);
-		}
+		struct job_cold *jc = j->cold, *njc = NULL;
+		if (jc && (njc = job_cold(nj))) {
+			if (jc->rootdir) {
+				njc->rootdir = strdup(jc->rootdir);
+			}
+			if (jc->workingdir) {
+				njc->workingdir = strdup(jc->workingdir);
+			}
+
+			/* FIXME: We shouldn't redirect all the output from these jobs to
+			 * the same file. We should uniquify the file names. But this
+			 * hasn't shown to be a problem in practice.
+			 */
+			if (jc->stdinpath) {
+				njc->stdinpath = strdup(jc->stdinpath);
+			}
+			if (jc->stdoutpath) {
+				njc->stdoutpath = strdup(jc->stdoutpath);
+			}
+			if (jc->stderrpath) {
+				njc->stderrpath = strdup(jc->stderrpath);
+			}
+			if (jc->alt_exc_handler) {
+				njc->alt_exc_handler = strdup(jc->alt_exc_handler);
+			}
+			if (jc->cfbundleidentifier) {
+				njc->cfbundleidentifier = strdup(jc->cfbundleidentifier);
+			}
 #if HAVE_SANDBOX
-		if (j->seatbelt_profile) {
-			nj->seatbelt_profile = strdup(j->seatbelt_profile);
-		}
-		if (j->container_identifier) {
-			nj->container_identifier = strdup(j->container_identifier);
-		}
+			if (jc->seatbelt_profile) {
+				njc->seatbelt_profile = strdup(jc->seatbelt_profile);
+			}
+			if (jc->container_identifier) {
+				njc->container_identifier = strdup(jc->container_identifier);
+			}
 #endif
 
 #if HAVE_QUARANTINE
-		if (j->quarantine_data) {
-			nj->quarantine_data = strdup(j->quarantine_data);
-		}
-		nj->quarantine_data_sz = j->quarantine_data_sz;
+			if (jc->quarantine_data) {
+				if ((njc->quarantine_data = malloc(jc->quarantine_data_sz))) {
+					memcpy(njc->quarantine_data, jc->quarantine_data, jc->quarantine_data_sz);
+					njc->quarantine_data_sz = jc->quarantine_data_sz;
+				} else {
+					(void)job_assumes_zero(nj, errno);
+				}
+			}
 #endif
-		if (j->j_binpref) {
-			size_t sz = malloc_size(j->j_binpref);
-			nj->j_binpref = (cpu_type_t *)malloc(sz);
-			if (nj->j_binpref) {
-				memcpy(&nj->j_binpref, &j->j_binpref, sz);
-			} else {
-				(void)job_assumes_zero(nj, errno);
+			if (jc->j_binpref) {
+				size_t sz = jc->j_binpref_cnt * sizeof(*jc->j_binpref);
+				njc->j_binpref = (cpu_type_t *)malloc(sz);
+				if (njc->j_binpref) {
+					memcpy(njc->j_binpref, jc->j_binpref, sz);
+					njc->j_binpref_cnt = jc->j_binpref_cnt;
+				} else {
+					(void)job_assumes_zero(nj, errno);
+				}
 			}
 		}
 
@@ -2058,7 +2195,7 @@ job_new_subjob(job_t j, uuid_t identifier)
 		if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 			where2put = j->mgr;
 		}
-		LIST_INSERT_HEAD(&where2put->label_hash[hash_label(nj->label)], nj, label_hash_sle);
+		hashtable_insert(&where2put->label_hash, &nj->label_hash_sle, hash_label(nj->label));
 		LIST_INSERT_HEAD(&j->subjobs, nj, subjob_sle);
 	} else {
 		(void)os_assumes_zero(errno);
@@ -2143,7 +2280,6 @@ job_new(jobmgr_t jm, const char *label, const char *prog, const char *const *arg
 	j->checkedin = true;
 	j->jetsam_priority = DEFAULT_JETSAM_PRIORITY;
 	j->jetsam_memlimit = -1;
-	uuid_clear(j->expected_audit_uuid);
 #if TARGET_OS_EMBEDDED
 	/* Run embedded daemons as background by default. SpringBoard jobs are
 	 * Interactive by default. Unfortunately, so many daemons have opted into
@@ -2212,8 +2348,7 @@ job_new(jobmgr_t jm, const char *label, const char *prog, const char *const *arg
 	if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 		where2put_label = j->mgr;
 	}
-	LIST_INSERT_HEAD(&where2put_label->label_hash[hash_label(j->label)], j, label_hash_sle);
-	uuid_clear(j->expected_audit_uuid);
+	hashtable_insert(&where2put_label->label_hash, &j->label_hash_sle, hash_label(j->label));
 
 	job_log(j, LOG_DEBUG, "Conceived");
 
@@ -2244,7 +2379,7 @@ job_new_alias(jobmgr_t jm, job_t src)
 
 	(void)strcpy((char *)j->label, src->label);
 	LIST_INSERT_HEAD(&jm->jobs, j, sle);
-	LIST_INSERT_HEAD(&jm->label_hash[hash_label(j->label)], j, label_hash_sle);
+	hashtable_insert(&jm->label_hash, &j->label_hash_sle, hash_label(j->label));
 	/* Bad jump address. The kqueue callback for aliases should never be
 	 * invoked.
 	 */
@@ -2319,7 +2454,9 @@ job_import_defaults(launch_data_t pload)
 		goto out;
 	}
 
+	/* Only ever read from now on, so later copies can share it */
 	_launchd_defaults_cache = xpc_copy(defaults);
+	xpc_object_freeze(_launchd_defaults_cache);
 	result = true;
 out:
 	if (xd) {
@@ -2381,6 +2518,13 @@ job_import_bulk(launch_data_t pload)
 
 	ja = alloca(c * sizeof(job_t));
 
+	/* Loading a directory of jobs would otherwise cost a kevent(2) call for
+	 * every timer, calendar re-arm and socket group it contains. Build every
+	 * job first, then dispatch them all, and hand the kernel everything that
+	 * this registered in one call at the end.
+	 */
+	kevent_mod_defer();
+
 	for (i = 0; i < c; i++) {
 		if ((likely(ja[i] = jobmgr_import2(root_jobmgr, launch_data_array_get_index(pload, i)))) && errno != ENEEDAUTH) {
 			errno = 0;
@@ -2395,223 +2539,166 @@ job_import_bulk(launch_data_t pload)
 		}
 	}
 
+	kevent_mod_flush();
+
 	return resp;
 }
 
 void
 job_import_bool(job_t j, const char *key, bool value)
 {
-	bool found_key = false;
-
-	switch (key[0]) {
-	case 'a':
-	case 'A':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ABANDONPROCESSGROUP) == 0) {
-			j->abandon_pg = value;
-			found_key = true;
-		}
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_ABANDONPROCESSGROUP:
+		j->abandon_pg = value;
 		break;
-	case 'b':
-	case 'B':
-		if (strcasecmp(key, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN) == 0) {
-			j->dirty_at_shutdown = value;
-			found_key = true;
-		}
+	case JOBKEY_BEGINTRANSACTIONATSHUTDOWN:
+		j->dirty_at_shutdown = value;
 		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JOINGUISESSION) == 0) {
-			j->joins_gui_session = value;
-			found_key = true;
-		}
+	case JOBKEY_JOINGUISESSION:
+		j->joins_gui_session = value;
 		break;
-	case 'k':
-	case 'K':
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE) == 0) {
-			j->ondemand = !value;
-			found_key = true;
-		}
+	case JOBKEY_KEEPALIVE:
+		j->ondemand = !value;
 		break;
-	case 'o':
-	case 'O':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ONDEMAND) == 0) {
-			j->ondemand = value;
-			found_key = true;
-		}
+	case JOBKEY_ONDEMAND:
+		j->ondemand = value;
 		break;
-	case 'd':
-	case 'D':
-		if (strcasecmp(key, LAUNCH_JOBKEY_DEBUG) == 0) {
-			j->debug = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_DISABLED) == 0) {
-			(void)job_assumes(j, !value);
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_DISABLEASLR) == 0) {
-			j->disable_aslr = value;
-			found_key = true;
-		}
+	case JOBKEY_DEBUG:
+		j->debug = value;
 		break;
-	case 'h':
-	case 'H':
-		if (strcasecmp(key, LAUNCH_JOBKEY_HOPEFULLYEXITSLAST) == 0) {
-			job_log(j, LOG_PERF, "%s has been deprecated. Please use the new %s key instead and add EnableTransactions to your launchd.plist.", LAUNCH_JOBKEY_HOPEFULLYEXITSLAST, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN);
-			j->dirty_at_shutdown = value;
-			found_key = true;
+	case JOBKEY_DISABLED:
+		(void)job_assumes(j, !value);
+		break;
+	case JOBKEY_DISABLEASLR:
+		j->disable_aslr = value;
+		break;
+	case JOBKEY_HOPEFULLYEXITSLAST:
+		job_log(j, LOG_PERF, "%s has been deprecated. Please use the new %s key instead and add EnableTransactions to your launchd.plist.", LAUNCH_JOBKEY_HOPEFULLYEXITSLAST, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN);
+		j->dirty_at_shutdown = value;
+		break;
+	case JOBKEY_SESSIONCREATE:
+		j->session_create = value;
+		break;
+	case JOBKEY_STARTONMOUNT:
+		if (value && !j->start_on_mount) {
+			LIST_INSERT_HEAD(&s_start_on_mount, j, start_on_mount_sle);
+		} else if (!value && j->start_on_mount) {
+			LIST_REMOVE(j, start_on_mount_sle);
 		}
+		j->start_on_mount = value;
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SESSIONCREATE) == 0) {
-			j->session_create = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STARTONMOUNT) == 0) {
-			j->start_on_mount = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SERVICEIPC) == 0) {
-			// this only does something on Mac OS X 10.4 "Tiger"
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SHUTDOWNMONITOR) == 0) {
-			if (_launchd_shutdown_monitor) {
-				job_log(j, LOG_ERR, "Only one job may monitor shutdown.");
-			} else {
-				j->shutdown_monitor = true;
-				_launchd_shutdown_monitor = j;
-			}
-			found_key = true;
+	case JOBKEY_SERVICEIPC:
+		// this only does something on Mac OS X 10.4 "Tiger"
+		break;
+	case JOBKEY_SHUTDOWNMONITOR:
+		if (_launchd_shutdown_monitor) {
+			job_log(j, LOG_ERR, "Only one job may monitor shutdown.");
+		} else {
+			j->shutdown_monitor = true;
+			_launchd_shutdown_monitor = j;
 		}
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LOWPRIORITYIO) == 0) {
-			j->low_pri_io = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LAUNCHONLYONCE) == 0) {
-			j->only_once = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LOWPRIORITYBACKGROUNDIO) == 0) {
-			j->low_priority_background_io = true;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LEGACYTIMERS) == 0) {
+	case JOBKEY_LOWPRIORITYIO:
+		j->low_pri_io = value;
+		break;
+	case JOBKEY_LAUNCHONLYONCE:
+		j->only_once = value;
+		break;
+	case JOBKEY_LOWPRIORITYBACKGROUNDIO:
+		j->low_priority_background_io = true;
+		break;
+	case JOBKEY_LEGACYTIMERS:
 #if !TARGET_OS_EMBEDDED
-			j->legacy_timers = value;
+		j->legacy_timers = value;
 #else // !TARGET_OS_EMBEDDED
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif // !TARGET_OS_EMBEDDED
-			found_key = true;
-		}
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHEXCEPTIONHANDLER) == 0) {
-			j->internal_exc_handler = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_MULTIPLEINSTANCES) == 0) {
-			j->multiple_instances = value;
-			found_key = true;
-		}
+	case JOBKEY_MACHEXCEPTIONHANDLER:
+		j->internal_exc_handler = value;
 		break;
-	case 'i':
-	case 'I':
-		if (strcasecmp(key, LAUNCH_JOBKEY_INITGROUPS) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			}
-			j->no_init_groups = !value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN) == 0) {
-			j->ignore_pg_at_shutdown = value;
-			found_key = true;
+	case JOBKEY_MULTIPLEINSTANCES:
+		j->multiple_instances = value;
+		break;
+	case JOBKEY_INITGROUPS:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
+			return;
 		}
+		j->no_init_groups = !value;
 		break;
-	case 'r':
-	case 'R':
-		if (strcasecmp(key, LAUNCH_JOBKEY_RUNATLOAD) == 0) {
-			if (value) {
-				// We don't want value == false to change j->start_pending
-				j->start_pending = true;
-			}
-			found_key = true;
+	case JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN:
+		j->ignore_pg_at_shutdown = value;
+		break;
+	case JOBKEY_RUNATLOAD:
+		if (value) {
+			// We don't want value == false to change j->start_pending
+			j->start_pending = true;
 		}
 		break;
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ENABLEGLOBBING) == 0) {
-			j->globargv = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_ENABLETRANSACTIONS) == 0) {
-			j->enable_transactions = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL) == 0) {
-			j->debug_before_kill = value;
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION) == 0) {
+	case JOBKEY_ENABLEGLOBBING:
+		j->globargv = value;
+		break;
+	case JOBKEY_ENABLETRANSACTIONS:
+		j->enable_transactions = value;
+		break;
+	case JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL:
+		j->debug_before_kill = value;
+		break;
+	case JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION:
 #if TARGET_OS_EMBEDDED
-			if (!_launchd_embedded_god) {
-				if ((j->embedded_god = value)) {
-					_launchd_embedded_god = j;
-				}
-			} else {
-				job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		if (!_launchd_embedded_god) {
+			if ((j->embedded_god = value)) {
+				_launchd_embedded_god = j;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		}
 #else
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif
-			found_key = true;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDHOMESCREEN) == 0) {
+		break;
+	case JOBKEY_EMBEDDEDHOMESCREEN:
 #if TARGET_OS_EMBEDDED
-			if (!_launchd_embedded_home) {
-				if ((j->embedded_home = value)) {
-					_launchd_embedded_home = j;
-				}
-			} else {
-				job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		if (!_launchd_embedded_home) {
+			if ((j->embedded_home = value)) {
+				_launchd_embedded_home = j;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Job tried to claim %s after it has already been claimed.", key);
+		}
 #else
-			job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
+		job_log(j, LOG_ERR, "This key is not supported on this platform: %s", key);
 #endif
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EVENTMONITOR) == 0) {
-			if (!_launchd_event_monitor) {
-				j->event_monitor = value;
-				if (value) {
-					_launchd_event_monitor = j;
-				}
-			} else {
-				job_log(j, LOG_NOTICE, "Job tried to steal event monitoring responsibility from: %s", _launchd_event_monitor->label);
+		break;
+	case JOBKEY_EVENTMONITOR:
+		if (!_launchd_event_monitor) {
+			j->event_monitor = value;
+			if (value) {
+				_launchd_event_monitor = j;
 			}
-			found_key = true;
+		} else {
+			job_log(j, LOG_NOTICE, "Job tried to steal event monitoring responsibility from: %s", _launchd_event_monitor->label);
 		}
 		break;
-	case 'w':
-	case 'W':
-		if (strcasecmp(key, LAUNCH_JOBKEY_WAITFORDEBUGGER) == 0) {
-			j->wait4debugger = value;
-			found_key = true;
-		}
+	case JOBKEY_WAITFORDEBUGGER:
+		j->wait4debugger = value;
 		break;
-	case 'x':
-	case 'X':
-		if (strcasecmp(key, LAUNCH_JOBKEY_XPCDOMAINBOOTSTRAPPER) == 0) {
-			if (pid1_magic) {
-				if (_launchd_xpc_bootstrapper) {
-					job_log(j, LOG_ERR, "This job tried to steal the XPC domain bootstrapper property from the following job: %s", _launchd_xpc_bootstrapper->label);
-				} else {
-					_launchd_xpc_bootstrapper = j;
-					j->xpc_bootstrapper = value;
-				}
+	case JOBKEY_XPCDOMAINBOOTSTRAPPER:
+		if (pid1_magic) {
+			if (_launchd_xpc_bootstrapper) {
+				job_log(j, LOG_ERR, "This job tried to steal the XPC domain bootstrapper property from the following job: %s", _launchd_xpc_bootstrapper->label);
 			} else {
-				job_log(j, LOG_ERR, "Non-daemon tried to claim XPC bootstrapper property.");
+				_launchd_xpc_bootstrapper = j;
+				j->xpc_bootstrapper = value;
 			}
+		} else {
+			job_log(j, LOG_ERR, "Non-daemon tried to claim XPC bootstrapper property.");
 		}
-		found_key = true;
 		break;
 	default:
-		break;
-	}
-
-	if (unlikely(!found_key)) {
 		job_log(j, LOG_WARNING, "Unknown key for boolean: %s", key);
+		break;
 	}
 }
 
@@ -2620,132 +2707,124 @@ job_import_string(job_t j, const char *key, const char *value)
 {
 	char **where2put = NULL;
 
-	switch (key[0]) {
-	case 'c':
-	case 'C':
-		if (strcasecmp(key, LAUNCH_JOBKEY_CFBUNDLEIDENTIFIER) == 0) {
-			where2put = &j->cfbundleidentifier;
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_CFBUNDLEIDENTIFIER:
+		if (!job_cold(j)) {
+			return;
 		}
+		where2put = &j->cold->cfbundleidentifier;
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHEXCEPTIONHANDLER) == 0) {
-			where2put = &j->alt_exc_handler;
+	case JOBKEY_MACHEXCEPTIONHANDLER:
+		if (!job_cold(j)) {
+			return;
 		}
+		where2put = &j->cold->alt_exc_handler;
 		break;
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_PROGRAM) == 0) {
+	case JOBKEY_PROGRAM:
+	case JOBKEY_LABEL:
+	case JOBKEY_LIMITLOADTOHOSTS:
+	case JOBKEY_LIMITLOADFROMHOSTS:
+	case JOBKEY_LIMITLOADTOSESSIONTYPE:
+	case JOBKEY_XPCDOMAIN:
+		return;
+	case JOBKEY_POSIXSPAWNTYPE:
+	case JOBKEY_PROCESSTYPE:
+		if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_INTERACTIVE) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_INTERACTIVE;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_ADAPTIVE) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_ADAPTIVE;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_STANDARD) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_STANDARD;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_BACKGROUND) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_BACKGROUND;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_TALAPP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_TAL;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_SYSTEMAPP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
+			j->system_app = true;
+		} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_APP) == 0) {
+			j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
+			j->app = true;
+		} else {
+			job_log(j, LOG_ERR, "Unknown value for key %s: %s", key, value);
+		}
+		return;
+	case JOBKEY_ROOTDIRECTORY:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_POSIXSPAWNTYPE) == 0
-				|| strcasecmp(key, LAUNCH_JOBKEY_PROCESSTYPE) == 0) {
-			if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_INTERACTIVE) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_INTERACTIVE;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_ADAPTIVE) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_ADAPTIVE;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_STANDARD) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_STANDARD;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_BACKGROUND) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_BACKGROUND;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_TALAPP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_TAL;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_SYSTEMAPP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
-				j->system_app = true;
-			} else if (strcasecmp(value, LAUNCH_KEY_POSIXSPAWNTYPE_APP) == 0) {
-				j->psproctype = POSIX_SPAWN_PROC_TYPE_APP_DEFAULT;
-				j->app = true;
-			} else {
-				job_log(j, LOG_ERR, "Unknown value for key %s: %s", key, value);
-			}
+		}
+		if (!job_cold(j)) {
 			return;
 		}
+		where2put = &j->cold->rootdir;
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LABEL) == 0) {
+	case JOBKEY_WORKINGDIRECTORY:
+		if (!job_cold(j)) {
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHOSTS) == 0) {
+		}
+		where2put = &j->cold->workingdir;
+		break;
+	case JOBKEY_USERNAME:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHOSTS) == 0) {
+		} else if (strcmp(value, "root") == 0) {
 			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE) == 0) {
+		}
+		where2put = &j->username;
+		break;
+	case JOBKEY_GROUPNAME:
+		if (getuid() != 0) {
+			job_log(j, LOG_WARNING, "Ignored this key: %s", key);
+			return;
+		} else if (strcmp(value, "wheel") == 0) {
 			return;
 		}
+		where2put = &j->groupname;
+		break;
+	case JOBKEY_STANDARDOUTPATH:
+		if (!job_cold(j)) {
+			return;
+		}
+		where2put = &j->cold->stdoutpath;
+		break;
+	case JOBKEY_STANDARDERRORPATH:
+		if (!job_cold(j)) {
+			return;
+		}
+		where2put = &j->cold->stderrpath;
+		break;
+	case JOBKEY_STANDARDINPATH:
+		if (!job_cold(j)) {
+			return;
+		}
+		where2put = &j->cold->stdinpath;
+		j->stdin_fd = _fd(open(value, O_RDONLY|O_CREAT|O_NOCTTY|O_NONBLOCK, DEFFILEMODE));
+		if (job_assumes_zero_p(j, j->stdin_fd) != -1) {
+			// open() should not block, but regular IO by the job should
+			(void)job_assumes_zero_p(j, fcntl(j->stdin_fd, F_SETFL, 0));
+			// XXX -- EV_CLEAR should make named pipes happy?
+			(void)job_assumes_zero_p(j, kevent_mod(j->stdin_fd, EVFILT_READ, EV_ADD|EV_CLEAR, 0, 0, j));
+		} else {
+			j->stdin_fd = 0;
+		}
 		break;
-	case 'r':
-	case 'R':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ROOTDIRECTORY) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			}
-			where2put = &j->rootdir;
-		}
-		break;
-	case 'w':
-	case 'W':
-		if (strcasecmp(key, LAUNCH_JOBKEY_WORKINGDIRECTORY) == 0) {
-			where2put = &j->workingdir;
-		}
-		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_USERNAME) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			} else if (strcmp(value, "root") == 0) {
-				return;
-			}
-			where2put = &j->username;
-		}
-		break;
-	case 'g':
-	case 'G':
-		if (strcasecmp(key, LAUNCH_JOBKEY_GROUPNAME) == 0) {
-			if (getuid() != 0) {
-				job_log(j, LOG_WARNING, "Ignored this key: %s", key);
-				return;
-			} else if (strcmp(value, "wheel") == 0) {
-				return;
-			}
-			where2put = &j->groupname;
-		}
-		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDOUTPATH) == 0) {
-			where2put = &j->stdoutpath;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDERRORPATH) == 0) {
-			where2put = &j->stderrpath;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STANDARDINPATH) == 0) {
-			where2put = &j->stdinpath;
-			j->stdin_fd = _fd(open(value, O_RDONLY|O_CREAT|O_NOCTTY|O_NONBLOCK, DEFFILEMODE));
-			if (job_assumes_zero_p(j, j->stdin_fd) != -1) {
-				// open() should not block, but regular IO by the job should
-				(void)job_assumes_zero_p(j, fcntl(j->stdin_fd, F_SETFL, 0));
-				// XXX -- EV_CLEAR should make named pipes happy?
-				(void)job_assumes_zero_p(j, kevent_mod(j->stdin_fd, EVFILT_READ, EV_ADD|EV_CLEAR, 0, 0, j));
-			} else {
-				j->stdin_fd = 0;
-			}
 #if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXPROFILE) == 0) {
-			where2put = &j->seatbelt_profile;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXCONTAINER) == 0) {
-			where2put = &j->container_identifier;
-#endif
+	case JOBKEY_SANDBOXPROFILE:
+		if (!job_cold(j)) {
+			return;
 		}
+		where2put = &j->cold->seatbelt_profile;
 		break;
-	case 'X':
-	case 'x':
-		if (strcasecmp(key, LAUNCH_JOBKEY_XPCDOMAIN) == 0) {
+	case JOBKEY_SANDBOXCONTAINER:
+		if (!job_cold(j)) {
 			return;
 		}
+		where2put = &j->cold->container_identifier;
 		break;
+#endif
 	default:
-		job_log(j, LOG_WARNING, "Unknown key for string: %s", key);
 		break;
 	}
 
@@ -2767,103 +2846,91 @@ job_import_string(job_t j, const char *key, const char *value)
 void
 job_import_integer(job_t j, const char *key, long long value)
 {
-	switch (key[0]) {
-	case 'a':
-	case 'A':
+	switch (jobkey_lookup(key)) {
 #if TARGET_OS_EMBEDDED
-		if (strcasecmp(key, LAUNCH_JOBKEY_ASID) == 0) {
-			if (launchd_embedded_handofgod) {
-				if (audit_session_port((au_asid_t)value, &j->asport) == -1 && errno != ENOSYS) {
-					(void)job_assumes_zero(j, errno);
-				}
+	case JOBKEY_ASID:
+		if (launchd_embedded_handofgod) {
+			if (audit_session_port((au_asid_t)value, &j->asport) == -1 && errno != ENOSYS) {
+				(void)job_assumes_zero(j, errno);
 			}
 		}
+		break;
 #endif
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_EXITTIMEOUT) == 0) {
-			if (unlikely(value < 0)) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
-			} else {
-				j->exit_timeout = (typeof(j->exit_timeout)) value;
-			}
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_EMBEDDEDMAINTHREADPRIORITY) == 0) {
-			j->main_thread_priority = value;
+	case JOBKEY_EXITTIMEOUT:
+		if (unlikely(value < 0)) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_EXITTIMEOUT);
+		} else {
+			j->exit_timeout = (typeof(j->exit_timeout)) value;
 		}
 		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JETSAMPRIORITY) == 0) {
-			job_log(j, LOG_WARNING | LOG_CONSOLE, "Please change the JetsamPriority key to be in a dictionary named JetsamProperties.");
+	case JOBKEY_EMBEDDEDMAINTHREADPRIORITY:
+		if (job_cold(j)) {
+			j->cold->main_thread_priority = (typeof(j->cold->main_thread_priority)) value;
+		}
+		break;
+	case JOBKEY_JETSAMPRIORITY: {
+		job_log(j, LOG_WARNING | LOG_CONSOLE, "Please change the JetsamPriority key to be in a dictionary named JetsamProperties.");
 
-			launch_data_t pri = launch_data_new_integer(value);
-			if (job_assumes(j, pri != NULL)) {
-				jetsam_property_setup(pri, LAUNCH_JOBKEY_JETSAMPRIORITY, j);
-				launch_data_free(pri);
-			}
+		launch_data_t pri = launch_data_new_integer(value);
+		if (job_assumes(j, pri != NULL)) {
+			jetsam_property_setup(pri, LAUNCH_JOBKEY_JETSAMPRIORITY, j);
+			launch_data_free(pri);
 		}
-	case 'n':
-	case 'N':
-		if (strcasecmp(key, LAUNCH_JOBKEY_NICE) == 0) {
-			if (unlikely(value < PRIO_MIN)) {
-				job_log(j, LOG_WARNING, "%s less than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MIN);
-			} else if (unlikely(value > PRIO_MAX)) {
-				job_log(j, LOG_WARNING, "%s is greater than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MAX);
-			} else {
-				j->nice = (typeof(j->nice)) value;
-				j->setnice = true;
-			}
+		break;
+	}
+	case JOBKEY_NICE:
+		if (unlikely(value < PRIO_MIN)) {
+			job_log(j, LOG_WARNING, "%s less than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MIN);
+		} else if (unlikely(value > PRIO_MAX)) {
+			job_log(j, LOG_WARNING, "%s is greater than %d. Ignoring.", LAUNCH_JOBKEY_NICE, PRIO_MAX);
+		} else {
+			j->nice = (typeof(j->nice)) value;
+			j->setnice = true;
 		}
 		break;
-	case 't':
-	case 'T':
-		if (strcasecmp(key, LAUNCH_JOBKEY_TIMEOUT) == 0) {
-			if (unlikely(value < 0)) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
-			} else {
-				j->timeout = (typeof(j->timeout)) value;
-			}
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_THROTTLEINTERVAL) == 0) {
-			if (value < 0) {
-				job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
-			} else if (value > UINT32_MAX) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
-			} else {
-				j->min_run_time = (typeof(j->min_run_time)) value;
-			}
+	case JOBKEY_TIMEOUT:
+		if (unlikely(value < 0)) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_TIMEOUT);
+		} else {
+			j->timeout = (typeof(j->timeout)) value;
 		}
 		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_UMASK) == 0) {
-			j->mask = value;
-			j->setmask = true;
+	case JOBKEY_THROTTLEINTERVAL:
+		if (value < 0) {
+			job_log(j, LOG_WARNING, "%s less than zero. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
+		} else if (value > UINT32_MAX) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_THROTTLEINTERVAL);
+		} else {
+			j->min_run_time = (typeof(j->min_run_time)) value;
 		}
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STARTINTERVAL) == 0) {
-			if (unlikely(value <= 0)) {
-				job_log(j, LOG_WARNING, "%s is not greater than zero. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
-			} else if (unlikely(value > UINT32_MAX)) {
-				job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
-			} else {
-				runtime_add_weak_ref();
-				j->start_interval = (typeof(j->start_interval)) value;
+	case JOBKEY_UMASK:
+		j->mask = value;
+		j->setmask = true;
+		break;
+	case JOBKEY_STARTINTERVAL:
+		if (unlikely(value <= 0)) {
+			job_log(j, LOG_WARNING, "%s is not greater than zero. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
+		} else if (unlikely(value > UINT32_MAX)) {
+			job_log(j, LOG_WARNING, "%s is too large. Ignoring.", LAUNCH_JOBKEY_STARTINTERVAL);
+		} else {
+			runtime_add_weak_ref();
+			j->start_interval = (typeof(j->start_interval)) value;
 
-				(void)job_assumes_zero_p(j, kevent_mod((uintptr_t)&j->start_interval, EVFILT_TIMER, EV_ADD, NOTE_SECONDS, j->start_interval, j));
-			}
+			kevent_mod_deferred((uintptr_t)&j->start_interval, EVFILT_TIMER, EV_ADD, NOTE_SECONDS, j->start_interval, j);
+		}
+		break;
 #if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXFLAGS) == 0) {
-			j->seatbelt_flags = value;
-#endif
+	case JOBKEY_SANDBOXFLAGS:
+		if (job_cold(j)) {
+			j->cold->seatbelt_flags = value;
 		}
-
 		break;
+#endif
 	default:
 		job_log(j, LOG_WARNING, "Unknown key for integer: %s", key);
 		break;
@@ -2873,28 +2940,25 @@ job_import_integer(job_t j, const char *key, long long value)
 void
 job_import_opaque(job_t j __attribute__((unused)), const char *key, launch_data_t value __attribute__((unused)))
 {
-	switch (key[0]) {
-	case 'q':
-	case 'Q':
+	switch (jobkey_lookup(key)) {
 #if HAVE_QUARANTINE
-		if (strcasecmp(key, LAUNCH_JOBKEY_QUARANTINEDATA) == 0) {
-			size_t tmpsz = launch_data_get_opaque_size(value);
+	case JOBKEY_QUARANTINEDATA: {
+		size_t tmpsz = launch_data_get_opaque_size(value);
 
-			if (job_assumes(j, j->quarantine_data = malloc(tmpsz))) {
-				memcpy(j->quarantine_data, launch_data_get_opaque(value), tmpsz);
-				j->quarantine_data_sz = tmpsz;
-			}
+		if (job_cold(j) && job_assumes(j, j->cold->quarantine_data = malloc(tmpsz))) {
+			memcpy(j->cold->quarantine_data, launch_data_get_opaque(value), tmpsz);
+			j->cold->quarantine_data_sz = tmpsz;
 		}
+		break;
+	}
 #endif
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SECURITYSESSIONUUID) == 0) {
-			size_t tmpsz = launch_data_get_opaque_size(value);
-			if (job_assumes(j, tmpsz == sizeof(uuid_t))) {
-				memcpy(j->expected_audit_uuid, launch_data_get_opaque(value), sizeof(uuid_t));
-			}
+	case JOBKEY_SECURITYSESSIONUUID: {
+		size_t tmpsz = launch_data_get_opaque_size(value);
+		if (job_assumes(j, tmpsz == sizeof(uuid_t)) && job_cold(j)) {
+			memcpy(j->cold->expected_audit_uuid, launch_data_get_opaque(value), sizeof(uuid_t));
 		}
 		break;
+	}
 	default:
 		break;
 	}
@@ -2928,88 +2992,58 @@ job_import_dictionary(job_t j, const char *key, launch_data_t value)
 {
 	launch_data_t tmp;
 
-	switch (key[0]) {
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_POLICIES) == 0) {
-			launch_data_dict_iterate(value, policy_setup, j);
-		}
-		break;
-	case 'k':
-	case 'K':
-		if (strcasecmp(key, LAUNCH_JOBKEY_KEEPALIVE) == 0) {
-			launch_data_dict_iterate(value, semaphoreitem_setup, j);
-		}
-		break;
-	case 'i':
-	case 'I':
-		if (strcasecmp(key, LAUNCH_JOBKEY_INETDCOMPATIBILITY) == 0) {
-			j->inetcompat = true;
-			j->abandon_pg = true;
-			if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_WAIT))) {
-				j->inetcompat_wait = launch_data_get_bool(tmp);
-			}
-		}
-		break;
-	case 'j':
-	case 'J':
-		if (strcasecmp(key, LAUNCH_JOBKEY_JETSAMPROPERTIES) == 0) {
-			launch_data_dict_iterate(value, (void (*)(launch_data_t, const char *, void *))jetsam_property_setup, j);
-		}
-	case 'e':
-	case 'E':
-		if (strcasecmp(key, LAUNCH_JOBKEY_ENVIRONMENTVARIABLES) == 0) {
-			launch_data_dict_iterate(value, envitem_setup, j);
-		}		
-		break;
-	case 'u':
-	case 'U':
-		if (strcasecmp(key, LAUNCH_JOBKEY_USERENVIRONMENTVARIABLES) == 0) {
-			j->importing_global_env = true;
-			launch_data_dict_iterate(value, envitem_setup, j);
-			j->importing_global_env = false;
-		}
-		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_SOCKETS) == 0) {
-			launch_data_dict_iterate(value, socketgroup_setup, j);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_STARTCALENDARINTERVAL) == 0) {
-			calendarinterval_new_from_obj(j, value);
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SOFTRESOURCELIMITS) == 0) {
-			launch_data_dict_iterate(value, limititem_setup, j);
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_POLICIES:
+		launch_data_dict_iterate(value, policy_setup, j);
+		break;
+	case JOBKEY_KEEPALIVE:
+		launch_data_dict_iterate(value, semaphoreitem_setup, j);
+		break;
+	case JOBKEY_INETDCOMPATIBILITY:
+		j->inetcompat = true;
+		j->abandon_pg = true;
+		if ((tmp = launch_data_dict_lookup(value, LAUNCH_JOBINETDCOMPATIBILITY_WAIT))) {
+			j->inetcompat_wait = launch_data_get_bool(tmp);
+		}
+		break;
+	case JOBKEY_JETSAMPROPERTIES:
+		launch_data_dict_iterate(value, (void (*)(launch_data_t, const char *, void *))jetsam_property_setup, j);
+		break;
+	case JOBKEY_ENVIRONMENTVARIABLES:
+		launch_data_dict_iterate(value, envitem_setup, j);
+		break;
+	case JOBKEY_USERENVIRONMENTVARIABLES:
+		j->importing_global_env = true;
+		launch_data_dict_iterate(value, envitem_setup, j);
+		j->importing_global_env = false;
+		break;
+	case JOBKEY_SOCKETS:
+		launch_data_dict_iterate(value, socketgroup_setup, j);
+		break;
+	case JOBKEY_STARTCALENDARINTERVAL:
+		calendarinterval_new_from_obj(j, value);
+		break;
+	case JOBKEY_SOFTRESOURCELIMITS:
+		launch_data_dict_iterate(value, limititem_setup, j);
+		break;
 #if HAVE_SANDBOX
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOXFLAGS) == 0) {
-			launch_data_dict_iterate(value, seatbelt_setup_flags, j);
+	case JOBKEY_SANDBOXFLAGS:
+		launch_data_dict_iterate(value, seatbelt_setup_flags, j);
+		break;
 #endif
-		}
+	case JOBKEY_HARDRESOURCELIMITS:
+		j->importing_hard_limits = true;
+		launch_data_dict_iterate(value, limititem_setup, j);
+		j->importing_hard_limits = false;
 		break;
-	case 'h':
-	case 'H':
-		if (strcasecmp(key, LAUNCH_JOBKEY_HARDRESOURCELIMITS) == 0) {
-			j->importing_hard_limits = true;
-			launch_data_dict_iterate(value, limititem_setup, j);
-			j->importing_hard_limits = false;
-		}
+	case JOBKEY_MACHSERVICES:
+		launch_data_dict_iterate(value, machservice_setup, j);
 		break;
-	case 'm':
-	case 'M':
-		if (strcasecmp(key, LAUNCH_JOBKEY_MACHSERVICES) == 0) {
-			launch_data_dict_iterate(value, machservice_setup, j);
-		}
+	case JOBKEY_LAUNCHEVENTS:
+		launch_data_dict_iterate(value, eventsystem_setup, j);
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LAUNCHEVENTS) == 0) {
-			launch_data_dict_iterate(value, eventsystem_setup, j);
-		} else {
-			if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHARDWARE) == 0) {
-				return;
-			}
-			if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHARDWARE) == 0) {
-				return;
-			}
-		}
+	case JOBKEY_LIMITLOADTOHARDWARE:
+	case JOBKEY_LIMITLOADFROMHARDWARE:
 		break;
 	default:
 		job_log(j, LOG_WARNING, "Unknown key for dictionary: %s", key);
@@ -3022,41 +3056,25 @@ job_import_array(job_t j, const char *key, launch_data_t value)
 {
 	size_t i, value_cnt = launch_data_array_get_count(value);
 
-	switch (key[0]) {
-	case 'p':
-	case 'P':
-		if (strcasecmp(key, LAUNCH_JOBKEY_PROGRAMARGUMENTS) == 0) {
-			return;
-		}
+	switch (jobkey_lookup(key)) {
+	case JOBKEY_PROGRAMARGUMENTS:
+	case JOBKEY_LIMITLOADTOHOSTS:
+	case JOBKEY_LIMITLOADFROMHOSTS:
 		break;
-	case 'l':
-	case 'L':
-		if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOHOSTS) == 0) {
-			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADFROMHOSTS) == 0) {
-			return;
-		} else if (strcasecmp(key, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE) == 0) {
-			job_log(j, LOG_NOTICE, "launchctl should have transformed the \"%s\" array to a string", LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
-			return;
-		}
+	case JOBKEY_LIMITLOADTOSESSIONTYPE:
+		job_log(j, LOG_NOTICE, "launchctl should have transformed the \"%s\" array to a string", LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE);
 		break;
-	case 'b':
-	case 'B':
-		if (strcasecmp(key, LAUNCH_JOBKEY_BINARYORDERPREFERENCE) == 0) {
-			if (job_assumes(j, j->j_binpref = malloc(value_cnt * sizeof(*j->j_binpref)))) {
-				j->j_binpref_cnt = value_cnt;
-				for (i = 0; i < value_cnt; i++) {
-					j->j_binpref[i] = (cpu_type_t) launch_data_get_integer(launch_data_array_get_index(value, i));
-				}
+	case JOBKEY_BINARYORDERPREFERENCE:
+		if (job_cold(j) && job_assumes(j, j->cold->j_binpref = malloc(value_cnt * sizeof(*j->cold->j_binpref)))) {
+			j->cold->j_binpref_cnt = value_cnt;
+			for (i = 0; i < value_cnt; i++) {
+				j->cold->j_binpref[i] = (cpu_type_t) launch_data_get_integer(launch_data_array_get_index(value, i));
 			}
 		}
 		break;
-	case 's':
-	case 'S':
-		if (strcasecmp(key, LAUNCH_JOBKEY_STARTCALENDARINTERVAL) == 0) {
-			for (i = 0; i < value_cnt; i++) {
-				calendarinterval_new_from_obj(j, launch_data_array_get_index(value, i));
-			}
+	case JOBKEY_STARTCALENDARINTERVAL:
+		for (i = 0; i < value_cnt; i++) {
+			calendarinterval_new_from_obj(j, launch_data_array_get_index(value, i));
 		}
 		break;
 	default:
@@ -3261,9 +3279,9 @@ jobmgr_import2(jobmgr_t jm, launch_data_t pload)
 		job_apply_defaults(j);
 #endif
 		launch_data_dict_iterate(pload, job_import_keys, j);
-		if (!uuid_is_null(j->expected_audit_uuid)) {
+		if (!uuid_is_null(job_cold_get(j)->expected_audit_uuid)) {
 			uuid_string_t uuid_str;
-			uuid_unparse(j->expected_audit_uuid, uuid_str);
+			uuid_unparse(j->cold->expected_audit_uuid, uuid_str);
 			job_log(j, LOG_DEBUG, "Imported job. Waiting for session for UUID %s.", uuid_str);
 			LIST_INSERT_HEAD(&s_needing_sessions, j, needing_session_sle);
 			errno = ENEEDAUTH;
@@ -3335,7 +3353,7 @@ job_find(jobmgr_t jm, const char *label)
 		jm = root_jobmgr;
 	}
 
-	LIST_FOREACH(ji, &jm->label_hash[hash_label(label)], label_hash_sle) {
+	HASHTABLE_FOREACH(ji, &jm->label_hash, hash_label(label), label_hash_sle) {
 		if (unlikely(ji->removal_pending || ji->mgr->shutting_down)) {
 			// 5351245 and 5488633 respectively
 			continue;
@@ -3350,20 +3368,19 @@ job_find(jobmgr_t jm, const char *label)
 	return NULL;
 }
 
-// Should try and consolidate with job_mig_intran2() and jobmgr_find_by_pid().
-job_t
-jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay)
+static job_t
+jobmgr_find_by_pid_walk(jobmgr_t jm, pid_t p, bool anon_okay)
 {
 	job_t ji = NULL;
-	LIST_FOREACH(ji, &jm->active_jobs[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
-		if (ji->p == p && (!ji->anonymous || (ji->anonymous && anon_okay))) {
+	HASHTABLE_FOREACH(ji, &jm->active_jobs, ACTIVE_JOB_HASH(p), pid_hash_sle) {
+		if (ji->p == p && (!ji->anonymous || anon_okay)) {
 			return ji;
 		}
 	}
 
 	jobmgr_t jmi = NULL;
 	SLIST_FOREACH(jmi, &jm->submgrs, sle) {
-		if ((ji = jobmgr_find_by_pid_deep(jmi, p, anon_okay))) {
+		if ((ji = jobmgr_find_by_pid_walk(jmi, p, anon_okay))) {
 			break;
 		}
 	}
@@ -3371,12 +3388,41 @@ jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay)
 	return ji;
 }
 
+/* Finds the job for p below jm. The answer is the one a depth-first walk of
+ * jm's subtree would give: jm's own jobs first, then each submanager's in
+ * list order. A pid is almost always held by a single job, so it is looked
+ * up in global_actives, and the tree is only walked when more than one job
+ * below jm claims it.
+ */
+job_t
+jobmgr_find_by_pid_deep(jobmgr_t jm, pid_t p, bool anon_okay)
+{
+	job_t ji, found = NULL;
+
+	HASHTABLE_FOREACH(ji, &global_actives, ACTIVE_JOB_HASH(p), global_pid_hash_sle) {
+		if (ji->p != p || (ji->anonymous && !anon_okay)) {
+			continue;
+		}
+
+		if (!jobmgr_contains(jm, ji->mgr)) {
+			continue;
+		}
+
+		if (found) {
+			return jobmgr_find_by_pid_walk(jm, p, anon_okay);
+		}
+		found = ji;
+	}
+
+	return found;
+}
+
 job_t
 jobmgr_find_by_pid(jobmgr_t jm, pid_t p, bool create_anon)
 {
 	job_t ji;
 
-	LIST_FOREACH(ji, &jm->active_jobs[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
+	HASHTABLE_FOREACH(ji, &jm->active_jobs, ACTIVE_JOB_HASH(p), pid_hash_sle) {
 		if (ji->p == p) {
 			return ji;
 		}
@@ -3390,8 +3436,8 @@ managed_job(pid_t p)
 {
 	job_t ji;
 
-	LIST_FOREACH(ji, &managed_actives[ACTIVE_JOB_HASH(p)], pid_hash_sle) {
-		if (ji->p == p) {
+	HASHTABLE_FOREACH(ji, &global_actives, ACTIVE_JOB_HASH(p), global_pid_hash_sle) {
+		if (ji->p == p && !ji->anonymous) {
 			return ji;
 		}
 	}
@@ -3405,20 +3451,14 @@ job_mig_intran2(jobmgr_t jm, mach_port_t mport, pid_t upid)
 	jobmgr_t jmi;
 	job_t ji;
 
-	if (jm->jm_port == mport) {
-		return jobmgr_find_by_pid(jm, upid, true);
-	}
-
-	SLIST_FOREACH(jmi, &jm->submgrs, sle) {
-		job_t jr;
-
-		if ((jr = job_mig_intran2(jmi, mport, upid))) {
-			return jr;
+	HASHTABLE_FOREACH(jmi, &jobmgr_port_hash, HASH_PORT(mport), port_hash_sle) {
+		if (jmi->jm_port == mport && jobmgr_contains(jm, jmi)) {
+			return jobmgr_find_by_pid(jmi, upid, true);
 		}
 	}
 
-	LIST_FOREACH(ji, &jm->jobs, sle) {
-		if (ji->j_port == mport) {
+	HASHTABLE_FOREACH(ji, &job_port_hash, HASH_PORT(mport), port_hash_sle) {
+		if (ji->j_port == mport && jobmgr_contains(jm, ji->mgr)) {
 			return ji;
 		}
 	}
@@ -3455,7 +3495,7 @@ job_find_by_service_port(mach_port_t p)
 {
 	struct machservice *ms;
 
-	LIST_FOREACH(ms, &port_hash[HASH_PORT(p)], port_hash_sle) {
+	HASHTABLE_FOREACH(ms, &port_hash, HASH_PORT(p), port_hash_sle) {
 		if (ms->recv && (ms->port == p)) {
 			return ms->job;
 		}
@@ -3707,10 +3747,8 @@ job_reap(job_t j)
 		(void)kevent_mod((uintptr_t)&j->exit_timeout, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
 	}
 
-	LIST_REMOVE(j, pid_hash_sle);
-	if (!j->anonymous) {
-		LIST_REMOVE(j, global_pid_hash_sle);
-	}
+	hashtable_remove(&j->pid_hash_sle);
+	hashtable_remove(&j->global_pid_hash_sle);
 
 	if (j->sent_signal_time) {
 		uint64_t td_sec, td_usec, td = runtime_get_nanoseconds_since(j->sent_signal_time);
@@ -3833,7 +3871,7 @@ job_reap(job_t j)
 	}
 
 	struct suspended_peruser *spi = NULL;
-	while ((spi = LIST_FIRST(&j->suspended_perusers))) {
+	while ((spi = LIST_FIRST(&job_cold_get(j)->suspended_perusers))) {
 		job_log(j, LOG_ERR, "Job exited before resuming per-user launchd for UID %u. Will forcibly resume.", spi->j->mach_uid);
 		spi->j->peruser_suspend_count--;
 		if (spi->j->peruser_suspend_count == 0) {
@@ -3905,7 +3943,7 @@ job_reap(job_t j)
 }
 
 void
-jobmgr_dispatch_all(jobmgr_t jm, bool newmounthack)
+jobmgr_dispatch_all(jobmgr_t jm)
 {
 	jobmgr_t jmi, jmn;
 	job_t ji, jn;
@@ -3915,43 +3953,67 @@ jobmgr_dispatch_all(jobmgr_t jm, bool newmounthack)
 	}
 
 	SLIST_FOREACH_SAFE(jmi, &jm->submgrs, sle, jmn) {
-		jobmgr_dispatch_all(jmi, newmounthack);
+		jobmgr_dispatch_all(jmi);
 	}
 
 	LIST_FOREACH_SAFE(ji, &jm->jobs, sle, jn) {
-		if (newmounthack && ji->start_on_mount) {
-			ji->start_pending = true;
-		}
-
 		job_dispatch(ji, false);
 	}
 }
 
+/* Act on the file system events that arrived within the coalescing window.
+ * A mount used to re-dispatch every job in every domain, but only the
+ * StartOnMount jobs can want to run because of one. No KeepAlive semaphore
+ * depends on the file system, so nothing else is looked at.
+ */
 void
-job_dispatch_curious_jobs(job_t j)
-{	
-	job_t ji = NULL, jt = NULL;
-	SLIST_FOREACH_SAFE(ji, &s_curious_jobs, curious_jobs_sle, jt) {
-		struct semaphoreitem *si = NULL;
-		SLIST_FOREACH(si, &ji->semaphores, sle) {			
-			if (!(si->why == OTHER_JOB_ENABLED || si->why == OTHER_JOB_DISABLED)) {
+jobmgr_dispatch_fs_events(void)
+{
+	bool mounted = s_fs_mount_pending;
+	job_t ji, jn;
+
+	s_fs_event_pending = false;
+	s_fs_mount_pending = false;
+
+	if (mounted) {
+		LIST_FOREACH_SAFE(ji, &s_start_on_mount, start_on_mount_sle, jn) {
+			if (jobmgr_shutting_down(ji->mgr)) {
 				continue;
 			}
 
-			if (strcmp(si->what, j->label) == 0) {
-				job_log(ji, LOG_DEBUG, "Dispatching out of interest in \"%s\".", j->label);
+			ji->start_pending = true;
+			job_dispatch(ji, false);
+		}
+	}
+}
 
-				if (!ji->removing) {
-					job_dispatch(ji, false);
-				} else {
-					job_log(ji, LOG_NOTICE, "The following job is circularly dependent upon this one: %s", j->label);
-				}
+void
+job_dispatch_curious_jobs(job_t j)
+{
+	struct semaphoreitem *si = NULL;
+	job_t ji = NULL;
 
-				/* ji could be removed here, so don't do anything with it or its semaphores
-				 * after this point.
-				 */
-				break;
-			}
+	/* Dispatching a job can free its semaphores, so find every interested job
+	 * first. A job watching this label more than once is only queued once.
+	 */
+	HASHTABLE_FOREACH(si, &s_curious_semaphores, hash_label(j->label), curious_sle) {
+		ji = si->job;
+		if (!ji->curious_pending && strcmp(si->what, j->label) == 0) {
+			ji->curious_pending = true;
+			LIST_INSERT_HEAD(&s_curious_pending, ji, curious_pending_sle);
+		}
+	}
+
+	// job_remove() takes a job off the list if dispatching another removes it.
+	while ((ji = LIST_FIRST(&s_curious_pending))) {
+		LIST_REMOVE(ji, curious_pending_sle);
+		ji->curious_pending = false;
+
+		job_log(ji, LOG_DEBUG, "Dispatching out of interest in \"%s\".", j->label);
+		if (!ji->removing) {
+			job_dispatch(ji, false);
+		} else {
+			job_log(ji, LOG_NOTICE, "The following job is circularly dependent upon this one: %s", j->label);
 		}
 	}
 }
@@ -3960,7 +4022,7 @@ job_t
 job_dispatch(job_t j, bool kickstart)
 {
 	// Don't dispatch a job if it has no audit session set.
-	if (!uuid_is_null(j->expected_audit_uuid)) {
+	if (!uuid_is_null(job_cold_get(j)->expected_audit_uuid)) {
 		job_log(j, LOG_DEBUG, "Job is still awaiting its audit session UUID. Not dispatching.");
 		return NULL;
 	}
@@ -4116,14 +4178,14 @@ job_callback_proc(job_t j, struct kevent *kev)
 
 				job_log(j, LOG_INFO, "Program changed. Updating the label to: %s", newlabel);
 
-				LIST_REMOVE(j, label_hash_sle);
+				hashtable_remove(&j->label_hash_sle);
 				strcpy((char *)j->label, newlabel);
 
 				jobmgr_t where2put = root_jobmgr;
 				if (j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN) {
 					where2put = j->mgr;
 				}
-				LIST_INSERT_HEAD(&where2put->label_hash[hash_label(j->label)], j, label_hash_sle);
+				hashtable_insert(&where2put->label_hash, &j->label_hash_sle, hash_label(j->label));
 			} else if (errno != ESRCH) {
 				(void)job_assumes_zero(j, errno);
 			}
@@ -4324,13 +4386,24 @@ jobmgr_callback(void *obj, struct kevent *kev)
 				}
 			}
 		} else if (kev->fflags & VQ_MOUNT) {
-			jobmgr_dispatch_all(jm, true);
+			s_fs_mount_pending = true;
+		}
+
+		/* Volumes tend to come and go in bursts, so wait a little and then
+		 * handle everything that arrived at once.
+		 */
+		if (!s_fs_event_pending) {
+			s_fs_event_pending = true;
+			if (jobmgr_assumes_zero_p(jm, kevent_mod((uintptr_t)&s_fs_event_pending, EVFILT_TIMER, EV_ADD|EV_ONESHOT, 0, LAUNCHD_FS_EVENT_COALESCE_MS, jm)) == -1) {
+				jobmgr_dispatch_fs_events();
+			}
 		}
-		jobmgr_dispatch_all_semaphores(jm);
 		break;
 	case EVFILT_TIMER:
 		if (kev->ident == (uintptr_t)&sorted_calendar_events) {
 			calendarinterval_callback();
+		} else if (kev->ident == (uintptr_t)&s_fs_event_pending) {
+			jobmgr_dispatch_fs_events();
 		} else if (kev->ident == (uintptr_t)jm) {
 			jobmgr_log(jm, LOG_DEBUG, "Shutdown timer firing.");
 			jobmgr_still_alive_with_check(jm);
@@ -4512,8 +4585,8 @@ job_start(job_t j)
 		job_log(j, LOG_PERF, "Job started.");
 		runtime_add_ref();
 		total_children++;
-		LIST_INSERT_HEAD(&j->mgr->active_jobs[ACTIVE_JOB_HASH(c)], j, pid_hash_sle);
-		LIST_INSERT_HEAD(&managed_actives[ACTIVE_JOB_HASH(c)], j, global_pid_hash_sle);
+		hashtable_insert(&j->mgr->active_jobs, &j->pid_hash_sle, ACTIVE_JOB_HASH(c));
+		hashtable_insert(&global_actives, &j->global_pid_hash_sle, ACTIVE_JOB_HASH(c));
 		j->p = c;
 
 		struct proc_uniqidentifierinfo info;
@@ -4654,9 +4727,9 @@ job_start_child(job_t j)
 	spflags |= j->pstype;
 
 	(void)job_assumes_zero(j, posix_spawnattr_setflags(&spattr, spflags));
-	if (unlikely(j->j_binpref_cnt)) {
-		(void)job_assumes_zero(j, posix_spawnattr_setbinpref_np(&spattr, j->j_binpref_cnt, j->j_binpref, &binpref_out_cnt));
-		(void)job_assumes(j, binpref_out_cnt == j->j_binpref_cnt);
+	if (unlikely(job_cold_get(j)->j_binpref_cnt)) {
+		(void)job_assumes_zero(j, posix_spawnattr_setbinpref_np(&spattr, j->cold->j_binpref_cnt, j->cold->j_binpref, &binpref_out_cnt));
+		(void)job_assumes(j, binpref_out_cnt == j->cold->j_binpref_cnt);
 	}
 
 	psproctype = j->psproctype;
@@ -4730,11 +4803,11 @@ job_start_child(job_t j)
 #endif
 
 #if HAVE_QUARANTINE
-	if (j->quarantine_data) {
+	if (job_cold_get(j)->quarantine_data) {
 		qtn_proc_t qp;
 
 		if (job_assumes(j, qp = qtn_proc_alloc())) {
-			if (job_assumes_zero(j, qtn_proc_init_with_data(qp, j->quarantine_data, j->quarantine_data_sz) == 0)) {
+			if (job_assumes_zero(j, qtn_proc_init_with_data(qp, j->cold->quarantine_data, j->cold->quarantine_data_sz) == 0)) {
 				(void)job_assumes_zero(j, qtn_proc_apply_to_self(qp));
 			}
 		}
@@ -4744,21 +4817,22 @@ job_start_child(job_t j)
 #if HAVE_SANDBOX
 #if TARGET_OS_EMBEDDED
 	struct sandbox_spawnattrs sbattrs;
-	if (j->seatbelt_profile || j->container_identifier) {
+	const struct job_cold *jc = job_cold_get(j);
+	if (jc->seatbelt_profile || jc->container_identifier) {
 		sandbox_spawnattrs_init(&sbattrs);
-		if (j->seatbelt_profile) {
-			sandbox_spawnattrs_setprofilename(&sbattrs, j->seatbelt_profile);
+		if (jc->seatbelt_profile) {
+			sandbox_spawnattrs_setprofilename(&sbattrs, jc->seatbelt_profile);
 		}
-		if (j->container_identifier) {
-			sandbox_spawnattrs_setcontainer(&sbattrs, j->container_identifier);
+		if (jc->container_identifier) {
+			sandbox_spawnattrs_setcontainer(&sbattrs, jc->container_identifier);
 		}
 		(void)job_assumes_zero(j, posix_spawnattr_setmacpolicyinfo_np(&spattr, "Sandbox", &sbattrs, sizeof(sbattrs)));
 	}
 #else
-	if (j->seatbelt_profile) {
+	if (job_cold_get(j)->seatbelt_profile) {
 		char *seatbelt_err_buf = NULL;
 
-		if (job_assumes_zero_p(j, sandbox_init(j->seatbelt_profile, j->seatbelt_flags, &seatbelt_err_buf)) == -1) {
+		if (job_assumes_zero_p(j, sandbox_init(j->cold->seatbelt_profile, j->cold->seatbelt_flags, &seatbelt_err_buf)) == -1) {
 			if (seatbelt_err_buf) {
 				job_log(j, LOG_ERR, "Sandbox failed to init: %s", seatbelt_err_buf);
 			}
@@ -5160,6 +5234,7 @@ job_postfork_become_user(job_t j)
 void
 job_setup_attributes(job_t j)
 {
+	const struct job_cold *jc = job_cold_get(j);
 	struct limititem *li;
 	struct envitem *ei;
 
@@ -5196,17 +5271,17 @@ job_setup_attributes(job_t j)
 	if (j->low_priority_background_io) {
 		(void)job_assumes_zero_p(j, setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_DARWIN_BG, IOPOL_THROTTLE));
 	}
-	if (unlikely(j->rootdir)) {
-		(void)job_assumes_zero_p(j, chroot(j->rootdir));
+	if (unlikely(jc->rootdir)) {
+		(void)job_assumes_zero_p(j, chroot(jc->rootdir));
 		(void)job_assumes_zero_p(j, chdir("."));
 	}
 
 	job_postfork_become_user(j);
 
-	if (unlikely(j->workingdir)) {
-		if (chdir(j->workingdir) == -1) {
+	if (unlikely(jc->workingdir)) {
+		if (chdir(jc->workingdir) == -1) {
 			if (errno == ENOENT || errno == ENOTDIR) {
-				job_log(j, LOG_ERR, "Job specified non-existent working directory: %s", j->workingdir);
+				job_log(j, LOG_ERR, "Job specified non-existent working directory: %s", jc->workingdir);
 			} else {
 				(void)job_assumes_zero(j, errno);
 			}
@@ -5220,10 +5295,10 @@ job_setup_attributes(job_t j)
 	if (j->stdin_fd) {
 		(void)job_assumes_zero_p(j, dup2(j->stdin_fd, STDIN_FILENO));
 	} else {
-		job_setup_fd(j, STDIN_FILENO, j->stdinpath, O_RDONLY|O_CREAT);
+		job_setup_fd(j, STDIN_FILENO, jc->stdinpath, O_RDONLY|O_CREAT);
 	}
-	job_setup_fd(j, STDOUT_FILENO, j->stdoutpath, O_WRONLY|O_CREAT|O_APPEND);
-	job_setup_fd(j, STDERR_FILENO, j->stderrpath, O_WRONLY|O_CREAT|O_APPEND);
+	job_setup_fd(j, STDOUT_FILENO, jc->stdoutpath, O_WRONLY|O_CREAT|O_APPEND);
+	job_setup_fd(j, STDERR_FILENO, jc->stderrpath, O_WRONLY|O_CREAT|O_APPEND);
 
 	jobmgr_setup_env_from_other_jobs(j->mgr);
 
@@ -5238,10 +5313,10 @@ job_setup_attributes(job_t j)
 #endif
 
 #if TARGET_OS_EMBEDDED
-	if (j->main_thread_priority != 0) {
+	if (jc->main_thread_priority != 0) {
 		struct sched_param params;
 		bzero(&params, sizeof(params));
-		params.sched_priority = j->main_thread_priority;
+		params.sched_priority = jc->main_thread_priority;
 		(void)job_assumes_zero_p(j, pthread_setschedparam(pthread_self(), SCHED_OTHER, &params));
 	}
 #endif
@@ -5276,62 +5351,59 @@ job_setup_fd(job_t j, int target_fd, const char *path, int flags)
 	(void)job_assumes_zero(j, runtime_close(fd));
 }
 
-void
+/* Schedule ci's next firing without rearming the timer; the caller does that
+ * once it is done scheduling.
+ */
+bool
 calendarinterval_setalarm(job_t j, struct calendarinterval *ci)
 {
-	struct calendarinterval *ci_iter, *ci_prev = NULL;
-	time_t later, head_later;
-
-	later = cronemu(ci->when.tm_mon, ci->when.tm_mday, ci->when.tm_hour, ci->when.tm_min);
+	char time_string[100];
+	size_t time_string_len;
 
-	if (ci->when.tm_wday != -1) {
-		time_t otherlater = cronemu_wday(ci->when.tm_wday, ci->when.tm_hour, ci->when.tm_min);
+	ci->when_next = cronspec_next(&ci->when, time(NULL));
 
-		if (ci->when.tm_mday == -1) {
-			later = otherlater;
-		} else {
-			later = later < otherlater ? later : otherlater;
-		}
+	if (unlikely(ci->when_next == -1)) {
+		// Say, the 30th of February.
+		job_log(j, LOG_WARNING, "Calendar interval never matches a date; ignoring it");
+		minheap_remove(&sorted_calendar_events, &ci->global_hn);
+		return true;
 	}
 
-	ci->when_next = later;
-
-	LIST_FOREACH(ci_iter, &sorted_calendar_events, global_sle) {
-		if (ci->when_next < ci_iter->when_next) {
-			LIST_INSERT_BEFORE(ci_iter, ci, global_sle);
-			break;
-		}
-
-		ci_prev = ci_iter;
+	if (ci->global_hn.mhn_index) {
+		minheap_update(&sorted_calendar_events, &ci->global_hn, ci->when_next);
+	} else if (!job_assumes(j, minheap_insert(&sorted_calendar_events, &ci->global_hn, ci->when_next))) {
+		return false;
 	}
 
-	if (ci_iter == NULL) {
-		// ci must want to fire after every other timer, or there are no timers
+	ctime_r(&ci->when_next, time_string);
+	time_string_len = strlen(time_string);
 
-		if (LIST_EMPTY(&sorted_calendar_events)) {
-			LIST_INSERT_HEAD(&sorted_calendar_events, ci, global_sle);
-		} else {
-			LIST_INSERT_AFTER(ci_prev, ci, global_sle);
-		}
+	if (likely(time_string_len && time_string[time_string_len - 1] == '\n')) {
+		time_string[time_string_len - 1] = '\0';
 	}
 
-	head_later = LIST_FIRST(&sorted_calendar_events)->when_next;
+	job_log(j, LOG_INFO, "Scheduled to run again at %s", time_string);
 
-	if (job_assumes_zero_p(j, kevent_mod((uintptr_t)&sorted_calendar_events, EVFILT_TIMER, EV_ADD, NOTE_ABSOLUTE|NOTE_SECONDS, head_later, root_jobmgr)) != -1) {
-		char time_string[100];
-		size_t time_string_len;
-
-		ctime_r(&later, time_string);
-		time_string_len = strlen(time_string);
+	return true;
+}
 
-		if (likely(time_string_len && time_string[time_string_len - 1] == '\n')) {
-			time_string[time_string_len - 1] = '\0';
-		}
+// Point the calendar timer at the earliest event.
+void
+calendarinterval_arm(void)
+{
+	struct calendarinterval *ci = calendarinterval_first();
 
-		job_log(j, LOG_INFO, "Scheduled to run again at %s", time_string);
+	if (ci) {
+		kevent_mod_deferred((uintptr_t)&sorted_calendar_events, EVFILT_TIMER, EV_ADD, NOTE_ABSOLUTE|NOTE_SECONDS, ci->when_next, root_jobmgr);
 	}
 }
 
+struct calendarinterval *
+calendarinterval_first(void)
+{
+	return MINHEAP_ENTRY(minheap_min(&sorted_calendar_events), struct calendarinterval, global_hn);
+}
+
 bool
 jobmgr_log_bug(_SIMPLE_STRING asl_message __attribute__((unused)), void *ctx, const char *message)
 {
@@ -5362,8 +5434,8 @@ job_log_perf_statistics(job_t j, struct rusage_info_v1 *ri, int64_t exit_status)
 		return;
 	}
 	const char *name;
-	if (j->cfbundleidentifier) {
-		name = j->cfbundleidentifier;
+	if (job_cold_get(j)->cfbundleidentifier) {
+		name = j->cold->cfbundleidentifier;
 	} else {
 		name = j->label;
 	}
@@ -5621,8 +5693,16 @@ jobmgr_log_perf_statistics(jobmgr_t jm, bool signal_children)
 
 	jobmgr_log(jm, LOG_PERF, "Jobs in job manager:");
 
+	size_t jobs = 0, cold_jobs = 0, footprint = 0;
 	job_t ji = NULL;
 	LIST_FOREACH(ji, &jm->jobs, sle) {
+		size_t sz = job_footprint(ji);
+
+		job_log(ji, LOG_PERF, "Memory: %zu bytes%s", sz, ji->cold ? " (with cold properties)" : "");
+		jobs++;
+		cold_jobs += ji->cold != NULL;
+		footprint += sz;
+
 		job_log_perf_statistics(ji, NULL, -1);
 		if (unlikely(signal_children) && unlikely(strstr(ji->label, "com.apple.launchd.peruser.") == ji->label)) {
 			jobmgr_log(jm, LOG_PERF, "Sending SIGINFO to peruser launchd %d", ji->p);
@@ -5630,7 +5710,17 @@ jobmgr_log_perf_statistics(jobmgr_t jm, bool signal_children)
 		}
 	}
 
-	jobmgr_log(jm, LOG_PERF, "End of job list.");
+	jobmgr_log(jm, LOG_PERF, "End of job list. %zu jobs use %zu bytes; %zu have cold properties.", jobs, footprint, cold_jobs);
+
+	if (jm == root_jobmgr) {
+		struct mach_task_basic_info mtbi;
+		mach_msg_type_number_t cnt = MACH_TASK_BASIC_INFO_COUNT;
+
+		if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&mtbi, &cnt) == KERN_SUCCESS) {
+			jobmgr_log(jm, LOG_PERF, "Resident size: %llu bytes. Jobs are %zu bytes plus their label, and %zu more with cold properties.",
+				(unsigned long long)mtbi.resident_size, sizeof(struct job_s), sizeof(struct job_cold));
+		}
+	}
 }
 
 void
@@ -5792,12 +5882,19 @@ calendarinterval_new(job_t j, struct tm *w)
 		return false;
 	}
 
-	ci->when = *w;
+	cronspec_init(&ci->when, w->tm_mon, w->tm_mday, w->tm_wday, w->tm_hour, w->tm_min);
 	ci->job = j;
 
-	SLIST_INSERT_HEAD(&j->cal_intervals, ci, sle);
+	if (!calendarinterval_setalarm(j, ci)) {
+		free(ci);
+		return false;
+	}
+
+	if (calendarinterval_first() == ci) {
+		calendarinterval_arm();
+	}
 
-	calendarinterval_setalarm(j, ci);
+	SLIST_INSERT_HEAD(&j->cal_intervals, ci, sle);
 
 	runtime_add_weak_ref();
 
@@ -5808,7 +5905,7 @@ void
 calendarinterval_delete(job_t j, struct calendarinterval *ci)
 {
 	SLIST_REMOVE(&j->cal_intervals, ci, calendarinterval, sle);
-	LIST_REMOVE(ci, global_sle);
+	minheap_remove(&sorted_calendar_events, &ci->global_hn);
 
 	free(ci);
 
@@ -5818,7 +5915,7 @@ calendarinterval_delete(job_t j, struct calendarinterval *ci)
 void
 calendarinterval_sanity_check(void)
 {
-	struct calendarinterval *ci = LIST_FIRST(&sorted_calendar_events);
+	struct calendarinterval *ci = calendarinterval_first();
 	time_t now = time(NULL);
 
 	if (unlikely(ci && (ci->when_next < now))) {
@@ -5829,22 +5926,24 @@ calendarinterval_sanity_check(void)
 void
 calendarinterval_callback(void)
 {
-	struct calendarinterval *ci, *ci_next;
+	struct calendarinterval *ci;
 	time_t now = time(NULL);
+	size_t due = sorted_calendar_events.mh_count;
 
-	LIST_FOREACH_SAFE(ci, &sorted_calendar_events, global_sle, ci_next) {
+	/* Everything that is due is rescheduled past now, so the earliest event
+	 * is always the next one to fire. Bound the pass anyway in case the clock
+	 * is stepped while we are at it.
+	 */
+	while ((ci = calendarinterval_first()) && ci->when_next <= now && due-- > 0) {
 		job_t j = ci->job;
 
-		if (ci->when_next > now) {
-			break;
-		}
-
-		LIST_REMOVE(ci, global_sle);
-		calendarinterval_setalarm(j, ci);
+		(void)calendarinterval_setalarm(j, ci);
 
 		j->start_pending = true;
 		job_dispatch(j, false);
 	}
+
+	calendarinterval_arm();
 }
 
 bool
@@ -5917,6 +6016,12 @@ socketgroup_kevent_mod(job_t j, struct socketgroup *sg, bool do_add)
 
 	job_log(j, LOG_DEBUG, "%s Sockets:%s", do_add ? "Watching" : "Ignoring", buf);
 
+	/* A failed addition is logged with the job as its udata */
+	if (do_add) {
+		kevent_bulk_mod_deferred(kev, sg->fd_cnt);
+		return;
+	}
+
 	(void)job_assumes_zero_p(j, kevent_bulk_mod(kev, sg->fd_cnt));
 
 	for (i = 0; i < sg->fd_cnt; i++) {
@@ -6066,8 +6171,8 @@ seatbelt_setup_flags(launch_data_t obj, const char *key, void *context)
 		return;
 	}
 
-	if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOX_NAMED) == 0) {
-		j->seatbelt_flags |= SANDBOX_NAMED;
+	if (strcasecmp(key, LAUNCH_JOBKEY_SANDBOX_NAMED) == 0 && job_cold(j)) {
+		j->cold->seatbelt_flags |= SANDBOX_NAMED;
 	}
 }
 #endif
@@ -6314,14 +6419,14 @@ machservice_ignore(job_t j, struct machservice *ms)
 void
 machservice_resetport(job_t j, struct machservice *ms)
 {
-	LIST_REMOVE(ms, port_hash_sle);
+	hashtable_remove(&ms->port_hash_sle);
 	(void)job_assumes_zero(j, launchd_mport_close_recv(ms->port));
 	(void)job_assumes_zero(j, launchd_mport_deallocate(ms->port));
 
 	ms->gen_num++;
 	(void)job_assumes_zero(j, launchd_mport_create_recv(&ms->port));
 	(void)job_assumes_zero(j, launchd_mport_make_send(ms->port));
-	LIST_INSERT_HEAD(&port_hash[HASH_PORT(ms->port)], ms, port_hash_sle);
+	hashtable_insert(&port_hash, &ms->port_hash_sle, HASH_PORT(ms->port));
 }
 
 void
@@ -6389,22 +6494,14 @@ machservice_new(job_t j, const char *name, mach_port_t *serviceport, bool pid_lo
 
 	SLIST_INSERT_HEAD(&j->machservices, ms, sle);
 
-	jobmgr_t where2put = j->mgr;
-	// XPC domains are separate from Mach bootstraps.
-	if (!(j->mgr->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN)) {
-		if (launchd_flat_mach_namespace && !(j->mgr->properties & BOOTSTRAP_PROPERTY_EXPLICITSUBSET)) {
-			where2put = root_jobmgr;
-		}
-	}
-
 	/* Don't allow MachServices added by multiple-instance jobs to be looked up
 	 * by others. We could just do this with a simple bit, but then we'd have to
 	 * uniquify the names ourselves to avoid collisions. This is just easier.
 	 */
 	if (!j->dedicated_instance) {
-		LIST_INSERT_HEAD(&where2put->ms_hash[hash_ms(ms->name)], ms, name_hash_sle);	
+		machservice_hash_insert(jobmgr_ms_namespace(j->mgr), ms);
 	}
-	LIST_INSERT_HEAD(&port_hash[HASH_PORT(ms->port)], ms, port_hash_sle);
+	hashtable_insert(&port_hash, &ms->port_hash_sle, HASH_PORT(ms->port));
 
 	if (ms->recv) {
 		machservice_stamp_port(j, ms);
@@ -6429,7 +6526,7 @@ machservice_new_alias(job_t j, struct machservice *orig)
 		ms->alias = orig;
 		ms->job = j;
 
-		LIST_INSERT_HEAD(&j->mgr->ms_hash[hash_ms(ms->name)], ms, name_hash_sle);
+		machservice_hash_insert(j->mgr, ms);
 		SLIST_INSERT_HEAD(&j->machservices, ms, sle);
 		jobmgr_log(j->mgr, LOG_DEBUG, "Service aliased into job manager: %s", orig->name);
 	}
@@ -6457,12 +6554,12 @@ job_setup_exception_port(job_t j, task_t target_task)
 	thread_state_flavor_t f = 0;
 	mach_port_t exc_port = the_exception_server;
 
-	if (unlikely(j->alt_exc_handler)) {
-		ms = jobmgr_lookup_service(j->mgr, j->alt_exc_handler, true, 0);
+	if (unlikely(job_cold_get(j)->alt_exc_handler)) {
+		ms = jobmgr_lookup_service(j->mgr, j->cold->alt_exc_handler, true, 0);
 		if (likely(ms)) {
 			exc_port = machservice_port(ms);
 		} else {
-			job_log(j, LOG_WARNING, "Falling back to default Mach exception handler. Could not find: %s", j->alt_exc_handler);
+			job_log(j, LOG_WARNING, "Falling back to default Mach exception handler. Could not find: %s", j->cold->alt_exc_handler);
 		}
 	} else if (unlikely(j->internal_exc_handler)) {
 		exc_port = runtime_get_kernel_port();
@@ -6840,6 +6937,32 @@ jobmgr_parent(jobmgr_t jm)
 	return jm->parentmgr;
 }
 
+// Whether jmi is jm or one of its descendants.
+bool
+jobmgr_contains(jobmgr_t jm, jobmgr_t jmi)
+{
+	for (; jmi; jmi = jmi->parentmgr) {
+		if (jmi == jm) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Whether jm or any manager above it is shutting down.
+bool
+jobmgr_shutting_down(jobmgr_t jm)
+{
+	for (; jm; jm = jm->parentmgr) {
+		if (jm->shutting_down) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void
 job_uncork_fork(job_t j)
 {
@@ -6924,6 +7047,8 @@ jobmgr_new(jobmgr_t jm, mach_port_t requestorport, mach_port_t transfer_port, bo
 		goto out_bad;
 	}
 
+	hashtable_insert(&jobmgr_port_hash, &jmr->port_hash_sle, HASH_PORT(jmr->jm_port));
+
 	if (!name) {
 		sprintf(jmr->name_init, "%u", MACH_PORT_INDEX(jmr->jm_port));
 	}
@@ -7088,10 +7213,10 @@ jobmgr_init_session(jobmgr_t jm, const char *session_type, bool sflag)
 		bootstrapper->psproctype = POSIX_SPAWN_PROC_TYPE_DAEMON_INTERACTIVE;
 #endif
 		bootstrapper->is_bootstrapper = true;
-		if (jobmgr_assumes(jm, pid1_magic)) {
+		if (jobmgr_assumes(jm, pid1_magic) && job_cold(bootstrapper)) {
 			// Have our system bootstrapper print out to the console.
-			bootstrapper->stdoutpath = strdup(_PATH_CONSOLE);
-			bootstrapper->stderrpath = strdup(_PATH_CONSOLE);
+			bootstrapper->cold->stdoutpath = strdup(_PATH_CONSOLE);
+			bootstrapper->cold->stderrpath = strdup(_PATH_CONSOLE);
 
 			if (launchd_console) {
 				(void)jobmgr_assumes_zero_p(jm, kevent_mod((uintptr_t)fileno(launchd_console), EVFILT_VNODE, EV_ADD | EV_ONESHOT, NOTE_REVOKE, 0, jm));
@@ -7126,7 +7251,7 @@ jobmgr_delete_anything_with_port(jobmgr_t jm, mach_port_t port)
 			return jobmgr_shutdown(jm);
 		}
 
-		LIST_FOREACH_SAFE(ms, &port_hash[HASH_PORT(port)], port_hash_sle, next_ms) {
+		HASHTABLE_FOREACH_SAFE(ms, &port_hash, HASH_PORT(port), port_hash_sle, next_ms) {
 			if (ms->port == port && !ms->recv) {
 				machservice_delete(ms->job, ms, true);
 			}
@@ -7158,10 +7283,10 @@ struct machservice *
 jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t target_pid)
 {
 	struct machservice *ms;
+	struct ms_cache_entry *mce;
+	size_t hash = hash_ms(name);
 	job_t target_j;
 
-	jobmgr_log(jm, LOG_DEBUG, "Looking up %sservice %s", target_pid ? "per-PID " : "", name);
-
 	if (target_pid) {
 		/* This is a hack to let FileSyncAgent look up per-PID Mach services from the Background
 		 * bootstrap in other bootstraps.
@@ -7176,9 +7301,18 @@ jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t ta
 			}
 		}
 
-		SLIST_FOREACH(ms, &target_j->machservices, sle) {
-			if (ms->per_pid && strcmp(name, ms->name) == 0) {
-				return ms;
+		// Multiple-instance jobs keep their services out of the namespace.
+		if (target_j->dedicated_instance) {
+			SLIST_FOREACH(ms, &target_j->machservices, sle) {
+				if (ms->per_pid && strcmp(name, ms->name) == 0) {
+					return ms;
+				}
+			}
+		} else {
+			HASHTABLE_FOREACH(ms, &jobmgr_ms_namespace(target_j->mgr)->ms_hash, hash, name_hash_sle) {
+				if (ms->per_pid && ms->job == target_j && strcmp(name, ms->name) == 0) {
+					return ms;
+				}
 			}
 		}
 
@@ -7186,15 +7320,7 @@ jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t ta
 		return NULL;
 	}
 
-	jobmgr_t where2look = jm;
-	// XPC domains are separate from Mach bootstraps.
-	if (!(jm->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN)) {
-		if (launchd_flat_mach_namespace && !(jm->properties & BOOTSTRAP_PROPERTY_EXPLICITSUBSET)) {
-			where2look = root_jobmgr;
-		}
-	}
-
-	LIST_FOREACH(ms, &where2look->ms_hash[hash_ms(name)], name_hash_sle) {
+	HASHTABLE_FOREACH(ms, &jobmgr_ms_namespace(jm)->ms_hash, hash, name_hash_sle) {
 		if (!ms->per_pid && strcmp(name, ms->name) == 0) {
 			return ms;
 		}
@@ -7204,7 +7330,67 @@ jobmgr_lookup_service(jobmgr_t jm, const char *name, bool check_parent, pid_t ta
 		return NULL;
 	}
 
-	return jobmgr_lookup_service(jm->parentmgr, name, true, 0);
+	if (jm->ms_cache_gen != ms_hash_gen) {
+		jobmgr_ms_cache_flush(jm);
+		jm->ms_cache_gen = ms_hash_gen;
+	}
+
+	HASHTABLE_FOREACH(mce, &jm->ms_cache, hash, hash_sle) {
+		if (strcmp(name, mce->ms->name) == 0) {
+			return mce->ms;
+		}
+	}
+
+	/* Only hits are cached; clients may look up any number of names that do
+	 * not exist.
+	 */
+	ms = jobmgr_lookup_service(jm->parentmgr, name, true, 0);
+	if (ms && (mce = malloc(sizeof(*mce)))) {
+		mce->ms = ms;
+		hashtable_insert(&jm->ms_cache, &mce->hash_sle, hash);
+	}
+
+	return ms;
+}
+
+// The job manager whose ms_hash holds the Mach services of jm's jobs.
+jobmgr_t
+jobmgr_ms_namespace(jobmgr_t jm)
+{
+	// XPC domains are separate from Mach bootstraps.
+	if (!(jm->properties & BOOTSTRAP_PROPERTY_XPC_DOMAIN)) {
+		if (launchd_flat_mach_namespace && !(jm->properties & BOOTSTRAP_PROPERTY_EXPLICITSUBSET)) {
+			return root_jobmgr;
+		}
+	}
+
+	return jm;
+}
+
+void
+jobmgr_ms_cache_flush(jobmgr_t jm)
+{
+	struct ms_cache_entry *mce, *next;
+
+	HASHTABLE_FOREACH_ALL_SAFE(mce, &jm->ms_cache, hash_sle, next) {
+		free(mce);
+	}
+
+	hashtable_destroy(&jm->ms_cache);
+}
+
+void
+machservice_hash_insert(jobmgr_t jm, struct machservice *ms)
+{
+	hashtable_insert(&jm->ms_hash, &ms->name_hash_sle, hash_ms(ms->name));
+	ms_hash_gen++;
+}
+
+void
+machservice_hash_remove(struct machservice *ms)
+{
+	hashtable_remove(&ms->name_hash_sle);
+	ms_hash_gen++;
 }
 
 mach_port_t
@@ -7261,7 +7447,7 @@ machservice_drain_port(struct machservice *ms)
 		 * port, and it will break things if ReportCrash or SafetyNet start advertising other
 		 * Mach services. But for now, it should be okay.
 		 */
-		if (ms->job->alt_exc_handler || ms->job->internal_exc_handler) {
+		if (job_cold_get(ms->job)->alt_exc_handler || ms->job->internal_exc_handler) {
 			mr = launchd_exc_runtime_once(ms->port, sizeof(req_buff), sizeof(rep_buff), req_hdr, rep_hdr, 0);
 		} else {
 			mach_msg_options_t options =	MACH_RCV_MSG		|
@@ -7292,7 +7478,7 @@ machservice_delete(job_t j, struct machservice *ms, bool port_died)
 		 * pretty simple affair since they can't and shouldn't have any complex
 		 * behaviors associated with them.
 		 */
-		LIST_REMOVE(ms, name_hash_sle);
+		machservice_hash_remove(ms);
 		SLIST_REMOVE(&j->machservices, ms, machservice, sle);
 		free(ms);
 		return;
@@ -7322,9 +7508,9 @@ machservice_delete(job_t j, struct machservice *ms, bool port_died)
 	SLIST_REMOVE(&j->machservices, ms, machservice, sle);
 
 	if (!(j->dedicated_instance || ms->event_channel)) {
-		LIST_REMOVE(ms, name_hash_sle);
+		machservice_hash_remove(ms);
 	}
-	LIST_REMOVE(ms, port_hash_sle);
+	hashtable_remove(&ms->port_hash_sle);
 
 	free(ms);
 }
@@ -7415,7 +7601,7 @@ job_ack_port_destruction(mach_port_t p)
 	struct machservice *ms;
 	job_t j;
 
-	LIST_FOREACH(ms, &port_hash[HASH_PORT(p)], port_hash_sle) {
+	HASHTABLE_FOREACH(ms, &port_hash, HASH_PORT(p), port_hash_sle) {
 		if (ms->recv && (ms->port == p)) {
 			break;
 		}
@@ -7486,6 +7672,7 @@ job_ack_no_senders(job_t j)
 {
 	j->priv_port_has_senders = false;
 
+	hashtable_remove(&j->port_hash_sle);
 	(void)job_assumes_zero(j, launchd_mport_close_recv(j->j_port));
 	j->j_port = 0;
 
@@ -7508,6 +7695,7 @@ semaphoreitem_new(job_t j, semaphore_reason_t why, const char *what)
 		return false;
 	}
 
+	si->job = j;
 	si->why = why;
 
 	if (what) {
@@ -7516,10 +7704,9 @@ semaphoreitem_new(job_t j, semaphore_reason_t why, const char *what)
 
 	SLIST_INSERT_HEAD(&j->semaphores, si, sle);
 
-	if ((why == OTHER_JOB_ENABLED || why == OTHER_JOB_DISABLED) && !j->nosy) {
+	if ((why == OTHER_JOB_ENABLED || why == OTHER_JOB_DISABLED) && what) {
 		job_log(j, LOG_DEBUG, "Job is interested in \"%s\".", what);
-		SLIST_INSERT_HEAD(&s_curious_jobs, j, curious_jobs_sle);
-		j->nosy = true;
+		hashtable_insert(&s_curious_semaphores, &si->curious_sle, hash_label(what));
 	}
 
 	semaphoreitem_runtime_mod_ref(si, true);
@@ -7560,12 +7747,7 @@ semaphoreitem_delete(job_t j, struct semaphoreitem *si)
 	semaphoreitem_runtime_mod_ref(si, false);
 
 	SLIST_REMOVE(&j->semaphores, si, semaphoreitem, sle);
-
-	// We'll need to rethink this if it ever becomes possible to dynamically add or remove semaphores.
-	if ((si->why == OTHER_JOB_ENABLED || si->why == OTHER_JOB_DISABLED) && j->nosy) {
-		j->nosy = false;
-		SLIST_REMOVE(&s_curious_jobs, j, job_s, curious_jobs_sle);
-	}
+	hashtable_remove(&si->curious_sle);
 
 	free(si);
 }
@@ -7821,178 +8003,6 @@ jobmgr_dispatch_all_semaphores(jobmgr_t jm)
 	}
 }
 
-time_t
-cronemu(int mon, int mday, int hour, int min)
-{
-	struct tm workingtm;
-	time_t now;
-
-	now = time(NULL);
-	workingtm = *localtime(&now);
-
-	workingtm.tm_isdst = -1;
-	workingtm.tm_sec = 0;
-	workingtm.tm_min++;
-
-	while (!cronemu_mon(&workingtm, mon, mday, hour, min)) {
-		workingtm.tm_year++;
-		workingtm.tm_mon = 0;
-		workingtm.tm_mday = 1;
-		workingtm.tm_hour = 0;
-		workingtm.tm_min = 0;
-		mktime(&workingtm);
-	}
-
-	return mktime(&workingtm);
-}
-
-time_t
-cronemu_wday(int wday, int hour, int min)
-{
-	struct tm workingtm;
-	time_t now;
-
-	now = time(NULL);
-	workingtm = *localtime(&now);
-
-	workingtm.tm_isdst = -1;
-	workingtm.tm_sec = 0;
-	workingtm.tm_min++;
-
-	if (wday == 7) {
-		wday = 0;
-	}
-
-	while (!(workingtm.tm_wday == wday && cronemu_hour(&workingtm, hour, min))) {
-		workingtm.tm_mday++;
-		workingtm.tm_hour = 0;
-		workingtm.tm_min = 0;
-		mktime(&workingtm);
-	}
-
-	return mktime(&workingtm);
-}
-
-bool
-cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min)
-{
-	if (mon == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_mday(&workingtm, mday, hour, min)) {
-			workingtm.tm_mon++;
-			workingtm.tm_mday = 1;
-			workingtm.tm_hour = 0;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_mon;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_mon) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (mon < wtm->tm_mon) {
-		return false;
-	}
-
-	if (mon > wtm->tm_mon) {
-		wtm->tm_mon = mon;
-		wtm->tm_mday = 1;
-		wtm->tm_hour = 0;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_mday(wtm, mday, hour, min);
-}
-
-bool
-cronemu_mday(struct tm *wtm, int mday, int hour, int min)
-{
-	if (mday == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_hour(&workingtm, hour, min)) {
-			workingtm.tm_mday++;
-			workingtm.tm_hour = 0;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_mday;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_mday) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (mday < wtm->tm_mday) {
-		return false;
-	}
-
-	if (mday > wtm->tm_mday) {
-		wtm->tm_mday = mday;
-		wtm->tm_hour = 0;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_hour(wtm, hour, min);
-}
-
-bool
-cronemu_hour(struct tm *wtm, int hour, int min)
-{
-	if (hour == -1) {
-		struct tm workingtm = *wtm;
-		int carrytest;
-
-		while (!cronemu_min(&workingtm, min)) {
-			workingtm.tm_hour++;
-			workingtm.tm_min = 0;
-			carrytest = workingtm.tm_hour;
-			mktime(&workingtm);
-			if (carrytest != workingtm.tm_hour) {
-				return false;
-			}
-		}
-		*wtm = workingtm;
-		return true;
-	}
-
-	if (hour < wtm->tm_hour) {
-		return false;
-	}
-
-	if (hour > wtm->tm_hour) {
-		wtm->tm_hour = hour;
-		wtm->tm_min = 0;
-	}
-
-	return cronemu_min(wtm, min);
-}
-
-bool
-cronemu_min(struct tm *wtm, int min)
-{
-	if (min == -1) {
-		return true;
-	}
-
-	if (min < wtm->tm_min) {
-		return false;
-	}
-
-	if (min > wtm->tm_min) {
-		wtm->tm_min = min;
-	}
-
-	return true;
-}
-
 kern_return_t
 job_mig_create_server(job_t j, cmd_t server_cmd, uid_t server_uid, boolean_t on_demand, mach_port_t *server_portp)
 {
@@ -8444,7 +8454,7 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 			job_t jpu = jobmgr_lookup_per_user_context_internal(j, (uid_t)inval, &junk);
 			if (job_assumes(j, jpu != NULL)) {
 				struct suspended_peruser *spi = NULL;
-				LIST_FOREACH(spi, &j->suspended_perusers, sle) {
+				LIST_FOREACH(spi, &job_cold_get(j)->suspended_perusers, sle) {
 					if ((int64_t)(spi->j->mach_uid) == inval) {
 						job_log(j, LOG_WARNING, "Job tried to suspend per-user launchd for UID %lli twice.", inval);
 						break;
@@ -8453,7 +8463,9 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 
 				if (spi == NULL) {
 					job_log(j, LOG_INFO, "Job is suspending the per-user launchd for UID %lli.", inval);
-					spi = (struct suspended_peruser *)calloc(sizeof(struct suspended_peruser), 1);
+					if (job_cold(j)) {
+						spi = (struct suspended_peruser *)calloc(sizeof(struct suspended_peruser), 1);
+					}
 					if (job_assumes(j, spi != NULL)) {
 						/* Stop listening for events.
 						 *
@@ -8465,7 +8477,7 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 
 						spi->j = jpu;
 						spi->j->peruser_suspend_count++;
-						LIST_INSERT_HEAD(&j->suspended_perusers, spi, sle);
+						LIST_INSERT_HEAD(&j->cold->suspended_perusers, spi, sle);
 						job_stop(spi->j);
 						*outval = jpu->p;
 					} else {
@@ -8480,7 +8492,7 @@ job_mig_swap_integer(job_t j, vproc_gsk_t inkey, vproc_gsk_t outkey, int64_t inv
 	case VPROC_GSK_PERUSER_RESUME:
 		if (job_assumes(j, pid1_magic == true)) {
 			struct suspended_peruser *spi = NULL, *spt = NULL;
-			LIST_FOREACH_SAFE(spi, &j->suspended_perusers, sle, spt) {
+			LIST_FOREACH_SAFE(spi, &job_cold_get(j)->suspended_perusers, sle, spt) {
 				if ((int64_t)(spi->j->mach_uid) == inval) {
 					spi->j->peruser_suspend_count--;
 					LIST_REMOVE(spi, sle);
@@ -9278,12 +9290,9 @@ job_mig_info(job_t j, name_array_t *servicenamesp,
 		jm = j->mgr;
 	}
 
-	unsigned int i = 0;
 	struct machservice *msi = NULL;
-	for (i = 0; i < MACHSERVICE_HASH_SIZE; i++) {
-		LIST_FOREACH(msi, &jm->ms_hash[i], name_hash_sle) {
-			cnt += !msi->per_pid ? 1 : 0;
-		}
+	HASHTABLE_FOREACH_ALL(msi, &jm->ms_hash, name_hash_sle) {
+		cnt += !msi->per_pid ? 1 : 0;
 	}
 
 	if (cnt == 0) {
@@ -9305,19 +9314,19 @@ job_mig_info(job_t j, name_array_t *servicenamesp,
 		goto out_bad;
 	}
 
-	for (i = 0; i < MACHSERVICE_HASH_SIZE; i++) {
-		LIST_FOREACH(msi, &jm->ms_hash[i], name_hash_sle) {
-			if (!msi->per_pid) {
-				strlcpy(service_names[cnt2], machservice_name(msi), sizeof(service_names[0]));
-				msi = msi->alias ? msi->alias : msi;
-				if (msi->job->mgr->shortdesc) {
-					strlcpy(service_jobs[cnt2], msi->job->mgr->shortdesc, sizeof(service_jobs[0]));
-				} else {
-					strlcpy(service_jobs[cnt2], msi->job->label, sizeof(service_jobs[0]));
-				}
-				service_actives[cnt2] = machservice_status(msi);
-				cnt2++;
+	HASHTABLE_FOREACH_ALL(msi, &jm->ms_hash, name_hash_sle) {
+		if (!msi->per_pid) {
+			// Don't advance the iteration from the alias' target.
+			struct machservice *ms = msi->alias ? msi->alias : msi;
+
+			strlcpy(service_names[cnt2], machservice_name(msi), sizeof(service_names[0]));
+			if (ms->job->mgr->shortdesc) {
+				strlcpy(service_jobs[cnt2], ms->job->mgr->shortdesc, sizeof(service_jobs[0]));
+			} else {
+				strlcpy(service_jobs[cnt2], ms->job->label, sizeof(service_jobs[0]));
 			}
+			service_actives[cnt2] = machservice_status(ms);
+			cnt2++;
 		}
 	}
 
@@ -9547,10 +9556,12 @@ job_mig_set_security_session(job_t j, uuid_t uuid, mach_port_t asport)
 	job_t ji = NULL, jt = NULL;
 	LIST_FOREACH_SAFE(ji, &s_needing_sessions, sle, jt) {
 		uuid_string_t uuid_str2;
-		uuid_unparse(ji->expected_audit_uuid, uuid_str2);
+		uuid_unparse(job_cold_get(ji)->expected_audit_uuid, uuid_str2);
 
-		if (uuid_compare(uuid, ji->expected_audit_uuid) == 0) {
-			uuid_clear(ji->expected_audit_uuid);
+		if (uuid_compare(uuid, job_cold_get(ji)->expected_audit_uuid) == 0) {
+			if (ji->cold) {
+				uuid_clear(ji->cold->expected_audit_uuid);
+			}
 			if (asport != MACH_PORT_NULL) {
 				job_log(ji, LOG_DEBUG, "Job should join session with port 0x%x", asport);
 				(void)job_assumes_zero(j, launchd_mport_copy_send(asport));
@@ -9679,11 +9690,11 @@ job_mig_move_subset(job_t j, mach_port_t target_subset, name_t session_type, mac
 		// This is so awful.
 		// Remove the job from its current job manager.
 		LIST_REMOVE(j, sle);
-		LIST_REMOVE(j, pid_hash_sle);
+		hashtable_remove(&j->pid_hash_sle);
 
 		// Put the job into the target job manager.
 		LIST_INSERT_HEAD(&jmr->jobs, j, sle);
-		LIST_INSERT_HEAD(&jmr->active_jobs[ACTIVE_JOB_HASH(j->p)], j, pid_hash_sle);
+		hashtable_insert(&jmr->active_jobs, &j->pid_hash_sle, ACTIVE_JOB_HASH(j->p));
 
 		j->mgr = jmr;
 		job_set_global_on_demand(j, true);
@@ -9854,7 +9865,7 @@ job_mig_switch_to_session(job_t j, mach_port_t requestor_port, name_t session_na
 
 	// Remove the job from it's current job manager.
 	LIST_REMOVE(j, sle);
-	LIST_REMOVE(j, pid_hash_sle);
+	hashtable_remove(&j->pid_hash_sle);
 
 	job_t ji = NULL, jit = NULL;
 	LIST_FOREACH_SAFE(ji, &j->mgr->global_env_jobs, global_env_sle, jit) {
@@ -9866,7 +9877,7 @@ job_mig_switch_to_session(job_t j, mach_port_t requestor_port, name_t session_na
 
 	// Put the job into the target job manager.
 	LIST_INSERT_HEAD(&target_jm->jobs, j, sle);
-	LIST_INSERT_HEAD(&target_jm->active_jobs[ACTIVE_JOB_HASH(j->p)], j, pid_hash_sle);
+	hashtable_insert(&target_jm->active_jobs, &j->pid_hash_sle, ACTIVE_JOB_HASH(j->p));
 
 	if (ji) {
 		LIST_INSERT_HEAD(&target_jm->global_env_jobs, j, global_env_sle);
@@ -9876,8 +9887,8 @@ job_mig_switch_to_session(job_t j, mach_port_t requestor_port, name_t session_na
 	if (!launchd_flat_mach_namespace && !SLIST_EMPTY(&j->machservices)) {
 		struct machservice *msi = NULL, *msit = NULL;
 		SLIST_FOREACH_SAFE(msi, &j->machservices, sle, msit) {
-			LIST_REMOVE(msi, name_hash_sle);
-			LIST_INSERT_HEAD(&target_jm->ms_hash[hash_ms(msi->name)], msi, name_hash_sle);
+			machservice_hash_remove(msi);
+			machservice_hash_insert(target_jm, msi);
 		}
 	}
 
@@ -10019,6 +10030,7 @@ job_mig_take_subset(job_t j, mach_port_t *reqport, mach_port_t *rcvright,
 
 	jm->req_port = 0;
 	jm->jm_port = 0;
+	hashtable_remove(&jm->port_hash_sle);
 
 	workaround_5477111 = j;
 
@@ -10540,7 +10552,7 @@ xpc_event_find_channel(job_t j, const char *stream, struct machservice **ms)
 		 * bootstrap_look_up().
 		 */
 		if (!j->dedicated_instance) {
-			LIST_REMOVE(msi, name_hash_sle);
+			machservice_hash_remove(msi);
 		}
 		msi->event_channel = true;
 
@@ -11578,7 +11590,9 @@ job_mig_spawn_internal(job_t j, vm_offset_t indata, mach_msg_type_number_t indat
 	jr->abandon_pg = true;
 	jr->asport = asport;
 	jr->app = true;
-	uuid_clear(jr->expected_audit_uuid);
+	if (jr->cold) {
+		uuid_clear(jr->cold->expected_audit_uuid);
+	}
 	jr = job_dispatch(jr, true);
 
 	if (!job_assumes(j, jr != NULL)) {
@@ -11797,8 +11811,9 @@ void
 jobmgr_init(bool sflag)
 {
 	const char *root_session_type = pid1_magic ? VPROCMGR_SESSION_SYSTEM : VPROCMGR_SESSION_BACKGROUND;
-	SLIST_INIT(&s_curious_jobs);
 	LIST_INIT(&s_needing_sessions);
+	LIST_INIT(&s_curious_pending);
+	LIST_INIT(&s_start_on_mount);
 
 	os_assert((root_jobmgr = jobmgr_new(NULL, MACH_PORT_NULL, MACH_PORT_NULL, sflag, root_session_type, false, MACH_PORT_NULL)) != NULL);
 	os_assert((_s_xpc_system_domain = jobmgr_new_xpc_singleton_domain(root_jobmgr, strdup("com.apple.xpc.system"))) != NULL);
@@ -11819,32 +11834,16 @@ jobmgr_init(bool sflag)
 	s_no_hang_fd = _fd(s_no_hang_fd);
 }
 
-size_t
-our_strhash(const char *s)
-{
-	size_t c, r = 5381;
-
-	/* djb2
-	 * This algorithm was first reported by Dan Bernstein many years ago in comp.lang.c
-	 */
-
-	while ((c = *s++)) {
-		r = ((r << 5) + r) + c; // hash*33 + c
-	}
-
-	return r;
-}
-
 size_t
 hash_label(const char *label)
 {
-	return our_strhash(label) % LABEL_HASH_SIZE;
+	return hashtable_strhash(label);
 }
 
 size_t
 hash_ms(const char *msstr)
 {
-	return our_strhash(msstr) % MACHSERVICE_HASH_SIZE;
+	return hashtable_strhash(msstr);
 }
 
 bool
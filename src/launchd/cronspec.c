@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <stdbool.h>
+#include <strings.h>
+
+#include "cronspec.h"
+
+/* Leap days can be eight years apart, around 2100 */
+#define CRONSPEC_MAX_MONTHS	(9 * 12)
+
+/* Every seventh day of a month, starting with the 1st */
+#define CRONSPEC_WEEKLY		((1U << 1) | (1U << 8) | (1U << 15) | (1U << 22) | (1U << 29))
+
+void
+cronspec_init(struct cronspec *cs, int mon, int mday, int wday, int hour, int min)
+{
+	cs->cs_min = min == -1 ? (1ULL << 60) - 1 : 1ULL << min;
+	cs->cs_hour = hour == -1 ? (1U << 24) - 1 : 1U << hour;
+	cs->cs_mon = mon == -1 ? (1U << 12) - 1 : 1U << mon;
+	cs->cs_wday = wday == -1 ? 0 : 1U << (wday % 7);
+
+	/* With a weekday and no day of the month, only the weekday counts */
+	if (mday != -1) {
+		cs->cs_mday = 1U << mday;
+	} else {
+		cs->cs_mday = wday == -1 ? ~1U : 0;
+	}
+}
+
+static int
+cronspec_days_in_month(int year, int mon)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	year += 1900;
+	if (mon == 1 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) {
+		return 29;
+	}
+
+	return days[mon];
+}
+
+/* Sakamoto's method; the weekday of a date does not depend on the zone */
+static int
+cronspec_wday(int year, int mon, int mday)
+{
+	static const int t[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+
+	year += 1900;
+	if (mon < 2) {
+		year--;
+	}
+
+	return (year + year / 4 - year / 100 + year / 400 + t[mon] + mday) % 7;
+}
+
+/* The days of a month that match, as bits 1-31 */
+static uint32_t
+cronspec_days(const struct cronspec *cs, int year, int mon)
+{
+	uint32_t days = 0;
+	int first, i;
+
+	if (cs->cs_mon & (1U << mon)) {
+		days = cs->cs_mday;
+	}
+
+	if (cs->cs_wday) {
+		first = cronspec_wday(year, mon, 1);
+		for (i = 0; i < 7; i++) {
+			if (cs->cs_wday & (1U << ((first + i) % 7))) {
+				days |= CRONSPEC_WEEKLY << i;
+			}
+		}
+	}
+
+	return days & (((1ULL << cronspec_days_in_month(year, mon)) - 1) << 1);
+}
+
+/*
+ * Move tm to the first matching minute at or after it. Only the date, hour
+ * and minute are used, and tm_min may be 60.
+ */
+static bool
+cronspec_next_wall(const struct cronspec *cs, struct tm *tm)
+{
+	uint32_t days, hours;
+	uint64_t mins;
+	int n, mday, hour, min;
+
+	for (n = 0; n < CRONSPEC_MAX_MONTHS; n++) {
+		days = cronspec_days(cs, tm->tm_year, tm->tm_mon) & ~((1U << tm->tm_mday) - 1);
+
+		for (; days; days &= days - 1) {
+			mday = ffs((int)days) - 1;
+			if (mday != tm->tm_mday) {
+				tm->tm_hour = 0;
+				tm->tm_min = 0;
+			}
+
+			hours = cs->cs_hour & ~((1U << tm->tm_hour) - 1);
+			for (; hours; hours &= hours - 1) {
+				hour = ffs((int)hours) - 1;
+				if (hour != tm->tm_hour) {
+					tm->tm_min = 0;
+				}
+
+				mins = tm->tm_min < 64 ? cs->cs_min & ~((1ULL << tm->tm_min) - 1) : 0;
+				if (mins) {
+					min = ffsll((long long)mins) - 1;
+					tm->tm_mday = mday;
+					tm->tm_hour = hour;
+					tm->tm_min = min;
+					return true;
+				}
+			}
+
+			tm->tm_mday = mday;
+			tm->tm_hour = 0;
+			tm->tm_min = 0;
+		}
+
+		if (++tm->tm_mon == 12) {
+			tm->tm_mon = 0;
+			tm->tm_year++;
+		}
+		tm->tm_mday = 1;
+		tm->tm_hour = 0;
+		tm->tm_min = 0;
+	}
+
+	return false;
+}
+
+/*
+ * The earliest instant after now that reads as the given wall time. In the
+ * hour repeated when clocks go back that is usually the first of two; in
+ * the hour skipped when they go forward there is none, and mktime(3) moves
+ * the time past the gap.
+ */
+static time_t
+cronspec_mktime(const struct tm *wall, time_t now)
+{
+	struct tm tm, check;
+	time_t t, best = -1;
+	int isdst;
+
+	for (isdst = 0; isdst <= 1; isdst++) {
+		tm = *wall;
+		tm.tm_sec = 0;
+		tm.tm_isdst = isdst;
+		if ((t = mktime(&tm)) == -1 || t <= now) {
+			continue;
+		}
+
+		localtime_r(&t, &check);
+		if (check.tm_mday == wall->tm_mday && check.tm_hour == wall->tm_hour &&
+		    check.tm_min == wall->tm_min && (best == -1 || t < best)) {
+			best = t;
+		}
+	}
+
+	if (best == -1) {
+		tm = *wall;
+		tm.tm_sec = 0;
+		tm.tm_isdst = -1;
+		if ((t = mktime(&tm)) > now) {
+			best = t;
+		}
+	}
+
+	return best;
+}
+
+time_t
+cronspec_next(const struct cronspec *cs, time_t now)
+{
+	struct tm wall;
+	time_t t;
+	int tries;
+
+	localtime_r(&now, &wall);
+	wall.tm_min++;
+
+	/* Once clocks go back, the next matching wall time can lie before now;
+	 * look further until one does not.
+	 */
+	for (tries = 0; tries < 2 * 60; tries++) {
+		if (!cronspec_next_wall(cs, &wall)) {
+			return -1;
+		}
+
+		if ((t = cronspec_mktime(&wall, now)) != -1) {
+			return t;
+		}
+
+		wall.tm_min++;
+	}
+
+	return -1;
+}
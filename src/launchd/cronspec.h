@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHD_CRONSPEC_H__
+#define __LAUNCHD_CRONSPEC_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * A StartCalendarInterval schedule as one bitmask per field. A day matches
+ * if its month and day of the month both match, or if its weekday does;
+ * launchd has always ignored the month for weekday schedules. The next
+ * firing is found by scanning the masks a month at a time rather than by
+ * stepping a struct tm through mktime(3).
+ */
+struct cronspec {
+	uint64_t cs_min;	/* bits 0-59 */
+	uint32_t cs_hour;	/* bits 0-23 */
+	uint32_t cs_mday;	/* bits 1-31 */
+	uint16_t cs_mon;	/* bits 0-11 */
+	uint8_t cs_wday;	/* bits 0-6, Sunday first */
+};
+
+/* -1 is a wildcard; a weekday of 7 is Sunday, as in cron(8) */
+void cronspec_init(struct cronspec *cs, int mon, int mday, int wday, int hour, int min);
+
+/* The first matching minute after now, or -1 if the schedule never matches */
+time_t cronspec_next(const struct cronspec *cs, time_t now);
+
+#endif /* __LAUNCHD_CRONSPEC_H__ */
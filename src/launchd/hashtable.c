@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <stdlib.h>
+
+#include "hashtable.h"
+
+#define HASHTABLE_MINSIZE	16
+
+static struct hashlink **
+hashtable_bucket(const struct hashtable *ht, size_t hash)
+{
+	if (ht->ht_buckets == NULL) {
+		return (struct hashlink **)&ht->ht_inline;
+	}
+
+	return &ht->ht_buckets[hash & ht->ht_mask];
+}
+
+static void
+hashtable_link(struct hashlink **bucket, struct hashlink *hl)
+{
+	if ((hl->hl_next = *bucket) != NULL) {
+		hl->hl_next->hl_prev = &hl->hl_next;
+	}
+	*bucket = hl;
+	hl->hl_prev = bucket;
+}
+
+/* Move every link into a table twice the size. Failure leaves it as is. */
+static void
+hashtable_grow(struct hashtable *ht)
+{
+	struct hashlink **buckets, *hl, *next;
+	size_t size, i, oldsize;
+
+	oldsize = ht->ht_buckets ? ht->ht_mask + 1 : 1;
+	size = oldsize < HASHTABLE_MINSIZE ? HASHTABLE_MINSIZE : oldsize * 2;
+	if ((buckets = calloc(size, sizeof(*buckets))) == NULL) {
+		return;
+	}
+
+	for (i = 0; i < oldsize; i++) {
+		hl = ht->ht_buckets ? ht->ht_buckets[i] : ht->ht_inline;
+		for (; hl != NULL; hl = next) {
+			next = hl->hl_next;
+			hashtable_link(&buckets[hl->hl_hash & (size - 1)], hl);
+		}
+	}
+
+	free(ht->ht_buckets);
+	ht->ht_buckets = buckets;
+	ht->ht_inline = NULL;
+	ht->ht_mask = size - 1;
+}
+
+void
+hashtable_insert(struct hashtable *ht, struct hashlink *hl, size_t hash)
+{
+	if (ht->ht_count >= (ht->ht_buckets ? ht->ht_mask + 1 : 1)) {
+		hashtable_grow(ht);
+	}
+
+	hl->hl_hash = hash;
+	hl->hl_table = ht;
+	hashtable_link(hashtable_bucket(ht, hash), hl);
+	ht->ht_count++;
+}
+
+void
+hashtable_remove(struct hashlink *hl)
+{
+	/* Like LIST_REMOVE on a never-inserted entry, but harmless */
+	if (hl->hl_table == NULL) {
+		return;
+	}
+
+	if (hl->hl_next != NULL) {
+		hl->hl_next->hl_prev = hl->hl_prev;
+	}
+	*hl->hl_prev = hl->hl_next;
+	hl->hl_table->ht_count--;
+
+	hl->hl_next = NULL;
+	hl->hl_prev = NULL;
+	hl->hl_table = NULL;
+}
+
+/* The objects must have been removed or freed already */
+void
+hashtable_destroy(struct hashtable *ht)
+{
+	free(ht->ht_buckets);
+	ht->ht_buckets = NULL;
+	ht->ht_inline = NULL;
+	ht->ht_mask = 0;
+	ht->ht_count = 0;
+}
+
+static struct hashlink *
+hashtable_match(struct hashlink *hl, size_t hash)
+{
+	while (hl != NULL && hl->hl_hash != hash) {
+		hl = hl->hl_next;
+	}
+
+	return hl;
+}
+
+struct hashlink *
+hashtable_lookup(const struct hashtable *ht, size_t hash)
+{
+	return hashtable_match(*hashtable_bucket(ht, hash), hash);
+}
+
+struct hashlink *
+hashtable_lookup_next(const struct hashlink *hl)
+{
+	return hashtable_match(hl->hl_next, hl->hl_hash);
+}
+
+static struct hashlink *
+hashtable_scan(const struct hashtable *ht, size_t i)
+{
+	if (ht->ht_buckets == NULL) {
+		return i == 0 ? ht->ht_inline : NULL;
+	}
+
+	for (; i <= ht->ht_mask; i++) {
+		if (ht->ht_buckets[i] != NULL) {
+			return ht->ht_buckets[i];
+		}
+	}
+
+	return NULL;
+}
+
+struct hashlink *
+hashtable_first(const struct hashtable *ht)
+{
+	return hashtable_scan(ht, 0);
+}
+
+struct hashlink *
+hashtable_next(const struct hashlink *hl)
+{
+	const struct hashtable *ht = hl->hl_table;
+
+	if (hl->hl_next != NULL) {
+		return hl->hl_next;
+	}
+
+	return hashtable_scan(ht, (hl->hl_hash & ht->ht_mask) + 1);
+}
+
+/*
+ * FNV-1a, finished with the murmur3 avalanche so that the low bits the
+ * buckets are picked by depend on every byte. djb2, which this replaces,
+ * only mixes each character into the bits above it, which is fine modulo a
+ * prime but not for the power-of-two masks used here.
+ */
+size_t
+hashtable_strhash(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	unsigned char c;
+
+	while ((c = (unsigned char)*s++)) {
+		h ^= c;
+		h *= 0x100000001b3ULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return (size_t)h;
+}
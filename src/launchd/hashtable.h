@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHD_HASHTABLE_H__
+#define __LAUNCHD_HASHTABLE_H__
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Chained hash tables whose links live inside the hashed objects, like the
+ * LIST_ENTRYs they replace. Each link remembers its full hash and its
+ * table, so a table can be resized without knowing how to hash its
+ * objects, and an object can be removed without knowing which table it is
+ * in. A zeroed table is empty and valid; it starts with one bucket and
+ * doubles whenever it holds more objects than buckets. Tables never
+ * resize on removal, so the _SAFE iterators, which fetch the next object
+ * before running the body, may remove the current one. The others follow
+ * the current object's links, which removal clears.
+ */
+struct hashtable;
+
+struct hashlink {
+	struct hashlink *hl_next;
+	struct hashlink **hl_prev;
+	struct hashtable *hl_table;
+	size_t hl_hash;
+};
+
+struct hashtable {
+	struct hashlink **ht_buckets;
+	struct hashlink *ht_inline;	/* the bucket of an unallocated table */
+	size_t ht_mask;
+	size_t ht_count;
+};
+
+void hashtable_insert(struct hashtable *ht, struct hashlink *hl, size_t hash);
+void hashtable_remove(struct hashlink *hl);
+void hashtable_destroy(struct hashtable *ht);
+struct hashlink *hashtable_lookup(const struct hashtable *ht, size_t hash);
+struct hashlink *hashtable_lookup_next(const struct hashlink *hl);
+struct hashlink *hashtable_first(const struct hashtable *ht);
+struct hashlink *hashtable_next(const struct hashlink *hl);
+
+size_t hashtable_strhash(const char *s) __attribute__((pure));
+
+static inline size_t
+hashtable_inthash(uint64_t v)
+{
+	/* Fibonacci hashing; pids and port names differ mostly in low bits */
+	v *= 0x9e3779b97f4a7c15ULL;
+	return (size_t)(v ^ (v >> 32));
+}
+
+#define HASHTABLE_ENTRY(hl, var, field) \
+	((hl) ? (__typeof__(var))((char *)(hl) - offsetof(__typeof__(*(var)), field)) : NULL)
+
+/* Every object in ht whose hash is hash; compare the keys in the body */
+#define HASHTABLE_FOREACH(var, ht, hash, field) \
+	for ((var) = HASHTABLE_ENTRY(hashtable_lookup((ht), (hash)), var, field); \
+	    (var) != NULL; \
+	    (var) = HASHTABLE_ENTRY(hashtable_lookup_next(&(var)->field), var, field))
+
+/* Every object in ht, in no particular order */
+#define HASHTABLE_FOREACH_ALL(var, ht, field) \
+	for ((var) = HASHTABLE_ENTRY(hashtable_first(ht), var, field); \
+	    (var) != NULL; \
+	    (var) = HASHTABLE_ENTRY(hashtable_next(&(var)->field), var, field))
+
+#define HASHTABLE_FOREACH_SAFE(var, ht, hash, field, tvar) \
+	for ((var) = HASHTABLE_ENTRY(hashtable_lookup((ht), (hash)), var, field); \
+	    (var) != NULL && ((tvar) = HASHTABLE_ENTRY(hashtable_lookup_next(&(var)->field), var, field), 1); \
+	    (var) = (tvar))
+
+#define HASHTABLE_FOREACH_ALL_SAFE(var, ht, field, tvar) \
+	for ((var) = HASHTABLE_ENTRY(hashtable_first(ht), var, field); \
+	    (var) != NULL && ((tvar) = HASHTABLE_ENTRY(hashtable_next(&(var)->field), var, field), 1); \
+	    (var) = (tvar))
+
+#endif /* __LAUNCHD_HASHTABLE_H__ */
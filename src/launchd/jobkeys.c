@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+
+#include "jobkeys.h"
+
+/*
+ * A perfect hash over the key names: with this seed, FNV-1a over the
+ * lowercased name puts every key in its own slot, so a lookup is one hash
+ * and one strcasecmp(3). The slots are filled on first use. If a new key
+ * collides, lookups stay correct but fall back to a linear scan, and
+ * tests/launchd_jobkeys_benchmark.c says so and finds a new seed.
+ */
+#define JOBKEY_SEED	0x364bU
+#define JOBKEY_BITS	8
+
+static const char *const jobkey_names[JOBKEY_COUNT] = {
+	[JOBKEY_UNKNOWN] = NULL,
+#define JOBKEY_NAME(name, str) [JOBKEY_##name] = str,
+	JOBKEYS(JOBKEY_NAME)
+#undef JOBKEY_NAME
+};
+
+static uint8_t jobkey_slots[1U << JOBKEY_BITS];
+static bool jobkey_slots_ready;
+static bool jobkey_slots_collide;
+
+static inline uint32_t
+jobkey_hash(const char *key)
+{
+	uint32_t h = JOBKEY_SEED;
+
+	/* Keys are letters; anything else only has to hash consistently */
+	while (*key) {
+		h = (h ^ ((unsigned char)*key++ | 0x20)) * 0x01000193U;
+	}
+
+	return h >> (32 - JOBKEY_BITS);
+}
+
+static void
+jobkey_fill(void)
+{
+	uint32_t slot;
+	int k;
+
+	for (k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++) {
+		slot = jobkey_hash(jobkey_names[k]);
+		if (jobkey_slots[slot] != JOBKEY_UNKNOWN) {
+			jobkey_slots_collide = true;
+		}
+		jobkey_slots[slot] = (uint8_t)k;
+	}
+
+	jobkey_slots_ready = true;
+}
+
+enum jobkey
+jobkey_lookup(const char *key)
+{
+	int k;
+
+	if (!jobkey_slots_ready) {
+		jobkey_fill();
+	}
+
+	k = jobkey_slots[jobkey_hash(key)];
+	if (k != JOBKEY_UNKNOWN && strcasecmp(key, jobkey_names[k]) == 0) {
+		return (enum jobkey)k;
+	}
+
+	if (jobkey_slots_collide) {
+		for (k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++) {
+			if (strcasecmp(key, jobkey_names[k]) == 0) {
+				return (enum jobkey)k;
+			}
+		}
+	}
+
+	return JOBKEY_UNKNOWN;
+}
+
+const char *
+jobkey_name(enum jobkey k)
+{
+	return (unsigned)k < JOBKEY_COUNT ? jobkey_names[k] : NULL;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHD_JOBKEYS_H__
+#define __LAUNCHD_JOBKEYS_H__
+
+#include <launch.h>
+#include <launch_priv.h>
+
+/* Every top-level launchd.plist key that job_import_keys() understands */
+#define JOBKEYS(X) \
+	X(ABANDONPROCESSGROUP, LAUNCH_JOBKEY_ABANDONPROCESSGROUP) \
+	X(ASID, LAUNCH_JOBKEY_ASID) \
+	X(BEGINTRANSACTIONATSHUTDOWN, LAUNCH_JOBKEY_BEGINTRANSACTIONATSHUTDOWN) \
+	X(BINARYORDERPREFERENCE, LAUNCH_JOBKEY_BINARYORDERPREFERENCE) \
+	X(CFBUNDLEIDENTIFIER, LAUNCH_JOBKEY_CFBUNDLEIDENTIFIER) \
+	X(DEBUG, LAUNCH_JOBKEY_DEBUG) \
+	X(DISABLEASLR, LAUNCH_JOBKEY_DISABLEASLR) \
+	X(DISABLED, LAUNCH_JOBKEY_DISABLED) \
+	X(EMBEDDEDHOMESCREEN, LAUNCH_JOBKEY_EMBEDDEDHOMESCREEN) \
+	X(EMBEDDEDMAINTHREADPRIORITY, LAUNCH_JOBKEY_EMBEDDEDMAINTHREADPRIORITY) \
+	X(EMBEDDEDPRIVILEGEDISPENSATION, LAUNCH_JOBKEY_EMBEDDEDPRIVILEGEDISPENSATION) \
+	X(ENABLEGLOBBING, LAUNCH_JOBKEY_ENABLEGLOBBING) \
+	X(ENABLETRANSACTIONS, LAUNCH_JOBKEY_ENABLETRANSACTIONS) \
+	X(ENTERKERNELDEBUGGERBEFOREKILL, LAUNCH_JOBKEY_ENTERKERNELDEBUGGERBEFOREKILL) \
+	X(ENVIRONMENTVARIABLES, LAUNCH_JOBKEY_ENVIRONMENTVARIABLES) \
+	X(EVENTMONITOR, LAUNCH_JOBKEY_EVENTMONITOR) \
+	X(EXITTIMEOUT, LAUNCH_JOBKEY_EXITTIMEOUT) \
+	X(GROUPNAME, LAUNCH_JOBKEY_GROUPNAME) \
+	X(HARDRESOURCELIMITS, LAUNCH_JOBKEY_HARDRESOURCELIMITS) \
+	X(HOPEFULLYEXITSLAST, LAUNCH_JOBKEY_HOPEFULLYEXITSLAST) \
+	X(IGNOREPROCESSGROUPATSHUTDOWN, LAUNCH_JOBKEY_IGNOREPROCESSGROUPATSHUTDOWN) \
+	X(INETDCOMPATIBILITY, LAUNCH_JOBKEY_INETDCOMPATIBILITY) \
+	X(INITGROUPS, LAUNCH_JOBKEY_INITGROUPS) \
+	X(JETSAMPRIORITY, LAUNCH_JOBKEY_JETSAMPRIORITY) \
+	X(JETSAMPROPERTIES, LAUNCH_JOBKEY_JETSAMPROPERTIES) \
+	X(JOINGUISESSION, LAUNCH_JOBKEY_JOINGUISESSION) \
+	X(KEEPALIVE, LAUNCH_JOBKEY_KEEPALIVE) \
+	X(LABEL, LAUNCH_JOBKEY_LABEL) \
+	X(LAUNCHEVENTS, LAUNCH_JOBKEY_LAUNCHEVENTS) \
+	X(LAUNCHONLYONCE, LAUNCH_JOBKEY_LAUNCHONLYONCE) \
+	X(LEGACYTIMERS, LAUNCH_JOBKEY_LEGACYTIMERS) \
+	X(LIMITLOADFROMHARDWARE, LAUNCH_JOBKEY_LIMITLOADFROMHARDWARE) \
+	X(LIMITLOADFROMHOSTS, LAUNCH_JOBKEY_LIMITLOADFROMHOSTS) \
+	X(LIMITLOADTOHARDWARE, LAUNCH_JOBKEY_LIMITLOADTOHARDWARE) \
+	X(LIMITLOADTOHOSTS, LAUNCH_JOBKEY_LIMITLOADTOHOSTS) \
+	X(LIMITLOADTOSESSIONTYPE, LAUNCH_JOBKEY_LIMITLOADTOSESSIONTYPE) \
+	X(LOWPRIORITYBACKGROUNDIO, LAUNCH_JOBKEY_LOWPRIORITYBACKGROUNDIO) \
+	X(LOWPRIORITYIO, LAUNCH_JOBKEY_LOWPRIORITYIO) \
+	X(MACHEXCEPTIONHANDLER, LAUNCH_JOBKEY_MACHEXCEPTIONHANDLER) \
+	X(MACHSERVICES, LAUNCH_JOBKEY_MACHSERVICES) \
+	X(MULTIPLEINSTANCES, LAUNCH_JOBKEY_MULTIPLEINSTANCES) \
+	X(NICE, LAUNCH_JOBKEY_NICE) \
+	X(ONDEMAND, LAUNCH_JOBKEY_ONDEMAND) \
+	X(POLICIES, LAUNCH_JOBKEY_POLICIES) \
+	X(POSIXSPAWNTYPE, LAUNCH_JOBKEY_POSIXSPAWNTYPE) \
+	X(PROCESSTYPE, LAUNCH_JOBKEY_PROCESSTYPE) \
+	X(PROGRAM, LAUNCH_JOBKEY_PROGRAM) \
+	X(PROGRAMARGUMENTS, LAUNCH_JOBKEY_PROGRAMARGUMENTS) \
+	X(QUARANTINEDATA, LAUNCH_JOBKEY_QUARANTINEDATA) \
+	X(ROOTDIRECTORY, LAUNCH_JOBKEY_ROOTDIRECTORY) \
+	X(RUNATLOAD, LAUNCH_JOBKEY_RUNATLOAD) \
+	X(SANDBOXCONTAINER, LAUNCH_JOBKEY_SANDBOXCONTAINER) \
+	X(SANDBOXFLAGS, LAUNCH_JOBKEY_SANDBOXFLAGS) \
+	X(SANDBOXPROFILE, LAUNCH_JOBKEY_SANDBOXPROFILE) \
+	X(SECURITYSESSIONUUID, LAUNCH_JOBKEY_SECURITYSESSIONUUID) \
+	X(SERVICEIPC, LAUNCH_JOBKEY_SERVICEIPC) \
+	X(SESSIONCREATE, LAUNCH_JOBKEY_SESSIONCREATE) \
+	X(SHUTDOWNMONITOR, LAUNCH_JOBKEY_SHUTDOWNMONITOR) \
+	X(SOCKETS, LAUNCH_JOBKEY_SOCKETS) \
+	X(SOFTRESOURCELIMITS, LAUNCH_JOBKEY_SOFTRESOURCELIMITS) \
+	X(STANDARDERRORPATH, LAUNCH_JOBKEY_STANDARDERRORPATH) \
+	X(STANDARDINPATH, LAUNCH_JOBKEY_STANDARDINPATH) \
+	X(STANDARDOUTPATH, LAUNCH_JOBKEY_STANDARDOUTPATH) \
+	X(STARTCALENDARINTERVAL, LAUNCH_JOBKEY_STARTCALENDARINTERVAL) \
+	X(STARTINTERVAL, LAUNCH_JOBKEY_STARTINTERVAL) \
+	X(STARTONMOUNT, LAUNCH_JOBKEY_STARTONMOUNT) \
+	X(THROTTLEINTERVAL, LAUNCH_JOBKEY_THROTTLEINTERVAL) \
+	X(TIMEOUT, LAUNCH_JOBKEY_TIMEOUT) \
+	X(UMASK, LAUNCH_JOBKEY_UMASK) \
+	X(USERENVIRONMENTVARIABLES, LAUNCH_JOBKEY_USERENVIRONMENTVARIABLES) \
+	X(USERNAME, LAUNCH_JOBKEY_USERNAME) \
+	X(WAITFORDEBUGGER, LAUNCH_JOBKEY_WAITFORDEBUGGER) \
+	X(WORKINGDIRECTORY, LAUNCH_JOBKEY_WORKINGDIRECTORY) \
+	X(XPCDOMAIN, LAUNCH_JOBKEY_XPCDOMAIN) \
+	X(XPCDOMAINBOOTSTRAPPER, LAUNCH_JOBKEY_XPCDOMAINBOOTSTRAPPER)
+
+enum jobkey {
+	JOBKEY_UNKNOWN,
+#define JOBKEY_ENUM(name, str) JOBKEY_##name,
+	JOBKEYS(JOBKEY_ENUM)
+#undef JOBKEY_ENUM
+	JOBKEY_COUNT
+};
+
+/* Case-insensitive, like the strcasecmp(3) chains it replaces */
+enum jobkey jobkey_lookup(const char *key);
+const char *jobkey_name(enum jobkey k);
+
+#endif /* __LAUNCHD_JOBKEYS_H__ */
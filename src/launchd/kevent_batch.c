@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "kevent_batch.h"
+
+#define KEVENT_BATCH_MINSIZE	64
+
+/* Make room for n more changes */
+bool
+kevent_batch_reserve(struct kevent_batch *kb, size_t n)
+{
+	struct kevent *kev;
+	size_t size;
+
+	if (kb->kb_count + n <= kb->kb_size) {
+		return true;
+	}
+
+	size = kb->kb_size ? kb->kb_size : KEVENT_BATCH_MINSIZE;
+	while (size < kb->kb_count + n) {
+		size *= 2;
+	}
+
+	if ((kev = realloc(kb->kb_kev, size * sizeof(*kev))) == NULL) {
+		return false;
+	}
+	kb->kb_kev = kev;
+	kb->kb_size = size;
+	return true;
+}
+
+/* Queue n changes, which kevent_batch_reserve() has made room for */
+void
+kevent_batch_add(struct kevent_batch *kb, const struct kevent *kev, size_t n)
+{
+	size_t i;
+
+	memcpy(&kb->kb_kev[kb->kb_count], kev, n * sizeof(*kev));
+	for (i = 0; i < n; i++) {
+		kb->kb_kev[kb->kb_count + i].flags |= EV_RECEIPT;
+	}
+	kb->kb_count += n;
+}
+
+/* Hand every queued change to kq and empty the batch. Each addition that the
+ * kernel refused goes to failed(); a deletion of something that was never
+ * there is not worth reporting. Returns the number of receipts, one per
+ * change unless something went badly wrong, or -1 with errno set if
+ * kevent(2) itself failed.
+ */
+int
+kevent_batch_submit(struct kevent_batch *kb, int kq, kevent_batch_failed_t failed, void *context)
+{
+	size_t i;
+	int r;
+
+	if (kb->kb_count == 0) {
+		return 0;
+	}
+
+	r = kevent(kq, kb->kb_kev, (int)kb->kb_count, kb->kb_kev, (int)kb->kb_count, NULL);
+	if (r != -1) {
+		for (i = 0; i < (size_t)r; i++) {
+			if ((kb->kb_kev[i].flags & (EV_ERROR|EV_ADD)) == (EV_ERROR|EV_ADD) && kb->kb_kev[i].data) {
+				failed(&kb->kb_kev[i], context);
+			}
+		}
+	}
+
+	kb->kb_count = 0;
+	return r;
+}
+
+void
+kevent_batch_destroy(struct kevent_batch *kb)
+{
+	free(kb->kb_kev);
+	kb->kb_kev = NULL;
+	kb->kb_count = 0;
+	kb->kb_size = 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHD_KEVENT_BATCH_H__
+#define __LAUNCHD_KEVENT_BATCH_H__
+
+#include <sys/types.h>
+#include <sys/event.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * kevent(2) changes queued up to be handed to a kqueue in one call. They
+ * reach the kernel in the order they were queued, so an addition cancelled
+ * by a later deletion in the same batch nets out. Every change is sent with
+ * EV_RECEIPT, and each failed addition is passed back on its own, udata
+ * intact, so that the error can be put down to the job that made it. A
+ * zeroed batch is empty and valid.
+ */
+struct kevent_batch {
+	struct kevent *kb_kev;
+	size_t kb_count;
+	size_t kb_size;
+};
+
+typedef void (*kevent_batch_failed_t)(const struct kevent *kev, void *context);
+
+bool kevent_batch_reserve(struct kevent_batch *kb, size_t n);
+void kevent_batch_add(struct kevent_batch *kb, const struct kevent *kev, size_t n);
+int kevent_batch_submit(struct kevent_batch *kb, int kq, kevent_batch_failed_t failed, void *context);
+void kevent_batch_destroy(struct kevent_batch *kb);
+
+#endif /* __LAUNCHD_KEVENT_BATCH_H__ */
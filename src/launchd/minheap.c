@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+
+#include <stdlib.h>
+
+#include "minheap.h"
+
+#define MINHEAP_ARITY	4
+#define MINHEAP_MINSIZE	16
+
+static void
+minheap_place(struct minheap *mh, struct minheap_node *mhn, size_t i)
+{
+	mh->mh_nodes[i] = mhn;
+	mhn->mhn_index = i + 1;
+}
+
+static void
+minheap_sift_up(struct minheap *mh, struct minheap_node *mhn, size_t i)
+{
+	size_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / MINHEAP_ARITY;
+		if (mh->mh_nodes[parent]->mhn_key <= mhn->mhn_key) {
+			break;
+		}
+		minheap_place(mh, mh->mh_nodes[parent], i);
+		i = parent;
+	}
+
+	minheap_place(mh, mhn, i);
+}
+
+static void
+minheap_sift_down(struct minheap *mh, struct minheap_node *mhn, size_t i)
+{
+	size_t child, last, min;
+
+	for (;;) {
+		child = i * MINHEAP_ARITY + 1;
+		if (child >= mh->mh_count) {
+			break;
+		}
+
+		last = child + MINHEAP_ARITY;
+		if (last > mh->mh_count) {
+			last = mh->mh_count;
+		}
+
+		for (min = child++; child < last; child++) {
+			if (mh->mh_nodes[child]->mhn_key < mh->mh_nodes[min]->mhn_key) {
+				min = child;
+			}
+		}
+
+		if (mhn->mhn_key <= mh->mh_nodes[min]->mhn_key) {
+			break;
+		}
+		minheap_place(mh, mh->mh_nodes[min], i);
+		i = min;
+	}
+
+	minheap_place(mh, mhn, i);
+}
+
+/* Put a node that moved to position i back in order */
+static void
+minheap_fix(struct minheap *mh, struct minheap_node *mhn, size_t i)
+{
+	if (i > 0 && mhn->mhn_key < mh->mh_nodes[(i - 1) / MINHEAP_ARITY]->mhn_key) {
+		minheap_sift_up(mh, mhn, i);
+	} else {
+		minheap_sift_down(mh, mhn, i);
+	}
+}
+
+bool
+minheap_insert(struct minheap *mh, struct minheap_node *mhn, int64_t key)
+{
+	struct minheap_node **nodes;
+	size_t size;
+
+	if (mh->mh_count == mh->mh_size) {
+		size = mh->mh_size ? mh->mh_size * 2 : MINHEAP_MINSIZE;
+		if ((nodes = realloc(mh->mh_nodes, size * sizeof(*nodes))) == NULL) {
+			return false;
+		}
+		mh->mh_nodes = nodes;
+		mh->mh_size = size;
+	}
+
+	mhn->mhn_key = key;
+	minheap_sift_up(mh, mhn, mh->mh_count++);
+	return true;
+}
+
+void
+minheap_remove(struct minheap *mh, struct minheap_node *mhn)
+{
+	struct minheap_node *last;
+	size_t i;
+
+	if (mhn->mhn_index == 0) {
+		return;
+	}
+
+	i = mhn->mhn_index - 1;
+	mhn->mhn_index = 0;
+	last = mh->mh_nodes[--mh->mh_count];
+	if (last != mhn) {
+		minheap_fix(mh, last, i);
+	}
+}
+
+void
+minheap_update(struct minheap *mh, struct minheap_node *mhn, int64_t key)
+{
+	mhn->mhn_key = key;
+	minheap_fix(mh, mhn, mhn->mhn_index - 1);
+}
+
+/* The nodes must have been removed or freed already */
+void
+minheap_destroy(struct minheap *mh)
+{
+	free(mh->mh_nodes);
+	mh->mh_nodes = NULL;
+	mh->mh_count = 0;
+	mh->mh_size = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020 PureDarwin Project. All rights reserved.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_START@
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @APPLE_APACHE_LICENSE_HEADER_END@
+ */
+#ifndef __LAUNCHD_MINHEAP_H__
+#define __LAUNCHD_MINHEAP_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A 4-ary min-heap of nodes embedded in the objects it orders. Each node
+ * remembers its position, so an object can be removed or rekeyed in
+ * O(log n) without searching for it. A zeroed heap is empty and valid, and
+ * a zeroed node is in no heap.
+ */
+struct minheap_node {
+	int64_t mhn_key;
+	size_t mhn_index;	/* position + 1, or 0 when not in a heap */
+};
+
+struct minheap {
+	struct minheap_node **mh_nodes;
+	size_t mh_count;
+	size_t mh_size;
+};
+
+bool minheap_insert(struct minheap *mh, struct minheap_node *mhn, int64_t key);
+void minheap_remove(struct minheap *mh, struct minheap_node *mhn);
+void minheap_update(struct minheap *mh, struct minheap_node *mhn, int64_t key);
+void minheap_destroy(struct minheap *mh);
+
+static inline struct minheap_node *
+minheap_min(const struct minheap *mh)
+{
+	return mh->mh_count ? mh->mh_nodes[0] : NULL;
+}
+
+#define MINHEAP_ENTRY(mhn, type, field) \
+	((mhn) ? (type *)((char *)(mhn) - offsetof(type, field)) : NULL)
+
+#endif /* __LAUNCHD_MINHEAP_H__ */
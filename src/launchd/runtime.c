@@ -84,6 +84,7 @@
 #include "vproc_internal.h"
 #include "jobServer.h"
 #include "job_reply.h"
+#include "kevent_batch.h"
 
 #include <xpc/launchd.h>
 static mach_port_t ipc_port_set;
@@ -96,6 +97,10 @@ static struct kevent *bulk_kev;
 static int bulk_kev_i;
 static int bulk_kev_cnt;
 
+/* Registrations held back between kevent_mod_defer() and kevent_mod_flush() */
+static struct kevent_batch deferred_kev;
+static bool kevent_deferring;
+
 static pthread_t kqueue_demand_thread;
 
 static void mportset_callback(void);
@@ -777,6 +782,79 @@ launchd_mport_deallocate(mach_port_t name)
 	return errno = mach_port_deallocate(mach_task_self(), name);
 }
 
+/* An addition failed; say which one, so it can be traced to its job */
+static void
+kevent_add_failed(const struct kevent *kev, void *context __attribute__((unused)))
+{
+	launchd_syslog(LOG_ERR, "kevent addition failed: ident %lu, filter %hd, udata %p: %s",
+	    (unsigned long)kev->ident, kev->filter, kev->udata, strerror((int)kev->data));
+	log_kevent_struct(LOG_DEBUG, (struct kevent *)kev, 0);
+}
+
+static void
+kevent_batch_send(struct kevent_batch *kb)
+{
+	size_t cnt = kb->kb_count;
+	int r;
+
+	r = kevent_batch_submit(kb, mainkq, kevent_add_failed, NULL);
+	if (r == -1) {
+		(void)os_assumes_zero(errno);
+	} else {
+		(void)os_assumes(r == (int)cnt);
+	}
+}
+
+/* Make room to defer n more changes. If the buffer cannot grow, what is
+ * already queued goes to the kernel so that later changes stay in order.
+ */
+static bool
+kevent_defer_reserve(size_t n)
+{
+	if (kevent_batch_reserve(&deferred_kev, n)) {
+		return true;
+	}
+
+	kevent_batch_send(&deferred_kev);
+	return n <= deferred_kev.kb_size;
+}
+
+/* Between kevent_mod_defer() and kevent_mod_flush(), kevent_mod_deferred()
+ * and kevent_bulk_mod_deferred() queue their changes instead of making a
+ * system call for each one. kevent_mod() and kevent_bulk_mod() hand the
+ * queue to the kernel before their own change, so every change still
+ * reaches the kernel in the order it was made, and they still return the
+ * kernel's answer.
+ */
+void
+kevent_mod_defer(void)
+{
+	kevent_deferring = true;
+}
+
+void
+kevent_mod_flush(void)
+{
+	kevent_batch_send(&deferred_kev);
+	kevent_deferring = false;
+	kevent_batch_destroy(&deferred_kev);
+}
+
+/* Queue changes while deferring, or else make them at once */
+static void
+kevent_defer(struct kevent *kev, size_t kev_cnt)
+{
+	struct kevent_batch now = { kev, kev_cnt, kev_cnt };
+
+	if (kevent_deferring && kevent_defer_reserve(kev_cnt)) {
+		kevent_batch_add(&deferred_kev, kev, kev_cnt);
+		return;
+	}
+
+	kevent_batch_send(&deferred_kev);
+	kevent_batch_send(&now);
+}
+
 int
 kevent_bulk_mod(struct kevent *kev, size_t kev_cnt)
 {
@@ -786,31 +864,56 @@ kevent_bulk_mod(struct kevent *kev, size_t kev_cnt)
 		kev[i].flags |= EV_CLEAR|EV_RECEIPT;
 	}
 
+	kevent_batch_send(&deferred_kev);
+
 	return kevent(mainkq, kev, kev_cnt, kev, kev_cnt, NULL);
 }
 
-int
-kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata)
+/* kevent_bulk_mod() for callers that would only log a failure: the changes
+ * may be deferred, the receipts are not filled in, and each failed addition
+ * is logged with its kevent instead. Only for additions; a deletion has to
+ * be made at once, as kevent_mod() prunes what it deletes from the events
+ * already fetched.
+ */
+void
+kevent_bulk_mod_deferred(struct kevent *kev, size_t kev_cnt)
 {
-	struct kevent kev;
-	int r;
+	size_t i;
+
+	for (i = 0; i < kev_cnt; i++) {
+		kev[i].flags |= EV_CLEAR|EV_RECEIPT;
+	}
 
+	kevent_defer(kev, kev_cnt);
+}
+
+static u_short
+kevent_mod_flags(short filter, u_short flags)
+{
 	switch (filter) {
 	case EVFILT_READ:
 	case EVFILT_WRITE:
 		break;
-	case EVFILT_TIMER:
-		/* Workaround 5225889 */
-		if (flags & EV_ADD) {
-			(void)kevent_mod(ident, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
-		}
-		/* fall through */
 	default:
 		flags |= EV_CLEAR;
 		break;
 	}
 
-	flags |= EV_RECEIPT;
+	return flags|EV_RECEIPT;
+}
+
+int
+kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata)
+{
+	struct kevent kev;
+	int r;
+
+	/* Workaround 5225889 */
+	if (filter == EVFILT_TIMER && (flags & EV_ADD)) {
+		(void)kevent_mod(ident, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+	}
+
+	flags = kevent_mod_flags(filter, flags);
 
 	if (flags & EV_ADD && !udata) {
 		errno = EINVAL;
@@ -828,6 +931,8 @@ kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t
 
 	EV_SET(&kev, ident, filter, flags, fflags, data, udata);
 
+	kevent_batch_send(&deferred_kev);
+
 	r = kevent(mainkq, &kev, 1, &kev, 1, NULL);
 
 	if (r != 1) {
@@ -848,6 +953,24 @@ kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t
 	return r;
 }
 
+/* kevent_mod() for an addition whose failure the caller would only log; see
+ * kevent_bulk_mod_deferred().
+ */
+void
+kevent_mod_deferred(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata)
+{
+	struct kevent kev[2];
+	size_t n = 0;
+
+	/* Workaround 5225889 */
+	if (filter == EVFILT_TIMER && (flags & EV_ADD)) {
+		EV_SET(&kev[n++], ident, EVFILT_TIMER, EV_DELETE|EV_RECEIPT, 0, 0, NULL);
+	}
+	EV_SET(&kev[n++], ident, filter, kevent_mod_flags(filter, flags), fflags, data, udata);
+
+	kevent_defer(kev, n);
+}
+
 boolean_t
 launchd_internal_demux(mach_msg_header_t *Request, mach_msg_header_t *Reply)
 {
@@ -106,6 +106,10 @@ const char *reboot_flags_to_C_names(unsigned int flags);
 
 int kevent_bulk_mod(struct kevent *kev, size_t kev_cnt);
 int kevent_mod(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata);
+void kevent_bulk_mod_deferred(struct kevent *kev, size_t kev_cnt);
+void kevent_mod_deferred(uintptr_t ident, short filter, u_short flags, u_int fflags, intptr_t data, void *udata);
+void kevent_mod_defer(void);
+void kevent_mod_flush(void);
 void log_kevent_struct(int level, struct kevent *kev_base, int indx);
 
 pid_t runtime_fork(mach_port_t bsport);
@@ -1,115 +1,400 @@
 #include <sys/types.h>
+#include <sys/param.h>
+#include <sys/sbuf.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <unistd.h>
 
-struct sbuf {
-	char	*s_buf;		/* storage buffer */
-	void	*s_unused;	/* binary compatibility, unused */
-	int		 s_size;	/* size of storage buffer */
-	int		 s_len;		/* current length of string */
-	int		 s_flags;	/* flags, unused */
+/*
+ * s_len never counts the terminating NUL, but one byte of s_buf is always
+ * kept free for it, so sbuf_data() only has to store it.
+ *
+ * An autoextend buffer doubles whenever it runs out of room. A fixed-length
+ * buffer either overflows, after which everything but sbuf_clear() and
+ * sbuf_delete() is a no-op, or, if it has a drain, hands its contents to the
+ * drain and starts over. The drain hangs off s_unused so that the structure
+ * keeps its layout.
+ */
+
+#define	SBUF_MINSIZE	64
+
+struct sbuf_drain {
+	sbuf_drain_func	*sd_func;
+	void		*sd_arg;
 };
 
-struct sbuf *sbuf_new_auto(void) {
-	struct sbuf *sb = calloc(1, sizeof(*sb));
-	sb->s_buf = malloc(1024);
-	sb->s_size = 1024;
-	sb->s_len = 0;
-	return sb;
+#define	SBUF_ISDYNAMIC(s)	((s)->s_flags & SBUF_DYNAMIC)
+#define	SBUF_ISDYNSTRUCT(s)	((s)->s_flags & SBUF_DYNSTRUCT)
+#define	SBUF_CANEXTEND(s)	((s)->s_flags & SBUF_AUTOEXTEND)
+#define	SBUF_HASOVERFLOWED(s)	((s)->s_flags & SBUF_OVERFLOWED)
+#define	SBUF_ISFINISHED(s)	((s)->s_flags & SBUF_FINISHED)
+#define	SBUF_FREESPACE(s)	((s)->s_size - (s)->s_len - 1)
+
+static int
+sbuf_extend(struct sbuf *s, size_t need)
+{
+	size_t size;
+	char *buf;
+
+	if (!SBUF_CANEXTEND(s))
+		return (-1);
+
+	size = s->s_size;
+	while (size < (size_t)s->s_len + need + 1) {
+		if (size > INT_MAX / 2)
+			return (-1);
+		size *= 2;
+	}
+
+	if (SBUF_ISDYNAMIC(s)) {
+		buf = realloc(s->s_buf, size);
+		if (buf == NULL)
+			return (-1);
+	} else {
+		/* A caller-supplied buffer is not ours to realloc */
+		buf = malloc(size);
+		if (buf == NULL)
+			return (-1);
+		memcpy(buf, s->s_buf, s->s_len);
+		s->s_flags |= SBUF_DYNAMIC;
+	}
+
+	s->s_buf = buf;
+	s->s_size = (int)size;
+	return (0);
 }
 
-void sbuf_clear(struct sbuf *sb) {
-	free(sb->s_buf);
-	sb->s_buf = malloc(1024);
-	sb->s_size = 1024;
-	sb->s_len = 0;
+/* Empty the buffer into the drain */
+static int
+sbuf_drain(struct sbuf *s)
+{
+	struct sbuf_drain *d;
+	int off, n;
+
+	d = s->s_unused;
+	for (off = 0; off < s->s_len; off += n) {
+		n = d->sd_func(d->sd_arg, s->s_buf + off, s->s_len - off);
+		if (n <= 0) {
+			s->s_flags |= SBUF_OVERFLOWED;
+			return (-1);
+		}
+	}
+
+	s->s_len = 0;
+	return (0);
+}
+
+/* Make room for len more bytes, or as many as there can be */
+static int
+sbuf_reserve(struct sbuf *s, size_t len)
+{
+
+	if ((size_t)SBUF_FREESPACE(s) >= len)
+		return (0);
+	if (sbuf_extend(s, len) == 0)
+		return (0);
+	if (s->s_unused != NULL)
+		return (sbuf_drain(s));
+	return (-1);
+}
+
+struct sbuf *
+sbuf_new(struct sbuf *s, char *buf, int length, int flags)
+{
+
+	if (length < 0 || (flags & ~SBUF_USRFLAGMSK) != 0)
+		return (NULL);
+
+	if (s == NULL) {
+		s = calloc(1, sizeof(*s));
+		if (s == NULL)
+			return (NULL);
+		s->s_flags = SBUF_DYNSTRUCT;
+	} else {
+		memset(s, 0, sizeof(*s));
+	}
+
+	s->s_flags |= flags;
+	if (buf != NULL && length > 0) {
+		s->s_buf = buf;
+		s->s_size = length;
+		return (s);
+	}
+
+	if (length < SBUF_MINSIZE)
+		length = SBUF_MINSIZE;
+	s->s_buf = malloc(length);
+	if (s->s_buf == NULL) {
+		if (SBUF_ISDYNSTRUCT(s))
+			free(s);
+		return (NULL);
+	}
+
+	s->s_size = length;
+	s->s_flags |= SBUF_DYNAMIC;
+	return (s);
 }
 
-int	sbuf_setpos(struct sbuf *sb, int pos) {
-	// Unimplemented.
-	return sb->s_len;
+struct sbuf *
+sbuf_new_auto(void)
+{
+
+	return (sbuf_new(NULL, NULL, 0, SBUF_AUTOEXTEND));
 }
 
-int	sbuf_bcat(struct sbuf *sb, const void *ptr, size_t len) {
-	if ((sb->s_len + len) > sb->s_size) {
-		sb->s_size *= 2;
-		sb->s_buf = realloc(sb->s_buf, sb->s_size);
+void
+sbuf_set_drain(struct sbuf *s, sbuf_drain_func *func, void *arg)
+{
+	struct sbuf_drain *d;
+
+	d = s->s_unused;
+	if (func == NULL) {
+		free(d);
+		s->s_unused = NULL;
+		return;
+	}
+
+	if (d == NULL && (d = malloc(sizeof(*d))) == NULL) {
+		s->s_flags |= SBUF_OVERFLOWED;
+		return;
 	}
 
-	memcpy(sb->s_buf + sb->s_len, ptr, len);
-	sb->s_len += len;
-	return sb->s_len;
+	d->sd_func = func;
+	d->sd_arg = arg;
+	s->s_unused = d;
+}
+
+int
+sbuf_fd_drain(void *arg, const char *data, int len)
+{
+	ssize_t n;
+
+	do {
+		n = write((int)(intptr_t)arg, data, len);
+	} while (n == -1 && errno == EINTR);
+
+	return ((int)n);
+}
+
+void
+sbuf_clear(struct sbuf *s)
+{
+
+	s->s_flags &= ~(SBUF_FINISHED | SBUF_OVERFLOWED);
+	s->s_len = 0;
+}
+
+int
+sbuf_setpos(struct sbuf *s, int pos)
+{
+
+	if (pos < 0 || pos > s->s_len)
+		return (-1);
+
+	s->s_len = pos;
+	return (0);
 }
 
-int sbuf_bcpy(struct sbuf *sb, const void *ptr, size_t len) {
-	if (len > sb->s_size) {
-		sb->s_size *= 2;
-		sb->s_buf = realloc(sb->s_buf, sb->s_size);
+int
+sbuf_bcat(struct sbuf *s, const void *buf, size_t len)
+{
+	const char *p;
+	size_t n;
+
+	if (SBUF_HASOVERFLOWED(s))
+		return (-1);
+
+	/* With a drain, data larger than the buffer goes through in pieces */
+	for (p = buf; len > 0; p += n, len -= n) {
+		if (sbuf_reserve(s, len) != 0 &&
+		    (SBUF_HASOVERFLOWED(s) || SBUF_FREESPACE(s) == 0)) {
+			s->s_flags |= SBUF_OVERFLOWED;
+			return (-1);
+		}
+
+		n = MIN(len, (size_t)SBUF_FREESPACE(s));
+		memcpy(s->s_buf + s->s_len, p, n);
+		s->s_len += (int)n;
 	}
 
-	memcpy(sb->s_buf, ptr, len);
-	sb->s_len = (int)len;
-	return sb->s_len;
+	return (0);
 }
 
-int sbuf_cat(struct sbuf *sb, const char *str) {
-	return sbuf_bcat(sb, str, (int)strlen(str) * sizeof(char));
+int
+sbuf_bcpy(struct sbuf *s, const void *buf, size_t len)
+{
+
+	sbuf_clear(s);
+	return (sbuf_bcat(s, buf, len));
 }
 
-int sbuf_cpy(struct sbuf *sb, const char *str) {
-	return sbuf_bcpy(sb, str, (int)strlen(str) * sizeof(char));
+int
+sbuf_cat(struct sbuf *s, const char *str)
+{
+
+	return (sbuf_bcat(s, str, strlen(str)));
+}
+
+int
+sbuf_cpy(struct sbuf *s, const char *str)
+{
+
+	sbuf_clear(s);
+	return (sbuf_cat(s, str));
 }
 
-int sbuf_vprintf(struct sbuf *sb, const char *fmt, va_list ap) {
-	char *str; vasprintf(&str, fmt, ap);
-	int ret = sbuf_cat(sb, str);
+int
+sbuf_vprintf(struct sbuf *s, const char *fmt, va_list ap)
+{
+	va_list copy;
+	char *str;
+	int len, error;
+
+	if (SBUF_HASOVERFLOWED(s))
+		return (-1);
+
+	/* Format into the spare room; only retry if it did not fit */
+	va_copy(copy, ap);
+	len = vsnprintf(s->s_buf + s->s_len, SBUF_FREESPACE(s) + 1, fmt, copy);
+	va_end(copy);
+	if (len < 0) {
+		s->s_flags |= SBUF_OVERFLOWED;
+		return (-1);
+	}
+	if (len <= SBUF_FREESPACE(s)) {
+		s->s_len += len;
+		return (0);
+	}
+
+	if (sbuf_reserve(s, len) == 0 && len <= SBUF_FREESPACE(s)) {
+		va_copy(copy, ap);
+		vsnprintf(s->s_buf + s->s_len, SBUF_FREESPACE(s) + 1, fmt, copy);
+		va_end(copy);
+		s->s_len += len;
+		return (0);
+	}
+
+	/* Bigger than a drained buffer can ever hold */
+	if (s->s_unused == NULL || SBUF_HASOVERFLOWED(s)) {
+		s->s_flags |= SBUF_OVERFLOWED;
+		return (-1);
+	}
+
+	va_copy(copy, ap);
+	len = vasprintf(&str, fmt, copy);
+	va_end(copy);
+	if (len < 0) {
+		s->s_flags |= SBUF_OVERFLOWED;
+		return (-1);
+	}
+
+	error = sbuf_bcat(s, str, len);
 	free(str);
-	return ret;
+	return (error);
 }
 
-int sbuf_printf(struct sbuf *sb, const char *fmt, ...) {
+int
+sbuf_printf(struct sbuf *s, const char *fmt, ...)
+{
 	va_list ap;
+	int error;
+
 	va_start(ap, fmt);
-	int ret = sbuf_vprintf(sb, fmt, ap);
+	error = sbuf_vprintf(s, fmt, ap);
 	va_end(ap);
-	return ret;
+	return (error);
 }
 
-int sbuf_putc(struct sbuf *sb, int c) {
-	return sbuf_bcat(sb, &c, sizeof(int));
+int
+sbuf_putc(struct sbuf *s, int c)
+{
+
+	if (SBUF_HASOVERFLOWED(s))
+		return (-1);
+
+	if (SBUF_FREESPACE(s) == 0 &&
+	    (sbuf_reserve(s, 1) != 0 || SBUF_FREESPACE(s) == 0)) {
+		s->s_flags |= SBUF_OVERFLOWED;
+		return (-1);
+	}
+
+	s->s_buf[s->s_len++] = (char)c;
+	return (0);
 }
 
-int sbuf_trim(struct sbuf *sb) {
-	// Don't know what this does.
-	return 0;
+/* Strip trailing whitespace */
+int
+sbuf_trim(struct sbuf *s)
+{
+
+	if (SBUF_HASOVERFLOWED(s))
+		return (-1);
+
+	while (s->s_len > 0 && isspace((unsigned char)s->s_buf[s->s_len - 1]))
+		s->s_len--;
+
+	return (0);
 }
 
-int	sbuf_overflowed(struct sbuf *sb) {
-	// Don't know what this does.
-	return 0;
+int
+sbuf_overflowed(struct sbuf *s)
+{
+
+	return (SBUF_HASOVERFLOWED(s) != 0);
 }
 
-void sbuf_finish(struct sbuf *sb) {
-	// Don't know what this does.
+void
+sbuf_finish(struct sbuf *s)
+{
+
+	if (s->s_unused != NULL && !SBUF_HASOVERFLOWED(s))
+		sbuf_drain(s);
+
+	s->s_buf[s->s_len] = '\0';
+	s->s_flags |= SBUF_FINISHED;
 }
 
-char *sbuf_data(struct sbuf *sb) {
-	bzero(sb->s_buf + sb->s_len, sb->s_size - sb->s_len);
-	return sb->s_buf;
+char *
+sbuf_data(struct sbuf *s)
+{
+
+	s->s_buf[s->s_len] = '\0';
+	return (s->s_buf);
 }
 
-int	sbuf_len(struct sbuf *sb) {
-	return sb->s_len;
+int
+sbuf_len(struct sbuf *s)
+{
+
+	if (SBUF_HASOVERFLOWED(s))
+		return (-1);
+
+	return (s->s_len);
 }
 
-int sbuf_done(struct sbuf *sb) {
-	// Don't know what this does.
-	return 0;
+int
+sbuf_done(struct sbuf *s)
+{
+
+	return (SBUF_ISFINISHED(s) != 0);
 }
 
-void sbuf_delete(struct sbuf *sb) {
-	free(sb->s_buf);
-	free(sb);
+void
+sbuf_delete(struct sbuf *s)
+{
+	int isdyn;
+
+	if (SBUF_ISDYNAMIC(s))
+		free(s->s_buf);
+	free(s->s_unused);
+
+	isdyn = SBUF_ISDYNSTRUCT(s);
+	memset(s, 0, sizeof(*s));
+	if (isdyn)
+		free(s);
 }
@@ -109,6 +109,18 @@ void		*nvlist_pack(const nvlist_t *nvl, size_t *sizep);
 void		*nvlist_pack_buffer(const nvlist_t *nvl, void *buf, size_t *sizep);
 nvlist_t	*nvlist_unpack(const void *buf, size_t size);
 
+/*
+ * For callers that lay out a packed dictionary or array themselves: the
+ * list header, then per element an nvpair header with its name followed
+ * by the value, exactly as nvlist_pack() would produce them.
+ */
+size_t		 nvlist_pack_header_size(void);
+size_t		 nvpair_pack_header_size(const char *name);
+unsigned char	*nvlist_pack_raw_header(unsigned char *ptr, int type,
+		    size_t size);
+unsigned char	*nvpair_pack_raw_header(unsigned char *ptr, int type,
+		    const char *name, size_t datasize);
+
 int nvlist_send(int sock, const nvlist_t *nvl);
 nvlist_t *nvlist_recv(int sock);
 nvlist_t *nvlist_xfer(int sock, nvlist_t *nvl);
@@ -715,6 +715,38 @@ nvlist_pack_header(const nvlist_t *nvl, unsigned char *ptr, size_t *leftp)
 	return (ptr);
 }
 
+size_t
+nvlist_pack_header_size(void)
+{
+
+	return (sizeof(struct nvlist_header));
+}
+
+/*
+ * Write the header of a list of the given type without descriptors,
+ * whose packed form, header included, takes size bytes.
+ */
+unsigned char *
+nvlist_pack_raw_header(unsigned char *ptr, int type, size_t size)
+{
+	struct nvlist_header nvlhdr;
+
+	PJDLOG_ASSERT(size >= sizeof(nvlhdr));
+
+	nvlhdr.nvlh_magic = NVLIST_HEADER_MAGIC;
+	nvlhdr.nvlh_version = NVLIST_HEADER_VERSION;
+	nvlhdr.nvlh_flags = 0;
+	nvlhdr.nvlh_type = (uint8_t)type;
+#if BYTE_ORDER == BIG_ENDIAN
+	nvlhdr.nvlh_flags |= NV_FLAG_BIG_ENDIAN;
+#endif
+	nvlhdr.nvlh_descriptors = 0;
+	nvlhdr.nvlh_size = size - sizeof(nvlhdr);
+	memcpy(ptr, &nvlhdr, sizeof(nvlhdr));
+
+	return (ptr + sizeof(nvlhdr));
+}
+
 void *
 nvlist_xpack(const nvlist_t *nvl, void *ubuf, int64_t *fdidxp, size_t *sizep)
 {
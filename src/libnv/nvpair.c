@@ -236,6 +236,33 @@ nvpair_header_size(void)
 	return (sizeof(struct nvpair_header));
 }
 
+size_t
+nvpair_pack_header_size(const char *name)
+{
+
+	return (sizeof(struct nvpair_header) + strlen(name) + 1);
+}
+
+unsigned char *
+nvpair_pack_raw_header(unsigned char *ptr, int type, const char *name,
+    size_t datasize)
+{
+	struct nvpair_header nvphdr;
+	size_t namesize;
+
+	namesize = strlen(name) + 1;
+	PJDLOG_ASSERT(namesize <= UINT16_MAX);
+
+	nvphdr.nvph_type = (uint8_t)type;
+	nvphdr.nvph_namesize = (uint16_t)namesize;
+	nvphdr.nvph_datasize = datasize;
+	memcpy(ptr, &nvphdr, sizeof(nvphdr));
+	ptr += sizeof(nvphdr);
+	memcpy(ptr, name, namesize);
+
+	return (ptr + namesize);
+}
+
 size_t
 nvpair_size(const nvpair_t *nvp)
 {
@@ -48,6 +48,7 @@
 #include <sys/syscall.h>
 #include <dlfcn.h>
 #include <xpc/xpc.h>
+#include <xpc/private.h>
 #include "nv.h"
 
 extern void xpc_api_misuse(const char *reason, ...) __dead2;
@@ -364,10 +365,13 @@ launch_data_dict_remove(launch_data_t dict, const char *key)
 void
 launch_data_dict_iterate(launch_data_t dict, void (*cb)(launch_data_t, const char *, void *), void *context)
 {
-	xpc_dictionary_apply(dict, ^bool(const char *key, xpc_object_t value) {
+	xpc_dictionary_iter_t iter;
+	const char *key;
+	xpc_object_t value;
+
+	xpc_dictionary_iter_init(&iter, dict);
+	while (xpc_dictionary_iter_next(&iter, &key, &value))
 		cb(value, key, context);
-		return true;
-	});
 }
 
 bool
@@ -776,10 +780,14 @@ launch_msg_getmsgs(launch_data_t m, void *context)
 
 	launch_globals_t globals = _launch_globals();
 
+	/*
+	 * Nothing else holds on to a freshly received message, so take it
+	 * over rather than copying it.
+	 */
 	if ((LAUNCH_DATA_DICTIONARY == launch_data_get_type(m)) && (async_resp = launch_data_dict_lookup(m, LAUNCHD_ASYNC_MSG_KEY))) {
-		launch_data_array_set_index(globals->async_resp, launch_data_copy(async_resp), launch_data_array_get_count(globals->async_resp));
+		launch_data_array_set_index(globals->async_resp, xpc_retain(async_resp), launch_data_array_get_count(globals->async_resp));
 	} else {
-		*sync_resp = launch_data_copy(m);
+		*sync_resp = xpc_retain(m);
 	}
 }
 
@@ -1093,7 +1101,7 @@ out_bad:
 launch_data_t
 launch_data_copy(launch_data_t o)
 {
-	return xpc_retain(o);
+	return xpc_copy(o);
 }
 
 int
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <mach/mach.h>
 #include <xpc/launchd.h>
+#include <xpc/private.h>
 #include "xpc_internal.h"
 
 xpc_object_t
@@ -38,25 +39,71 @@ xpc_array_create(const xpc_object_t *objects, size_t count)
 	xpc_u val; bzero(&val, sizeof(val));
 
 	xo = _xpc_prim_create(XPC_TYPE_ARRAY, val, 0);
-	
+	xpc_array_reserve(xo, count);
+
 	for (i = 0; i < count; i++)
 		xpc_array_append_value(xo, objects[i]);
 
 	return (xo);
 }
 
+xpc_object_t
+xpc_array_create_with_capacity(size_t capacity)
+{
+	struct xpc_object *xo;
+	xpc_u val; bzero(&val, sizeof(val));
+
+	xo = _xpc_prim_create(XPC_TYPE_ARRAY, val, 0);
+	xpc_array_reserve(xo, capacity);
+	return (xo);
+}
+
+xpc_object_t
+xpc_array_create_adopt(xpc_object_t *values, size_t count)
+{
+	struct xpc_object *xo;
+	xpc_u val; bzero(&val, sizeof(val));
+
+	xo = _xpc_prim_create(XPC_TYPE_ARRAY, val, 0);
+	if (count == 0)
+		return (xo);
+
+	xpc_array_reserve(xo, count);
+	memcpy(xo->xo_array.xa_items, values, count * sizeof(xpc_object_t));
+	xo->xo_size = count;
+	return (xo);
+}
+
+/* Unlike xpc_array_grow(), size the vector exactly */
+void
+xpc_array_reserve(xpc_object_t xarray, size_t count)
+{
+	struct xpc_object *xo;
+	struct xpc_array_head *arr;
+
+	xo = xarray;
+	arr = &xo->xo_array;
+	if (count <= arr->xa_capacity)
+		return;
+
+	arr->xa_items = reallocf(arr->xa_items,
+	    count * sizeof(struct xpc_object *));
+	xpc_assert(arr->xa_items != NULL, "cannot grow array to %zu elements",
+	    count);
+	arr->xa_capacity = count;
+}
+
 void
 xpc_array_set_value(xpc_object_t xarray, size_t index, xpc_object_t value)
 {
-	struct xpc_object *xo, *xotmp, *xotmp2;
+	struct xpc_object *xo, *xotmp;
 	struct xpc_array_head *arr;
-	size_t i;
 
 	xo = xarray;
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_ARRAY);
+	xpc_assert_mutable(xo);
 	arr = &xo->xo_array;
-	i = 0;
 
 	if (index == XPC_ARRAY_APPEND)
 		return xpc_array_append_value(xarray, value);
@@ -64,16 +111,29 @@ xpc_array_set_value(xpc_object_t xarray, size_t index, xpc_object_t value)
 	if (index >= (size_t)xo->xo_size)
 		return;
 
-	TAILQ_FOREACH_SAFE(xotmp, arr, xo_link, xotmp2) {
-		if (i++ == index) {
-			TAILQ_INSERT_AFTER(arr, (struct xpc_object *)value,
-			    xotmp, xo_link);
-			TAILQ_REMOVE(arr, xotmp, xo_link);
-			xpc_retain(value);
-			free(xotmp);
-			break;
-		}
-	}
+	xpc_hash_invalidate(xo);
+	xotmp = arr->xa_items[index];
+	arr->xa_items[index] = xpc_retain(value);
+	xpc_release(xotmp);
+}
+
+static void
+xpc_array_grow(struct xpc_array_head *arr, size_t count)
+{
+	size_t capacity;
+
+	if (count <= arr->xa_capacity)
+		return;
+
+	capacity = arr->xa_capacity ? arr->xa_capacity : 4;
+	while (capacity < count)
+		capacity *= 2;
+
+	arr->xa_items = reallocf(arr->xa_items,
+	    capacity * sizeof(struct xpc_object *));
+	xpc_assert(arr->xa_items != NULL, "cannot grow array to %zu elements",
+	    capacity);
+	arr->xa_capacity = capacity;
 }
 	
 void
@@ -85,35 +145,28 @@ xpc_array_append_value(xpc_object_t xarray, xpc_object_t value)
 	xo = xarray;
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_ARRAY);
+	xpc_assert_mutable(xo);
 	arr = &xo->xo_array;
 
-	TAILQ_INSERT_TAIL(arr, (struct xpc_object *)value, xo_link);
-	xpc_retain(value);
+	xpc_hash_invalidate(xo);
+	xpc_array_grow(arr, xo->xo_size + 1);
+	arr->xa_items[xo->xo_size++] = xpc_retain(value);
 }
 
 
 xpc_object_t
 xpc_array_get_value(xpc_object_t xarray, size_t index)
 {
-	struct xpc_object *xo, *xotmp;
-	struct xpc_array_head *arr;
-	size_t i;
+	struct xpc_object *xo;
 
 	xo = xarray;
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_ARRAY);
-	arr = &xo->xo_array;
-	i = 0;
 
-	if (index > xo->xo_size)
+	if (index >= xo->xo_size)
 		return (NULL);
-	
-	TAILQ_FOREACH(xotmp, arr, xo_link) {
-		if (i++ == index)
-			return (xotmp);
-	}
 
-	return (NULL);
+	return (xo->xo_array.xa_items[index]);
 }
 
 size_t
@@ -321,16 +374,34 @@ xpc_array_get_connection(xpc_object_t array, size_t index)
 bool
 xpc_array_apply(xpc_object_t xarray, xpc_array_applier_t applier)
 {
-	struct xpc_object *xo, *xotmp;
-	struct xpc_array_head *arr;
+	struct xpc_object *xo;
 	size_t i;
 
-	i = 0;
 	xo = xarray;
-	arr = &xo->xo_array;
+	xpc_assert_nonnull(xo);
+	xpc_assert_type(xo, XPC_TYPE_ARRAY);
+
+	for (i = 0; i < xo->xo_size; i++) {
+		if (!applier(i, xo->xo_array.xa_items[i]))
+			return (false);
+	}
+
+	return (true);
+}
+
+bool
+xpc_array_apply_f(xpc_object_t xarray, void *context,
+    xpc_array_applier_f applier)
+{
+	struct xpc_object *xo;
+	size_t i;
+
+	xo = xarray;
+	xpc_assert_nonnull(xo);
+	xpc_assert_type(xo, XPC_TYPE_ARRAY);
 
-	TAILQ_FOREACH(xotmp, arr, xo_link) {
-		if (!applier(i++, xotmp))
+	for (i = 0; i < xo->xo_size; i++) {
+		if (!applier(context, i, xo->xo_array.xa_items[i]))
 			return (false);
 	}
 
@@ -0,0 +1,996 @@
+/*
+ * Copyright 2020 PureDarwin Project
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+#include "xpc_internal.h"
+
+/*
+ * Binary property lists, version 00: an 8 byte magic, the objects, an
+ * offset table with the position of every object, and a 32 byte trailer
+ * that gives the width of offsets and object references, the number of
+ * objects, the top-level object and where the offset table starts.
+ * Multi-byte integers are big-endian throughout.
+ */
+
+#define	BPLIST_MAGIC		"bplist00"
+#define	BPLIST_MAGIC_LEN	8
+#define	BPLIST_TRAILER_LEN	32
+#define	BPLIST_MAX_DEPTH	512
+
+/*
+ * Objects are decoded anew at every reference, so a small file could
+ * describe an enormous tree (each array holding the next one twice doubles
+ * it with every level). The reader gives up once it has decoded
+ * BPLIST_EXPANSION times as many objects as the file has objects and
+ * references, or BPLIST_EXPANSION times the file size (but at least
+ * BPLIST_MIN_BYTES) in strings and data.
+ */
+#define	BPLIST_EXPANSION	4
+#define	BPLIST_MIN_BYTES	(16 << 20)
+
+/* Dates count seconds from 2001-01-01, xpc dates nanoseconds from 1970 */
+#define	BPLIST_EPOCH_DELTA	978307200LL
+
+#define	BPLIST_NULL		0x00
+#define	BPLIST_FALSE		0x08
+#define	BPLIST_TRUE		0x09
+#define	BPLIST_INT		0x10
+#define	BPLIST_REAL		0x20
+#define	BPLIST_DATE		0x33
+#define	BPLIST_DATA		0x40
+#define	BPLIST_ASCII		0x50
+#define	BPLIST_UTF16		0x60
+#define	BPLIST_ARRAY		0xa0
+#define	BPLIST_DICT		0xd0
+
+static uint64_t
+bplist_get_be(const uint8_t *p, size_t width)
+{
+	uint64_t v;
+	size_t i;
+
+	v = 0;
+	for (i = 0; i < width; i++)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static void
+bplist_put_be(uint8_t *p, uint64_t v, size_t width)
+{
+
+	while (width-- > 0) {
+		p[width] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+/* Bytes needed to store values up to max */
+static size_t
+bplist_width(uint64_t max)
+{
+
+	if (max <= UINT8_MAX)
+		return (1);
+	if (max <= UINT16_MAX)
+		return (2);
+	if (max <= UINT32_MAX)
+		return (4);
+	return (8);
+}
+
+#pragma mark Reader
+
+struct bplist_reader {
+	const uint8_t *		br_data;
+	size_t			br_size;
+	const uint8_t *		br_offsets;
+	size_t			br_offset_width;
+	size_t			br_ref_width;
+	uint64_t		br_count;
+	uint64_t		br_table;	/* start of the offset table */
+	uint8_t *		br_busy;	/* containers being read */
+	uint64_t		br_objects_left;
+	uint64_t		br_bytes_left;
+	char *			br_text;
+	size_t			br_textcap;
+};
+
+static xpc_object_t bplist_read_object(struct bplist_reader *r, uint64_t ref,
+    int depth);
+
+/* Charges one decoded object of len payload bytes against the budget */
+static bool
+bplist_spend(struct bplist_reader *r, uint64_t len)
+{
+
+	if (r->br_objects_left == 0 || len > r->br_bytes_left)
+		return (false);
+
+	r->br_objects_left--;
+	r->br_bytes_left -= len;
+	return (true);
+}
+
+/* Locate an object by reference; the caller bounds-checks its payload */
+static const uint8_t *
+bplist_object(struct bplist_reader *r, uint64_t ref)
+{
+	uint64_t offset;
+
+	if (ref >= r->br_count)
+		return (NULL);
+
+	offset = bplist_get_be(r->br_offsets + ref * r->br_offset_width,
+	    r->br_offset_width);
+	if (offset < BPLIST_MAGIC_LEN || offset >= r->br_table)
+		return (NULL);
+
+	return (r->br_data + offset);
+}
+
+static bool
+bplist_has(struct bplist_reader *r, const uint8_t *p, uint64_t len)
+{
+
+	return (p <= r->br_data + r->br_table &&
+	    len <= (uint64_t)(r->br_data + r->br_table - p));
+}
+
+/*
+ * The low nibble of a marker is a count, unless it is 0xf, in which case
+ * an integer object with the count follows.
+ */
+static bool
+bplist_read_count(struct bplist_reader *r, const uint8_t **pp, uint64_t *countp)
+{
+	const uint8_t *p;
+	size_t width;
+
+	p = *pp;
+	if ((*p & 0x0f) != 0x0f) {
+		*countp = *p & 0x0f;
+		*pp = p + 1;
+		return (true);
+	}
+
+	p++;
+	if (!bplist_has(r, p, 1) || (*p & 0xf0) != BPLIST_INT ||
+	    (*p & 0x0f) > 3)
+		return (false);
+
+	width = (size_t)1 << (*p & 0x0f);
+	if (!bplist_has(r, p + 1, width))
+		return (false);
+
+	*countp = bplist_get_be(p + 1, width);
+	*pp = p + 1 + width;
+	return (true);
+}
+
+static bool
+bplist_text_reserve(struct bplist_reader *r, size_t len)
+{
+	char *text;
+
+	if (len <= r->br_textcap)
+		return (true);
+
+	text = realloc(r->br_text, len);
+	if (text == NULL)
+		return (false);
+
+	r->br_text = text;
+	r->br_textcap = len;
+	return (true);
+}
+
+/* Decode an ASCII or UTF-16 string object into br_text as UTF-8 */
+static const char *
+bplist_read_string(struct bplist_reader *r, uint64_t ref)
+{
+	const uint8_t *p;
+	uint64_t count, i;
+	uint32_t c, c2;
+	char *out;
+	uint8_t marker;
+
+	if ((p = bplist_object(r, ref)) == NULL)
+		return (NULL);
+
+	marker = *p & 0xf0;
+	if ((marker != BPLIST_ASCII && marker != BPLIST_UTF16) ||
+	    !bplist_read_count(r, &p, &count) || !bplist_spend(r, count))
+		return (NULL);
+
+	if (marker == BPLIST_ASCII) {
+		if (!bplist_has(r, p, count) || memchr(p, '\0', count) != NULL ||
+		    !bplist_text_reserve(r, count + 1))
+			return (NULL);
+		memcpy(r->br_text, p, count);
+		r->br_text[count] = '\0';
+		return (r->br_text);
+	}
+
+	if (count > SIZE_MAX / 6 || !bplist_has(r, p, count * 2) ||
+	    !bplist_text_reserve(r, count * 3 + 1))
+		return (NULL);
+
+	out = r->br_text;
+	for (i = 0; i < count; i++) {
+		c = (uint32_t)bplist_get_be(p + i * 2, 2);
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < count) {
+			c2 = (uint32_t)bplist_get_be(p + (i + 1) * 2, 2);
+			if (c2 >= 0xdc00 && c2 < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+				i++;
+			}
+		}
+
+		if (c == 0)
+			return (NULL);
+		if (c < 0x80)
+			*out++ = (char)c;
+		else if (c < 0x800) {
+			*out++ = (char)(0xc0 | (c >> 6));
+			*out++ = (char)(0x80 | (c & 0x3f));
+		} else if (c < 0x10000) {
+			*out++ = (char)(0xe0 | (c >> 12));
+			*out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+			*out++ = (char)(0x80 | (c & 0x3f));
+		} else {
+			*out++ = (char)(0xf0 | (c >> 18));
+			*out++ = (char)(0x80 | ((c >> 12) & 0x3f));
+			*out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+			*out++ = (char)(0x80 | (c & 0x3f));
+		}
+	}
+
+	*out = '\0';
+	return (r->br_text);
+}
+
+static xpc_object_t
+bplist_read_container(struct bplist_reader *r, uint64_t ref,
+    const uint8_t *p, int depth)
+{
+	xpc_object_t result, value;
+	const uint8_t *refs;
+	const char *key;
+	uint64_t count, i;
+	bool dict;
+
+	dict = (*p & 0xf0) == BPLIST_DICT;
+	if (!bplist_read_count(r, &p, &count))
+		return (NULL);
+
+	refs = p;
+	if (count > SIZE_MAX / (2 * r->br_ref_width) ||
+	    !bplist_has(r, refs, count * r->br_ref_width * (dict ? 2 : 1)))
+		return (NULL);
+
+	/* A container that contains itself */
+	if (r->br_busy[ref / 8] & (1 << (ref % 8)))
+		return (NULL);
+	r->br_busy[ref / 8] |= 1 << (ref % 8);
+
+	if (dict)
+		result = xpc_dictionary_create_with_capacity((size_t)count);
+	else
+		result = xpc_array_create_with_capacity((size_t)count);
+
+	for (i = 0; i < count; i++) {
+		value = bplist_read_object(r, bplist_get_be(refs +
+		    (dict ? count + i : i) * r->br_ref_width, r->br_ref_width),
+		    depth + 1);
+		if (value == NULL)
+			goto fail;
+
+		if (!dict) {
+			xpc_array_append_value(result, value);
+			xpc_release(value);
+			continue;
+		}
+
+		key = bplist_read_string(r, bplist_get_be(refs +
+		    i * r->br_ref_width, r->br_ref_width));
+		if (key == NULL || strncmp(key, XPC_RESERVED_KEY_PREFIX,
+		    strlen(XPC_RESERVED_KEY_PREFIX)) == 0) {
+			xpc_release(value);
+			goto fail;
+		}
+
+		xpc_dictionary_set_value(result, key, value);
+		xpc_release(value);
+	}
+
+	r->br_busy[ref / 8] &= ~(1 << (ref % 8));
+	return (result);
+
+fail:
+	r->br_busy[ref / 8] &= ~(1 << (ref % 8));
+	xpc_release(result);
+	return (NULL);
+}
+
+static xpc_object_t
+bplist_read_object(struct bplist_reader *r, uint64_t ref, int depth)
+{
+	const uint8_t *p;
+	uint64_t count, u;
+	union {
+		uint64_t u;
+		uint32_t u32;
+		double d;
+		float f;
+	} real;
+	double secs;
+	size_t width;
+
+	if (depth > BPLIST_MAX_DEPTH || (p = bplist_object(r, ref)) == NULL ||
+	    !bplist_spend(r, 0))
+		return (NULL);
+
+	switch (*p & 0xf0) {
+	case 0x00:
+		if (*p == BPLIST_NULL)
+			return (xpc_null_create());
+		if (*p == BPLIST_FALSE || *p == BPLIST_TRUE)
+			return (xpc_bool_create(*p == BPLIST_TRUE));
+		return (NULL);
+
+	case BPLIST_INT:
+		width = (size_t)1 << (*p & 0x0f);
+		if (width > 16 || !bplist_has(r, p + 1, width))
+			return (NULL);
+
+		/* 128-bit integers carry unsigned values above INT64_MAX */
+		if (width == 16) {
+			if (bplist_get_be(p + 1, 8) != 0)
+				return (NULL);
+			u = bplist_get_be(p + 9, 8);
+			if (u > INT64_MAX)
+				return (xpc_uint64_create(u));
+			return (xpc_int64_create((int64_t)u));
+		}
+		return (xpc_int64_create((int64_t)bplist_get_be(p + 1, width)));
+
+	case BPLIST_REAL:
+		width = (size_t)1 << (*p & 0x0f);
+		if ((width != 4 && width != 8) || !bplist_has(r, p + 1, width))
+			return (NULL);
+		if (width == 4) {
+			real.u32 = (uint32_t)bplist_get_be(p + 1, 4);
+			return (xpc_double_create(real.f));
+		}
+		real.u = bplist_get_be(p + 1, 8);
+		return (xpc_double_create(real.d));
+
+	case 0x30:
+		if (*p != BPLIST_DATE || !bplist_has(r, p + 1, 8))
+			return (NULL);
+		real.u = bplist_get_be(p + 1, 8);
+		secs = real.d + BPLIST_EPOCH_DELTA;
+		if (!(fabs(secs) < (double)INT64_MAX / NSEC_PER_SEC))
+			return (NULL);
+		return (xpc_date_create((int64_t)(secs * NSEC_PER_SEC)));
+
+	case BPLIST_DATA:
+		if (!bplist_read_count(r, &p, &count) ||
+		    !bplist_has(r, p, count) || !bplist_spend(r, count))
+			return (NULL);
+		return (xpc_data_create(p, (size_t)count));
+
+	case BPLIST_ASCII:
+	case BPLIST_UTF16:
+		if (bplist_read_string(r, ref) == NULL)
+			return (NULL);
+		return (xpc_string_create(r->br_text));
+
+	case BPLIST_ARRAY:
+	case BPLIST_DICT:
+		return (bplist_read_container(r, ref, p, depth));
+
+	default:
+		return (NULL);
+	}
+}
+
+xpc_object_t
+xpc_create_from_bplist(const void *data, size_t size)
+{
+	struct bplist_reader r;
+	const uint8_t *trailer;
+	xpc_object_t result;
+	uint64_t top;
+
+	memset(&r, 0, sizeof(r));
+	r.br_data = data;
+	r.br_size = size;
+
+	if (size < BPLIST_MAGIC_LEN + BPLIST_TRAILER_LEN ||
+	    memcmp(data, BPLIST_MAGIC, BPLIST_MAGIC_LEN) != 0)
+		goto invalid;
+
+	trailer = r.br_data + size - BPLIST_TRAILER_LEN;
+	r.br_offset_width = trailer[6];
+	r.br_ref_width = trailer[7];
+	r.br_count = bplist_get_be(trailer + 8, 8);
+	top = bplist_get_be(trailer + 16, 8);
+	r.br_table = bplist_get_be(trailer + 24, 8);
+
+	if (r.br_offset_width < 1 || r.br_offset_width > 8 ||
+	    r.br_ref_width < 1 || r.br_ref_width > 8 || r.br_count == 0 ||
+	    top >= r.br_count || r.br_table < BPLIST_MAGIC_LEN ||
+	    r.br_table > size - BPLIST_TRAILER_LEN ||
+	    r.br_count > (size - BPLIST_TRAILER_LEN - r.br_table) /
+	    r.br_offset_width)
+		goto invalid;
+
+	r.br_offsets = r.br_data + r.br_table;
+	r.br_objects_left = BPLIST_EXPANSION * (r.br_count +
+	    (r.br_table - BPLIST_MAGIC_LEN) / r.br_ref_width);
+	r.br_bytes_left = BPLIST_EXPANSION * (uint64_t)size;
+	if (r.br_bytes_left < BPLIST_MIN_BYTES)
+		r.br_bytes_left = BPLIST_MIN_BYTES;
+	r.br_busy = calloc((size_t)(r.br_count + 7) / 8, 1);
+	if (r.br_busy == NULL)
+		return (NULL);
+
+	result = bplist_read_object(&r, top, 0);
+	free(r.br_busy);
+	free(r.br_text);
+	if (result == NULL)
+		goto invalid;
+
+	return (result);
+
+invalid:
+	debugf("malformed binary property list");
+	errno = EINVAL;
+	return (NULL);
+}
+
+#pragma mark Writer
+
+/*
+ * The writer flattens the object graph first: every container and every
+ * distinct leaf gets an object number. Leaves are encoded right away and
+ * identical encodings (repeated keys, mostly) share one object, found
+ * through a hash table over the encoded bytes. Containers keep their
+ * children's numbers in bw_refs until the number of objects, and so the
+ * width of a reference, is known.
+ */
+
+struct bplist_entry {
+	bool			be_container;
+	uint8_t			be_marker;
+	size_t			be_start;	/* in bw_leaves or bw_refs */
+	size_t			be_count;
+};
+
+struct bplist_writer {
+	struct bplist_entry *	bw_objects;
+	size_t			bw_count;
+	size_t			bw_capacity;
+	uint8_t *		bw_leaves;
+	size_t			bw_leaves_len;
+	size_t			bw_leaves_cap;
+	uint64_t *		bw_refs;
+	size_t			bw_refs_len;
+	size_t			bw_refs_cap;
+	size_t *		bw_buckets;	/* object number + 1, 0 if free */
+	size_t			bw_nbuckets;
+	bool			bw_failed;
+};
+
+static void *
+bplist_grow(void *p, size_t *capp, size_t need, size_t elsize)
+{
+	size_t cap;
+
+	if (need <= *capp)
+		return (p);
+
+	cap = *capp ? *capp : 64;
+	while (cap < need)
+		cap *= 2;
+
+	p = reallocf(p, cap * elsize);
+	*capp = p != NULL ? cap : 0;
+	return (p);
+}
+
+static size_t
+bplist_new_object(struct bplist_writer *w)
+{
+
+	w->bw_objects = bplist_grow(w->bw_objects, &w->bw_capacity,
+	    w->bw_count + 1, sizeof(*w->bw_objects));
+	if (w->bw_objects == NULL) {
+		w->bw_failed = true;
+		w->bw_count = 0;
+		return (0);
+	}
+
+	return (w->bw_count++);
+}
+
+static bool
+bplist_rehash(struct bplist_writer *w)
+{
+	const struct bplist_entry *e;
+	size_t *buckets, nbuckets, i, b;
+
+	nbuckets = w->bw_nbuckets ? w->bw_nbuckets * 2 : 256;
+	buckets = calloc(nbuckets, sizeof(*buckets));
+	if (buckets == NULL)
+		return (false);
+
+	for (i = 0; i < w->bw_count; i++) {
+		e = &w->bw_objects[i];
+		if (e->be_container)
+			continue;
+		b = xpc_data_hash(w->bw_leaves + e->be_start, e->be_count, 0) &
+		    (nbuckets - 1);
+		while (buckets[b] != 0)
+			b = (b + 1) & (nbuckets - 1);
+		buckets[b] = i + 1;
+	}
+
+	free(w->bw_buckets);
+	w->bw_buckets = buckets;
+	w->bw_nbuckets = nbuckets;
+	return (true);
+}
+
+/* Add an encoded leaf, or find an identical one */
+static size_t
+bplist_add_leaf(struct bplist_writer *w, const uint8_t *bytes, size_t len)
+{
+	struct bplist_entry *e;
+	size_t b, n;
+
+	if (w->bw_failed)
+		return (0);
+
+	/* Keep the table at most half full */
+	if (w->bw_count * 2 >= w->bw_nbuckets && !bplist_rehash(w)) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	b = xpc_data_hash(bytes, len, 0) & (w->bw_nbuckets - 1);
+	while ((n = w->bw_buckets[b]) != 0) {
+		e = &w->bw_objects[n - 1];
+		if (!e->be_container && e->be_count == len &&
+		    memcmp(w->bw_leaves + e->be_start, bytes, len) == 0)
+			return (n - 1);
+		b = (b + 1) & (w->bw_nbuckets - 1);
+	}
+
+	w->bw_leaves = bplist_grow(w->bw_leaves, &w->bw_leaves_cap,
+	    w->bw_leaves_len + len, 1);
+	n = bplist_new_object(w);
+	if (w->bw_leaves == NULL || w->bw_failed) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	memcpy(w->bw_leaves + w->bw_leaves_len, bytes, len);
+	e = &w->bw_objects[n];
+	e->be_container = false;
+	e->be_start = w->bw_leaves_len;
+	e->be_count = len;
+	w->bw_leaves_len += len;
+	w->bw_buckets[b] = n + 1;
+	return (n);
+}
+
+/* Marker with a count, extended by an integer object when it is large */
+static size_t
+bplist_put_marker(uint8_t *buf, uint8_t marker, uint64_t count)
+{
+	size_t width;
+
+	if (count < 0x0f) {
+		buf[0] = marker | (uint8_t)count;
+		return (1);
+	}
+
+	width = bplist_width(count);
+	buf[0] = marker | 0x0f;
+	buf[1] = BPLIST_INT | (uint8_t)(width == 8 ? 3 : width / 2);
+	bplist_put_be(buf + 2, count, width);
+	return (2 + width);
+}
+
+static size_t
+bplist_add_bytes(struct bplist_writer *w, uint8_t marker, const void *bytes,
+    size_t len, size_t count)
+{
+	uint8_t *buf;
+	size_t n, hlen;
+
+	buf = malloc(len + 11);
+	if (buf == NULL) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	hlen = bplist_put_marker(buf, marker, count);
+	memcpy(buf + hlen, bytes, len);
+	n = bplist_add_leaf(w, buf, hlen + len);
+	free(buf);
+	return (n);
+}
+
+static size_t
+bplist_add_string(struct bplist_writer *w, const char *str, size_t len)
+{
+	const uint8_t *s;
+	uint8_t *utf16;
+	uint32_t c;
+	size_t i, n, units;
+
+	for (i = 0; i < len; i++)
+		if ((uint8_t)str[i] >= 0x80)
+			break;
+	if (i == len)
+		return (bplist_add_bytes(w, BPLIST_ASCII, str, len, len));
+
+	/* Anything else is stored as UTF-16 */
+	utf16 = malloc(len * 2);
+	if (utf16 == NULL) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	s = (const uint8_t *)str;
+	units = 0;
+	for (i = 0; i < len; ) {
+		if (s[i] < 0x80)
+			c = s[i++];
+		else if ((s[i] & 0xe0) == 0xc0 && i + 1 < len) {
+			c = ((s[i] & 0x1f) << 6) | (s[i + 1] & 0x3f);
+			i += 2;
+		} else if ((s[i] & 0xf0) == 0xe0 && i + 2 < len) {
+			c = ((s[i] & 0x0f) << 12) | ((s[i + 1] & 0x3f) << 6) |
+			    (s[i + 2] & 0x3f);
+			i += 3;
+		} else if ((s[i] & 0xf8) == 0xf0 && i + 3 < len) {
+			c = ((s[i] & 0x07) << 18) | ((s[i + 1] & 0x3f) << 12) |
+			    ((s[i + 2] & 0x3f) << 6) | (s[i + 3] & 0x3f);
+			i += 4;
+		} else {
+			free(utf16);
+			w->bw_failed = true;
+			return (0);
+		}
+
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			bplist_put_be(utf16 + units++ * 2, 0xd800 + (c >> 10), 2);
+			c = 0xdc00 + (c & 0x3ff);
+		}
+		bplist_put_be(utf16 + units++ * 2, c, 2);
+	}
+
+	n = bplist_add_bytes(w, BPLIST_UTF16, utf16, units * 2, units);
+	free(utf16);
+	return (n);
+}
+
+static size_t
+bplist_add_int(struct bplist_writer *w, int64_t v)
+{
+	uint8_t buf[9];
+	size_t width;
+
+	width = v < 0 ? 8 : bplist_width((uint64_t)v);
+	buf[0] = BPLIST_INT | (uint8_t)(width == 8 ? 3 : width / 2);
+	bplist_put_be(buf + 1, (uint64_t)v, width);
+	return (bplist_add_leaf(w, buf, 1 + width));
+}
+
+static size_t
+bplist_add_object(struct bplist_writer *w, struct xpc_object *xo, int depth);
+
+static size_t
+bplist_add_container(struct bplist_writer *w, struct xpc_object *xo, int depth)
+{
+	struct xpc_dict_pair *pair;
+	struct bplist_entry *e;
+	size_t n, start, count, i, ref;
+
+	n = bplist_new_object(w);
+	if (w->bw_failed)
+		return (0);
+	w->bw_objects[n].be_container = true;
+
+	/* Reserve our references, then fill them in as children are added */
+	count = xo->xo_size;
+	start = w->bw_refs_len;
+	w->bw_refs_len += xo->xo_xpc_type == XPC_TYPE_DICTIONARY ?
+	    count * 2 : count;
+	w->bw_refs = bplist_grow(w->bw_refs, &w->bw_refs_cap, w->bw_refs_len,
+	    sizeof(*w->bw_refs));
+	if (w->bw_refs == NULL) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
+		for (i = 0; i < count; i++) {
+			ref = bplist_add_object(w, xo->xo_array.xa_items[i],
+			    depth + 1);
+			w->bw_refs[start + i] = ref;
+		}
+	} else {
+		i = 0;
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link) {
+			ref = bplist_add_string(w, pair->key, strlen(pair->key));
+			w->bw_refs[start + i] = ref;
+			ref = bplist_add_object(w, pair->value, depth + 1);
+			w->bw_refs[start + count + i] = ref;
+			i++;
+		}
+	}
+
+	if (w->bw_failed)
+		return (0);
+
+	e = &w->bw_objects[n];
+	e->be_marker = xo->xo_xpc_type == XPC_TYPE_ARRAY ? BPLIST_ARRAY :
+	    BPLIST_DICT;
+	e->be_start = start;
+	e->be_count = count;
+	return (n);
+}
+
+static size_t
+bplist_add_object(struct bplist_writer *w, struct xpc_object *xo, int depth)
+{
+	xpc_type_t type;
+	uint8_t buf[17];
+	union {
+		uint64_t u;
+		double d;
+	} real;
+
+	if (w->bw_failed)
+		return (0);
+
+	if (depth > BPLIST_MAX_DEPTH) {
+		w->bw_failed = true;
+		return (0);
+	}
+
+	type = xo->xo_xpc_type;
+	if (type == XPC_TYPE_DICTIONARY || type == XPC_TYPE_ARRAY)
+		return (bplist_add_container(w, xo, depth));
+
+	if (type == XPC_TYPE_STRING)
+		return (bplist_add_string(w, xo->xo_str, xo->xo_size));
+
+	if (type == XPC_TYPE_BOOL) {
+		buf[0] = xo->xo_bool ? BPLIST_TRUE : BPLIST_FALSE;
+		return (bplist_add_leaf(w, buf, 1));
+	}
+
+	if (type == XPC_TYPE_NULL) {
+		buf[0] = BPLIST_NULL;
+		return (bplist_add_leaf(w, buf, 1));
+	}
+
+	if (type == XPC_TYPE_INT64)
+		return (bplist_add_int(w, xo->xo_int));
+
+	if (type == XPC_TYPE_UINT64) {
+		if (xo->xo_uint <= INT64_MAX)
+			return (bplist_add_int(w, (int64_t)xo->xo_uint));
+
+		buf[0] = BPLIST_INT | 4;
+		bplist_put_be(buf + 1, 0, 8);
+		bplist_put_be(buf + 9, xo->xo_uint, 8);
+		return (bplist_add_leaf(w, buf, 17));
+	}
+
+	if (type == XPC_TYPE_DOUBLE) {
+		real.d = xo->xo_d;
+		buf[0] = BPLIST_REAL | 3;
+		bplist_put_be(buf + 1, real.u, 8);
+		return (bplist_add_leaf(w, buf, 9));
+	}
+
+	if (type == XPC_TYPE_DATE) {
+		real.d = (double)xo->xo_int / NSEC_PER_SEC - BPLIST_EPOCH_DELTA;
+		buf[0] = BPLIST_DATE;
+		bplist_put_be(buf + 1, real.u, 8);
+		return (bplist_add_leaf(w, buf, 9));
+	}
+
+	if (type == XPC_TYPE_DATA)
+		return (bplist_add_bytes(w, BPLIST_DATA,
+		    (const void *)xo->xo_ptr, xo->xo_size, xo->xo_size));
+
+	/* Property lists have no UUIDs; store the bytes */
+	if (type == XPC_TYPE_UUID)
+		return (bplist_add_bytes(w, BPLIST_DATA, xo->xo_uuid,
+		    sizeof(uuid_t), sizeof(uuid_t)));
+
+	w->bw_failed = true;
+	return (0);
+}
+
+static void
+bplist_writer_free(struct bplist_writer *w)
+{
+
+	free(w->bw_objects);
+	free(w->bw_leaves);
+	free(w->bw_refs);
+	free(w->bw_buckets);
+}
+
+void *
+xpc_bplist_create(xpc_object_t object, size_t *sizep)
+{
+	struct bplist_writer w;
+	const struct bplist_entry *e;
+	uint8_t *buf, *p, *trailer;
+	size_t ref_width, offset_width, size, i, j, top;
+	uint64_t table;
+
+	xpc_assert_nonnull(object);
+
+	memset(&w, 0, sizeof(w));
+	top = bplist_add_object(&w, object, 0);
+	if (w.bw_failed) {
+		bplist_writer_free(&w);
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	/* Size the objects to learn how wide the offsets have to be */
+	ref_width = bplist_width(w.bw_count - 1);
+	table = BPLIST_MAGIC_LEN + w.bw_leaves_len;
+	for (i = 0; i < w.bw_count; i++) {
+		e = &w.bw_objects[i];
+		if (e->be_container)
+			table += (e->be_count < 0x0f ? 1 :
+			    2 + bplist_width(e->be_count)) + ref_width *
+			    e->be_count * (e->be_marker == BPLIST_DICT ? 2 : 1);
+	}
+
+	offset_width = bplist_width(table);
+	size = table + w.bw_count * offset_width + BPLIST_TRAILER_LEN;
+	buf = malloc(size);
+	if (buf == NULL) {
+		bplist_writer_free(&w);
+		return (NULL);
+	}
+
+	memcpy(buf, BPLIST_MAGIC, BPLIST_MAGIC_LEN);
+	p = buf + BPLIST_MAGIC_LEN;
+	for (i = 0; i < w.bw_count; i++) {
+		e = &w.bw_objects[i];
+		bplist_put_be(buf + table + i * offset_width, p - buf,
+		    offset_width);
+
+		if (!e->be_container) {
+			memcpy(p, w.bw_leaves + e->be_start, e->be_count);
+			p += e->be_count;
+			continue;
+		}
+
+		p += bplist_put_marker(p, e->be_marker, e->be_count);
+		for (j = 0; j < e->be_count *
+		    (e->be_marker == BPLIST_DICT ? 2 : 1); j++) {
+			bplist_put_be(p, w.bw_refs[e->be_start + j], ref_width);
+			p += ref_width;
+		}
+	}
+
+	xpc_assert(p == buf + table, "binary plist size mismatch");
+
+	trailer = buf + size - BPLIST_TRAILER_LEN;
+	memset(trailer, 0, BPLIST_TRAILER_LEN);
+	trailer[6] = (uint8_t)offset_width;
+	trailer[7] = (uint8_t)ref_width;
+	bplist_put_be(trailer + 8, w.bw_count, 8);
+	bplist_put_be(trailer + 16, top, 8);
+	bplist_put_be(trailer + 24, table, 8);
+
+	bplist_writer_free(&w);
+	*sizep = size;
+	return (buf);
+}
+
+/* Replaces path atomically, by writing a temporary file and renaming it */
+int
+xpc_bplist_write_file(xpc_object_t object, const char *path)
+{
+	char tmp[PATH_MAX];
+	void *buf;
+	size_t size, off;
+	ssize_t n;
+	int fd, error;
+
+	if ((buf = xpc_bplist_create(object, &size)) == NULL)
+		return (errno);
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp)) {
+		free(buf);
+		return (ENAMETOOLONG);
+	}
+
+	if ((fd = mkstemp(tmp)) == -1) {
+		error = errno;
+		free(buf);
+		return (error);
+	}
+
+	error = 0;
+	for (off = 0; off < size; off += n) {
+		n = write(fd, (const uint8_t *)buf + off, size - off);
+		if (n == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			error = errno;
+			break;
+		}
+	}
+
+	free(buf);
+	if (error == 0 && fchmod(fd, 0644) == -1)
+		error = errno;
+	/* On disk before the rename, or a crash could leave path empty */
+	if (error == 0 && fsync(fd) == -1)
+		error = errno;
+	if (close(fd) == -1 && error == 0)
+		error = errno;
+	if (error == 0 && rename(tmp, path) == -1)
+		error = errno;
+	if (error != 0)
+		(void)unlink(tmp);
+
+	return (error);
+}
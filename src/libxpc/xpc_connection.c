@@ -26,9 +26,12 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <servers/bootstrap.h>
 #include <xpc/xpc.h>
+#include <xpc/private.h>
 #include <stdatomic.h>
 #include <bsm/libbsm.h>
 #include <Block.h>
@@ -39,6 +42,34 @@
 
 static void xpc_connection_recv_message(void *);
 static void xpc_send(xpc_connection_t xconn, xpc_object_t message, uint64_t id);
+static size_t xpc_message_size(struct xpc_object *xo);
+static int xpc_flow_enqueue(struct xpc_connection *conn, size_t size, bool wait);
+static void xpc_flow_dequeue(struct xpc_connection *conn, size_t size);
+static void xpc_connection_invoke(struct xpc_connection *conn,
+    xpc_handler_t handler, xpc_object_t obj);
+static void xpc_timer_wheel_insert(struct xpc_connection *conn,
+    struct xpc_pending_call *call, uint64_t timeout);
+static void xpc_timer_wheel_tick(void *context);
+static bool xpc_timer_wheel_forget(struct xpc_connection *conn, uint64_t id);
+static void xpc_pending_call_remove(struct xpc_connection *conn,
+    struct xpc_pending_call *call);
+static void xpc_pending_call_complete(struct xpc_connection *conn,
+    struct xpc_pending_call *call, xpc_object_t result);
+static void xpc_connection_fail_all(struct xpc_connection *conn,
+    xpc_object_t error);
+static void xpc_connection_peer_died(void *context);
+static void xpc_lanes_init(struct xpc_lanes *lanes);
+static bool xpc_lanes_push(struct xpc_lanes *lanes, unsigned int lane,
+    struct xpc_lane_item *item);
+static struct xpc_lane_item *xpc_lanes_pop(struct xpc_lanes *lanes);
+static void xpc_connection_queue_send(struct xpc_connection *conn,
+    xpc_object_t message, uint64_t id, size_t size);
+static void xpc_connection_drain_send(void *context);
+static void xpc_connection_deliver(struct xpc_connection *conn,
+    xpc_object_t message);
+static void xpc_connection_drain_recv(void *context);
+
+static int xpc_send_queue_key;
 
 OS_OBJECT_OBJC_CLASS_DECL(xpc_connection);
 
@@ -59,12 +90,20 @@ xpc_connection_create(const char *name, dispatch_queue_t targetq)
 	conn->xc_last_id = 1;
 	TAILQ_INIT(&conn->xc_peers);
 	TAILQ_INIT(&conn->xc_pending);
+	pthread_mutex_init(&conn->xc_pending_lock, NULL);
+	xpc_lanes_init(&conn->xc_send_lanes);
+	xpc_lanes_init(&conn->xc_recv_lanes);
 
 	/* Create send queue */
 	asprintf(&qname, "com.ixsystems.xpc.connection.sendq.%p", conn);
 	conn->xc_send_queue = dispatch_queue_create(qname, NULL);
+	dispatch_queue_set_specific(conn->xc_send_queue, &xpc_send_queue_key,
+	    conn, NULL);
 	free(qname);
 
+	pthread_mutex_init(&conn->xc_fc_lock, NULL);
+	conn->xc_fc_drained = dispatch_semaphore_create(0);
+
 	/* Create recv queue */
 	asprintf(&qname, "com.ixsystems.xpc.connection.recvq.%p", conn);
 	conn->xc_recv_queue = dispatch_queue_create(qname, NULL);
@@ -167,9 +206,7 @@ xpc_connection_set_event_handler(xpc_connection_t xconn,
 
 	debugf("connection=%p", xconn);
 	conn = xconn;
-    // _sjc_ because i'm not currently sure what should be linked to to get Block_copy()
-    printf("you hit a missing Block_copy() in libxpc\n");
-//    conn->xc_handler = (xpc_handler_t)Block_copy(handler);
+	conn->xc_handler = (xpc_handler_t)Block_copy(handler);
 }
 
 void
@@ -200,64 +237,219 @@ xpc_connection_resume(xpc_connection_t xconn)
 		dispatch_resume(conn->xc_recv_source);
 	}
 
+	/* Fail outstanding calls as soon as the peer goes away */
+	if (conn->xc_remote_port != MACH_PORT_NULL &&
+	    conn->xc_dead_source == NULL) {
+		conn->xc_dead_source = dispatch_source_create(
+		    DISPATCH_SOURCE_TYPE_MACH_SEND, conn->xc_remote_port,
+		    DISPATCH_MACH_SEND_DEAD, conn->xc_recv_queue);
+		dispatch_set_context(conn->xc_dead_source, conn);
+		dispatch_source_set_event_handler_f(conn->xc_dead_source,
+		    xpc_connection_peer_died);
+		dispatch_resume(conn->xc_dead_source);
+	}
+
 	dispatch_resume(conn->xc_recv_queue);
 }
 
-void
-xpc_connection_send_message(xpc_connection_t xconn,
-    xpc_object_t message)
+static int
+xpc_connection_enqueue_message(xpc_connection_t xconn, xpc_object_t message,
+    bool wait)
 {
 	struct xpc_connection *conn;
 	uint64_t id;
+	size_t size;
+	int error;
 
 	conn = xconn;
+	atomic_store(&conn->xc_sent, true);
+	size = xpc_message_size(message);
+	error = xpc_flow_enqueue(conn, size, wait);
+	if (error != 0)
+		return (error);
+
 	id = xpc_dictionary_get_uint64(message, XPC_SEQID);
 
 	if (id == 0)
 		id = XPC_CONNECTION_NEXT_ID(conn);
 
-	dispatch_async(conn->xc_send_queue, ^{
-		xpc_send(conn, message, id);
-	});
+	xpc_connection_queue_send(conn, message, id, size);
+	return (0);
 }
 
 void
-xpc_connection_send_message_with_reply(xpc_connection_t xconn,
-    xpc_object_t message, dispatch_queue_t targetq, xpc_handler_t handler)
+xpc_connection_send_message(xpc_connection_t xconn,
+    xpc_object_t message)
+{
+	int error;
+
+	error = xpc_connection_enqueue_message(xconn, message, true);
+	xpc_assert(error == 0, "blocking send refused with %d", error);
+}
+
+int
+xpc_connection_try_send_message(xpc_connection_t xconn,
+    xpc_object_t message)
+{
+
+	return (xpc_connection_enqueue_message(xconn, message, false));
+}
+
+void
+xpc_message_set_priority(xpc_object_t xmsg, xpc_message_priority_t priority)
+{
+	struct xpc_object *xo;
+
+	xo = xmsg;
+	xpc_assert_nonnull(xo);
+	xpc_precondition(priority <= XPC_MESSAGE_PRIORITY_BULK,
+	    "invalid message priority %d", priority);
+
+	xo->xo_flags &= ~_XPC_PRIORITY_MASK;
+	xo->xo_flags |= priority << _XPC_PRIORITY_SHIFT;
+}
+
+xpc_message_priority_t
+xpc_message_get_priority(xpc_object_t xmsg)
+{
+	struct xpc_object *xo;
+
+	xo = xmsg;
+	xpc_assert_nonnull(xo);
+	return ((xo->xo_flags & _XPC_PRIORITY_MASK) >> _XPC_PRIORITY_SHIFT);
+}
+
+static void
+xpc_connection_send_with_reply(xpc_connection_t xconn, xpc_object_t message,
+    dispatch_queue_t targetq, uint64_t timeout, xpc_handler_t handler)
 {
 	struct xpc_connection *conn;
 	struct xpc_pending_call *call;
+	dispatch_queue_t queue;
+	dispatch_time_t deadline;
+	uint64_t id;
+	size_t size;
+	int error;
 
 	conn = xconn;
+	atomic_store(&conn->xc_sent, true);
+	size = xpc_message_size(message);
+	queue = targetq ? targetq : conn->xc_target_queue;
+
+	/*
+	 * Take the call's send credit before anything is queued, so that a
+	 * full window holds up this caller rather than the send queue. The
+	 * credit comes back when the call completes, whether with a reply,
+	 * a timeout or a cancel.
+	 */
+	if (conn->xc_send_credits != NULL) {
+		deadline = timeout != 0 ?
+		    dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeout) :
+		    DISPATCH_TIME_FOREVER;
+		if (dispatch_semaphore_wait(conn->xc_send_credits,
+		    deadline) != 0) {
+			dispatch_async(queue, ^{
+				handler(XPC_ERROR_CONNECTION_INTERRUPTED);
+			});
+			return;
+		}
+	}
+
+	error = xpc_flow_enqueue(conn, size, true);
+	xpc_assert(error == 0, "blocking send refused with %d", error);
+
 	call = malloc(sizeof(struct xpc_pending_call));
-	call->xp_id = XPC_CONNECTION_NEXT_ID(conn);
+	call->xp_id = id = XPC_CONNECTION_NEXT_ID(conn);
+	call->xp_send_time = 0;
+	call->xp_deadline = 0;
 	call->xp_handler = handler;
 	call->xp_queue = targetq;
+
+	if (atomic_load_explicit(&conn->xc_histograms,
+	    memory_order_relaxed) != NULL)
+		call->xp_send_time = mach_absolute_time();
+
+	pthread_mutex_lock(&conn->xc_pending_lock);
+	if (conn->xc_canceled) {
+		pthread_mutex_unlock(&conn->xc_pending_lock);
+		free(call);
+		xpc_flow_dequeue(conn, size);
+		if (conn->xc_send_credits != NULL)
+			dispatch_semaphore_signal(conn->xc_send_credits);
+		dispatch_async(queue, ^{
+			handler(XPC_ERROR_CONNECTION_INVALID);
+		});
+		return;
+	}
+
 	TAILQ_INSERT_TAIL(&conn->xc_pending, call, xp_link);
+	if (timeout != 0)
+		xpc_timer_wheel_insert(conn, call, timeout);
+	pthread_mutex_unlock(&conn->xc_pending_lock);
+
+	atomic_fetch_add_explicit(&conn->xc_stat_pending, 1,
+	    memory_order_relaxed);
+
+	/*
+	 * The call may time out or be canceled before it is sent, so only
+	 * its id is queued, never the call itself.
+	 */
+	xpc_connection_queue_send(conn, message, id, size);
+}
 
-	dispatch_async(conn->xc_send_queue, ^{
-		xpc_send(conn, message, call->xp_id);
-	});
+void
+xpc_connection_send_message_with_reply(xpc_connection_t xconn,
+    xpc_object_t message, dispatch_queue_t targetq, xpc_handler_t handler)
+{
 
+	xpc_connection_send_with_reply(xconn, message, targetq, 0, handler);
+}
+
+void
+xpc_connection_send_message_with_reply_timeout(xpc_connection_t xconn,
+    xpc_object_t message, dispatch_queue_t targetq, uint64_t timeout,
+    xpc_handler_t handler)
+{
+
+	xpc_connection_send_with_reply(xconn, message, targetq, timeout,
+	    handler);
 }
 
 xpc_object_t
-xpc_connection_send_message_with_reply_sync(xpc_connection_t conn,
-    xpc_object_t message)
+xpc_connection_send_message_with_reply_sync_timeout(xpc_connection_t conn,
+    xpc_object_t message, uint64_t timeout)
 {
 	__block xpc_object_t result;
 	dispatch_semaphore_t sem = dispatch_semaphore_create(0);
 
-	xpc_connection_send_message_with_reply(conn, message, NULL,
+	/*
+	 * The handler only signals, so it runs on a global queue rather than
+	 * the target queue: callers are often on the target queue themselves,
+	 * which they would be blocking. It is guaranteed to run, with
+	 * XPC_ERROR_CONNECTION_INTERRUPTED once the deadline passes, so the
+	 * wait needs no deadline of its own.
+	 */
+	xpc_connection_send_with_reply(conn, message,
+	    dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), timeout,
 	    ^(xpc_object_t o) {
 		result = o;
 		dispatch_semaphore_signal(sem);
 	});
 
 	dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
+	dispatch_release(sem);
 	return (result);
 }
 
+xpc_object_t
+xpc_connection_send_message_with_reply_sync(xpc_connection_t conn,
+    xpc_object_t message)
+{
+
+	return (xpc_connection_send_message_with_reply_sync_timeout(conn,
+	    message, 0));
+}
+
 void
 xpc_connection_send_barrier(xpc_connection_t xconn, dispatch_block_t barrier)
 {
@@ -268,9 +460,66 @@ xpc_connection_send_barrier(xpc_connection_t xconn, dispatch_block_t barrier)
 }
 
 void
-xpc_connection_cancel(xpc_connection_t connection)
+xpc_connection_set_send_watermarks(xpc_connection_t xconn, size_t low_msgs,
+    size_t high_msgs, size_t low_bytes, size_t high_bytes)
+{
+	struct xpc_connection *conn;
+
+	conn = xconn;
+	xpc_precondition(high_msgs == 0 || low_msgs <= high_msgs,
+	    "low message watermark (%zu) above high watermark (%zu)",
+	    low_msgs, high_msgs);
+	xpc_precondition(high_bytes == 0 || low_bytes <= high_bytes,
+	    "low byte watermark (%zu) above high watermark (%zu)",
+	    low_bytes, high_bytes);
+
+	conn->xc_fc_low_msgs = low_msgs;
+	conn->xc_fc_high_msgs = high_msgs;
+	conn->xc_fc_low_bytes = low_bytes;
+	conn->xc_fc_high_bytes = high_bytes;
+}
+
+void
+xpc_connection_set_send_window(xpc_connection_t xconn, uint32_t credits)
+{
+	struct xpc_connection *conn;
+
+	conn = xconn;
+	xpc_precondition(conn->xc_send_credits == NULL,
+	    "send window can only be set once");
+	xpc_precondition(!atomic_load(&conn->xc_sent),
+	    "send window must be set before the first message is sent");
+
+	if (credits == 0)
+		return;
+
+	conn->xc_send_window = credits;
+	conn->xc_send_credits = dispatch_semaphore_create(credits);
+}
+
+void
+xpc_connection_cancel(xpc_connection_t xconn)
 {
+	struct xpc_connection *conn;
+
+	conn = xconn;
+	debugf("connection=%p", xconn);
 
+	pthread_mutex_lock(&conn->xc_pending_lock);
+	if (conn->xc_canceled) {
+		pthread_mutex_unlock(&conn->xc_pending_lock);
+		return;
+	}
+	conn->xc_canceled = true;
+	pthread_mutex_unlock(&conn->xc_pending_lock);
+
+	if (conn->xc_recv_source != NULL)
+		dispatch_source_cancel(conn->xc_recv_source);
+
+	if (conn->xc_dead_source != NULL)
+		dispatch_source_cancel(conn->xc_dead_source);
+
+	xpc_connection_fail_all(conn, XPC_ERROR_CONNECTION_INVALID);
 }
 
 const char *
@@ -370,16 +619,565 @@ static void
 xpc_send(xpc_connection_t xconn, xpc_object_t message, uint64_t id)
 {
 	struct xpc_connection *conn;
+	size_t size = 0;
 	int error_code;
 
 	debugf("connection=%p, message=%p, id=%llu", xconn, message, id);
 
 	conn = xconn;
 	error_code = xpc_pipe_send(message, conn->xc_remote_port,
-	    conn->xc_local_port, id);
+	    conn->xc_local_port, id, &size);
 
-	if (error_code != 0)
+	if (error_code != 0) {
 		debugf("send failed, errno=%s", strerror(error_code));
+		atomic_fetch_add_explicit(&conn->xc_stat_send_errors, 1,
+		    memory_order_relaxed);
+		return;
+	}
+
+	atomic_fetch_add_explicit(&conn->xc_stat_msgs_sent, 1,
+	    memory_order_relaxed);
+	atomic_fetch_add_explicit(&conn->xc_stat_bytes_sent, size,
+	    memory_order_relaxed);
+}
+
+static void
+xpc_connection_count_received(struct xpc_connection *conn, size_t size)
+{
+
+	atomic_fetch_add_explicit(&conn->xc_stat_msgs_received, 1,
+	    memory_order_relaxed);
+	atomic_fetch_add_explicit(&conn->xc_stat_bytes_received, size,
+	    memory_order_relaxed);
+}
+
+/*
+ * Run an event or reply handler, timing it if somebody has asked for
+ * this connection's statistics.
+ */
+static void
+xpc_connection_invoke(struct xpc_connection *conn, xpc_handler_t handler,
+    xpc_object_t obj)
+{
+	struct xpc_connection_histograms *hist;
+	uint64_t start;
+
+	hist = atomic_load_explicit(&conn->xc_histograms, memory_order_relaxed);
+	if (hist == NULL) {
+		handler(obj);
+		return;
+	}
+
+	start = mach_absolute_time();
+	handler(obj);
+	xpc_histogram_record(&hist->xch_handler_time,
+	    mach_absolute_time() - start);
+}
+
+/*
+ * Rough estimate of the serialized size of a message, used for byte
+ * accounting of the send queue. It does not need to be exact, only
+ * proportional to what xpc_pipe_send() will hand to the kernel.
+ */
+static size_t
+xpc_message_size(struct xpc_object *xo)
+{
+	struct xpc_dict_pair *pair;
+	size_t size, i;
+
+	if (xo == NULL)
+		return (0);
+
+	if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
+		size = 0;
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link)
+			size += strlen(pair->key) + 1 +
+			    xpc_message_size(pair->value);
+		return (size);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
+		size = 0;
+		for (i = 0; i < xo->xo_size; i++)
+			size += xpc_message_size(xo->xo_array.xa_items[i]);
+		return (size);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_STRING)
+		return (xo->xo_size + 1);
+
+	if (xo->xo_xpc_type == XPC_TYPE_DATA)
+		return (xo->xo_size);
+
+	return (sizeof(uint64_t));
+}
+
+static bool
+xpc_flow_above_high(struct xpc_connection *conn, size_t msgs, size_t bytes)
+{
+
+	if (conn->xc_fc_high_msgs != 0 && msgs >= conn->xc_fc_high_msgs)
+		return (true);
+
+	if (conn->xc_fc_high_bytes != 0 && bytes >= conn->xc_fc_high_bytes)
+		return (true);
+
+	return (false);
+}
+
+static bool
+xpc_flow_below_low(struct xpc_connection *conn, size_t msgs, size_t bytes)
+{
+
+	if (conn->xc_fc_high_msgs != 0 && msgs > conn->xc_fc_low_msgs)
+		return (false);
+
+	if (conn->xc_fc_high_bytes != 0 && bytes > conn->xc_fc_low_bytes)
+		return (false);
+
+	return (true);
+}
+
+/*
+ * Account for a message about to be put on the send queue. While the
+ * connection is throttled, either fail with EAGAIN or wait for the send
+ * queue to drain below the low watermarks. Enqueues made from the send
+ * queue itself are counted but never held back, since nothing could
+ * drain it.
+ *
+ * A sender only counts itself as a waiter if the throttle is still on
+ * under xc_fc_lock, which xpc_flow_dequeue() holds while it clears the
+ * throttle and takes the count, so every signal has a sender waiting
+ * for it.
+ */
+static int
+xpc_flow_enqueue(struct xpc_connection *conn, size_t size, bool wait)
+{
+	size_t msgs, bytes;
+	bool throttled, sendq;
+
+	sendq = dispatch_get_specific(&xpc_send_queue_key) == conn;
+
+	while (!sendq && atomic_load(&conn->xc_fc_throttled)) {
+		if (!wait)
+			return (EAGAIN);
+
+		pthread_mutex_lock(&conn->xc_fc_lock);
+		throttled = atomic_load(&conn->xc_fc_throttled);
+		if (throttled)
+			conn->xc_fc_waiters++;
+		pthread_mutex_unlock(&conn->xc_fc_lock);
+
+		if (throttled) {
+			debugf("connection=%p throttled, waiting for drain", conn);
+			dispatch_semaphore_wait(conn->xc_fc_drained,
+			    DISPATCH_TIME_FOREVER);
+		}
+	}
+
+	msgs = atomic_fetch_add(&conn->xc_queued_msgs, 1) + 1;
+	bytes = atomic_fetch_add(&conn->xc_queued_bytes, size) + size;
+
+	if (xpc_flow_above_high(conn, msgs, bytes))
+		atomic_store(&conn->xc_fc_throttled, true);
+
+	return (0);
+}
+
+static void
+xpc_flow_dequeue(struct xpc_connection *conn, size_t size)
+{
+	size_t msgs, bytes;
+	int waiters;
+
+	msgs = atomic_fetch_sub(&conn->xc_queued_msgs, 1) - 1;
+	bytes = atomic_fetch_sub(&conn->xc_queued_bytes, size) - size;
+
+	if (!atomic_load(&conn->xc_fc_throttled) ||
+	    !xpc_flow_below_low(conn, msgs, bytes))
+		return;
+
+	pthread_mutex_lock(&conn->xc_fc_lock);
+	atomic_store(&conn->xc_fc_throttled, false);
+	waiters = conn->xc_fc_waiters;
+	conn->xc_fc_waiters = 0;
+	pthread_mutex_unlock(&conn->xc_fc_lock);
+
+	while (waiters-- > 0)
+		dispatch_semaphore_signal(conn->xc_fc_drained);
+}
+
+static const unsigned int xpc_lane_weight[XPC_LANE_COUNT] = { 8, 4, 1 };
+
+static unsigned int
+xpc_message_lane(xpc_object_t message)
+{
+
+	switch (xpc_message_get_priority(message)) {
+	case XPC_MESSAGE_PRIORITY_INTERACTIVE:
+		return (XPC_LANE_INTERACTIVE);
+	case XPC_MESSAGE_PRIORITY_BULK:
+		return (XPC_LANE_BULK);
+	default:
+		return (XPC_LANE_DEFAULT);
+	}
+}
+
+static void
+xpc_lanes_init(struct xpc_lanes *lanes)
+{
+	unsigned int i;
+
+	pthread_mutex_init(&lanes->xl_lock, NULL);
+	for (i = 0; i < XPC_LANE_COUNT; i++) {
+		lanes->xl_budget[i] = xpc_lane_weight[i];
+		TAILQ_INIT(&lanes->xl_queue[i]);
+	}
+}
+
+/*
+ * Queue an item. Returns true if the lanes were idle, in which case the
+ * caller must schedule a drain; one drain runs at a time and keeps going
+ * until xpc_lanes_pop() finds every lane empty.
+ */
+static bool
+xpc_lanes_push(struct xpc_lanes *lanes, unsigned int lane,
+    struct xpc_lane_item *item)
+{
+	bool schedule;
+
+	pthread_mutex_lock(&lanes->xl_lock);
+	TAILQ_INSERT_TAIL(&lanes->xl_queue[lane], item, xl_link);
+	schedule = !lanes->xl_scheduled;
+	lanes->xl_scheduled = true;
+	pthread_mutex_unlock(&lanes->xl_lock);
+
+	return (schedule);
+}
+
+static struct xpc_lane_item *
+xpc_lanes_pop(struct xpc_lanes *lanes)
+{
+	struct xpc_lane_item *item;
+	unsigned int i, round;
+
+	pthread_mutex_lock(&lanes->xl_lock);
+
+	/* If no busy lane has turns left, start a new round and retry */
+	for (round = 0; round < 2; round++) {
+		for (i = 0; i < XPC_LANE_COUNT; i++) {
+			item = TAILQ_FIRST(&lanes->xl_queue[i]);
+			if (item == NULL || lanes->xl_budget[i] == 0)
+				continue;
+
+			lanes->xl_budget[i]--;
+			TAILQ_REMOVE(&lanes->xl_queue[i], item, xl_link);
+			pthread_mutex_unlock(&lanes->xl_lock);
+			return (item);
+		}
+
+		for (i = 0; i < XPC_LANE_COUNT; i++)
+			lanes->xl_budget[i] = xpc_lane_weight[i];
+	}
+
+	lanes->xl_scheduled = false;
+	pthread_mutex_unlock(&lanes->xl_lock);
+	return (NULL);
+}
+
+static void
+xpc_connection_queue_send(struct xpc_connection *conn, xpc_object_t message,
+    uint64_t id, size_t size)
+{
+	struct xpc_lane_item *item;
+
+	item = malloc(sizeof(*item));
+	item->xl_message = xpc_retain(message);
+	item->xl_id = id;
+	item->xl_size = size;
+
+	if (xpc_lanes_push(&conn->xc_send_lanes, xpc_message_lane(message),
+	    item))
+		dispatch_async_f(conn->xc_send_queue, conn,
+		    xpc_connection_drain_send);
+}
+
+/* Runs on the send queue */
+static void
+xpc_connection_drain_send(void *context)
+{
+	struct xpc_connection *conn;
+	struct xpc_lane_item *item;
+
+	conn = context;
+	while ((item = xpc_lanes_pop(&conn->xc_send_lanes)) != NULL) {
+		/* Whatever is still queued at cancel time is dropped */
+		if (!conn->xc_canceled)
+			xpc_send(conn, item->xl_message, item->xl_id);
+		xpc_flow_dequeue(conn, item->xl_size);
+		xpc_release(item->xl_message);
+		free(item);
+	}
+}
+
+/* Hand an incoming message to the event handler, in priority order */
+static void
+xpc_connection_deliver(struct xpc_connection *conn, xpc_object_t message)
+{
+	struct xpc_lane_item *item;
+
+	item = malloc(sizeof(*item));
+	item->xl_message = message;
+	item->xl_id = 0;
+	item->xl_size = 0;
+
+	if (xpc_lanes_push(&conn->xc_recv_lanes, xpc_message_lane(message),
+	    item))
+		dispatch_async_f(conn->xc_target_queue, conn,
+		    xpc_connection_drain_recv);
+}
+
+/* Runs on the target queue */
+static void
+xpc_connection_drain_recv(void *context)
+{
+	struct xpc_connection *conn;
+	struct xpc_lane_item *item;
+
+	conn = context;
+	while ((item = xpc_lanes_pop(&conn->xc_recv_lanes)) != NULL) {
+		if (conn->xc_handler != NULL)
+			xpc_connection_invoke(conn, conn->xc_handler,
+			    item->xl_message);
+		free(item);
+	}
+}
+
+/*
+ * Pending calls with a deadline are kept on a hashed timer wheel of
+ * XPC_WHEEL_SLOTS slots, XPC_WHEEL_TICK_NS apart. A call sits in the
+ * slot of its deadline tick modulo the wheel size, so each tick only
+ * looks at the calls hashed into one slot. The wheel's timer only runs
+ * while some call has a deadline. Called with xc_pending_lock held.
+ */
+static void
+xpc_timer_wheel_insert(struct xpc_connection *conn,
+    struct xpc_pending_call *call, uint64_t timeout)
+{
+	struct xpc_timer_wheel *wheel;
+	uint64_t now, tick;
+	unsigned int i;
+
+	wheel = conn->xc_wheel;
+	now = xpc_abs_to_nsec(mach_absolute_time()) / XPC_WHEEL_TICK_NS;
+
+	if (wheel == NULL) {
+		wheel = calloc(1, sizeof(*wheel));
+		for (i = 0; i < XPC_WHEEL_SLOTS; i++)
+			TAILQ_INIT(&wheel->xw_slots[i]);
+		wheel->xw_tick = now;
+		wheel->xw_timer = dispatch_source_create(
+		    DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+		    dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+		dispatch_source_set_timer(wheel->xw_timer,
+		    dispatch_time(DISPATCH_TIME_NOW, XPC_WHEEL_TICK_NS),
+		    XPC_WHEEL_TICK_NS, XPC_WHEEL_TICK_NS / 2);
+		dispatch_set_context(wheel->xw_timer, conn);
+		dispatch_source_set_event_handler_f(wheel->xw_timer,
+		    xpc_timer_wheel_tick);
+		conn->xc_wheel = wheel;
+	}
+
+	/* Catch an idle wheel up with the current time */
+	if (wheel->xw_count == 0)
+		wheel->xw_tick = now;
+
+	tick = now + (timeout + XPC_WHEEL_TICK_NS - 1) / XPC_WHEEL_TICK_NS;
+	if (tick <= wheel->xw_tick)
+		tick = wheel->xw_tick + 1;
+
+	call->xp_deadline = tick;
+	TAILQ_INSERT_TAIL(&wheel->xw_slots[tick % XPC_WHEEL_SLOTS], call,
+	    xp_wheel_link);
+
+	if (wheel->xw_count++ == 0)
+		dispatch_resume(wheel->xw_timer);
+}
+
+/* Called with xc_pending_lock held */
+static void
+xpc_pending_call_remove(struct xpc_connection *conn,
+    struct xpc_pending_call *call)
+{
+	struct xpc_timer_wheel *wheel;
+
+	TAILQ_REMOVE(&conn->xc_pending, call, xp_link);
+
+	if (call->xp_deadline == 0)
+		return;
+
+	wheel = conn->xc_wheel;
+	TAILQ_REMOVE(&wheel->xw_slots[call->xp_deadline % XPC_WHEEL_SLOTS],
+	    call, xp_wheel_link);
+	if (--wheel->xw_count == 0)
+		dispatch_suspend(wheel->xw_timer);
+}
+
+static void
+xpc_timer_wheel_tick(void *context)
+{
+	struct xpc_connection *conn;
+	struct xpc_timer_wheel *wheel;
+	struct xpc_pending_call *call, *tmp;
+	TAILQ_HEAD(, xpc_pending_call) expired;
+	uint64_t now, steps;
+
+	conn = context;
+	wheel = conn->xc_wheel;
+	TAILQ_INIT(&expired);
+	now = xpc_abs_to_nsec(mach_absolute_time()) / XPC_WHEEL_TICK_NS;
+
+	pthread_mutex_lock(&conn->xc_pending_lock);
+
+	/* After a long stall, one lap around the wheel visits every slot */
+	steps = 0;
+	while (wheel->xw_tick < now && steps++ < XPC_WHEEL_SLOTS) {
+		wheel->xw_tick++;
+		TAILQ_FOREACH_SAFE(call,
+		    &wheel->xw_slots[wheel->xw_tick % XPC_WHEEL_SLOTS],
+		    xp_wheel_link, tmp) {
+			if (call->xp_deadline > now)
+				continue;
+
+			xpc_pending_call_remove(conn, call);
+			TAILQ_INSERT_TAIL(&expired, call, xp_link);
+
+			wheel->xw_expired[wheel->xw_expired_next] = call->xp_id;
+			wheel->xw_expired_next = (wheel->xw_expired_next + 1) %
+			    XPC_WHEEL_EXPIRED;
+		}
+	}
+	wheel->xw_tick = now;
+
+	pthread_mutex_unlock(&conn->xc_pending_lock);
+
+	TAILQ_FOREACH_SAFE(call, &expired, xp_link, tmp) {
+		debugf("connection=%p, call %llu timed out", conn, call->xp_id);
+		xpc_pending_call_complete(conn, call,
+		    XPC_ERROR_CONNECTION_INTERRUPTED);
+	}
+}
+
+/*
+ * If id is that of a call that timed out, forget it and return true.
+ * Called with xc_pending_lock held.
+ */
+static bool
+xpc_timer_wheel_forget(struct xpc_connection *conn, uint64_t id)
+{
+	struct xpc_timer_wheel *wheel;
+	unsigned int i;
+
+	wheel = conn->xc_wheel;
+	if (wheel == NULL || id == 0)
+		return (false);
+
+	for (i = 0; i < XPC_WHEEL_EXPIRED; i++) {
+		if (wheel->xw_expired[i] == id) {
+			wheel->xw_expired[i] = 0;
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+/*
+ * Hand a reply (or an error standing in for one) to a call that has
+ * already been taken off the pending list, and free the call. This also
+ * gives back the send credit the call took when it was made.
+ */
+static void
+xpc_pending_call_complete(struct xpc_connection *conn,
+    struct xpc_pending_call *call, xpc_object_t result)
+{
+	dispatch_queue_t queue;
+
+	if (conn->xc_send_credits != NULL)
+		dispatch_semaphore_signal(conn->xc_send_credits);
+
+	atomic_fetch_sub_explicit(&conn->xc_stat_pending, 1,
+	    memory_order_relaxed);
+
+	queue = call->xp_queue ? call->xp_queue : conn->xc_target_queue;
+	dispatch_async(queue, ^{
+		xpc_connection_invoke(conn, call->xp_handler, result);
+		free(call);
+	});
+}
+
+/*
+ * Fail every outstanding call at once, then tell the event handler, after
+ * whatever messages it has yet to be handed.
+ */
+static void
+xpc_connection_fail_all(struct xpc_connection *conn, xpc_object_t error)
+{
+	struct xpc_pending_call *call, *tmp;
+	TAILQ_HEAD(, xpc_pending_call) failed;
+
+	TAILQ_INIT(&failed);
+
+	pthread_mutex_lock(&conn->xc_pending_lock);
+	TAILQ_FOREACH_SAFE(call, &conn->xc_pending, xp_link, tmp) {
+		xpc_pending_call_remove(conn, call);
+		TAILQ_INSERT_TAIL(&failed, call, xp_link);
+	}
+	pthread_mutex_unlock(&conn->xc_pending_lock);
+
+	TAILQ_FOREACH_SAFE(call, &failed, xp_link, tmp)
+		xpc_pending_call_complete(conn, call, error);
+
+	xpc_connection_deliver(conn, error);
+}
+
+static bool
+xpc_connection_recv_pending(struct xpc_connection *conn)
+{
+	mach_port_status_t status;
+	mach_msg_type_number_t count;
+
+	count = MACH_PORT_RECEIVE_STATUS_COUNT;
+	if (mach_port_get_attributes(mach_task_self(), conn->xc_local_port,
+	    MACH_PORT_RECEIVE_STATUS, (mach_port_info_t)&status,
+	    &count) != KERN_SUCCESS)
+		return (false);
+
+	return (status.mps_msgcount > 0);
+}
+
+/* Runs on the receive queue */
+static void
+xpc_connection_peer_died(void *context)
+{
+	struct xpc_connection *conn;
+
+	conn = context;
+	debugf("connection=%p, remote port <%u> died", conn,
+	    conn->xc_remote_port);
+
+	/*
+	 * The receive source may not have seen everything the peer sent
+	 * before it died; hand that over first, so that the error comes
+	 * last.
+	 */
+	if (conn->xc_recv_source != NULL) {
+		conn->xc_peer_dead = true;
+		while (xpc_connection_recv_pending(conn))
+			xpc_connection_recv_message(conn);
+	}
+
+	xpc_connection_fail_all(conn, XPC_ERROR_CONNECTION_INTERRUPTED);
 }
 
 static void
@@ -410,25 +1208,34 @@ xpc_connection_recv_message(void *context)
 	struct xpc_pending_call *call;
 	struct xpc_connection *conn, *peer;
 	xpc_object_t result;
+	struct xpc_connection_histograms *hist;
 	mach_port_t remote;
 	kern_return_t kr;
 	uint64_t id;
+	size_t size = 0;
+	bool late = false;
 
 	debugf("connection=%p", context);
 
 	conn = context;
-	kr = xpc_pipe_receive(conn->xc_local_port, &remote, &result, &id);
+
+	/* What the receive source saw may already be drained */
+	if (conn->xc_peer_dead && !xpc_connection_recv_pending(conn))
+		return;
+
+	kr = xpc_pipe_receive(conn->xc_local_port, &remote, &result, &id,
+	    &size);
 	if (kr != KERN_SUCCESS)
 		return;
 
 	debugf("message=%p, id=%llu, remote=<%d>", result, id, remote);
 
+	/* A listener's messages are counted on the peers they are for */
 	if (conn->xc_flags & XPC_CONNECTION_MACH_SERVICE_LISTENER) {
 		TAILQ_FOREACH(peer, &conn->xc_peers, xc_link) {
 			if (remote == peer->xc_remote_port) {
-				dispatch_async(peer->xc_target_queue, ^{
-					peer->xc_handler(result);
-				});
+				xpc_connection_count_received(peer, size);
+				xpc_connection_deliver(peer, result);
 				return;
 			}
 		}
@@ -443,41 +1250,49 @@ xpc_connection_recv_message(void *context)
 		    ((struct xpc_object *)result)->xo_audit_token);
 
 		TAILQ_INSERT_TAIL(&conn->xc_peers, peer, xc_link);
+		xpc_connection_count_received(peer, size);
 
 		dispatch_async(conn->xc_target_queue, ^{
-			conn->xc_handler(peer);
+			xpc_connection_invoke(conn, conn->xc_handler, peer);
 		});
 
-		dispatch_async(peer->xc_target_queue, ^{
-			peer->xc_handler(result);
-		});
+		xpc_connection_deliver(peer, result);
 
 	} else {
+		xpc_connection_count_received(conn, size);
 		xpc_connection_set_credentials(conn,
 		    ((struct xpc_object *)result)->xo_audit_token);
 
+		pthread_mutex_lock(&conn->xc_pending_lock);
 		TAILQ_FOREACH(call, &conn->xc_pending, xp_link) {
-			if (call->xp_id == id) {
-				dispatch_async(conn->xc_target_queue, ^{
-					call->xp_handler(result);
-					TAILQ_REMOVE(&conn->xc_pending, call,
-					    xp_link);
-					free(call);
-				});
-				return;
-			}
+			if (call->xp_id == id)
+				break;
+		}
+		if (call != NULL)
+			xpc_pending_call_remove(conn, call);
+		else
+			late = xpc_timer_wheel_forget(conn, id);
+		pthread_mutex_unlock(&conn->xc_pending_lock);
+
+		/* The caller was already told the call timed out */
+		if (late) {
+			debugf("connection=%p, dropping late reply to %llu",
+			    conn, id);
+			xpc_release(result);
+			return;
 		}
 
-		if (conn->xc_handler) {
-			dispatch_async(conn->xc_target_queue, ^{
-			    conn->xc_handler(result);
-			});
+		if (call != NULL) {
+			hist = atomic_load_explicit(&conn->xc_histograms,
+			    memory_order_relaxed);
+			if (hist != NULL && call->xp_send_time != 0)
+				xpc_histogram_record(&hist->xch_reply_latency,
+				    mach_absolute_time() - call->xp_send_time);
+
+			xpc_pending_call_complete(conn, call, result);
+			return;
 		}
-	}
-}
 
-void
-xpc_create_from_plist(void)
-{
-	xpc_api_misuse("%s: Function unimplemented", __FUNCTION__);
+		xpc_connection_deliver(conn, result);
+	}
 }
@@ -1,8 +1,23 @@
 #include <xpc/xpc.h>
 #include <sys/reason.h>
 #include <CrashReporterClient.h>
+#include "xpc_internal.h"
 
 static char *xpc_api_misuse_reason = NULL;
+static os_log_t xpc_log;
+static dispatch_once_t xpc_log_once;
+
+static void
+xpc_log_init(void *context __unused)
+{
+	xpc_log = os_log_create("org.puredarwin.libxpc", "Debug");
+}
+
+__attribute__((visibility("hidden")))
+os_log_t xpc_log_handle(void) {
+	dispatch_once_f(&xpc_log_once, NULL, xpc_log_init);
+	return xpc_log;
+}
 
 __attribute__((visibility("hidden"), noreturn))
 void xpc_api_misuse(const char *info, ...) {
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <mach/mach.h>
 #include <xpc/launchd.h>
+#include <xpc/private.h>
 #include "xpc_internal.h"
 #include <assert.h>
 
@@ -53,6 +54,8 @@ nv2xpc(const nvlist_t *nv, mach_port_t (^port_deserializer)(int64_t port_id))
 	struct xpc_object *xo = NULL, *xotmp = NULL;
 	void *cookiep;
 	const char *key;
+	const void *bytes;
+	size_t count, keybytes, size;
 	int type;
 	xpc_u val;
 	const nvlist_t *nvtmp;
@@ -87,12 +90,25 @@ nv2xpc(const nvlist_t *nv, mach_port_t (^port_deserializer)(int64_t port_id))
 				xpc_api_misuse("Unexpected NVLIST_XPC_TYPE in dictionary: %s", type);
 			}
 		}
+	}
 
-		xo = xpc_dictionary_create(NULL, NULL, 0);
+	/*
+	 * Size the container up front: one pass to count the entries and
+	 * their key bytes, so that a dictionary gets all of its entries from
+	 * a single arena and an array never has to regrow.
+	 */
+	count = keybytes = 0;
+	cookiep = NULL;
+	while ((key = nvlist_next(nv, &type, &cookiep)) != NULL) {
+		count++;
+		keybytes += strlen(key);
 	}
 
-	if (nvlist_type(nv) == NV_TYPE_NVLIST_ARRAY)
-		xo = xpc_array_create(NULL, 0);
+	if (nvlist_type(nv) == NV_TYPE_NVLIST_DICTIONARY) {
+		xo = xpc_dictionary_create(NULL, NULL, 0);
+		xpc_dictionary_reserve(xo, count, keybytes);
+	} else
+		xo = xpc_array_create_with_capacity(count);
 
 	cookiep = NULL;
 	while ((key = nvlist_next(nv, &type, &cookiep)) != NULL) {
@@ -127,12 +143,15 @@ nv2xpc(const nvlist_t *nv, mach_port_t (^port_deserializer)(int64_t port_id))
 			break;
 
 		case NV_TYPE_BINARY:
+			bytes = nvlist_get_binary(nv, key, &size);
+			xotmp = xpc_data_create(bytes, size);
 			break;
 
 		case NV_TYPE_UUID:
 			memcpy(&val.uuid, nvlist_get_uuid(nv, key),
 			    sizeof(uuid_t));
 			xotmp = _xpc_prim_create(XPC_TYPE_UUID, val, 0);
+			break;
 
 		case NV_TYPE_NVLIST_ARRAY:
 			nvtmp = nvlist_get_nvlist_array(nv, key);
@@ -145,12 +164,15 @@ nv2xpc(const nvlist_t *nv, mach_port_t (^port_deserializer)(int64_t port_id))
 			break;
 		}
 
-		if (xotmp) {
-			if (nvlist_type(nv) == NV_TYPE_NVLIST_DICTIONARY)
-				xpc_dictionary_set_value(xo, key, xotmp);
+		if (xotmp == NULL)
+			continue;
 
-			if (nvlist_type(nv) == NV_TYPE_NVLIST_ARRAY)
-				xpc_array_append_value(xo, xotmp);
+		/* nvlist keys are unique, and the new object's reference is ours */
+		if (nvlist_type(nv) == NV_TYPE_NVLIST_DICTIONARY)
+			xpc_dictionary_append_value_nocheck(xo, key, xotmp);
+		else {
+			xpc_array_append_value(xo, xotmp);
+			xpc_release(xotmp);
 		}
 	}
 
@@ -222,15 +244,15 @@ nvlist_t *
 xpc2nv(struct xpc_object *xo, int64_t (^port_serializer)(mach_port_t port))
 {
 	nvlist_t *nv;
-	struct xpc_object *xotmp;
+	struct xpc_dict_pair *pair;
+	size_t i;
 
 	if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
 		nv = nvlist_create_dictionary(0);
 		debugf("nv = %p\n", nv);
-		xpc_dictionary_apply(xo, ^(const char *k, xpc_object_t v) {
-			xpc2nv_primitive(nv, k, v, port_serializer);
-			return ((bool)true);
-		});
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link)
+			xpc2nv_primitive(nv, pair->key, pair->value,
+			    port_serializer);
 
 		return nv;
 	}
@@ -238,12 +260,12 @@ xpc2nv(struct xpc_object *xo, int64_t (^port_serializer)(mach_port_t port))
 	if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
 		char *key = NULL;
 		nv = nvlist_create_array(0);
-		xpc_array_apply(xo, ^(size_t index, xpc_object_t v) {
-			asprintf(&key, "%ld", index);
-			xpc2nv_primitive(nv, key, v, port_serializer);
+		for (i = 0; i < xo->xo_size; i++) {
+			asprintf(&key, "%zu", i);
+			xpc2nv_primitive(nv, key, xo->xo_array.xa_items[i],
+			    port_serializer);
 			free(key);
-			return ((bool)true);
-		});
+		}
 
 		return nv;
 	}
@@ -257,17 +279,120 @@ xpc_dictionary_create(const char * const *keys, const xpc_object_t *values,
     size_t count)
 {
 	struct xpc_object *xo;
-	size_t i;
+	size_t i, keybytes;
 	xpc_u val = {0};
 
-	xo = _xpc_prim_create(XPC_TYPE_DICTIONARY, val, count);
-	
+	xo = _xpc_prim_create(XPC_TYPE_DICTIONARY, val, 0);
+	if (count == 0)
+		return (xo);
+
+	keybytes = 0;
+	for (i = 0; i < count; i++)
+		keybytes += strlen(keys[i]);
+
+	xpc_dictionary_reserve(xo, count, keybytes);
 	for (i = 0; i < count; i++)
 		xpc_dictionary_set_value(xo, keys[i], values[i]);
 	
 	return (xo);
 }
 
+xpc_object_t
+xpc_dictionary_create_with_capacity(size_t capacity)
+{
+	struct xpc_object *xo;
+	xpc_u val = {0};
+
+	xo = _xpc_prim_create(XPC_TYPE_DICTIONARY, val, 0);
+	xpc_dictionary_reserve(xo, capacity, capacity * XPC_DICT_KEY_ESTIMATE);
+	return (xo);
+}
+
+xpc_object_t
+xpc_dictionary_create_adopt(const char * const *keys, xpc_object_t *values,
+    size_t count)
+{
+	struct xpc_object *xo;
+	size_t i, keybytes;
+	xpc_u val = {0};
+
+	xo = _xpc_prim_create(XPC_TYPE_DICTIONARY, val, 0);
+
+	keybytes = 0;
+	for (i = 0; i < count; i++)
+		keybytes += strlen(keys[i]);
+
+	xpc_dictionary_reserve(xo, count, keybytes);
+	for (i = 0; i < count; i++)
+		xpc_dictionary_append_value_nocheck(xo, keys[i], values[i]);
+
+	return (xo);
+}
+
+/*
+ * Set up an arena for count more entries whose keys add up to keybytes.
+ * Only the first reservation of a dictionary takes effect.
+ */
+void
+xpc_dictionary_reserve(xpc_object_t xdict, size_t count, size_t keybytes)
+{
+	struct xpc_object *xo;
+	struct xpc_dict_arena *arena;
+	size_t size;
+
+	xo = xdict;
+	if (xo->xo_arena != NULL || count == 0)
+		return;
+
+	/* Each entry may need up to a word of padding */
+	size = count * (XPC_DICT_PAIR_SIZE(0) + sizeof(void *)) + keybytes;
+	arena = malloc(sizeof(*arena) + size);
+	if (arena == NULL)
+		return;
+
+	arena->xda_size = size;
+	arena->xda_used = 0;
+	arena->xda_template = NULL;
+	xo->xo_arena = arena;
+}
+
+static struct xpc_dict_pair *
+xpc_dict_pair_alloc(struct xpc_object *xo, const char *key)
+{
+	struct xpc_dict_arena *arena;
+	struct xpc_dict_pair *pair;
+	size_t keylen, size;
+
+	keylen = strlen(key);
+	size = XPC_DICT_PAIR_SIZE(keylen);
+	arena = xo->xo_arena;
+
+	if (arena != NULL && arena->xda_size - arena->xda_used >= size) {
+		pair = (struct xpc_dict_pair *)(arena->xda_bytes +
+		    arena->xda_used);
+		arena->xda_used += size;
+	} else
+		pair = malloc(size);
+
+	memcpy(pair + 1, key, keylen + 1);
+	pair->key = (const char *)(pair + 1);
+	return (pair);
+}
+
+/* Entries carved out of the arena go away with the dictionary */
+void
+xpc_dict_pair_free(struct xpc_object *xo, struct xpc_dict_pair *pair)
+{
+	struct xpc_dict_arena *arena;
+
+	arena = xo->xo_arena;
+	if (arena != NULL && (char *)pair >= arena->xda_bytes &&
+	    (char *)pair < arena->xda_bytes + arena->xda_size)
+		return;
+
+	free(pair);
+}
+
 xpc_object_t
 xpc_dictionary_create_reply(xpc_object_t original)
 {
@@ -280,6 +405,8 @@ xpc_dictionary_create_reply(xpc_object_t original)
 		return (NULL);
 
 	xpc_object_t reply = xpc_dictionary_create(NULL, NULL, 0);
+	((struct xpc_object *)reply)->xo_flags |=
+	    xo_orig->xo_flags & _XPC_PRIORITY_MASK;
 
 	mach_port_t rport = xpc_dictionary_copy_mach_send(original, XPC_RPORT);
 	if (rport != MACH_PORT_NULL) xpc_dictionary_set_mach_send(reply, XPC_RPORT, rport);
@@ -353,28 +480,59 @@ xpc_dictionary_set_value_nokeycheck(xpc_object_t xdict, const char *key, xpc_obj
 
 	xpc_assert_nonnull(xdict);
 	xpc_assert_type(xo, XPC_TYPE_DICTIONARY);
+	xpc_assert_mutable(xo);
 
 	xo = xdict;
 	head = &xo->xo_dict;
 
 	TAILQ_FOREACH(pair, head, xo_link) {
 		if (!strcmp(pair->key, key)) {
+			xpc_hash_invalidate(xo);
+			xotmp = pair->value;
 			if (value != NULL) {
-				pair->value = value;
+				pair->value = xpc_retain(value);
 			} else {
 				TAILQ_REMOVE(head, pair, xo_link);
+				xo->xo_size--;
+				xpc_dict_pair_free(xo, pair);
+
+				/* Its slots would point at unlinked entries */
+				if (xo->xo_arena != NULL &&
+				    xo->xo_arena->xda_template != NULL) {
+					xpc_message_template_release(
+					    xo->xo_arena->xda_template);
+					xo->xo_arena->xda_template = NULL;
+				}
 			}
 
+			xpc_release(xotmp);
 			return;
 		}
 	}
 
-	xo->xo_size++;
-	pair = malloc(sizeof(struct xpc_dict_pair));
-	pair->key = key;
+	if (value == NULL)
+		return;
+
+	xpc_dictionary_append_value_nocheck(xdict, key, xpc_retain(value));
+}
+
+/*
+ * Add a key that is known not to be in the dictionary yet, without
+ * looking for it first. Takes over the caller's reference to value.
+ */
+void
+xpc_dictionary_append_value_nocheck(xpc_object_t xdict, const char *key,
+    xpc_object_t value)
+{
+	struct xpc_object *xo;
+	struct xpc_dict_pair *pair;
+
+	xo = xdict;
+	xpc_hash_invalidate(xo);
+	pair = xpc_dict_pair_alloc(xo, key);
 	pair->value = value;
 	TAILQ_INSERT_TAIL(&xo->xo_dict, pair, xo_link);
-	xpc_retain(value);
+	xo->xo_size++;
 }
 
 void
@@ -551,3 +709,49 @@ xpc_dictionary_apply(xpc_object_t xdict, xpc_dictionary_applier_t applier)
 
 	return (true);
 }
+
+bool
+xpc_dictionary_apply_f(xpc_object_t xdict, void *context,
+    xpc_dictionary_applier_f applier)
+{
+	struct xpc_object *xo = xdict;
+	struct xpc_dict_pair *pair;
+
+	xpc_assert_nonnull(xdict);
+	xpc_assert_type(xo, XPC_TYPE_DICTIONARY);
+
+	TAILQ_FOREACH(pair, &xo->xo_dict, xo_link) {
+		if (!applier(context, pair->key, pair->value))
+			return (false);
+	}
+
+	return (true);
+}
+
+void
+xpc_dictionary_iter_init(xpc_dictionary_iter_t *iter, xpc_object_t xdict)
+{
+	struct xpc_object *xo = xdict;
+
+	xpc_assert_nonnull(xdict);
+	xpc_assert_type(xo, XPC_TYPE_DICTIONARY);
+
+	iter->xi_next = TAILQ_FIRST(&xo->xo_dict);
+}
+
+bool
+xpc_dictionary_iter_next(xpc_dictionary_iter_t *iter, const char **key,
+    xpc_object_t *value)
+{
+	struct xpc_dict_pair *pair;
+
+	pair = iter->xi_next;
+	if (pair == NULL)
+		return (false);
+
+	/* Step past the entry first, so the caller may remove it */
+	iter->xi_next = TAILQ_NEXT(pair, xo_link);
+	*key = pair->key;
+	*value = pair->value;
+	return (true);
+}
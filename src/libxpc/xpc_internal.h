@@ -29,6 +29,7 @@
 #define	_LIBXPC_XPC_INTERNAL_H
 
 #include "nv.h"
+#include <pthread.h>
 #include <os/log.h>
 #include <os/object_private.h>
 
@@ -37,12 +38,28 @@
 
 
 
+/*
+ * XPC_LOG_LEVEL selects at compile time which diagnostics are built in:
+ * 0 compiles every debugf() away, 1 and up keeps them. Debug builds
+ * default to 1. When built in, the log handle is created once and
+ * os_log_debug() checks whether debug messages are enabled before it
+ * evaluates or formats any of its arguments.
+ */
+#ifndef XPC_LOG_LEVEL
+#if DEBUG
+#define XPC_LOG_LEVEL 1
+#else
+#define XPC_LOG_LEVEL 0
+#endif
+#endif
+
+#if XPC_LOG_LEVEL > 0
+#define debugf(msg, ...) \
+	os_log_debug(xpc_log_handle(), msg, ##__VA_ARGS__)
+#else
 #define debugf(msg, ...) \
-	do { \
-		os_log_t logger = os_log_create("org.puredarwin.libxpc", "Debug"); \
-		os_log(logger, msg, ##__VA_ARGS__); \
-		os_release(logger); \
-	} while(0);
+	do { } while (0)
+#endif
 
 #define	XPC_SEQID	"XPC sequence number"
 #define	XPC_RPORT	"XPC remote port"
@@ -54,7 +71,16 @@ struct xpc_object;
 struct xpc_dict_pair;
 
 TAILQ_HEAD(xpc_dict_head, xpc_dict_pair);
-TAILQ_HEAD(xpc_array_head, xpc_object);
+
+/*
+ * Arrays hold their elements in a vector rather than linking them, so the
+ * same object can sit in any number of arrays (see xpc_copy()). The
+ * element count is the array's xo_size.
+ */
+struct xpc_array_head {
+	struct xpc_object **	xa_items;
+	size_t			xa_capacity;
+};
 
 typedef union {
 	struct xpc_dict_head dict;
@@ -72,6 +98,9 @@ typedef union {
 
 
 #define _XPC_FROM_WIRE 0x1
+#define _XPC_PRIORITY_SHIFT 1
+#define _XPC_PRIORITY_MASK (0x3 << _XPC_PRIORITY_SHIFT)
+#define _XPC_FROZEN 0x8
 
 struct xpc_object_header {
 	_OS_OBJECT_HEADER(const void *isa, ref_cnt, xref_cnt);
@@ -84,7 +113,9 @@ struct xpc_object {
 	size_t			xo_size;
 	xpc_u			xo_u;
 	audit_token_t *		xo_audit_token;
-	TAILQ_ENTRY(xpc_object) xo_link;
+	_Atomic(size_t)		xo_hash;	/* cached xpc_hash(), 0 if none */
+	uint64_t		xo_hash_epoch;	/* a container's xo_hash is for */
+	struct xpc_dict_arena *	xo_arena;
 };
 
 struct xpc_dict_pair {
@@ -93,12 +124,121 @@ struct xpc_dict_pair {
 	TAILQ_ENTRY(xpc_dict_pair) xo_link;
 };
 
+/*
+ * Dictionary entries are allocated together with a copy of their key.
+ * A dictionary created with a known size carves its entries out of one
+ * arena instead, and only falls back to malloc() once that is used up.
+ */
+#define	XPC_DICT_KEY_ESTIMATE	24
+#define	XPC_DICT_PAIR_SIZE(keylen) \
+	__DARWIN_ALIGN(sizeof(struct xpc_dict_pair) + (keylen) + 1)
+
+struct xpc_message_template;
+
+struct xpc_dict_arena {
+	size_t			xda_size;
+	size_t			xda_used;
+	struct xpc_message_template *xda_template;
+	char			xda_bytes[];
+};
+
+/*
+ * A message template fixes the keys and value types of a dictionary.
+ * Messages created from it get their entries laid out in their arena in
+ * field order, so a slot index maps straight to its entry, and xmt_image
+ * holds the packed nvpair header and key of every field. Each message
+ * holds a reference on its template until it is freed or stops matching.
+ */
+struct xpc_message_field {
+	const char *		xmf_key;
+	xpc_type_t		xmf_type;
+	int			xmf_nvtype;
+	size_t			xmf_pair_offset;	/* entry in the arena */
+	size_t			xmf_image_offset;	/* header in xmt_image */
+	size_t			xmf_image_size;
+};
+
+struct xpc_message_template {
+	_Atomic(unsigned int)	xmt_refcnt;	/* creator + messages */
+	size_t			xmt_count;
+	size_t			xmt_arena_size;
+	size_t			xmt_fixed_size;	/* packed size minus values */
+	unsigned char *		xmt_image;
+	struct xpc_message_field xmt_fields[];
+};
+
+/*
+ * Log-linear ("HDR") histogram: each power of two is split into
+ * 2^XPC_HISTOGRAM_SUB_BITS linear sub-buckets, which bounds the
+ * relative error of any recorded value to 1 / 2^XPC_HISTOGRAM_SUB_BITS.
+ */
+#define	XPC_HISTOGRAM_SUB_BITS	2
+#define	XPC_HISTOGRAM_BUCKETS	(64 << XPC_HISTOGRAM_SUB_BITS)
+
+struct xpc_histogram {
+	_Atomic(uint64_t)	xh_count;
+	_Atomic(uint64_t)	xh_sum;
+	_Atomic(uint64_t)	xh_max;
+	_Atomic(uint64_t)	xh_buckets[XPC_HISTOGRAM_BUCKETS];
+};
+
+struct xpc_connection_histograms {
+	struct xpc_histogram	xch_reply_latency;
+	struct xpc_histogram	xch_handler_time;
+};
+
 struct xpc_pending_call {
 	uint64_t		xp_id;
+	uint64_t		xp_send_time;
+	uint64_t		xp_deadline;	/* wheel tick, 0 if none */
 	xpc_object_t		xp_response;
 	dispatch_queue_t	xp_queue;
 	xpc_handler_t		xp_handler;
 	TAILQ_ENTRY(xpc_pending_call) xp_link;
+	TAILQ_ENTRY(xpc_pending_call) xp_wheel_link;
+};
+
+#define	XPC_WHEEL_SLOTS		256
+#define	XPC_WHEEL_TICK_NS	(10 * NSEC_PER_MSEC)
+#define	XPC_WHEEL_EXPIRED	128
+
+/*
+ * The ids of the last XPC_WHEEL_EXPIRED calls that timed out are kept so
+ * that their replies, should they still come, can be told apart from
+ * messages the peer sent on its own.
+ */
+struct xpc_timer_wheel {
+	dispatch_source_t	xw_timer;
+	uint64_t		xw_tick;
+	size_t			xw_count;
+	TAILQ_HEAD(, xpc_pending_call) xw_slots[XPC_WHEEL_SLOTS];
+	uint64_t		xw_expired[XPC_WHEEL_EXPIRED];	/* 0 if free */
+	unsigned int		xw_expired_next;
+};
+
+/*
+ * Messages waiting to be sent or delivered are kept in one FIFO lane per
+ * priority. Lanes are drained highest priority first, but each lane may
+ * only take xpc_lane_weight[lane] turns per round, so bulk traffic keeps
+ * moving while interactive traffic is queued.
+ */
+#define	XPC_LANE_INTERACTIVE	0
+#define	XPC_LANE_DEFAULT	1
+#define	XPC_LANE_BULK		2
+#define	XPC_LANE_COUNT		3
+
+struct xpc_lane_item {
+	xpc_object_t		xl_message;
+	uint64_t		xl_id;
+	size_t			xl_size;
+	TAILQ_ENTRY(xpc_lane_item) xl_link;
+};
+
+struct xpc_lanes {
+	pthread_mutex_t		xl_lock;
+	bool			xl_scheduled;
+	unsigned int		xl_budget[XPC_LANE_COUNT];
+	TAILQ_HEAD(, xpc_lane_item) xl_queue[XPC_LANE_COUNT];
 };
 
 struct xpc_connection {
@@ -115,12 +255,39 @@ struct xpc_connection {
 	int			xc_transaction_count;
 	int 			xc_flags;
 	_Atomic(uint64_t)	xc_last_id;
+	_Atomic(bool)		xc_sent;	/* a message has been queued */
 	void *			xc_context;
 	struct xpc_connection * xc_parent;
 	uid_t			xc_remote_euid;
 	gid_t			xc_remote_guid;
 	pid_t			xc_remote_pid;
 	au_asid_t		xc_remote_asid;
+	size_t			xc_fc_low_msgs;
+	size_t			xc_fc_high_msgs;
+	size_t			xc_fc_low_bytes;
+	size_t			xc_fc_high_bytes;
+	_Atomic(size_t)		xc_queued_msgs;
+	_Atomic(size_t)		xc_queued_bytes;
+	_Atomic(bool)		xc_fc_throttled;
+	pthread_mutex_t		xc_fc_lock;
+	int			xc_fc_waiters;	/* under xc_fc_lock */
+	dispatch_semaphore_t	xc_fc_drained;
+	uint32_t		xc_send_window;
+	dispatch_semaphore_t	xc_send_credits;
+	_Atomic(uint64_t)	xc_stat_msgs_sent;
+	_Atomic(uint64_t)	xc_stat_bytes_sent;
+	_Atomic(uint64_t)	xc_stat_msgs_received;
+	_Atomic(uint64_t)	xc_stat_bytes_received;
+	_Atomic(uint64_t)	xc_stat_send_errors;
+	_Atomic(uint64_t)	xc_stat_pending;
+	_Atomic(struct xpc_connection_histograms *) xc_histograms;
+	pthread_mutex_t		xc_pending_lock;
+	_Atomic(bool)		xc_canceled;
+	dispatch_source_t	xc_dead_source;
+	bool			xc_peer_dead;	/* on the receive queue */
+	struct xpc_timer_wheel *xc_wheel;
+	struct xpc_lanes	xc_send_lanes;
+	struct xpc_lanes	xc_recv_lanes;
 	TAILQ_HEAD(, xpc_pending_call) xc_pending;
 	TAILQ_HEAD(, xpc_connection) xc_peers;
 	TAILQ_ENTRY(xpc_connection) xc_link;
@@ -154,10 +321,27 @@ __private_extern__ nvlist_t *xpc2nv(struct xpc_object *xo, int64_t (^port_serial
 __private_extern__ struct xpc_object *nv2xpc(const nvlist_t *nv, mach_port_t (^port_deserializer)(int64_t port_id));
 __private_extern__ void xpc_object_destroy(struct xpc_object *xo);
 __private_extern__ int xpc_pipe_send(xpc_object_t obj, mach_port_t dst,
-    mach_port_t local, uint64_t id);
+    mach_port_t local, uint64_t id, size_t *sizep);
 __private_extern__ int xpc_pipe_receive(mach_port_t local, mach_port_t *remote,
-    xpc_object_t *result, uint64_t *id);
+    xpc_object_t *result, uint64_t *id, size_t *sizep);
+__private_extern__ void xpc_histogram_record(struct xpc_histogram *h,
+    uint64_t abstime);
+__private_extern__ xpc_object_t xpc_histogram_copy_description(
+    struct xpc_histogram *h);
+__private_extern__ uint64_t xpc_abs_to_nsec(uint64_t abstime);
 __private_extern__ void xpc_dictionary_set_value_nokeycheck(xpc_object_t xdict, const char *key, xpc_object_t value);
+__private_extern__ void xpc_dictionary_append_value_nocheck(xpc_object_t xdict, const char *key, xpc_object_t value);
+__private_extern__ void xpc_dictionary_reserve(xpc_object_t xdict, size_t count, size_t keybytes);
+__private_extern__ void xpc_dict_pair_free(struct xpc_object *xo, struct xpc_dict_pair *pair);
+__private_extern__ void xpc_array_reserve(xpc_object_t xarray, size_t count);
+__private_extern__ void *xpc_message_template_pack(struct xpc_object *xo,
+    size_t *sizep);
+__private_extern__ void xpc_hash_invalidate(struct xpc_object *xo);
+__private_extern__ uint64_t xpc_data_hash(const void *data, size_t length,
+    uint64_t seed);
+__private_extern__ xpc_object_t xpc_create_from_bplist(const void *data,
+    size_t size);
+__private_extern__ os_log_t xpc_log_handle(void);
 __private_extern__ void xpc_api_misuse(const char *info, ...) __attribute__((noreturn, format(printf, 1, 2)));
 
 #define xpc_precondition(cond, message, ...) \
@@ -169,6 +353,8 @@ __private_extern__ void xpc_api_misuse(const char *info, ...) __attribute__((nor
 	xpc_precondition(xo != NULL, "Parameter cannot be NULL")
 #define xpc_assert_type(xo, type) \
 	xpc_precondition(xo->xo_xpc_type == type, "object type mismatch: Expected %s", #type);
+#define xpc_assert_mutable(xo) \
+	xpc_precondition((xo->xo_flags & _XPC_FROZEN) == 0, "cannot modify a frozen object")
 
 #define XPC_RESERVED_KEY_PREFIX	"__xpc_internal__:"
 
@@ -0,0 +1,1002 @@
+/*
+ * Copyright 2020 PureDarwin Project
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+#include "xpc_internal.h"
+
+/*
+ * JSON has no data, UUID or date values, and no integers beyond what a
+ * double holds exactly. Those are written as single-key objects:
+ *
+ *	{"$data": "<base64>"}	{"$uuid": "<uuid string>"}
+ *	{"$date": <ns since 1970>}	{"$double": "nan" | "inf" | "-inf"}
+ *
+ * Integers are written as plain numbers; the reader makes int64 of
+ * anything that fits and uint64 of larger ones. A dictionary that would
+ * look like a tag (one key, starting with '$') is wrapped as
+ * {"$dict": {...}} so that it reads back as itself.
+ */
+
+#define	XPC_JSON_MAX_DEPTH	512
+#define	XPC_JSON_BUFSIZE	4096
+
+/* A dictionary that would read back as a tag if written as it is */
+static bool
+xpc_json_looks_tagged(struct xpc_object *xo)
+{
+
+	return (xo->xo_xpc_type == XPC_TYPE_DICTIONARY && xo->xo_size == 1 &&
+	    TAILQ_FIRST(&xo->xo_dict)->key[0] == '$');
+}
+
+#pragma mark Writer
+
+struct xpc_json_writer {
+	xpc_json_write_func_t	xjw_func;
+	void *			xjw_context;
+	int			xjw_flags;
+	int			xjw_error;
+	size_t			xjw_len;
+	char			xjw_buf[XPC_JSON_BUFSIZE];
+};
+
+static const char xpc_json_base64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void
+xpc_json_flush(struct xpc_json_writer *w)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < w->xjw_len && w->xjw_error == 0; off += n) {
+		n = w->xjw_func(w->xjw_context, w->xjw_buf + off,
+		    w->xjw_len - off);
+		if (n <= 0)
+			w->xjw_error = n < 0 ? errno : EIO;
+	}
+
+	w->xjw_len = 0;
+}
+
+static void
+xpc_json_put(struct xpc_json_writer *w, const char *s, size_t len)
+{
+	size_t n;
+
+	while (len > 0 && w->xjw_error == 0) {
+		if (w->xjw_len == sizeof(w->xjw_buf))
+			xpc_json_flush(w);
+		n = MIN(len, sizeof(w->xjw_buf) - w->xjw_len);
+		memcpy(w->xjw_buf + w->xjw_len, s, n);
+		w->xjw_len += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static void
+xpc_json_putc(struct xpc_json_writer *w, char c)
+{
+
+	if (w->xjw_len == sizeof(w->xjw_buf))
+		xpc_json_flush(w);
+	w->xjw_buf[w->xjw_len++] = c;
+}
+
+static void
+xpc_json_newline(struct xpc_json_writer *w, int depth)
+{
+
+	if ((w->xjw_flags & XPC_JSON_PRETTY) == 0)
+		return;
+
+	xpc_json_putc(w, '\n');
+	while (depth-- > 0)
+		xpc_json_put(w, "    ", 4);
+}
+
+/*
+ * Length of the well-formed UTF-8 sequence at p, or 0: no overlong forms,
+ * surrogates or code points above U+10FFFF.
+ */
+static size_t
+xpc_json_utf8_len(const unsigned char *p, size_t left)
+{
+	size_t i, n;
+	uint32_t c, min;
+
+	if (p[0] < 0xc2 || p[0] > 0xf4)
+		return (0);
+	if (p[0] < 0xe0) {
+		n = 2;
+		c = p[0] & 0x1f;
+		min = 0x80;
+	} else if (p[0] < 0xf0) {
+		n = 3;
+		c = p[0] & 0x0f;
+		min = 0x800;
+	} else {
+		n = 4;
+		c = p[0] & 0x07;
+		min = 0x10000;
+	}
+
+	if (n > left)
+		return (0);
+	for (i = 1; i < n; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return (0);
+		c = (c << 6) | (p[i] & 0x3f);
+	}
+
+	if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+		return (0);
+	return (n);
+}
+
+/* JSON text is Unicode, so strings that are not valid UTF-8 fail with EILSEQ */
+static void
+xpc_json_string(struct xpc_json_writer *w, const char *s, size_t len)
+{
+	char esc[7];
+	size_t i, n, run;
+	unsigned char c;
+
+	xpc_json_putc(w, '"');
+	for (i = run = 0; i < len; i++) {
+		c = (unsigned char)s[i];
+		if (c >= 0x80) {
+			n = xpc_json_utf8_len((const unsigned char *)s + i,
+			    len - i);
+			if (n == 0) {
+				w->xjw_error = EILSEQ;
+				return;
+			}
+			i += n - 1;
+			continue;
+		}
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		xpc_json_put(w, s + run, i - run);
+		run = i + 1;
+		switch (c) {
+		case '"':
+			xpc_json_put(w, "\\\"", 2);
+			break;
+		case '\\':
+			xpc_json_put(w, "\\\\", 2);
+			break;
+		case '\n':
+			xpc_json_put(w, "\\n", 2);
+			break;
+		case '\t':
+			xpc_json_put(w, "\\t", 2);
+			break;
+		default:
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			xpc_json_put(w, esc, 6);
+			break;
+		}
+	}
+
+	xpc_json_put(w, s + run, len - run);
+	xpc_json_putc(w, '"');
+}
+
+static void
+xpc_json_tag(struct xpc_json_writer *w, const char *tag)
+{
+
+	xpc_json_putc(w, '{');
+	xpc_json_string(w, tag, strlen(tag));
+	xpc_json_putc(w, ':');
+}
+
+static void
+xpc_json_data(struct xpc_json_writer *w, const uint8_t *p, size_t len)
+{
+	char out[4];
+	uint32_t v;
+	size_t i;
+
+	xpc_json_tag(w, "$data");
+	xpc_json_putc(w, '"');
+	for (i = 0; i + 3 <= len; i += 3) {
+		v = (uint32_t)p[i] << 16 | (uint32_t)p[i + 1] << 8 | p[i + 2];
+		out[0] = xpc_json_base64[v >> 18];
+		out[1] = xpc_json_base64[(v >> 12) & 0x3f];
+		out[2] = xpc_json_base64[(v >> 6) & 0x3f];
+		out[3] = xpc_json_base64[v & 0x3f];
+		xpc_json_put(w, out, 4);
+	}
+
+	if (i < len) {
+		v = (uint32_t)p[i] << 16;
+		if (i + 1 < len)
+			v |= (uint32_t)p[i + 1] << 8;
+		out[0] = xpc_json_base64[v >> 18];
+		out[1] = xpc_json_base64[(v >> 12) & 0x3f];
+		out[2] = i + 1 < len ? xpc_json_base64[(v >> 6) & 0x3f] : '=';
+		out[3] = '=';
+		xpc_json_put(w, out, 4);
+	}
+
+	xpc_json_put(w, "\"}", 2);
+}
+
+static void
+xpc_json_double(struct xpc_json_writer *w, double d)
+{
+	const char *name;
+	char buf[32];
+	int n;
+
+	if (isnan(d) || isinf(d)) {
+		name = isnan(d) ? "nan" : d > 0 ? "inf" : "-inf";
+		xpc_json_tag(w, "$double");
+		xpc_json_string(w, name, strlen(name));
+		xpc_json_putc(w, '}');
+		return;
+	}
+
+	/* Shortest form that reads back exactly, and still reads as a real */
+	n = snprintf(buf, sizeof(buf), "%.15g", d);
+	if (strtod(buf, NULL) != d)
+		n = snprintf(buf, sizeof(buf), "%.17g", d);
+	if (strpbrk(buf, ".eE") == NULL)
+		n += snprintf(buf + n, sizeof(buf) - n, ".0");
+	xpc_json_put(w, buf, (size_t)n);
+}
+
+static void
+xpc_json_value(struct xpc_json_writer *w, struct xpc_object *xo, int depth);
+
+static void
+xpc_json_dictionary(struct xpc_json_writer *w, struct xpc_object *xo, int depth)
+{
+	struct xpc_dict_pair *pair;
+	bool wrap, first;
+
+	wrap = xpc_json_looks_tagged(xo);
+	if (wrap) {
+		xpc_json_tag(w, "$dict");
+		depth++;
+	}
+
+	xpc_json_putc(w, '{');
+	first = true;
+	TAILQ_FOREACH(pair, &xo->xo_dict, xo_link) {
+		if (!first)
+			xpc_json_putc(w, ',');
+		first = false;
+		xpc_json_newline(w, depth + 1);
+		xpc_json_string(w, pair->key, strlen(pair->key));
+		xpc_json_put(w, ": ", (w->xjw_flags & XPC_JSON_PRETTY) ? 2 : 1);
+		xpc_json_value(w, pair->value, depth + 1);
+	}
+
+	if (!first)
+		xpc_json_newline(w, depth);
+	xpc_json_putc(w, '}');
+
+	if (wrap)
+		xpc_json_putc(w, '}');
+}
+
+static void
+xpc_json_value(struct xpc_json_writer *w, struct xpc_object *xo, int depth)
+{
+	uuid_string_t uuid;
+	xpc_type_t type;
+	char buf[32];
+	size_t i;
+	int n;
+
+	if (w->xjw_error != 0)
+		return;
+
+	if (depth > XPC_JSON_MAX_DEPTH) {
+		w->xjw_error = EINVAL;
+		return;
+	}
+
+	type = xo->xo_xpc_type;
+	if (type == XPC_TYPE_DICTIONARY) {
+		xpc_json_dictionary(w, xo, depth);
+	} else if (type == XPC_TYPE_ARRAY) {
+		xpc_json_putc(w, '[');
+		for (i = 0; i < xo->xo_size; i++) {
+			if (i > 0)
+				xpc_json_putc(w, ',');
+			xpc_json_newline(w, depth + 1);
+			xpc_json_value(w, xo->xo_array.xa_items[i], depth + 1);
+		}
+		if (xo->xo_size > 0)
+			xpc_json_newline(w, depth);
+		xpc_json_putc(w, ']');
+	} else if (type == XPC_TYPE_STRING) {
+		xpc_json_string(w, xo->xo_str, xo->xo_size);
+	} else if (type == XPC_TYPE_INT64) {
+		n = snprintf(buf, sizeof(buf), "%" PRId64, xo->xo_int);
+		xpc_json_put(w, buf, (size_t)n);
+	} else if (type == XPC_TYPE_UINT64) {
+		n = snprintf(buf, sizeof(buf), "%" PRIu64, xo->xo_uint);
+		xpc_json_put(w, buf, (size_t)n);
+	} else if (type == XPC_TYPE_BOOL) {
+		if (xo->xo_bool)
+			xpc_json_put(w, "true", 4);
+		else
+			xpc_json_put(w, "false", 5);
+	} else if (type == XPC_TYPE_NULL) {
+		xpc_json_put(w, "null", 4);
+	} else if (type == XPC_TYPE_DOUBLE) {
+		xpc_json_double(w, xo->xo_d);
+	} else if (type == XPC_TYPE_DATE) {
+		xpc_json_tag(w, "$date");
+		n = snprintf(buf, sizeof(buf), "%" PRId64 "}", xo->xo_int);
+		xpc_json_put(w, buf, (size_t)n);
+	} else if (type == XPC_TYPE_DATA) {
+		xpc_json_data(w, (const uint8_t *)xo->xo_ptr, xo->xo_size);
+	} else if (type == XPC_TYPE_UUID) {
+		uuid_unparse_upper(xo->xo_uuid, uuid);
+		xpc_json_tag(w, "$uuid");
+		xpc_json_string(w, uuid, strlen(uuid));
+		xpc_json_putc(w, '}');
+	} else if (w->xjw_flags & XPC_JSON_SKIP_UNSUPPORTED) {
+		xpc_json_put(w, "null", 4);
+	} else {
+		w->xjw_error = EINVAL;
+	}
+}
+
+/*
+ * Output goes through a fixed buffer, so memory use does not depend on the
+ * size of the object. On failure, func may have been given the start of
+ * the output, up to the last full buffer before the error; the rest is
+ * dropped.
+ */
+int
+xpc_json_write(xpc_object_t object, xpc_json_write_func_t func, void *context,
+    int flags)
+{
+	struct xpc_json_writer *w;
+	int error;
+
+	xpc_assert_nonnull(object);
+
+	w = malloc(sizeof(*w));
+	if (w == NULL)
+		return (ENOMEM);
+
+	w->xjw_func = func;
+	w->xjw_context = context;
+	w->xjw_flags = flags;
+	w->xjw_error = 0;
+	w->xjw_len = 0;
+
+	xpc_json_value(w, object, 0);
+	if (flags & XPC_JSON_PRETTY)
+		xpc_json_putc(w, '\n');
+	if (w->xjw_error == 0)
+		xpc_json_flush(w);
+
+	error = w->xjw_error;
+	free(w);
+	return (error);
+}
+
+static ssize_t
+xpc_json_write_to_fd(void *context, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	do {
+		n = write((int)(intptr_t)context, buf, len);
+	} while (n == -1 && errno == EINTR);
+
+	return (n);
+}
+
+int
+xpc_json_write_fd(xpc_object_t object, int fd, int flags)
+{
+
+	return (xpc_json_write(object, xpc_json_write_to_fd,
+	    (void *)(intptr_t)fd, flags));
+}
+
+#pragma mark Reader
+
+struct xpc_json_reader {
+	const char *		xjr_cur;
+	const char *		xjr_end;
+	char *			xjr_text;
+	size_t			xjr_textlen;
+	size_t			xjr_textcap;
+};
+
+static xpc_object_t xpc_json_read_value(struct xpc_json_reader *r, int depth);
+static xpc_object_t xpc_json_read_object(struct xpc_json_reader *r, int depth,
+    bool tags);
+
+static void
+xpc_json_skip_space(struct xpc_json_reader *r)
+{
+
+	while (r->xjr_cur < r->xjr_end && (*r->xjr_cur == ' ' ||
+	    *r->xjr_cur == '\t' || *r->xjr_cur == '\n' || *r->xjr_cur == '\r'))
+		r->xjr_cur++;
+}
+
+static bool
+xpc_json_expect(struct xpc_json_reader *r, char c)
+{
+
+	xpc_json_skip_space(r);
+	if (r->xjr_cur == r->xjr_end || *r->xjr_cur != c)
+		return (false);
+	r->xjr_cur++;
+	return (true);
+}
+
+static bool
+xpc_json_literal(struct xpc_json_reader *r, const char *s, size_t len)
+{
+
+	if ((size_t)(r->xjr_end - r->xjr_cur) < len ||
+	    memcmp(r->xjr_cur, s, len) != 0)
+		return (false);
+	r->xjr_cur += len;
+	return (true);
+}
+
+static bool
+xpc_json_text_append(struct xpc_json_reader *r, const char *s, size_t len)
+{
+	size_t cap;
+	char *text;
+
+	if (r->xjr_textlen + len + 1 > r->xjr_textcap) {
+		cap = r->xjr_textcap ? r->xjr_textcap : 256;
+		while (cap < r->xjr_textlen + len + 1)
+			cap *= 2;
+		text = realloc(r->xjr_text, cap);
+		if (text == NULL)
+			return (false);
+		r->xjr_text = text;
+		r->xjr_textcap = cap;
+	}
+
+	memcpy(r->xjr_text + r->xjr_textlen, s, len);
+	r->xjr_textlen += len;
+	r->xjr_text[r->xjr_textlen] = '\0';
+	return (true);
+}
+
+static int
+xpc_json_hex4(const char *p)
+{
+	int i, v;
+
+	v = 0;
+	for (i = 0; i < 4; i++) {
+		v <<= 4;
+		if (p[i] >= '0' && p[i] <= '9')
+			v |= p[i] - '0';
+		else if (p[i] >= 'a' && p[i] <= 'f')
+			v |= p[i] - 'a' + 10;
+		else if (p[i] >= 'A' && p[i] <= 'F')
+			v |= p[i] - 'A' + 10;
+		else
+			return (-1);
+	}
+
+	return (v);
+}
+
+static bool
+xpc_json_escape(struct xpc_json_reader *r)
+{
+	char out[4];
+	int c, c2;
+	size_t n;
+
+	if (r->xjr_cur == r->xjr_end)
+		return (false);
+
+	switch (*r->xjr_cur++) {
+	case '"':	return (xpc_json_text_append(r, "\"", 1));
+	case '\\':	return (xpc_json_text_append(r, "\\", 1));
+	case '/':	return (xpc_json_text_append(r, "/", 1));
+	case 'b':	return (xpc_json_text_append(r, "\b", 1));
+	case 'f':	return (xpc_json_text_append(r, "\f", 1));
+	case 'n':	return (xpc_json_text_append(r, "\n", 1));
+	case 'r':	return (xpc_json_text_append(r, "\r", 1));
+	case 't':	return (xpc_json_text_append(r, "\t", 1));
+	case 'u':	break;
+	default:	return (false);
+	}
+
+	if (r->xjr_end - r->xjr_cur < 4 || (c = xpc_json_hex4(r->xjr_cur)) < 0)
+		return (false);
+	r->xjr_cur += 4;
+
+	/* Surrogate pairs */
+	if (c >= 0xd800 && c < 0xdc00) {
+		if (r->xjr_end - r->xjr_cur < 6 || r->xjr_cur[0] != '\\' ||
+		    r->xjr_cur[1] != 'u' ||
+		    (c2 = xpc_json_hex4(r->xjr_cur + 2)) < 0xdc00 || c2 >= 0xe000)
+			return (false);
+		r->xjr_cur += 6;
+		c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+	} else if (c >= 0xdc00 && c < 0xe000) {
+		return (false);
+	}
+
+	/* Strings are NUL-terminated */
+	if (c == 0)
+		return (false);
+
+	if (c < 0x80) {
+		out[0] = (char)c;
+		n = 1;
+	} else if (c < 0x800) {
+		out[0] = (char)(0xc0 | (c >> 6));
+		out[1] = (char)(0x80 | (c & 0x3f));
+		n = 2;
+	} else if (c < 0x10000) {
+		out[0] = (char)(0xe0 | (c >> 12));
+		out[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+		out[2] = (char)(0x80 | (c & 0x3f));
+		n = 3;
+	} else {
+		out[0] = (char)(0xf0 | (c >> 18));
+		out[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+		out[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+		out[3] = (char)(0x80 | (c & 0x3f));
+		n = 4;
+	}
+
+	return (xpc_json_text_append(r, out, n));
+}
+
+/* Reads a string into xjr_text; unescaped runs are copied in one piece */
+static bool
+xpc_json_read_string(struct xpc_json_reader *r)
+{
+	const char *run;
+
+	r->xjr_textlen = 0;
+	if (!xpc_json_expect(r, '"') || !xpc_json_text_append(r, "", 0))
+		return (false);
+
+	for (run = r->xjr_cur; r->xjr_cur < r->xjr_end; ) {
+		if (*r->xjr_cur == '"') {
+			if (!xpc_json_text_append(r, run, r->xjr_cur - run))
+				return (false);
+			r->xjr_cur++;
+			return (true);
+		}
+
+		if ((unsigned char)*r->xjr_cur < 0x20)
+			return (false);
+
+		if (*r->xjr_cur == '\\') {
+			if (!xpc_json_text_append(r, run, r->xjr_cur - run))
+				return (false);
+			r->xjr_cur++;
+			if (!xpc_json_escape(r))
+				return (false);
+			run = r->xjr_cur;
+			continue;
+		}
+
+		r->xjr_cur++;
+	}
+
+	return (false);
+}
+
+static bool
+xpc_json_digits(struct xpc_json_reader *r)
+{
+	const char *start;
+
+	start = r->xjr_cur;
+	while (r->xjr_cur < r->xjr_end && *r->xjr_cur >= '0' &&
+	    *r->xjr_cur <= '9')
+		r->xjr_cur++;
+	return (r->xjr_cur != start);
+}
+
+/*
+ * Numbers as RFC 8259 has them: an optional minus, no leading zeros, and
+ * digits on both sides of a decimal point. Numbers with a fraction or
+ * exponent are doubles, and must be finite.
+ */
+static xpc_object_t
+xpc_json_read_number(struct xpc_json_reader *r)
+{
+	const char *start;
+	char buf[64], *end;
+	uint64_t u;
+	int64_t v;
+	double d;
+	bool real;
+	size_t len;
+
+	start = r->xjr_cur;
+	real = false;
+	if (r->xjr_cur < r->xjr_end && *r->xjr_cur == '-')
+		r->xjr_cur++;
+	if (r->xjr_cur < r->xjr_end && *r->xjr_cur == '0')
+		r->xjr_cur++;
+	else if (!xpc_json_digits(r))
+		return (NULL);
+
+	if (r->xjr_cur < r->xjr_end && *r->xjr_cur == '.') {
+		r->xjr_cur++;
+		if (!xpc_json_digits(r))
+			return (NULL);
+		real = true;
+	}
+
+	if (r->xjr_cur < r->xjr_end && (*r->xjr_cur == 'e' ||
+	    *r->xjr_cur == 'E')) {
+		r->xjr_cur++;
+		if (r->xjr_cur < r->xjr_end && (*r->xjr_cur == '+' ||
+		    *r->xjr_cur == '-'))
+			r->xjr_cur++;
+		if (!xpc_json_digits(r))
+			return (NULL);
+		real = true;
+	}
+
+	len = (size_t)(r->xjr_cur - start);
+	if (len >= sizeof(buf))
+		return (NULL);
+	memcpy(buf, start, len);
+	buf[len] = '\0';
+
+	errno = 0;
+	if (real) {
+		d = strtod(buf, &end);
+		if (*end != '\0' || isinf(d))
+			return (NULL);
+		return (xpc_double_create(d));
+	}
+
+	if (buf[0] == '-') {
+		v = strtoll(buf, &end, 10);
+		if (*end != '\0' || errno != 0)
+			return (NULL);
+		return (xpc_int64_create(v));
+	}
+
+	u = strtoull(buf, &end, 10);
+	if (*end != '\0' || errno != 0)
+		return (NULL);
+	if (u > INT64_MAX)
+		return (xpc_uint64_create(u));
+	return (xpc_int64_create((int64_t)u));
+}
+
+static int
+xpc_json_base64_value(char c)
+{
+	const char *p;
+
+	if (c == '\0' || (p = strchr(xpc_json_base64, c)) == NULL)
+		return (-1);
+	return ((int)(p - xpc_json_base64));
+}
+
+/* Decodes xjr_text in place */
+static xpc_object_t
+xpc_json_decode_data(struct xpc_json_reader *r)
+{
+	unsigned char *out;
+	uint32_t acc;
+	size_t i, len;
+	int bits, v;
+
+	out = (unsigned char *)r->xjr_text;
+	len = 0;
+	acc = 0;
+	bits = 0;
+	for (i = 0; i < r->xjr_textlen; i++) {
+		if (r->xjr_text[i] == '=')
+			break;
+		if ((v = xpc_json_base64_value(r->xjr_text[i])) < 0)
+			return (NULL);
+
+		acc = (acc << 6) | (uint32_t)v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out[len++] = (unsigned char)(acc >> bits);
+		}
+	}
+
+	/* A single character left over cannot encode a byte */
+	if (bits == 6)
+		return (NULL);
+
+	return (xpc_data_create(out, len));
+}
+
+/* The value of a {"$tag": value} object; the key has been read */
+static xpc_object_t
+xpc_json_read_tagged(struct xpc_json_reader *r, int depth)
+{
+	xpc_object_t result, value;
+	uuid_t uuid;
+	char tag[8];
+
+	if (r->xjr_textlen >= sizeof(tag))
+		return (NULL);
+	strlcpy(tag, r->xjr_text, sizeof(tag));
+
+	/* The wrapped dictionary is taken literally, whatever its key */
+	if (strcmp(tag, "$dict") == 0) {
+		if (!xpc_json_expect(r, '{'))
+			return (NULL);
+		return (xpc_json_read_object(r, depth + 1, false));
+	}
+
+	if (strcmp(tag, "$date") == 0) {
+		xpc_json_skip_space(r);
+		value = xpc_json_read_number(r);
+		if (value == NULL || xpc_get_type(value) != XPC_TYPE_INT64) {
+			if (value != NULL)
+				xpc_release(value);
+			return (NULL);
+		}
+		result = xpc_date_create(xpc_int64_get_value(value));
+		xpc_release(value);
+		return (result);
+	}
+
+	if (!xpc_json_read_string(r))
+		return (NULL);
+
+	if (strcmp(tag, "$data") == 0)
+		return (xpc_json_decode_data(r));
+
+	if (strcmp(tag, "$uuid") == 0) {
+		if (uuid_parse(r->xjr_text, uuid) != 0)
+			return (NULL);
+		return (xpc_uuid_create(uuid));
+	}
+
+	if (strcmp(tag, "$double") == 0) {
+		if (strcmp(r->xjr_text, "nan") == 0)
+			return (xpc_double_create(NAN));
+		if (strcmp(r->xjr_text, "inf") == 0)
+			return (xpc_double_create(INFINITY));
+		if (strcmp(r->xjr_text, "-inf") == 0)
+			return (xpc_double_create(-INFINITY));
+	}
+
+	return (NULL);
+}
+
+static xpc_object_t
+xpc_json_read_object(struct xpc_json_reader *r, int depth, bool tags)
+{
+	xpc_object_t result, value;
+	const char *save;
+	char keybuf[128], *key;
+	bool first;
+
+	result = xpc_dictionary_create(NULL, NULL, 0);
+	first = tags;
+	if (xpc_json_expect(r, '}'))
+		return (result);
+
+	do {
+		if (!xpc_json_read_string(r) || !xpc_json_expect(r, ':'))
+			goto fail;
+
+		/* Reading the value reuses xjr_text; most keys fit on the stack */
+		if (r->xjr_textlen < sizeof(keybuf))
+			key = memcpy(keybuf, r->xjr_text, r->xjr_textlen + 1);
+		else if ((key = strdup(r->xjr_text)) == NULL)
+			goto fail;
+
+		/* A lone "$..." key is a type tag */
+		value = NULL;
+		if (first && key[0] == '$') {
+			xpc_json_skip_space(r);
+			save = r->xjr_cur;
+			value = xpc_json_read_tagged(r, depth);
+			if (value != NULL && xpc_json_expect(r, '}')) {
+				if (key != keybuf)
+					free(key);
+				xpc_release(result);
+				return (value);
+			}
+
+			/*
+			 * An ordinary key after all. Reading a "$dict" object
+			 * again would give the same dictionary unless it is a
+			 * lone "$..." key itself, and would fail just the same;
+			 * reading it again at every level of nesting doubles
+			 * the work each time.
+			 */
+			if (strcmp(key, "$dict") == 0 && save < r->xjr_end &&
+			    *save == '{' && depth < XPC_JSON_MAX_DEPTH) {
+				if (value == NULL) {
+					if (key != keybuf)
+						free(key);
+					goto fail;
+				}
+				if (xpc_json_looks_tagged(value)) {
+					xpc_release(value);
+					value = NULL;
+				}
+			} else if (value != NULL) {
+				xpc_release(value);
+				value = NULL;
+			}
+			if (value == NULL)
+				r->xjr_cur = save;
+		}
+		first = false;
+
+		if (value == NULL && strncmp(key, XPC_RESERVED_KEY_PREFIX,
+		    strlen(XPC_RESERVED_KEY_PREFIX)) != 0)
+			value = xpc_json_read_value(r, depth + 1);
+		if (value != NULL) {
+			xpc_dictionary_set_value(result, key, value);
+			xpc_release(value);
+		}
+		if (key != keybuf)
+			free(key);
+		if (value == NULL)
+			goto fail;
+	} while (xpc_json_expect(r, ','));
+
+	if (!xpc_json_expect(r, '}'))
+		goto fail;
+
+	return (result);
+
+fail:
+	xpc_release(result);
+	return (NULL);
+}
+
+static xpc_object_t
+xpc_json_read_array(struct xpc_json_reader *r, int depth)
+{
+	xpc_object_t result, value;
+
+	result = xpc_array_create(NULL, 0);
+	if (xpc_json_expect(r, ']'))
+		return (result);
+
+	do {
+		if ((value = xpc_json_read_value(r, depth + 1)) == NULL)
+			goto fail;
+		xpc_array_append_value(result, value);
+		xpc_release(value);
+	} while (xpc_json_expect(r, ','));
+
+	if (!xpc_json_expect(r, ']'))
+		goto fail;
+
+	return (result);
+
+fail:
+	xpc_release(result);
+	return (NULL);
+}
+
+static xpc_object_t
+xpc_json_read_value(struct xpc_json_reader *r, int depth)
+{
+
+	if (depth > XPC_JSON_MAX_DEPTH)
+		return (NULL);
+
+	xpc_json_skip_space(r);
+	if (r->xjr_cur == r->xjr_end)
+		return (NULL);
+
+	switch (*r->xjr_cur) {
+	case '{':
+		r->xjr_cur++;
+		return (xpc_json_read_object(r, depth, true));
+	case '[':
+		r->xjr_cur++;
+		return (xpc_json_read_array(r, depth));
+	case '"':
+		if (!xpc_json_read_string(r))
+			return (NULL);
+		return (xpc_string_create(r->xjr_text));
+	case 't':
+		if (!xpc_json_literal(r, "true", 4))
+			return (NULL);
+		return (xpc_bool_create(true));
+	case 'f':
+		if (!xpc_json_literal(r, "false", 5))
+			return (NULL);
+		return (xpc_bool_create(false));
+	case 'n':
+		if (!xpc_json_literal(r, "null", 4))
+			return (NULL);
+		return (xpc_null_create());
+	default:
+		return (xpc_json_read_number(r));
+	}
+}
+
+xpc_object_t
+xpc_create_from_json(const void *data, size_t size)
+{
+	struct xpc_json_reader r;
+	xpc_object_t result;
+
+	if (data == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.xjr_cur = data;
+	r.xjr_end = r.xjr_cur + size;
+
+	result = xpc_json_read_value(&r, 0);
+	xpc_json_skip_space(&r);
+	if (result != NULL && r.xjr_cur != r.xjr_end) {
+		xpc_release(result);
+		result = NULL;
+	}
+
+	if (result == NULL) {
+		debugf("JSON parse error at offset %zu",
+		    (size_t)(r.xjr_cur - (const char *)data));
+		errno = EINVAL;
+	}
+
+	free(r.xjr_text);
+	return (result);
+}
@@ -31,6 +31,7 @@
 #include <mach/mach.h>
 #include <mach/message.h>
 #include <xpc/launchd.h>
+#include <xpc/private.h>
 #include <assert.h>
 #include <syslog.h>
 #include <stdarg.h>
@@ -53,6 +54,7 @@ struct xpc_message {
 	mach_msg_ool_descriptor_t ool_data;
 	mach_msg_ool_ports_descriptor_t ool_ports;
 	uint64_t id;
+	uint32_t priority;
 	mach_msg_trailer_t trailer;
 };
 
@@ -75,22 +77,24 @@ xpc_dictionary_destroy(struct xpc_object *dict)
 	TAILQ_FOREACH_SAFE(p, head, xo_link, ptmp) {
 		TAILQ_REMOVE(head, p, xo_link);
 		xpc_release(p->value);
-		free(p);
+		xpc_dict_pair_free(dict, p);
 	}
+
+	if (dict->xo_arena != NULL && dict->xo_arena->xda_template != NULL)
+		xpc_message_template_release(dict->xo_arena->xda_template);
+
+	free(dict->xo_arena);
 }
 
 static void
-xpc_array_destroy(struct xpc_object *dict)
+xpc_array_destroy(struct xpc_object *array)
 {
-	struct xpc_object *p, *ptmp;
-	struct xpc_array_head *head;
+	size_t i;
 
-	head = &dict->xo_array;
+	for (i = 0; i < array->xo_size; i++)
+		xpc_release(array->xo_array.xa_items[i]);
 
-	TAILQ_FOREACH_SAFE(p, head, xo_link, ptmp) {
-		TAILQ_REMOVE(head, p, xo_link);
-		xpc_release(p);
-	}
+	free(array->xo_array.xa_items);
 }
 
 void
@@ -124,6 +128,93 @@ xpc_release(xpc_object_t obj)
 	os_release(obj);
 }
 
+/*
+ * Frozen objects can no longer be modified, so any number of owners can
+ * share them: xpc_copy() of a frozen object, or of a tree containing
+ * frozen subtrees, only takes references to them. Freezing is one way.
+ */
+void
+xpc_object_freeze(xpc_object_t obj)
+{
+	struct xpc_object *xo;
+	struct xpc_dict_pair *pair;
+	size_t i;
+
+	xo = obj;
+	xpc_assert_nonnull(xo);
+
+	if ((xo->xo_flags & _XPC_FROZEN) ||
+	    xo->header.ref_cnt == _OS_OBJECT_GLOBAL_REFCNT)
+		return;
+
+	xo->xo_flags |= _XPC_FROZEN;
+
+	if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link)
+			xpc_object_freeze(pair->value);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
+		for (i = 0; i < xo->xo_size; i++)
+			xpc_object_freeze(xo->xo_array.xa_items[i]);
+	}
+}
+
+xpc_object_t
+xpc_copy(xpc_object_t obj)
+{
+	struct xpc_object *xo, *xocopy, *xotmp;
+	struct xpc_dict_pair *pair;
+	xpc_u val;
+	size_t i, keybytes;
+
+	xo = obj;
+	xpc_assert_nonnull(xo);
+
+	if ((xo->xo_flags & _XPC_FROZEN) ||
+	    xo->header.ref_cnt == _OS_OBJECT_GLOBAL_REFCNT)
+		return (xpc_retain(xo));
+
+	if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
+		xocopy = xpc_dictionary_create(NULL, NULL, 0);
+		keybytes = 0;
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link)
+			keybytes += strlen(pair->key);
+		xpc_dictionary_reserve(xocopy, xo->xo_size, keybytes);
+
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link) {
+			xotmp = xpc_copy(pair->value);
+			xpc_dictionary_append_value_nocheck(xocopy, pair->key,
+			    xotmp);
+		}
+		return (xocopy);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
+		bzero(&val, sizeof(val));
+		xocopy = _xpc_prim_create(XPC_TYPE_ARRAY, val, 0);
+		if (xo->xo_size == 0)
+			return (xocopy);
+
+		xocopy->xo_array.xa_items = malloc(xo->xo_size *
+		    sizeof(struct xpc_object *));
+		xocopy->xo_array.xa_capacity = xo->xo_size;
+		for (i = 0; i < xo->xo_size; i++)
+			xocopy->xo_array.xa_items[i] =
+			    xpc_copy(xo->xo_array.xa_items[i]);
+		xocopy->xo_size = xo->xo_size;
+		return (xocopy);
+	}
+
+	if (xo->xo_xpc_type == XPC_TYPE_STRING)
+		return (xpc_string_create(xo->xo_str));
+
+	if (xo->xo_xpc_type == XPC_TYPE_DATA)
+		return (xpc_data_create((const void *)xo->xo_ptr, xo->xo_size));
+
+	return (_xpc_prim_create(xo->xo_xpc_type, xo->xo_u, xo->xo_size));
+}
+
 static const char *xpc_errors[] = {
 	"No Error Found",
 	"No Memory",
@@ -183,7 +274,6 @@ xpc_copy_description_level(xpc_object_t obj, struct sbuf *sbuf, int level)
 		memcpy(id, xpc_uuid_get_bytes(obj), sizeof(uuid_t));
 		uuid_unparse_upper(id, uuid_str);
 		sbuf_printf(sbuf, "%s\n", uuid_str);
-		free(uuid_str);
 	} else if (xo->xo_xpc_type == XPC_TYPE_ENDPOINT) {
 		sbuf_printf(sbuf, "<%lld>\n", xo->xo_int);
 	} else if (xo->xo_xpc_type == XPC_TYPE_NULL) {
@@ -193,8 +283,6 @@ xpc_copy_description_level(xpc_object_t obj, struct sbuf *sbuf, int level)
 	}
 }
 
-extern struct sbuf *sbuf_new_auto(void);
-
 char *
 xpc_copy_description(xpc_object_t obj)
 {
@@ -275,6 +363,8 @@ xpc_pipe_routine_reply(xpc_object_t xobj)
 	message->header.msgh_local_port = MACH_PORT_NULL;
 	message->id = xpc_dictionary_get_uint64(xobj, XPC_SEQID);
 	xpc_assert(message->id != 0, "'%s' key not found in reply", XPC_SEQID);
+	message->priority = (xo->xo_flags & _XPC_PRIORITY_MASK) >>
+	    _XPC_PRIORITY_SHIFT;
 
 	const mach_msg_ool_descriptor_t ool_data = {
 		packed, // address
@@ -312,11 +402,13 @@ xpc_pipe_routine_reply(xpc_object_t xobj)
 
 int
 xpc_pipe_send(xpc_object_t xobj, mach_port_t dst, mach_port_t local,
-    uint64_t id)
+    uint64_t id, size_t *sizep)
 {
 	struct xpc_object *xo;
 	size_t size, msg_size;
 	struct xpc_message *message;
+	nvlist_t *nvl;
+	void *packed;
 	kern_return_t kr;
 	int err;
 
@@ -328,33 +420,38 @@ xpc_pipe_send(xpc_object_t xobj, mach_port_t dst, mach_port_t local,
 	xo = xobj;
 	xpc_assert(xo->xo_xpc_type == XPC_TYPE_DICTIONARY, "xpc_object_t not of %s type", "dictionary");
 
-	nvlist_t *nvl = xpc2nv(xobj, ^(mach_port_t port) {
-		int64_t port_index = port_set.port_count++;
-
-		if (port_index > port_set.buffer_size) {
-			port_set.buffer_size *= 2;
-			port_set.buffer = realloc(port_set.buffer, port_set.buffer_size * sizeof(mach_port_t));
-		}
-
-		kern_return_t kr = mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
-		xpc_assert(kr == KERN_SUCCESS, "mach_port_insert_right() failed");
-
-		port_set.buffer[port_index] = port;
-		return port_index;
-	});
-
-	size = nvlist_size(nvl);
-
 	msg_size = __DARWIN_ALIGN(sizeof(struct xpc_message));
 	if ((message = calloc(msg_size, 1)) == NULL)
 		return (ENOMEM);
 
-	void *packed = nvlist_pack_buffer(nvl, NULL, &size);
+	/* Messages that still match their template carry no ports */
+	nvl = NULL;
+	packed = xpc_message_template_pack(xo, &size);
 	if (packed == NULL) {
-		debugf("Could not pack XPC message for transport");
-		free(message);
-		nvlist_destroy(nvl);
-		return (EINVAL);
+		nvl = xpc2nv(xobj, ^(mach_port_t port) {
+			int64_t port_index = port_set.port_count++;
+
+			if (port_index > port_set.buffer_size) {
+				port_set.buffer_size *= 2;
+				port_set.buffer = realloc(port_set.buffer, port_set.buffer_size * sizeof(mach_port_t));
+			}
+
+			kern_return_t kr = mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+			xpc_assert(kr == KERN_SUCCESS, "mach_port_insert_right() failed");
+
+			port_set.buffer[port_index] = port;
+			return port_index;
+		});
+
+		size = nvlist_size(nvl);
+		packed = nvlist_pack_buffer(nvl, NULL, &size);
+		if (packed == NULL) {
+			debugf("Could not pack XPC message for transport");
+			free(message);
+			free(port_set.buffer);
+			nvlist_destroy(nvl);
+			return (EINVAL);
+		}
 	}
 
 	message->header.msgh_size = (mach_msg_size_t)msg_size;
@@ -363,6 +460,8 @@ xpc_pipe_send(xpc_object_t xobj, mach_port_t dst, mach_port_t local,
 	message->header.msgh_remote_port = dst;
 	message->header.msgh_local_port = local;
 	message->id = id;
+	message->priority = (xo->xo_flags & _XPC_PRIORITY_MASK) >>
+	    _XPC_PRIORITY_SHIFT;
 
 	const mach_msg_ool_descriptor_t ool_data = {
 		packed, // address
@@ -392,6 +491,8 @@ xpc_pipe_send(xpc_object_t xobj, mach_port_t dst, mach_port_t local,
 		err = (kr == KERN_INVALID_TASK) ? EPIPE : EINVAL;
 	} else
 		err = 0;
+	if (sizep != NULL)
+		*sizep = size;
 	free(packed);
 	free(message);
 	free(port_set.buffer);
@@ -401,7 +502,7 @@ xpc_pipe_send(xpc_object_t xobj, mach_port_t dst, mach_port_t local,
 
 int
 xpc_pipe_receive(mach_port_t local, mach_port_t *remote, xpc_object_t *result,
-    uint64_t *id)
+    uint64_t *id, size_t *sizep)
 {
 	struct xpc_message message;
 	mach_msg_header_t *request;
@@ -427,6 +528,8 @@ xpc_pipe_receive(mach_port_t local, mach_port_t *remote, xpc_object_t *result,
 	*id = message.id;
 	data_size = message.ool_data.size;
 	debugf("unpacking data_size=%zu", data_size);
+	if (sizep != NULL)
+		*sizep = data_size;
 
 	nvlist_t *nv = nvlist_unpack(&message.ool_data.address, data_size);
 	xo = nv2xpc(nv, ^(int64_t port_index) {
@@ -466,7 +569,8 @@ xpc_pipe_receive(mach_port_t local, mach_port_t *remote, xpc_object_t *result,
 		xpc_release(xotmp);
 	}
 
-	xo->xo_flags |= _XPC_FROM_WIRE;
+	xo->xo_flags |= _XPC_FROM_WIRE |
+	    ((message.priority << _XPC_PRIORITY_SHIFT) & _XPC_PRIORITY_MASK);
 	*result = xo;
 	return (0);
 }
@@ -535,7 +639,8 @@ xpc_pipe_try_receive(mach_port_t portset, xpc_object_t *requestobj, mach_port_t
 
 	xpc_dictionary_set_mach_send(xo, XPC_RPORT, request->msgh_remote_port);
 	xpc_dictionary_set_uint64(xo, XPC_SEQID, message.id);
-	xo->xo_flags |= _XPC_FROM_WIRE;
+	xo->xo_flags |= _XPC_FROM_WIRE |
+	    ((message.priority << _XPC_PRIORITY_SHIFT) & _XPC_PRIORITY_MASK);
 	*requestobj = xo;
 	return (0);
 }
@@ -0,0 +1,782 @@
+/*
+ * Copyright 2020 PureDarwin Project
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+#include "xpc_internal.h"
+
+/*
+ * XML property list parser. The input is scanned once, element by
+ * element, and every element is handed to a builder as soon as it is
+ * complete, so objects are created directly from the bytes with no
+ * intermediate tree. Containers being filled are kept on an explicit
+ * stack rather than by recursion, which bounds the nesting we accept
+ * without bounding the C stack.
+ */
+
+#define	XPC_PLIST_MAX_DEPTH	512
+
+enum xpc_plist_tag {
+	XPC_PLIST_NONE,
+	XPC_PLIST_PLIST,
+	XPC_PLIST_DICT,
+	XPC_PLIST_ARRAY,
+	XPC_PLIST_KEY,
+	XPC_PLIST_STRING,
+	XPC_PLIST_INTEGER,
+	XPC_PLIST_REAL,
+	XPC_PLIST_TRUE,
+	XPC_PLIST_FALSE,
+	XPC_PLIST_DATA,
+	XPC_PLIST_DATE,
+};
+
+static const struct {
+	const char *	name;
+	size_t		len;
+	enum xpc_plist_tag tag;
+} xpc_plist_tags[] = {
+	{ "plist", 5, XPC_PLIST_PLIST },
+	{ "dict", 4, XPC_PLIST_DICT },
+	{ "array", 5, XPC_PLIST_ARRAY },
+	{ "key", 3, XPC_PLIST_KEY },
+	{ "string", 6, XPC_PLIST_STRING },
+	{ "integer", 7, XPC_PLIST_INTEGER },
+	{ "real", 4, XPC_PLIST_REAL },
+	{ "true", 4, XPC_PLIST_TRUE },
+	{ "false", 5, XPC_PLIST_FALSE },
+	{ "data", 4, XPC_PLIST_DATA },
+	{ "date", 4, XPC_PLIST_DATE },
+};
+
+struct xpc_plist_frame {
+	enum xpc_plist_tag	xf_tag;
+	xpc_object_t		xf_container;	/* NULL for <plist> */
+	char *			xf_key;		/* pending dictionary key */
+};
+
+struct xpc_plist_parser {
+	const char *		xp_cur;
+	const char *		xp_end;
+	const char *		xp_error;
+	struct xpc_plist_frame	xp_stack[XPC_PLIST_MAX_DEPTH];
+	size_t			xp_depth;
+	xpc_object_t		xp_result;
+	char *			xp_text;	/* decoded character data */
+	size_t			xp_textlen;
+	size_t			xp_textcap;
+};
+
+static bool
+xpc_plist_fail(struct xpc_plist_parser *p, const char *error)
+{
+
+	if (p->xp_error == NULL)
+		p->xp_error = error;
+	return (false);
+}
+
+static bool
+xpc_plist_starts(struct xpc_plist_parser *p, const char *s, size_t len)
+{
+
+	return ((size_t)(p->xp_end - p->xp_cur) >= len &&
+	    memcmp(p->xp_cur, s, len) == 0);
+}
+
+static void
+xpc_plist_skip_space(struct xpc_plist_parser *p)
+{
+
+	while (p->xp_cur < p->xp_end && (*p->xp_cur == ' ' ||
+	    *p->xp_cur == '\t' || *p->xp_cur == '\n' || *p->xp_cur == '\r'))
+		p->xp_cur++;
+}
+
+/* Move past the next occurrence of s */
+static bool
+xpc_plist_skip_past(struct xpc_plist_parser *p, const char *s, size_t len)
+{
+	const char *found;
+
+	found = memmem(p->xp_cur, p->xp_end - p->xp_cur, s, len);
+	if (found == NULL)
+		return (xpc_plist_fail(p, "unterminated markup"));
+
+	p->xp_cur = found + len;
+	return (true);
+}
+
+static bool
+xpc_plist_text_append(struct xpc_plist_parser *p, const char *s, size_t len)
+{
+	char *text;
+	size_t cap;
+
+	if (p->xp_textlen + len + 1 > p->xp_textcap) {
+		cap = p->xp_textcap ? p->xp_textcap : 256;
+		while (cap < p->xp_textlen + len + 1)
+			cap *= 2;
+		text = realloc(p->xp_text, cap);
+		if (text == NULL)
+			return (xpc_plist_fail(p, "out of memory"));
+		p->xp_text = text;
+		p->xp_textcap = cap;
+	}
+
+	memcpy(p->xp_text + p->xp_textlen, s, len);
+	p->xp_textlen += len;
+	p->xp_text[p->xp_textlen] = '\0';
+	return (true);
+}
+
+static bool
+xpc_plist_append_utf8(struct xpc_plist_parser *p, unsigned long c)
+{
+	char buf[4];
+	size_t len;
+
+	if (c < 0x80) {
+		buf[0] = (char)c;
+		len = 1;
+	} else if (c < 0x800) {
+		buf[0] = (char)(0xc0 | (c >> 6));
+		buf[1] = (char)(0x80 | (c & 0x3f));
+		len = 2;
+	} else if (c < 0x10000) {
+		buf[0] = (char)(0xe0 | (c >> 12));
+		buf[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+		buf[2] = (char)(0x80 | (c & 0x3f));
+		len = 3;
+	} else if (c < 0x110000) {
+		buf[0] = (char)(0xf0 | (c >> 18));
+		buf[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+		buf[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+		buf[3] = (char)(0x80 | (c & 0x3f));
+		len = 4;
+	} else
+		return (xpc_plist_fail(p, "invalid character reference"));
+
+	return (xpc_plist_text_append(p, buf, len));
+}
+
+/*
+ * The code point of a character reference, given what follows "&#" up to
+ * the ';': decimal digits, or 'x' and hex digits, and nothing else. NUL
+ * and surrogates are not characters XML allows.
+ */
+static bool
+xpc_plist_char_ref(const char *s, const char *end, unsigned long *cp)
+{
+	unsigned long c, base, digit;
+
+	base = 10;
+	if (*s == 'x') {
+		base = 16;
+		s++;
+	}
+	if (s == end)
+		return (false);
+
+	for (c = 0; s < end; s++) {
+		if (*s >= '0' && *s <= '9')
+			digit = *s - '0';
+		else if (base == 16 && *s >= 'a' && *s <= 'f')
+			digit = *s - 'a' + 10;
+		else if (base == 16 && *s >= 'A' && *s <= 'F')
+			digit = *s - 'A' + 10;
+		else
+			return (false);
+
+		c = c * base + digit;
+		if (c > 0x10ffff)
+			return (false);
+	}
+
+	if (c == 0 || (c >= 0xd800 && c <= 0xdfff))
+		return (false);
+
+	*cp = c;
+	return (true);
+}
+
+static bool
+xpc_plist_entity(struct xpc_plist_parser *p)
+{
+	const char *end;
+	unsigned long c;
+	size_t len;
+
+	end = memchr(p->xp_cur, ';', p->xp_end - p->xp_cur);
+	if (end == NULL)
+		return (xpc_plist_fail(p, "unterminated entity"));
+
+	len = end - p->xp_cur + 1;
+	if (len == 4 && memcmp(p->xp_cur, "&lt;", 4) == 0)
+		c = '<';
+	else if (len == 4 && memcmp(p->xp_cur, "&gt;", 4) == 0)
+		c = '>';
+	else if (len == 5 && memcmp(p->xp_cur, "&amp;", 5) == 0)
+		c = '&';
+	else if (len == 6 && memcmp(p->xp_cur, "&quot;", 6) == 0)
+		c = '"';
+	else if (len == 6 && memcmp(p->xp_cur, "&apos;", 6) == 0)
+		c = '\'';
+	else if (len > 3 && p->xp_cur[1] == '#') {
+		if (!xpc_plist_char_ref(p->xp_cur + 2, end, &c))
+			return (xpc_plist_fail(p, "invalid character reference"));
+	} else
+		return (xpc_plist_fail(p, "unknown entity"));
+
+	p->xp_cur = end + 1;
+	return (xpc_plist_append_utf8(p, c));
+}
+
+/*
+ * Collect the character data of a leaf element up to its end tag,
+ * decoding entities and CDATA sections into xp_text.
+ */
+static bool
+xpc_plist_read_text(struct xpc_plist_parser *p, const char *name, size_t len)
+{
+	const char *start, *end;
+
+	p->xp_textlen = 0;
+	if (!xpc_plist_text_append(p, "", 0))
+		return (false);
+
+	for (;;) {
+		start = p->xp_cur;
+		while (p->xp_cur < p->xp_end && *p->xp_cur != '<' &&
+		    *p->xp_cur != '&')
+			p->xp_cur++;
+		if (!xpc_plist_text_append(p, start, p->xp_cur - start))
+			return (false);
+
+		if (p->xp_cur == p->xp_end)
+			return (xpc_plist_fail(p, "unexpected end of input"));
+
+		if (*p->xp_cur == '&') {
+			if (!xpc_plist_entity(p))
+				return (false);
+			continue;
+		}
+
+		if (xpc_plist_starts(p, "<![CDATA[", 9)) {
+			p->xp_cur += 9;
+			start = p->xp_cur;
+			if (!xpc_plist_skip_past(p, "]]>", 3))
+				return (false);
+			if (!xpc_plist_text_append(p, start, p->xp_cur - 3 - start))
+				return (false);
+			continue;
+		}
+
+		if (xpc_plist_starts(p, "<!--", 4)) {
+			if (!xpc_plist_skip_past(p, "-->", 3))
+				return (false);
+			continue;
+		}
+
+		break;
+	}
+
+	/* The only markup allowed inside a leaf is its own end tag */
+	end = p->xp_cur;
+	if ((size_t)(p->xp_end - end) < len + 3 || end[1] != '/' ||
+	    memcmp(end + 2, name, len) != 0)
+		return (xpc_plist_fail(p, "mismatched end tag"));
+
+	p->xp_cur = end + 2 + len;
+	xpc_plist_skip_space(p);
+	if (p->xp_cur == p->xp_end || *p->xp_cur != '>')
+		return (xpc_plist_fail(p, "mismatched end tag"));
+
+	p->xp_cur++;
+	return (true);
+}
+
+static void
+xpc_plist_trim(struct xpc_plist_parser *p)
+{
+	char *text;
+	size_t len;
+
+	text = p->xp_text;
+	len = p->xp_textlen;
+	while (len > 0 && strchr(" \t\r\n", text[len - 1]) != NULL)
+		len--;
+	while (len > 0 && strchr(" \t\r\n", *text) != NULL) {
+		text++;
+		len--;
+	}
+
+	memmove(p->xp_text, text, len);
+	p->xp_text[len] = '\0';
+	p->xp_textlen = len;
+}
+
+static xpc_object_t
+xpc_plist_integer(struct xpc_plist_parser *p)
+{
+	const char *s;
+	char *end;
+	unsigned long long u;
+	long long i;
+	int base;
+
+	xpc_plist_trim(p);
+	s = p->xp_text;
+	base = 10;
+	if ((s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) ||
+	    (s[0] == '-' && s[1] == '0' && (s[2] == 'x' || s[2] == 'X')))
+		base = 16;
+
+	errno = 0;
+	if (s[0] != '-') {
+		u = strtoull(s, &end, base);
+		if (end == s || *end != '\0' || errno != 0)
+			return (NULL);
+		if (u > INT64_MAX)
+			return (xpc_uint64_create(u));
+		return (xpc_int64_create((int64_t)u));
+	}
+
+	i = strtoll(s, &end, base);
+	if (end == s || *end != '\0' || errno != 0)
+		return (NULL);
+	return (xpc_int64_create(i));
+}
+
+static xpc_object_t
+xpc_plist_real(struct xpc_plist_parser *p)
+{
+	char *end;
+	double d;
+
+	xpc_plist_trim(p);
+	if (strcmp(p->xp_text, "nan") == 0)
+		return (xpc_double_create(NAN));
+	if (strcmp(p->xp_text, "+infinity") == 0)
+		return (xpc_double_create(INFINITY));
+	if (strcmp(p->xp_text, "-infinity") == 0)
+		return (xpc_double_create(-INFINITY));
+
+	d = strtod(p->xp_text, &end);
+	if (end == p->xp_text || *end != '\0')
+		return (NULL);
+	return (xpc_double_create(d));
+}
+
+static xpc_object_t
+xpc_plist_date(struct xpc_plist_parser *p)
+{
+	struct tm tm;
+	char *end;
+	time_t t;
+
+	xpc_plist_trim(p);
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(p->xp_text, "%Y-%m-%dT%H:%M:%SZ", &tm);
+	if (end == NULL || *end != '\0')
+		return (NULL);
+
+	t = timegm(&tm);
+	return (xpc_date_create((int64_t)t * NSEC_PER_SEC));
+}
+
+static int
+xpc_plist_base64_value(char c)
+{
+
+	if (c >= 'A' && c <= 'Z')
+		return (c - 'A');
+	if (c >= 'a' && c <= 'z')
+		return (c - 'a' + 26);
+	if (c >= '0' && c <= '9')
+		return (c - '0' + 52);
+	if (c == '+')
+		return (62);
+	if (c == '/')
+		return (63);
+	return (-1);
+}
+
+/* Decodes in place; whitespace is skipped and padding ends the data */
+static xpc_object_t
+xpc_plist_data(struct xpc_plist_parser *p)
+{
+	unsigned char *out;
+	uint32_t acc;
+	size_t i, len;
+	int bits, v;
+
+	out = (unsigned char *)p->xp_text;
+	len = 0;
+	acc = 0;
+	bits = 0;
+	for (i = 0; i < p->xp_textlen; i++) {
+		if (p->xp_text[i] == '=')
+			break;
+		if (strchr(" \t\r\n", p->xp_text[i]) != NULL)
+			continue;
+		if ((v = xpc_plist_base64_value(p->xp_text[i])) < 0)
+			return (NULL);
+
+		acc = (acc << 6) | (uint32_t)v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out[len++] = (unsigned char)(acc >> bits);
+		}
+	}
+
+	return (xpc_data_create(out, len));
+}
+
+/* Hand a finished value to the container on top of the stack */
+static bool
+xpc_plist_emit(struct xpc_plist_parser *p, xpc_object_t value)
+{
+	struct xpc_plist_frame *top;
+
+	if (value == NULL)
+		return (xpc_plist_fail(p, "malformed value"));
+
+	if (p->xp_depth == 0 || p->xp_stack[p->xp_depth - 1].xf_container ==
+	    NULL) {
+		if (p->xp_result != NULL) {
+			xpc_release(value);
+			return (xpc_plist_fail(p, "more than one top-level value"));
+		}
+		p->xp_result = value;
+		return (true);
+	}
+
+	top = &p->xp_stack[p->xp_depth - 1];
+	if (top->xf_tag == XPC_PLIST_ARRAY) {
+		xpc_array_append_value(top->xf_container, value);
+		xpc_release(value);
+		return (true);
+	}
+
+	if (top->xf_key == NULL) {
+		xpc_release(value);
+		return (xpc_plist_fail(p, "dictionary value without a key"));
+	}
+
+	xpc_dictionary_set_value(top->xf_container, top->xf_key, value);
+	xpc_release(value);
+	free(top->xf_key);
+	top->xf_key = NULL;
+	return (true);
+}
+
+static bool
+xpc_plist_push(struct xpc_plist_parser *p, enum xpc_plist_tag tag,
+    xpc_object_t container)
+{
+	struct xpc_plist_frame *frame;
+
+	if (p->xp_depth == XPC_PLIST_MAX_DEPTH) {
+		if (container != NULL)
+			xpc_release(container);
+		return (xpc_plist_fail(p, "nested too deeply"));
+	}
+
+	frame = &p->xp_stack[p->xp_depth++];
+	frame->xf_tag = tag;
+	frame->xf_container = container;
+	frame->xf_key = NULL;
+	return (true);
+}
+
+static bool
+xpc_plist_pop(struct xpc_plist_parser *p, enum xpc_plist_tag tag)
+{
+	struct xpc_plist_frame *frame;
+
+	if (p->xp_depth == 0 || p->xp_stack[p->xp_depth - 1].xf_tag != tag)
+		return (xpc_plist_fail(p, "mismatched end tag"));
+
+	frame = &p->xp_stack[--p->xp_depth];
+	if (frame->xf_key != NULL) {
+		free(frame->xf_key);
+		if (frame->xf_container != NULL)
+			xpc_release(frame->xf_container);
+		return (xpc_plist_fail(p, "dictionary key without a value"));
+	}
+
+	if (frame->xf_container == NULL)
+		return (true);
+
+	return (xpc_plist_emit(p, frame->xf_container));
+}
+
+static bool
+xpc_plist_key(struct xpc_plist_parser *p)
+{
+	struct xpc_plist_frame *top;
+
+	if (p->xp_depth == 0)
+		return (xpc_plist_fail(p, "key outside of a dictionary"));
+
+	top = &p->xp_stack[p->xp_depth - 1];
+	if (top->xf_tag != XPC_PLIST_DICT || top->xf_key != NULL)
+		return (xpc_plist_fail(p, "unexpected key"));
+
+	if (strncmp(p->xp_text, XPC_RESERVED_KEY_PREFIX,
+	    strlen(XPC_RESERVED_KEY_PREFIX)) == 0)
+		return (xpc_plist_fail(p, "reserved dictionary key"));
+
+	top->xf_key = strndup(p->xp_text, p->xp_textlen);
+	if (top->xf_key == NULL)
+		return (xpc_plist_fail(p, "out of memory"));
+	return (true);
+}
+
+static enum xpc_plist_tag
+xpc_plist_lookup_tag(const char *name, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(xpc_plist_tags) / sizeof(xpc_plist_tags[0]); i++)
+		if (xpc_plist_tags[i].len == len &&
+		    memcmp(xpc_plist_tags[i].name, name, len) == 0)
+			return (xpc_plist_tags[i].tag);
+
+	return (XPC_PLIST_NONE);
+}
+
+/* One start or end tag, together with the content of leaf elements */
+static bool
+xpc_plist_element(struct xpc_plist_parser *p)
+{
+	enum xpc_plist_tag tag;
+	const char *name, *gt;
+	size_t len;
+	bool closing, empty;
+
+	p->xp_cur++;
+	closing = (p->xp_cur < p->xp_end && *p->xp_cur == '/');
+	if (closing)
+		p->xp_cur++;
+
+	name = p->xp_cur;
+	while (p->xp_cur < p->xp_end && strchr(" \t\r\n/>", *p->xp_cur) == NULL)
+		p->xp_cur++;
+	len = p->xp_cur - name;
+
+	/* Attributes (only <plist version=...> has any) are ignored */
+	gt = memchr(p->xp_cur, '>', p->xp_end - p->xp_cur);
+	if (gt == NULL)
+		return (xpc_plist_fail(p, "unterminated tag"));
+	empty = !closing && gt[-1] == '/';
+	p->xp_cur = gt + 1;
+
+	tag = xpc_plist_lookup_tag(name, len);
+	if (tag == XPC_PLIST_NONE)
+		return (xpc_plist_fail(p, "unknown element"));
+
+	if (closing)
+		return (xpc_plist_pop(p, tag));
+
+	switch (tag) {
+	case XPC_PLIST_PLIST:
+		if (p->xp_depth != 0)
+			return (xpc_plist_fail(p, "nested plist element"));
+		return (empty || xpc_plist_push(p, tag, NULL));
+
+	case XPC_PLIST_DICT:
+		if (empty)
+			return (xpc_plist_emit(p,
+			    xpc_dictionary_create(NULL, NULL, 0)));
+		return (xpc_plist_push(p, tag,
+		    xpc_dictionary_create(NULL, NULL, 0)));
+
+	case XPC_PLIST_ARRAY:
+		if (empty)
+			return (xpc_plist_emit(p, xpc_array_create(NULL, 0)));
+		return (xpc_plist_push(p, tag, xpc_array_create(NULL, 0)));
+
+	case XPC_PLIST_TRUE:
+	case XPC_PLIST_FALSE:
+		if (!empty && !xpc_plist_read_text(p, name, len))
+			return (false);
+		return (xpc_plist_emit(p,
+		    xpc_bool_create(tag == XPC_PLIST_TRUE)));
+
+	default:
+		break;
+	}
+
+	if (empty) {
+		p->xp_textlen = 0;
+		if (!xpc_plist_text_append(p, "", 0))
+			return (false);
+	} else if (!xpc_plist_read_text(p, name, len))
+		return (false);
+
+	switch (tag) {
+	case XPC_PLIST_KEY:
+		return (xpc_plist_key(p));
+	case XPC_PLIST_STRING:
+		return (xpc_plist_emit(p, xpc_string_create(p->xp_text)));
+	case XPC_PLIST_INTEGER:
+		return (xpc_plist_emit(p, xpc_plist_integer(p)));
+	case XPC_PLIST_REAL:
+		return (xpc_plist_emit(p, xpc_plist_real(p)));
+	case XPC_PLIST_DATA:
+		return (xpc_plist_emit(p, xpc_plist_data(p)));
+	case XPC_PLIST_DATE:
+		return (xpc_plist_emit(p, xpc_plist_date(p)));
+	default:
+		return (xpc_plist_fail(p, "unexpected element"));
+	}
+}
+
+static bool
+xpc_plist_parse(struct xpc_plist_parser *p)
+{
+
+	for (;;) {
+		xpc_plist_skip_space(p);
+		if (p->xp_cur == p->xp_end)
+			break;
+
+		if (*p->xp_cur != '<')
+			return (xpc_plist_fail(p, "text outside of an element"));
+
+		if (xpc_plist_starts(p, "<?", 2)) {
+			if (!xpc_plist_skip_past(p, "?>", 2))
+				return (false);
+		} else if (xpc_plist_starts(p, "<!--", 4)) {
+			if (!xpc_plist_skip_past(p, "-->", 3))
+				return (false);
+		} else if (xpc_plist_starts(p, "<!", 2)) {
+			if (!xpc_plist_skip_past(p, ">", 1))
+				return (false);
+		} else if (!xpc_plist_element(p))
+			return (false);
+	}
+
+	if (p->xp_depth != 0)
+		return (xpc_plist_fail(p, "unexpected end of input"));
+	if (p->xp_result == NULL)
+		return (xpc_plist_fail(p, "no value"));
+	return (true);
+}
+
+xpc_object_t
+xpc_create_from_plist(void *data, size_t size)
+{
+	struct xpc_plist_parser *p;
+	xpc_object_t result;
+
+	if (data == NULL || size == 0) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	if (size >= 8 && memcmp(data, "bplist00", 8) == 0)
+		return (xpc_create_from_bplist(data, size));
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return (NULL);
+
+	p->xp_cur = data;
+	p->xp_end = p->xp_cur + size;
+
+	if (xpc_plist_parse(p)) {
+		result = p->xp_result;
+	} else {
+		debugf("plist parse error at offset %zu: %s",
+		    (size_t)(p->xp_cur - (const char *)data), p->xp_error);
+		while (p->xp_depth > 0) {
+			p->xp_depth--;
+			free(p->xp_stack[p->xp_depth].xf_key);
+			if (p->xp_stack[p->xp_depth].xf_container != NULL)
+				xpc_release(p->xp_stack[p->xp_depth].xf_container);
+		}
+		if (p->xp_result != NULL)
+			xpc_release(p->xp_result);
+		result = NULL;
+		errno = EINVAL;
+	}
+
+	free(p->xp_text);
+	free(p);
+	return (result);
+}
+
+xpc_object_t
+xpc_create_from_plist_file(const char *path)
+{
+	xpc_object_t result;
+	struct stat st;
+	void *data;
+	int fd, saved_errno;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return (NULL);
+
+	if (fstat(fd, &st) == -1) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return (NULL);
+	}
+
+	if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return (NULL);
+
+	result = xpc_create_from_plist(data, (size_t)st.st_size);
+	saved_errno = errno;
+	munmap(data, (size_t)st.st_size);
+	errno = saved_errno;
+	return (result);
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2020 PureDarwin Project
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <xpc/xpc.h>
+#include <stdatomic.h>
+#include "xpc_internal.h"
+
+/*
+ * Per-connection statistics. The counters are plain relaxed atomics
+ * that are always maintained. The latency histograms need a clock read
+ * per message, so they are only allocated, and only fed, once somebody
+ * has called xpc_connection_copy_statistics() on the connection.
+ */
+
+#define	XPC_HISTOGRAM_SUB_MASK	((1 << XPC_HISTOGRAM_SUB_BITS) - 1)
+
+static mach_timebase_info_data_t xpc_timebase;
+static dispatch_once_t xpc_timebase_once;
+
+static void
+xpc_timebase_init(void *context __unused)
+{
+
+	(void)mach_timebase_info(&xpc_timebase);
+}
+
+__private_extern__ uint64_t
+xpc_abs_to_nsec(uint64_t abstime)
+{
+
+	dispatch_once_f(&xpc_timebase_once, NULL, xpc_timebase_init);
+	if (xpc_timebase.numer == xpc_timebase.denom)
+		return (abstime);
+
+	return (abstime * xpc_timebase.numer / xpc_timebase.denom);
+}
+
+static unsigned int
+xpc_histogram_index(uint64_t value)
+{
+	unsigned int exponent;
+
+	if (value <= XPC_HISTOGRAM_SUB_MASK)
+		return ((unsigned int)value);
+
+	exponent = 63 - __builtin_clzll(value);
+	return (((exponent - XPC_HISTOGRAM_SUB_BITS + 1) <<
+	    XPC_HISTOGRAM_SUB_BITS) |
+	    ((value >> (exponent - XPC_HISTOGRAM_SUB_BITS)) &
+	    XPC_HISTOGRAM_SUB_MASK));
+}
+
+/* Smallest value that lands in the given bucket */
+static uint64_t
+xpc_histogram_lower_bound(unsigned int index)
+{
+	unsigned int exponent;
+
+	if (index <= XPC_HISTOGRAM_SUB_MASK)
+		return (index);
+
+	exponent = (index >> XPC_HISTOGRAM_SUB_BITS) +
+	    XPC_HISTOGRAM_SUB_BITS - 1;
+	return ((1ULL << exponent) | ((uint64_t)(index &
+	    XPC_HISTOGRAM_SUB_MASK) << (exponent - XPC_HISTOGRAM_SUB_BITS)));
+}
+
+__private_extern__ void
+xpc_histogram_record(struct xpc_histogram *h, uint64_t abstime)
+{
+	uint64_t value, max;
+
+	value = xpc_abs_to_nsec(abstime);
+
+	atomic_fetch_add_explicit(&h->xh_count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->xh_sum, value, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->xh_buckets[xpc_histogram_index(value)],
+	    1, memory_order_relaxed);
+
+	max = atomic_load_explicit(&h->xh_max, memory_order_relaxed);
+	while (value > max && !atomic_compare_exchange_weak_explicit(
+	    &h->xh_max, &max, value, memory_order_relaxed,
+	    memory_order_relaxed))
+		;
+}
+
+static uint64_t
+xpc_histogram_percentile(const uint64_t *buckets, uint64_t count,
+    double percentile)
+{
+	uint64_t target, seen;
+	unsigned int i;
+
+	if (count == 0)
+		return (0);
+
+	target = (uint64_t)(count * percentile / 100.0);
+	if (target == 0)
+		target = 1;
+
+	seen = 0;
+	for (i = 0; i < XPC_HISTOGRAM_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= target)
+			return (xpc_histogram_lower_bound(i));
+	}
+
+	return (xpc_histogram_lower_bound(XPC_HISTOGRAM_BUCKETS - 1));
+}
+
+/*
+ * Snapshot a histogram into a dictionary. All values are in nanoseconds;
+ * "buckets" only lists non-empty buckets, as [lower bound, count] pairs.
+ */
+__private_extern__ xpc_object_t
+xpc_histogram_copy_description(struct xpc_histogram *h)
+{
+	uint64_t buckets[XPC_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	xpc_object_t dict, list, pair;
+	unsigned int i;
+
+	count = 0;
+	for (i = 0; i < XPC_HISTOGRAM_BUCKETS; i++) {
+		buckets[i] = atomic_load_explicit(&h->xh_buckets[i],
+		    memory_order_relaxed);
+		count += buckets[i];
+	}
+
+	dict = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_uint64(dict, "count", count);
+	xpc_dictionary_set_uint64(dict, "sum", atomic_load_explicit(&h->xh_sum,
+	    memory_order_relaxed));
+	xpc_dictionary_set_uint64(dict, "max", atomic_load_explicit(&h->xh_max,
+	    memory_order_relaxed));
+	xpc_dictionary_set_uint64(dict, "p50",
+	    xpc_histogram_percentile(buckets, count, 50.0));
+	xpc_dictionary_set_uint64(dict, "p90",
+	    xpc_histogram_percentile(buckets, count, 90.0));
+	xpc_dictionary_set_uint64(dict, "p99",
+	    xpc_histogram_percentile(buckets, count, 99.0));
+	xpc_dictionary_set_uint64(dict, "p99.9",
+	    xpc_histogram_percentile(buckets, count, 99.9));
+
+	list = xpc_array_create(NULL, 0);
+	for (i = 0; i < XPC_HISTOGRAM_BUCKETS; i++) {
+		if (buckets[i] == 0)
+			continue;
+
+		pair = xpc_array_create(NULL, 0);
+		xpc_array_set_uint64(pair, XPC_ARRAY_APPEND,
+		    xpc_histogram_lower_bound(i));
+		xpc_array_set_uint64(pair, XPC_ARRAY_APPEND, buckets[i]);
+		xpc_array_append_value(list, pair);
+		xpc_release(pair);
+	}
+
+	xpc_dictionary_set_value(dict, "buckets", list);
+	xpc_release(list);
+	return (dict);
+}
+
+static struct xpc_connection_histograms *
+xpc_connection_histograms(struct xpc_connection *conn)
+{
+	struct xpc_connection_histograms *hist, *expected;
+
+	hist = atomic_load(&conn->xc_histograms);
+	if (hist != NULL)
+		return (hist);
+
+	hist = calloc(1, sizeof(*hist));
+	if (hist == NULL)
+		return (NULL);
+
+	expected = NULL;
+	if (!atomic_compare_exchange_strong(&conn->xc_histograms, &expected,
+	    hist)) {
+		free(hist);
+		return (expected);
+	}
+
+	return (hist);
+}
+
+xpc_object_t
+xpc_connection_copy_statistics(xpc_connection_t xconn)
+{
+	struct xpc_connection *conn;
+	struct xpc_connection_histograms *hist;
+	xpc_object_t dict, tmp;
+
+	conn = xconn;
+	xpc_assert_nonnull(conn);
+
+	dict = xpc_dictionary_create(NULL, NULL, 0);
+
+#define	XPC_STAT(key, field) \
+	xpc_dictionary_set_uint64(dict, key, \
+	    atomic_load_explicit(&conn->field, memory_order_relaxed))
+
+	XPC_STAT("messages sent", xc_stat_msgs_sent);
+	XPC_STAT("bytes sent", xc_stat_bytes_sent);
+	XPC_STAT("messages received", xc_stat_msgs_received);
+	XPC_STAT("bytes received", xc_stat_bytes_received);
+	XPC_STAT("send errors", xc_stat_send_errors);
+	XPC_STAT("pending replies", xc_stat_pending);
+	XPC_STAT("send queue messages", xc_queued_msgs);
+	XPC_STAT("send queue bytes", xc_queued_bytes);
+
+#undef XPC_STAT
+
+	xpc_dictionary_set_uint64(dict, "send window", conn->xc_send_window);
+	xpc_dictionary_set_bool(dict, "throttled",
+	    atomic_load(&conn->xc_fc_throttled));
+
+	hist = xpc_connection_histograms(conn);
+	if (hist != NULL) {
+		tmp = xpc_histogram_copy_description(&hist->xch_reply_latency);
+		xpc_dictionary_set_value(dict, "reply latency", tmp);
+		xpc_release(tmp);
+
+		tmp = xpc_histogram_copy_description(&hist->xch_handler_time);
+		xpc_dictionary_set_value(dict, "handler time", tmp);
+		xpc_release(tmp);
+	}
+
+	return (dict);
+}
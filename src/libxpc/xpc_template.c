@@ -0,0 +1,464 @@
+/*
+ * Copyright 2020 PureDarwin Project
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <mach/mach.h>
+#include <stdatomic.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+#include "xpc_internal.h"
+
+/*
+ * Message templates. A message created from a template is an ordinary
+ * dictionary, so every other API works on it, but its entries sit in
+ * its arena at offsets the template knows, and the packed nvpair headers
+ * and keys are computed once per template. As long as the message holds
+ * exactly the template's keys with values of the declared types, sending
+ * it only copies the values behind those precomputed headers; any other
+ * change makes it fall back to xpc2nv().
+ */
+
+static int
+xpc_message_field_nvtype(xpc_type_t type)
+{
+
+	if (type == XPC_TYPE_BOOL)
+		return (NV_TYPE_BOOL);
+	if (type == XPC_TYPE_INT64)
+		return (NV_TYPE_INT64);
+	if (type == XPC_TYPE_UINT64)
+		return (NV_TYPE_UINT64);
+	if (type == XPC_TYPE_STRING)
+		return (NV_TYPE_STRING);
+	if (type == XPC_TYPE_DATA)
+		return (NV_TYPE_BINARY);
+	if (type == XPC_TYPE_UUID)
+		return (NV_TYPE_UUID);
+
+	return (NV_TYPE_NONE);
+}
+
+/* Packed size of a value, or 0 for types whose size varies */
+static size_t
+xpc_message_field_fixed_size(int nvtype)
+{
+
+	switch (nvtype) {
+	case NV_TYPE_BOOL:
+		return (sizeof(uint8_t));
+	case NV_TYPE_INT64:
+	case NV_TYPE_UINT64:
+		return (sizeof(uint64_t));
+	case NV_TYPE_UUID:
+		return (sizeof(uuid_t));
+	default:
+		return (0);
+	}
+}
+
+static xpc_object_t
+xpc_message_field_default(xpc_type_t type)
+{
+	static const uuid_t null_uuid;
+
+	if (type == XPC_TYPE_BOOL)
+		return (xpc_bool_create(false));
+	if (type == XPC_TYPE_INT64)
+		return (xpc_int64_create(0));
+	if (type == XPC_TYPE_UINT64)
+		return (xpc_uint64_create(0));
+	if (type == XPC_TYPE_STRING)
+		return (xpc_string_create(""));
+	if (type == XPC_TYPE_DATA)
+		return (xpc_data_create(NULL, 0));
+
+	return (xpc_uuid_create(null_uuid));
+}
+
+xpc_message_template_t
+xpc_message_template_create(const xpc_message_field_t *fields, size_t count)
+{
+	struct xpc_message_template *tmpl;
+	struct xpc_message_field *field;
+	unsigned char *ptr;
+	size_t i, j, image_size;
+
+	xpc_precondition(count > 0, "a message template needs at least one field");
+
+	tmpl = calloc(1, sizeof(*tmpl) + count * sizeof(*field));
+	if (tmpl == NULL)
+		return (NULL);
+
+	atomic_init(&tmpl->xmt_refcnt, 1);
+	tmpl->xmt_count = count;
+	image_size = 0;
+	for (i = 0; i < count; i++) {
+		field = &tmpl->xmt_fields[i];
+		field->xmf_type = fields[i].type;
+		field->xmf_nvtype = xpc_message_field_nvtype(fields[i].type);
+		xpc_precondition(field->xmf_nvtype != NV_TYPE_NONE,
+		    "type of template field %s cannot be templated",
+		    fields[i].key);
+		xpc_precondition(strncmp(fields[i].key, XPC_RESERVED_KEY_PREFIX,
+		    strlen(XPC_RESERVED_KEY_PREFIX)) != 0,
+		    "Cannot add key %s to dictionary, as it is reserved for internal use",
+		    fields[i].key);
+		for (j = 0; j < i; j++)
+			xpc_precondition(strcmp(fields[j].key,
+			    fields[i].key) != 0,
+			    "duplicate template field %s", fields[i].key);
+
+		field->xmf_key = strdup(fields[i].key);
+		if (field->xmf_key == NULL) {
+			xpc_message_template_release(tmpl);
+			return (NULL);
+		}
+
+		field->xmf_pair_offset = tmpl->xmt_arena_size;
+		field->xmf_image_offset = image_size;
+		field->xmf_image_size = nvpair_pack_header_size(field->xmf_key);
+
+		tmpl->xmt_arena_size += XPC_DICT_PAIR_SIZE(strlen(field->xmf_key));
+		image_size += field->xmf_image_size;
+	}
+
+	/* Headers of variable-size fields are written per message */
+	tmpl->xmt_image = malloc(image_size);
+	if (tmpl->xmt_image == NULL) {
+		xpc_message_template_release(tmpl);
+		return (NULL);
+	}
+
+	ptr = tmpl->xmt_image;
+	for (i = 0; i < count; i++) {
+		field = &tmpl->xmt_fields[i];
+		ptr = nvpair_pack_raw_header(ptr, field->xmf_nvtype,
+		    field->xmf_key,
+		    xpc_message_field_fixed_size(field->xmf_nvtype));
+	}
+
+	tmpl->xmt_fixed_size = nvlist_pack_header_size() + image_size;
+	return (tmpl);
+}
+
+void
+xpc_message_template_release(xpc_message_template_t xtmpl)
+{
+	struct xpc_message_template *tmpl;
+	size_t i;
+
+	tmpl = xtmpl;
+	xpc_assert_nonnull(tmpl);
+
+	if (atomic_fetch_sub(&tmpl->xmt_refcnt, 1) != 1)
+		return;
+
+	for (i = 0; i < tmpl->xmt_count; i++)
+		free((void *)tmpl->xmt_fields[i].xmf_key);
+
+	free(tmpl->xmt_image);
+	free(tmpl);
+}
+
+xpc_object_t
+xpc_message_template_create_message(xpc_message_template_t xtmpl)
+{
+	struct xpc_message_template *tmpl;
+	struct xpc_dict_arena *arena;
+	struct xpc_object *xo;
+	xpc_object_t value;
+	size_t i;
+	xpc_u val = {0};
+
+	tmpl = xtmpl;
+	xpc_assert_nonnull(tmpl);
+
+	arena = malloc(sizeof(*arena) + tmpl->xmt_arena_size);
+	if (arena == NULL)
+		return (NULL);
+
+	xo = _xpc_prim_create(XPC_TYPE_DICTIONARY, val, 0);
+	if (xo == NULL) {
+		free(arena);
+		return (NULL);
+	}
+
+	arena->xda_size = tmpl->xmt_arena_size;
+	arena->xda_used = 0;
+	arena->xda_template = tmpl;
+	atomic_fetch_add(&tmpl->xmt_refcnt, 1);
+	xo->xo_arena = arena;
+
+	for (i = 0; i < tmpl->xmt_count; i++) {
+		value = xpc_message_field_default(tmpl->xmt_fields[i].xmf_type);
+		if (value == NULL) {
+			xpc_release(xo);
+			return (NULL);
+		}
+
+		xpc_dictionary_append_value_nocheck(xo,
+		    tmpl->xmt_fields[i].xmf_key, value);
+	}
+
+	return (xo);
+}
+
+static struct xpc_dict_pair *
+xpc_message_slot(xpc_object_t xmsg, size_t slot, xpc_type_t type)
+{
+	const struct xpc_message_template *tmpl;
+	struct xpc_object *xo;
+
+	xo = xmsg;
+	xpc_assert_nonnull(xo);
+	xpc_assert_type(xo, XPC_TYPE_DICTIONARY);
+	xpc_precondition(xo->xo_arena != NULL &&
+	    xo->xo_arena->xda_template != NULL,
+	    "message %p is not laid out by a template", xo);
+
+	tmpl = xo->xo_arena->xda_template;
+	xpc_precondition(slot < tmpl->xmt_count,
+	    "slot %zu out of range for a template of %zu fields", slot,
+	    tmpl->xmt_count);
+	xpc_precondition(type == NULL || tmpl->xmt_fields[slot].xmf_type == type,
+	    "template field %s has a different type",
+	    tmpl->xmt_fields[slot].xmf_key);
+
+	return ((struct xpc_dict_pair *)(xo->xo_arena->xda_bytes +
+	    tmpl->xmt_fields[slot].xmf_pair_offset));
+}
+
+/*
+ * Takes over the caller's reference to value. A NULL value, from a failed
+ * allocation, leaves the slot as it was.
+ */
+static void
+xpc_message_set_slot(xpc_object_t xmsg, size_t slot, xpc_object_t value)
+{
+	struct xpc_object *xo;
+	struct xpc_dict_pair *pair;
+	xpc_object_t old;
+
+	xo = value;
+	if (xo == NULL)
+		return;
+
+	pair = xpc_message_slot(xmsg, slot, xo->xo_xpc_type);
+	xo = xmsg;
+	xpc_assert_mutable(xo);
+	xpc_hash_invalidate(xo);
+
+	old = pair->value;
+	pair->value = value;
+	xpc_release(old);
+}
+
+/*
+ * The value in a slot if it may be updated in place: it still has the
+ * field's type, and nothing but the message holds on to it.
+ */
+static struct xpc_object *
+xpc_message_slot_owned(xpc_object_t xmsg, size_t slot, xpc_type_t type)
+{
+	struct xpc_object *xo;
+
+	xo = xmsg;
+	xpc_assert_mutable(xo);
+
+	xo = xpc_message_slot(xmsg, slot, type)->value;
+	if (xo->xo_xpc_type != type || (xo->xo_flags & _XPC_FROZEN) ||
+	    xo->header.xref_cnt != 0 || xo->header.ref_cnt != 0)
+		return (NULL);
+
+	xpc_hash_invalidate(xo);
+	return (xo);
+}
+
+void
+xpc_message_set_bool(xpc_object_t xmsg, size_t slot, bool value)
+{
+
+	/* Shared constants, so no allocation either way */
+	xpc_message_set_slot(xmsg, slot, xpc_bool_create(value));
+}
+
+void
+xpc_message_set_int64(xpc_object_t xmsg, size_t slot, int64_t value)
+{
+	struct xpc_object *xo;
+
+	xo = xpc_message_slot_owned(xmsg, slot, XPC_TYPE_INT64);
+	if (xo != NULL)
+		xo->xo_int = value;
+	else
+		xpc_message_set_slot(xmsg, slot, xpc_int64_create(value));
+}
+
+void
+xpc_message_set_uint64(xpc_object_t xmsg, size_t slot, uint64_t value)
+{
+	struct xpc_object *xo;
+
+	xo = xpc_message_slot_owned(xmsg, slot, XPC_TYPE_UINT64);
+	if (xo != NULL)
+		xo->xo_uint = value;
+	else
+		xpc_message_set_slot(xmsg, slot, xpc_uint64_create(value));
+}
+
+void
+xpc_message_set_string(xpc_object_t xmsg, size_t slot, const char *value)
+{
+
+	xpc_message_set_slot(xmsg, slot, xpc_string_create(value));
+}
+
+void
+xpc_message_set_data(xpc_object_t xmsg, size_t slot, const void *bytes,
+    size_t length)
+{
+
+	xpc_message_set_slot(xmsg, slot, xpc_data_create(bytes, length));
+}
+
+void
+xpc_message_set_uuid(xpc_object_t xmsg, size_t slot, const uuid_t value)
+{
+	struct xpc_object *xo;
+
+	xo = xpc_message_slot_owned(xmsg, slot, XPC_TYPE_UUID);
+	if (xo != NULL)
+		memcpy(xo->xo_uuid, value, sizeof(uuid_t));
+	else
+		xpc_message_set_slot(xmsg, slot, xpc_uuid_create(value));
+}
+
+xpc_object_t
+xpc_message_get_value(xpc_object_t xmsg, size_t slot)
+{
+
+	return (xpc_message_slot(xmsg, slot, NULL)->value);
+}
+
+static const void *
+xpc_message_value_bytes(struct xpc_object *value, size_t *sizep)
+{
+
+	if (value->xo_xpc_type == XPC_TYPE_STRING) {
+		*sizep = value->xo_size + 1;
+		return (value->xo_str);
+	}
+
+	if (value->xo_xpc_type == XPC_TYPE_DATA) {
+		*sizep = value->xo_size;
+		return (xpc_data_get_bytes_ptr(value));
+	}
+
+	if (value->xo_xpc_type == XPC_TYPE_UUID) {
+		*sizep = sizeof(uuid_t);
+		return (value->xo_uuid);
+	}
+
+	*sizep = sizeof(uint64_t);
+	return (&value->xo_u.ui);
+}
+
+/*
+ * Pack a message through its template. Returns NULL if the message was
+ * not created from a template or no longer matches it, in which case
+ * the caller has to go through xpc2nv().
+ */
+void *
+xpc_message_template_pack(struct xpc_object *xo, size_t *sizep)
+{
+	const struct xpc_message_template *tmpl;
+	const struct xpc_message_field *field;
+	struct xpc_dict_pair *pair;
+	struct xpc_object *value;
+	unsigned char *buf, *ptr;
+	const void *bytes;
+	size_t i, size, valsize;
+
+	if (xo->xo_arena == NULL || xo->xo_arena->xda_template == NULL)
+		return (NULL);
+
+	tmpl = xo->xo_arena->xda_template;
+	if (xo->xo_size != tmpl->xmt_count)
+		return (NULL);
+
+	size = tmpl->xmt_fixed_size;
+	for (i = 0; i < tmpl->xmt_count; i++) {
+		field = &tmpl->xmt_fields[i];
+		pair = (struct xpc_dict_pair *)(xo->xo_arena->xda_bytes +
+		    field->xmf_pair_offset);
+		if (pair->value->xo_xpc_type != field->xmf_type)
+			return (NULL);
+
+		if (field->xmf_nvtype == NV_TYPE_BOOL)
+			size += sizeof(uint8_t);
+		else {
+			(void)xpc_message_value_bytes(pair->value, &valsize);
+			size += valsize;
+		}
+	}
+
+	buf = malloc(size);
+	if (buf == NULL)
+		return (NULL);
+
+	ptr = nvlist_pack_raw_header(buf, NV_TYPE_NVLIST_DICTIONARY, size);
+	for (i = 0; i < tmpl->xmt_count; i++) {
+		field = &tmpl->xmt_fields[i];
+		pair = (struct xpc_dict_pair *)(xo->xo_arena->xda_bytes +
+		    field->xmf_pair_offset);
+		value = pair->value;
+
+		if (field->xmf_nvtype == NV_TYPE_BOOL) {
+			memcpy(ptr, tmpl->xmt_image + field->xmf_image_offset,
+			    field->xmf_image_size);
+			ptr += field->xmf_image_size;
+			*ptr++ = (uint8_t)value->xo_bool;
+			continue;
+		}
+
+		bytes = xpc_message_value_bytes(value, &valsize);
+		if (xpc_message_field_fixed_size(field->xmf_nvtype) != 0) {
+			memcpy(ptr, tmpl->xmt_image + field->xmf_image_offset,
+			    field->xmf_image_size);
+			ptr += field->xmf_image_size;
+		} else
+			ptr = nvpair_pack_raw_header(ptr, field->xmf_nvtype,
+			    field->xmf_key, valsize);
+
+		memcpy(ptr, bytes, valsize);
+		ptr += valsize;
+	}
+
+	xpc_assert(ptr == buf + size, "template packing overran its buffer");
+	*sizep = size;
+	return (buf);
+}
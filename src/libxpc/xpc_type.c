@@ -30,6 +30,8 @@
 #include <xpc/launchd.h>
 #include <sys/fileport.h>
 #include <time.h>
+#include <math.h>
+#include <stdatomic.h>
 #include "xpc_internal.h"
 
 OS_OBJECT_OBJC_CLASS_DECL(xpc_object);
@@ -96,8 +98,6 @@ static const struct xpc_object _xpc_null_instance = {
 	.xo_size = 0
 };
 
-static size_t xpc_data_hash(const uint8_t *data, size_t length);
-
 static xpc_type_t xpc_typemap[] = {
 	NULL,
 	XPC_TYPE_DICTIONARY,
@@ -160,12 +160,17 @@ _xpc_prim_create_flags(xpc_type_t type, xpc_u value, size_t size, uint16_t flags
 	xo->xo_flags = flags;
 	xo->xo_u = value;
 	xo->xo_audit_token = NULL;
+	xo->xo_hash = 0;
+	xo->xo_hash_epoch = 0;
+	xo->xo_arena = NULL;
 
 	if (type == XPC_TYPE_DICTIONARY)
 		TAILQ_INIT(&xo->xo_dict);
 
-	if (type == XPC_TYPE_ARRAY)
-		TAILQ_INIT(&xo->xo_array);
+	if (type == XPC_TYPE_ARRAY) {
+		xo->xo_array.xa_items = NULL;
+		xo->xo_array.xa_capacity = 0;
+	}
 
 	return (xo);
 }
@@ -207,9 +212,11 @@ xpc_bool_set_value(xpc_object_t xbool, bool value) {
 
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_BOOL);
+	xpc_assert_mutable(xo);
 	xpc_assert(xo->header.ref_cnt != _OS_OBJECT_GLOBAL_REFCNT, "You cannot call xpc_bool_set_value() on the statically allocated xpc_bool instances");
 
 	xo->xo_bool = value;
+	xpc_hash_invalidate(xo);
 }
 
 xpc_object_t
@@ -238,8 +245,10 @@ xpc_int64_set_value(xpc_object_t xint, int64_t value) {
 
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_INT64);
+	xpc_assert_mutable(xo);
 
 	xo->xo_int = value;
+	xpc_hash_invalidate(xo);
 }
 
 xpc_object_t
@@ -289,8 +298,10 @@ xpc_double_set_value(xpc_object_t xdouble, double value)
 
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_DOUBLE);
+	xpc_assert_mutable(xo);
 
 	xo->xo_d = value;
+	xpc_hash_invalidate(xo);
 }
 
 xpc_object_t
@@ -382,10 +393,13 @@ xpc_data_set_bytes(xpc_object_t xdata, void *buffer, size_t length)
 
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_DATA);
+	xpc_assert_mutable(xo);
 
 	free(xo->xo_u.ptr);
 	xo->xo_u.ptr = malloc(length);
 	memcpy(xo->xo_u.ptr, buffer, length);
+	xo->xo_size = length;
+	xpc_hash_invalidate(xo);
 }
 
 xpc_object_t
@@ -465,9 +479,12 @@ xpc_string_set_value(xpc_object_t xstring, const char *value) {
 
 	xpc_assert_nonnull(xo);
 	xpc_assert_type(xo, XPC_TYPE_STRING);
+	xpc_assert_mutable(xo);
 
 	free(xo->xo_u.str);
 	xo->xo_u.str = strdup(value);
+	xo->xo_size = strlen(value);
+	xpc_hash_invalidate(xo);
 }
 
 xpc_object_t
@@ -499,10 +516,108 @@ xpc_get_type(xpc_object_t obj)
 	return xo->xo_xpc_type;
 }
 
+static int
+xpc_dict_pair_compare(const void *a, const void *b)
+{
+	const struct xpc_dict_pair *p1, *p2;
+
+	p1 = *(const struct xpc_dict_pair * const *)a;
+	p2 = *(const struct xpc_dict_pair * const *)b;
+	return (strcmp(p1->key, p2->key));
+}
+
+/*
+ * Compare the entries of two equally sized dictionaries. Copies and
+ * dictionaries built by the same code list their keys in the same order,
+ * so walk both in lockstep; only once the orders diverge sort what is
+ * left of each and merge, which keeps the worst case at O(n log n).
+ */
+static bool
+xpc_dictionary_equal(struct xpc_object *xo1, struct xpc_object *xo2)
+{
+	struct xpc_dict_pair *p1, *p2, **v1, **v2;
+	size_t n, i;
+	bool equal;
+
+	p1 = TAILQ_FIRST(&xo1->xo_dict);
+	p2 = TAILQ_FIRST(&xo2->xo_dict);
+	n = xo1->xo_size;
+
+	for (; p1 != NULL && p2 != NULL; p1 = TAILQ_NEXT(p1, xo_link),
+	    p2 = TAILQ_NEXT(p2, xo_link), n--) {
+		if (strcmp(p1->key, p2->key) != 0)
+			break;
+		if (!xpc_equal(p1->value, p2->value))
+			return (false);
+	}
+
+	if (p1 == NULL || p2 == NULL)
+		return (p1 == p2);
+
+	v1 = malloc(n * sizeof(*v1));
+	v2 = malloc(n * sizeof(*v2));
+	for (i = 0; i < n && p1 != NULL && p2 != NULL; i++) {
+		v1[i] = p1;
+		v2[i] = p2;
+		p1 = TAILQ_NEXT(p1, xo_link);
+		p2 = TAILQ_NEXT(p2, xo_link);
+	}
+
+	equal = (i == n);
+	if (equal) {
+		qsort(v1, n, sizeof(*v1), xpc_dict_pair_compare);
+		qsort(v2, n, sizeof(*v2), xpc_dict_pair_compare);
+	}
+
+	for (i = 0; equal && i < n; i++) {
+		if (strcmp(v1[i]->key, v2[i]->key) != 0 ||
+		    !xpc_equal(v1[i]->value, v2[i]->value))
+			equal = false;
+	}
+
+	free(v1);
+	free(v2);
+	return (equal);
+}
+
+/* Moves on whenever an object with a cached hash changes; see xpc_hash() */
+static _Atomic(uint64_t) xpc_hash_epoch;
+
+/* The cached hash of xo, or 0 if it has none or it has gone stale */
+static size_t
+xpc_hash_cached(struct xpc_object *xo)
+{
+	size_t hash;
+
+	hash = atomic_load_explicit(&xo->xo_hash, memory_order_relaxed);
+	if (hash == 0 || (xo->xo_flags & _XPC_FROZEN))
+		return (hash);
+
+	if ((xo->xo_xpc_type == XPC_TYPE_DICTIONARY ||
+	    xo->xo_xpc_type == XPC_TYPE_ARRAY) && xo->xo_hash_epoch !=
+	    atomic_load_explicit(&xpc_hash_epoch, memory_order_relaxed))
+		return (0);
+
+	return (hash);
+}
+
+/* xo is about to change */
+void
+xpc_hash_invalidate(struct xpc_object *xo)
+{
+
+	if (atomic_load_explicit(&xo->xo_hash, memory_order_relaxed) == 0)
+		return;
+
+	atomic_store_explicit(&xo->xo_hash, 0, memory_order_relaxed);
+	atomic_fetch_add_explicit(&xpc_hash_epoch, 1, memory_order_relaxed);
+}
+
 bool
 xpc_equal(xpc_object_t x1, xpc_object_t x2)
 {
 	struct xpc_object *xo1, *xo2;
+	size_t h1, h2, i;
 
 	xo1 = x1;
 	xo2 = x2;
@@ -510,99 +625,273 @@ xpc_equal(xpc_object_t x1, xpc_object_t x2)
 	xpc_assert_nonnull(xo1);
 	xpc_assert_nonnull(xo2);
 
-	if (xo1->xo_xpc_type != xo2->xo_xpc_type) return false;
+	if (xo1 == xo2)
+		return (true);
+
+	if (xo1->xo_xpc_type != xo2->xo_xpc_type)
+		return (false);
+
+	/* Only look at hashes that are already known, never compute them */
+	h1 = xpc_hash_cached(xo1);
+	h2 = xpc_hash_cached(xo2);
+	if (h1 != 0 && h2 != 0 && h1 != h2)
+		return (false);
 
 	if (xo1->xo_xpc_type == XPC_TYPE_BOOL) {
-		return xo1->xo_u.b == xo2->xo_u.b;
-	} else if (xo1->xo_xpc_type == XPC_TYPE_INT64 || xo1->xo_xpc_type == XPC_TYPE_DATE) {
-		return xo1->xo_u.i == xo2->xo_u.i;
+		return (xo1->xo_bool == xo2->xo_bool);
+	} else if (xo1->xo_xpc_type == XPC_TYPE_INT64 ||
+	    xo1->xo_xpc_type == XPC_TYPE_DATE) {
+		return (xo1->xo_int == xo2->xo_int);
 	} else if (xo1->xo_xpc_type == XPC_TYPE_UINT64) {
-		return xo1->xo_u.ui == xo2->xo_u.ui;
-	} else if (xo1->xo_xpc_type == XPC_TYPE_ENDPOINT) {
-		return xo1->xo_u.port == xo2->xo_u.port;
+		return (xo1->xo_uint == xo2->xo_uint);
+	} else if (xo1->xo_xpc_type == XPC_TYPE_DOUBLE) {
+		return (xo1->xo_d == xo2->xo_d);
+	} else if (xo1->xo_xpc_type == XPC_TYPE_ENDPOINT ||
+	    xo1->xo_xpc_type == XPC_TYPE_CONNECTION ||
+	    xo1->xo_xpc_type == XPC_TYPE_FD) {
+		return (xo1->xo_port == xo2->xo_port);
+	} else if (xo1->xo_xpc_type == XPC_TYPE_NULL) {
+		return (true);
+	} else if (xo1->xo_xpc_type == XPC_TYPE_UUID) {
+		return (memcmp(xo1->xo_uuid, xo2->xo_uuid, sizeof(uuid_t)) == 0);
 	} else if (xo1->xo_xpc_type == XPC_TYPE_STRING) {
-		return strcmp(xo1->xo_u.str, xo1->xo_u.str) == 0;
+		if (xo1->xo_size != xo2->xo_size)
+			return (false);
+		return (memcmp(xo1->xo_str, xo2->xo_str, xo1->xo_size) == 0);
 	} else if (xo1->xo_xpc_type == XPC_TYPE_DATA) {
-		if (xo1->xo_size != xo2->xo_size) return false;
-		return memcmp((void *)xo1->xo_u.ptr, (void *)xo2->xo_u.ptr, xo1->xo_size) == 0;
+		if (xo1->xo_size != xo2->xo_size)
+			return (false);
+		return (memcmp((void *)xo1->xo_ptr, (void *)xo2->xo_ptr,
+		    xo1->xo_size) == 0);
 	} else if (xo1->xo_xpc_type == XPC_TYPE_DICTIONARY) {
-		struct xpc_dict_pair *pair;
-		size_t count1 = 0, count2 = 0;
-		TAILQ_FOREACH(pair, &xo1->xo_u.dict, xo_link) {
-			count1++;
-		}
-		TAILQ_FOREACH(pair, &xo2->xo_u.dict, xo_link) {
-			count2++;
+		if (xo1->xo_size != xo2->xo_size)
+			return (false);
+		return (xpc_dictionary_equal(xo1, xo2));
+	} else if (xo1->xo_xpc_type == XPC_TYPE_ARRAY) {
+		if (xo1->xo_size != xo2->xo_size)
+			return (false);
+
+		for (i = 0; i < xo1->xo_size; i++) {
+			if (!xpc_equal(xo1->xo_array.xa_items[i],
+			    xo2->xo_array.xa_items[i]))
+				return (false);
 		}
 
-		if (count1 != count2) return false;
+		return (true);
+	} else {
+		xpc_api_misuse("xpc_equal() is not implemented for this object type");
+	}
+}
 
-		TAILQ_FOREACH(pair, &xo1->xo_u.dict, xo_link) {
-			struct xpc_object *value1 = pair->value;
-			struct xpc_object *value2 = xpc_dictionary_get_value(xo2, pair->key);
-			if (value2 == NULL) return false;
-			if (!xpc_equal(value1, value2)) return false;
-		}
+/*
+ * wyhash (final version 4, public domain, by Wang Yi). It reads the
+ * input 8 bytes at a time, 48 bytes per round in three independent
+ * lanes, and folds each pair of words with one 64x64->128 multiply.
+ */
+static const uint64_t xpc_hash_secret[4] = {
+	0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+	0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
 
-		TAILQ_FOREACH(pair, &xo2->xo_u.dict, xo_link) {
-			if (xpc_dictionary_get_value(xo1, pair->key) == NULL) return false;
-		}
+static inline void
+xpc_hash_mum(uint64_t *a, uint64_t *b)
+{
+	__uint128_t r;
 
-		return true;
-	} else if (xo1->xo_xpc_type == XPC_TYPE_ARRAY) {
-		if (xpc_array_get_count(xo1) != xpc_array_get_count(xo2)) return false;
+	r = (__uint128_t)*a * *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t
+xpc_hash_mix(uint64_t a, uint64_t b)
+{
+
+	xpc_hash_mum(&a, &b);
+	return (a ^ b);
+}
+
+static inline uint64_t
+xpc_hash_read8(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
 
-		return xpc_array_apply(xo1, ^bool(size_t index, xpc_object_t value) {
-			return xpc_equal(value, xpc_array_get_value(xo2, index));
-		});
+static inline uint64_t
+xpc_hash_read4(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+uint64_t
+xpc_data_hash(const void *data, size_t length, uint64_t seed)
+{
+	const uint64_t *secret = xpc_hash_secret;
+	const uint8_t *p = data;
+	uint64_t a, b, see1, see2;
+	size_t i;
+
+	seed ^= xpc_hash_mix(seed ^ secret[0], secret[1]);
+
+	if (length <= 16) {
+		if (length >= 4) {
+			a = (xpc_hash_read4(p) << 32) |
+			    xpc_hash_read4(p + ((length >> 3) << 2));
+			b = (xpc_hash_read4(p + length - 4) << 32) |
+			    xpc_hash_read4(p + length - 4 - ((length >> 3) << 2));
+		} else if (length > 0) {
+			a = ((uint64_t)p[0] << 16) |
+			    ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+			b = 0;
+		} else
+			a = b = 0;
 	} else {
-		xpc_api_misuse("xpc_equal() is not implemented for this object type");
+		i = length;
+		if (i > 48) {
+			see1 = see2 = seed;
+			do {
+				seed = xpc_hash_mix(xpc_hash_read8(p) ^ secret[1],
+				    xpc_hash_read8(p + 8) ^ seed);
+				see1 = xpc_hash_mix(xpc_hash_read8(p + 16) ^
+				    secret[2], xpc_hash_read8(p + 24) ^ see1);
+				see2 = xpc_hash_mix(xpc_hash_read8(p + 32) ^
+				    secret[3], xpc_hash_read8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = xpc_hash_mix(xpc_hash_read8(p) ^ secret[1],
+			    xpc_hash_read8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = xpc_hash_read8(p + i - 16);
+		b = xpc_hash_read8(p + i - 8);
 	}
+
+	a ^= secret[1];
+	b ^= seed;
+	xpc_hash_mum(&a, &b);
+	return (xpc_hash_mix(a ^ secret[0] ^ length, b ^ secret[1]));
 }
 
-static size_t
-xpc_data_hash(const uint8_t *data, size_t length)
+/* One 64-bit word, seeded with the object type */
+static uint64_t
+xpc_word_hash(xpc_type_t type, uint64_t value)
+{
+
+	return (xpc_hash_mix(value ^ xpc_hash_secret[0],
+	    (uintptr_t)type ^ xpc_hash_secret[1]));
+}
+
+/*
+ * Doubles that compare equal must hash alike, so both zeros hash as +0.0.
+ * A NaN is not equal to anything, itself included, so no lookup can rely
+ * on its hash; all NaNs hash as the default NaN whatever their sign and
+ * payload bits.
+ */
+static uint64_t
+xpc_double_hash(double d)
 {
-    size_t hash = 5381;
+	uint64_t bits;
 
-    while (length--)
-        hash = ((hash << 5) + hash) + data[length];
+	if (d == 0)
+		d = 0.0;
+	else if (isnan(d))
+		d = NAN;
 
-    return (hash);
+	memcpy(&bits, &d, sizeof(bits));
+	return (xpc_word_hash(XPC_TYPE_DOUBLE, bits));
 }
 
+/*
+ * Dictionaries are unordered, so their entries are combined by addition,
+ * which unlike XOR does not cancel out equal entries; each entry is
+ * mixed non-linearly first so that swapping values between keys changes
+ * the result. Arrays are chained in order.
+ *
+ * The result is cached in every object but the static ones. A leaf's is
+ * dropped by its setters, and a container's by its own setters and
+ * removals. A container cannot see changes made to its children, so its
+ * hash is also only good for the xpc_hash_epoch it was computed in: any
+ * change to an object that has a hash cached, and so may be inside a
+ * container that has one too, starts a new epoch. Frozen objects cannot
+ * change at all and keep theirs.
+ */
 size_t
 xpc_hash(xpc_object_t obj)
 {
 	struct xpc_object *xo;
-	__block size_t hash = 0;
+	struct xpc_dict_pair *pair;
+	uint64_t hash, entry, epoch;
+	size_t i;
+	bool cache;
 
 	xo = obj;
-	if (xo->xo_xpc_type == XPC_TYPE_BOOL || xo->xo_xpc_type == XPC_TYPE_INT64 ||
-		xo->xo_xpc_type == XPC_TYPE_UINT64 || xo->xo_xpc_type == XPC_TYPE_DATE ||
-		xo->xo_xpc_type == XPC_TYPE_ENDPOINT) {
-		return ((size_t)xo->xo_u.port);
+	xpc_assert_nonnull(xo);
+
+	hash = xpc_hash_cached(xo);
+	if (hash != 0)
+		return ((size_t)hash);
+
+	cache = xo->header.ref_cnt != _OS_OBJECT_GLOBAL_REFCNT;
+	epoch = atomic_load_explicit(&xpc_hash_epoch, memory_order_relaxed);
+
+	if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
+		hash = 0;
+		TAILQ_FOREACH(pair, &xo->xo_dict, xo_link) {
+			entry = xpc_data_hash(pair->key, strlen(pair->key), 0);
+			hash += xpc_hash_mix(entry ^ xpc_hash_secret[2],
+			    xpc_hash(pair->value) ^ xpc_hash_secret[3]);
+		}
+		hash = xpc_word_hash(xo->xo_xpc_type, hash ^ xo->xo_size);
+	} else if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
+		hash = xo->xo_size;
+		for (i = 0; i < xo->xo_size; i++)
+			hash = xpc_hash_mix(hash ^ xpc_hash_secret[1],
+			    xpc_hash(xo->xo_array.xa_items[i]) ^
+			    xpc_hash_secret[2]);
+		hash = xpc_word_hash(xo->xo_xpc_type, hash);
 	} else if (xo->xo_xpc_type == XPC_TYPE_STRING) {
-		return (xpc_data_hash((const uint8_t *)xpc_string_get_string_ptr(obj), xpc_string_get_length(obj)));
+		hash = xpc_data_hash(xo->xo_str, xo->xo_size, 0);
 	} else if (xo->xo_xpc_type == XPC_TYPE_DATA) {
-		return (xpc_data_hash(xpc_data_get_bytes_ptr(obj), xpc_data_get_length(obj)));
-	} else if (xo->xo_xpc_type == XPC_TYPE_DICTIONARY) {
-		xpc_dictionary_apply(obj, ^bool(const char *k, xpc_object_t v) {
-			hash ^= xpc_data_hash((const uint8_t *)k, strlen(k));
-			hash ^= xpc_hash(v);
-			return true;
-		});
-		return (hash);
-	} else if (xo->xo_xpc_type == XPC_TYPE_ARRAY) {
-		xpc_array_apply(obj, ^bool(size_t idx, xpc_object_t v) {
-			hash ^= xpc_hash(v);
-			return true;
-		});
-		return (hash);
+		hash = xpc_data_hash((const void *)xo->xo_ptr, xo->xo_size, 0);
+	} else if (xo->xo_xpc_type == XPC_TYPE_UUID) {
+		hash = xpc_data_hash(xo->xo_uuid, sizeof(uuid_t), 0);
+	} else if (xo->xo_xpc_type == XPC_TYPE_BOOL) {
+		hash = xpc_word_hash(xo->xo_xpc_type, xo->xo_bool);
+	} else if (xo->xo_xpc_type == XPC_TYPE_INT64 ||
+	    xo->xo_xpc_type == XPC_TYPE_UINT64 ||
+	    xo->xo_xpc_type == XPC_TYPE_DATE) {
+		hash = xpc_word_hash(xo->xo_xpc_type, xo->xo_uint);
+	} else if (xo->xo_xpc_type == XPC_TYPE_DOUBLE) {
+		hash = xpc_double_hash(xo->xo_d);
+	} else {
+		/* Port based objects: endpoints, connections, fds */
+		hash = xpc_word_hash(xo->xo_xpc_type, xo->xo_port);
+	}
+
+	/* 0 means "not cached" */
+	if (hash == 0)
+		hash = 1;
+
+	if (cache) {
+		xo->xo_hash_epoch = epoch;
+		atomic_store_explicit(&xo->xo_hash, hash,
+		    memory_order_relaxed);
 	}
 
-    printf("end of unimplmented xpc_hash()\n");
-    return 1; // _sjc_ nothing here, returned this now
+	return ((size_t)hash);
 }
 
 mach_port_t
@@ -0,0 +1,61 @@
+//
+//  bench.h
+//  Checks and timing loops shared by the test programs. Each program exits
+//  non-zero at its first failed CHECK(), which is what the "tests" target
+//  looks at; the timings are only printed.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#ifndef __TESTS_BENCH_H__
+#define __TESTS_BENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mach/mach_time.h>
+
+#define CHECK(cond, fmt, ...) \
+	do { \
+		if (!(cond)) { \
+			printf("FAIL: %s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+			exit(1); \
+		} \
+	} while (0)
+
+static uint64_t bench_start_time;
+
+static inline double
+elapsed_ns(uint64_t start, uint64_t end)
+{
+	static mach_timebase_info_data_t tbi;
+
+	if (tbi.denom == 0)
+		mach_timebase_info(&tbi);
+
+	return (double)(end - start) * tbi.numer / tbi.denom;
+}
+
+static inline void
+bench_start(void)
+{
+	bench_start_time = mach_absolute_time();
+}
+
+// Prints and returns the time since bench_start(), per n units of work
+static inline double
+bench_stop(const char *what, double n, const char *unit)
+{
+	double ns = elapsed_ns(bench_start_time, mach_absolute_time()) / n;
+
+	printf("%-32s %12.1f ns/%s\n", what, ns, unit);
+	return ns;
+}
+
+// The index'th numeric argument, if given
+static inline size_t
+bench_arg(int argc, const char *argv[], int index, size_t def)
+{
+	return argc > index ? strtoul(argv[index], NULL, 10) : def;
+}
+
+#endif /* __TESTS_BENCH_H__ */
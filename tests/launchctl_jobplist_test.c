@@ -0,0 +1,154 @@
+//
+//  launchctl_jobplist_test.c
+//  Loads a job plist the way launchctl's read_plist_file() does without
+//  CoreFoundation, and checks the keys launchctl injects on the way: the
+//  Disabled override, a job's own JetsamProperties from the jetsam
+//  defaults, and the default memory limit when there are no defaults.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "../src/launchctl/jobplist.c"
+
+#include "bench.h"
+
+#define LABEL	"org.puredarwin.jobplist-test"
+
+static const char job_plist[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+    "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+    "<plist version=\"1.0\">\n"
+    "<dict>\n"
+    "\t<key>Label</key>\n"
+    "\t<string>" LABEL "</string>\n"
+    "\t<key>Program</key>\n"
+    "\t<string>/usr/bin/true</string>\n"
+    "</dict>\n"
+    "</plist>\n";
+
+static CFDictionaryRef
+dict1(const char *key, CFTypeRef value)
+{
+	CFStringRef cfkey = CFStringCreateWithCString(NULL, key, kCFStringEncodingUTF8);
+	CFDictionaryRef d = CFDictionaryCreate(NULL, (const void **)&cfkey, &value, 1,
+	    &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+	CFRelease(cfkey);
+	return d;
+}
+
+static CFNumberRef
+number(long long n)
+{
+	return CFNumberCreate(NULL, kCFNumberLongLongType, &n);
+}
+
+static launch_data_t
+load(const char *path, CFDictionaryRef overrides_db)
+{
+	launch_data_t job = read_plist_file_native(path, overrides_db);
+
+	CHECK(job != NULL, "%s did not load", path);
+	CHECK(strcmp(launch_data_get_string(launch_data_dict_lookup(job,
+	    LAUNCH_JOBKEY_LABEL)), LABEL) == 0, "wrong label");
+	return job;
+}
+
+static long long
+jetsam_integer(launch_data_t job, const char *key)
+{
+	launch_data_t props = launch_data_dict_lookup(job, LAUNCH_JOBKEY_JETSAMPROPERTIES);
+	launch_data_t value;
+
+	CHECK(props != NULL && launch_data_get_type(props) == LAUNCH_DATA_DICTIONARY,
+	    "no JetsamProperties injected");
+	value = launch_data_dict_lookup(props, key);
+	CHECK(value != NULL && launch_data_get_type(value) == LAUNCH_DATA_INTEGER,
+	    "JetsamProperties has no %s", key);
+	return launch_data_get_integer(value);
+}
+
+int main(int argc, const char * argv[]) {
+	char path[] = "/tmp/launchctl_jobplist_test.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1, "mkstemp");
+	CHECK(write(fd, job_plist, sizeof(job_plist) - 1) == sizeof(job_plist) - 1, "write");
+	close(fd);
+
+	CFStringRef label = CFStringCreateWithCString(NULL, LABEL, kCFStringEncodingUTF8);
+
+	// Nothing is added unless asked for.
+	launch_data_t job = load(path, NULL);
+	CHECK(launch_data_dict_lookup(job, LAUNCH_JOBKEY_DISABLED) == NULL,
+	    "Disabled added without an override");
+	CHECK(launch_data_dict_lookup(job, LAUNCH_JOBKEY_JETSAMPROPERTIES) == NULL,
+	    "JetsamProperties added by the plain read");
+	launch_data_free(job);
+
+	// The Disabled override
+	CFDictionaryRef disabled = dict1(LAUNCH_JOBKEY_DISABLED, kCFBooleanTrue);
+	CFDictionaryRef overrides_db = CFDictionaryCreate(NULL, (const void **)&label,
+	    (const void **)&disabled, 1, &kCFTypeDictionaryKeyCallBacks,
+	    &kCFTypeDictionaryValueCallBacks);
+	job = load(path, overrides_db);
+	launch_data_t value = launch_data_dict_lookup(job, LAUNCH_JOBKEY_DISABLED);
+	CHECK(value != NULL && launch_data_get_type(value) == LAUNCH_DATA_BOOL &&
+	    launch_data_get_bool(value), "Disabled override not applied");
+	launch_data_free(job);
+
+	// No jetsam defaults at all: the default memory limit
+	job = load(path, NULL);
+	job_set_jetsam_properties(job, NULL);
+	CHECK(jetsam_integer(job, LAUNCH_JOBKEY_JETSAMMEMORYLIMIT) == 0,
+	    "default memory limit is %lld", jetsam_integer(job, LAUNCH_JOBKEY_JETSAMMEMORYLIMIT));
+	launch_data_free(job);
+
+	// The job's own entry in the jetsam defaults
+	CFNumberRef priority = number(3), limit = number(100);
+	const void *keys[] = { CFSTR(LAUNCH_JOBKEY_JETSAMPRIORITY), CFSTR(LAUNCH_JOBKEY_JETSAMMEMORYLIMIT) };
+	const void *values[] = { priority, limit };
+	CFDictionaryRef props = CFDictionaryCreate(NULL, keys, values, 2,
+	    &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+	CFDictionaryRef jetsam_defaults = CFDictionaryCreate(NULL, (const void **)&label,
+	    (const void **)&props, 1, &kCFTypeDictionaryKeyCallBacks,
+	    &kCFTypeDictionaryValueCallBacks);
+
+	job = load(path, overrides_db);
+	job_set_jetsam_properties(job, jetsam_defaults);
+	CHECK(jetsam_integer(job, LAUNCH_JOBKEY_JETSAMPRIORITY) == 3, "wrong JetsamPriority");
+	CHECK(jetsam_integer(job, LAUNCH_JOBKEY_JETSAMMEMORYLIMIT) == 100, "wrong JetsamMemoryLimit");
+	CHECK(launch_data_dict_lookup(job, LAUNCH_JOBKEY_DISABLED) != NULL,
+	    "Disabled override lost");
+	launch_data_free(job);
+
+	// The CoreFoundation path is given the very same properties.
+	CFDictionaryRef copied = jetsam_properties_copy(jetsam_defaults, label);
+	CHECK(copied != NULL && CFEqual(copied, props), "CoreFoundation path differs");
+	CFRelease(copied);
+
+	// Defaults that do not mention the job leave it alone.
+	CFDictionaryRef other_defaults = dict1("org.puredarwin.other", props);
+	job = load(path, NULL);
+	job_set_jetsam_properties(job, other_defaults);
+	CHECK(launch_data_dict_lookup(job, LAUNCH_JOBKEY_JETSAMPROPERTIES) == NULL,
+	    "JetsamProperties given to a job the defaults do not list");
+	launch_data_free(job);
+
+	CFRelease(other_defaults);
+	CFRelease(jetsam_defaults);
+	CFRelease(props);
+	CFRelease(limit);
+	CFRelease(priority);
+	CFRelease(overrides_db);
+	CFRelease(disabled);
+	CFRelease(label);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,190 @@
+//
+//  launchd_calendar_benchmark.c
+//  Times scheduling and firing 50,000 StartCalendarInterval entries with
+//  launchd's min-heap, against the sorted list it replaced, and checks
+//  that both fire in the same order, that the heap stays ordered through
+//  rekeying and removal from the middle, and that it drains in key order.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/queue.h>
+
+#include "../src/launchd/minheap.h"
+#include "../src/launchd/minheap.c"
+
+#include "bench.h"
+
+#define TIEBREAK_BITS	20
+
+struct event {
+	struct minheap_node hn;
+	LIST_ENTRY(event) sle;
+	int64_t when_next;
+	int64_t interval;
+};
+
+static struct minheap heap;
+static LIST_HEAD(, event) sorted;
+
+static void
+list_schedule(struct event *e)
+{
+	struct event *iter, *prev = NULL;
+
+	LIST_FOREACH(iter, &sorted, sle) {
+		if (e->when_next < iter->when_next) {
+			LIST_INSERT_BEFORE(iter, e, sle);
+			return;
+		}
+		prev = iter;
+	}
+
+	if (prev == NULL) {
+		LIST_INSERT_HEAD(&sorted, e, sle);
+	} else {
+		LIST_INSERT_AFTER(prev, e, sle);
+	}
+}
+
+// Every node knows its position and no node is keyed below its parent
+static void
+check_heap(const struct minheap *mh)
+{
+	for (size_t i = 0; i < mh->mh_count; i++) {
+		CHECK(mh->mh_nodes[i]->mhn_index == i + 1,
+		    "node at %zu thinks it is at %zu", i, mh->mh_nodes[i]->mhn_index - 1);
+		if (i > 0) {
+			size_t parent = (i - 1) / MINHEAP_ARITY;
+			CHECK(mh->mh_nodes[parent]->mhn_key <= mh->mh_nodes[i]->mhn_key,
+			    "node at %zu (%lld) is below its parent (%lld)", i,
+			    (long long)mh->mh_nodes[i]->mhn_key,
+			    (long long)mh->mh_nodes[parent]->mhn_key);
+		}
+	}
+}
+
+// Pops everything left, checking keys never go down and nothing is lost
+static void
+check_drain(struct minheap *mh, size_t expected)
+{
+	struct minheap_node *mhn;
+	int64_t last = INT64_MIN;
+	size_t n = 0;
+
+	while ((mhn = minheap_min(mh))) {
+		CHECK(mhn->mhn_key >= last, "drained %lld after %lld",
+		    (long long)mhn->mhn_key, (long long)last);
+		last = mhn->mhn_key;
+		minheap_remove(mh, mhn);
+		CHECK(mhn->mhn_index == 0, "removed node still has a position");
+		n++;
+	}
+	CHECK(n == expected, "drained %zu of %zu nodes", n, expected);
+}
+
+// Small heaps, heavy on equal keys, rekeyed both ways and cut from the middle
+static void
+check_ordering(void)
+{
+	struct minheap mh = { 0 };
+	size_t count = 1000;
+	struct event *events = calloc(count, sizeof(*events));
+
+	for (size_t i = 0; i < count; i++) {
+		CHECK(minheap_insert(&mh, &events[i].hn, random() % 50), "insert failed");
+	}
+	check_heap(&mh);
+
+	for (size_t i = 0; i < count; i += 3) {
+		minheap_update(&mh, &events[i].hn, events[i].hn.mhn_key + random() % 100 - 50);
+	}
+	check_heap(&mh);
+
+	size_t left = count;
+	for (size_t i = 0; i < count; i += 7) {
+		minheap_remove(&mh, &events[i].hn);
+		left--;
+	}
+	minheap_remove(&mh, &events[0].hn);
+	check_heap(&mh);
+
+	check_drain(&mh, left);
+	CHECK(minheap_min(&mh) == NULL, "empty heap has a minimum");
+
+	minheap_destroy(&mh);
+	free(events);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = bench_arg(argc, argv, 1, 50000);
+	size_t firings = bench_arg(argc, argv, 2, 10000);
+
+	srandom(1);
+	check_ordering();
+
+	// Minute-granular schedules spread over a day, like cron entries. The
+	// entry's index sits in the low bits so that no two keys are ever equal
+	// and both structures have to fire the very same entries.
+	CHECK(count < (1 << TIEBREAK_BITS), "at most %d entries", (1 << TIEBREAK_BITS) - 1);
+	struct event *events = calloc(count, sizeof(*events));
+	for (size_t i = 0; i < count; i++) {
+		events[i].interval = (60 * (1 + random() % 1440)) << TIEBREAK_BITS;
+		events[i].when_next = ((60 * (random() % 1440)) << TIEBREAK_BITS) | i;
+	}
+
+	bench_start();
+	for (size_t i = 0; i < count; i++) {
+		CHECK(minheap_insert(&heap, &events[i].hn, events[i].when_next),
+		    "insert failed");
+	}
+	bench_stop("schedule, heap", count, "entry");
+	check_heap(&heap);
+
+	bench_start();
+	for (size_t i = 0; i < count; i++) {
+		list_schedule(&events[i]);
+	}
+	bench_stop("schedule, sorted list", count, "entry");
+
+	// Fire whatever is earliest and reschedule it, as calendarinterval_callback() does.
+	int64_t *heap_order = calloc(firings, sizeof(*heap_order));
+	bench_start();
+	for (size_t n = 0; n < firings; n++) {
+		struct event *e = MINHEAP_ENTRY(minheap_min(&heap), struct event, hn);
+		heap_order[n] = e->hn.mhn_key;
+		minheap_update(&heap, &e->hn, heap_order[n] + e->interval);
+	}
+	bench_stop("fire, heap", firings, "firing");
+	check_heap(&heap);
+
+	bench_start();
+	for (size_t n = 0; n < firings; n++) {
+		struct event *e = LIST_FIRST(&sorted);
+		CHECK(e->when_next == heap_order[n], "firing %zu: heap fired %lld, list %lld",
+		    n, (long long)heap_order[n], (long long)e->when_next);
+		LIST_REMOVE(e, sle);
+		e->when_next += e->interval;
+		list_schedule(e);
+	}
+	bench_stop("fire, sorted list", firings, "firing");
+
+	for (size_t n = 1; n < firings; n++) {
+		CHECK(heap_order[n] > heap_order[n - 1], "firing %zu went back in time", n);
+	}
+
+	bench_start();
+	for (size_t i = 0; i < count; i += 2) {
+		minheap_remove(&heap, &events[i].hn);
+	}
+	bench_stop("unschedule, heap", (count + 1) / 2, "entry");
+	check_heap(&heap);
+	check_drain(&heap, count / 2);
+
+	minheap_destroy(&heap);
+	free(heap_order);
+	free(events);
+	return 0;
+}
@@ -0,0 +1,328 @@
+//
+//  launchd_cron_test.c
+//  Checks cronspec_next() against the cronemu() search it replaced, on
+//  random schedules and random start times across DST changes, and against
+//  a minute-by-minute scan for the nearest firing.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../src/launchd/cronspec.h"
+#include "../src/launchd/cronspec.c"
+
+static bool cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min);
+static bool cronemu_mday(struct tm *wtm, int mday, int hour, int min);
+static bool cronemu_hour(struct tm *wtm, int hour, int min);
+static bool cronemu_min(struct tm *wtm, int min);
+
+// The old implementation, verbatim but for taking now as an argument.
+
+static time_t
+cronemu(time_t now, int mon, int mday, int hour, int min)
+{
+	struct tm workingtm;
+
+	workingtm = *localtime(&now);
+
+	workingtm.tm_isdst = -1;
+	workingtm.tm_sec = 0;
+	workingtm.tm_min++;
+
+	while (!cronemu_mon(&workingtm, mon, mday, hour, min)) {
+		workingtm.tm_year++;
+		workingtm.tm_mon = 0;
+		workingtm.tm_mday = 1;
+		workingtm.tm_hour = 0;
+		workingtm.tm_min = 0;
+		mktime(&workingtm);
+	}
+
+	return mktime(&workingtm);
+}
+
+static time_t
+cronemu_wday(time_t now, int wday, int hour, int min)
+{
+	struct tm workingtm;
+
+	workingtm = *localtime(&now);
+
+	workingtm.tm_isdst = -1;
+	workingtm.tm_sec = 0;
+	workingtm.tm_min++;
+
+	if (wday == 7) {
+		wday = 0;
+	}
+
+	while (!(workingtm.tm_wday == wday && cronemu_hour(&workingtm, hour, min))) {
+		workingtm.tm_mday++;
+		workingtm.tm_hour = 0;
+		workingtm.tm_min = 0;
+		mktime(&workingtm);
+	}
+
+	return mktime(&workingtm);
+}
+
+static bool
+cronemu_mon(struct tm *wtm, int mon, int mday, int hour, int min)
+{
+	if (mon == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!cronemu_mday(&workingtm, mday, hour, min)) {
+			workingtm.tm_mon++;
+			workingtm.tm_mday = 1;
+			workingtm.tm_hour = 0;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_mon;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_mon) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+
+	if (mon < wtm->tm_mon) {
+		return false;
+	}
+
+	if (mon > wtm->tm_mon) {
+		wtm->tm_mon = mon;
+		wtm->tm_mday = 1;
+		wtm->tm_hour = 0;
+		wtm->tm_min = 0;
+	}
+
+	return cronemu_mday(wtm, mday, hour, min);
+}
+
+static bool
+cronemu_mday(struct tm *wtm, int mday, int hour, int min)
+{
+	if (mday == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!cronemu_hour(&workingtm, hour, min)) {
+			workingtm.tm_mday++;
+			workingtm.tm_hour = 0;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_mday;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_mday) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+
+	if (mday < wtm->tm_mday) {
+		return false;
+	}
+
+	if (mday > wtm->tm_mday) {
+		wtm->tm_mday = mday;
+		wtm->tm_hour = 0;
+		wtm->tm_min = 0;
+	}
+
+	return cronemu_hour(wtm, hour, min);
+}
+
+static bool
+cronemu_hour(struct tm *wtm, int hour, int min)
+{
+	if (hour == -1) {
+		struct tm workingtm = *wtm;
+		int carrytest;
+
+		while (!cronemu_min(&workingtm, min)) {
+			workingtm.tm_hour++;
+			workingtm.tm_min = 0;
+			carrytest = workingtm.tm_hour;
+			mktime(&workingtm);
+			if (carrytest != workingtm.tm_hour) {
+				return false;
+			}
+		}
+		*wtm = workingtm;
+		return true;
+	}
+
+	if (hour < wtm->tm_hour) {
+		return false;
+	}
+
+	if (hour > wtm->tm_hour) {
+		wtm->tm_hour = hour;
+		wtm->tm_min = 0;
+	}
+
+	return cronemu_min(wtm, min);
+}
+
+static bool
+cronemu_min(struct tm *wtm, int min)
+{
+	if (min == -1) {
+		return true;
+	}
+
+	if (min < wtm->tm_min) {
+		return false;
+	}
+
+	if (min > wtm->tm_min) {
+		wtm->tm_min = min;
+	}
+
+	return true;
+}
+
+static time_t
+cronemu_next(time_t now, int mon, int mday, int wday, int hour, int min)
+{
+	time_t later = cronemu(now, mon, mday, hour, min);
+
+	if (wday != -1) {
+		time_t otherlater = cronemu_wday(now, wday, hour, min);
+
+		if (mday == -1) {
+			later = otherlater;
+		} else {
+			later = later < otherlater ? later : otherlater;
+		}
+	}
+
+	return later;
+}
+
+// Whether the local time t is one the schedule asks for.
+static bool
+matches(time_t t, int mon, int mday, int wday, int hour, int min)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	if ((hour != -1 && tm.tm_hour != hour) || (min != -1 && tm.tm_min != min) || tm.tm_sec != 0) {
+		return false;
+	}
+
+	bool by_date = (mon == -1 || tm.tm_mon == mon) && (mday == -1 || tm.tm_mday == mday);
+	bool by_wday = wday != -1 && tm.tm_wday == wday % 7;
+
+	if (wday == -1) {
+		return by_date;
+	}
+	if (mday == -1) {
+		return by_wday;
+	}
+	return by_date || by_wday;
+}
+
+static int
+pick(int lo, int hi)
+{
+	// A wildcard about a third of the time
+	if (random() % 3 == 0) {
+		return -1;
+	}
+	return lo + (int)(random() % (hi - lo + 1));
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = 20000;
+	if (argc > 1) {
+		count = strtoul(argv[1], NULL, 10);
+	}
+
+	// Exercise daylight saving changes.
+	setenv("TZ", "America/New_York", 1);
+	tzset();
+
+	srandom(1);
+	size_t compared = 0, old_wrong = 0, old_late = 0, failures = 0;
+	for (size_t n = 0; n < count; n++) {
+		// Anywhere from 2020 to 2031, on a minute boundary or not
+		time_t now = 1577836800 + (time_t)(random() % (12 * 366 * 86400L));
+		int mon = pick(0, 11), mday = pick(1, 31), wday = pick(0, 7);
+		int hour = pick(0, 23), min = pick(0, 59);
+
+		struct cronspec cs;
+		cronspec_init(&cs, mon, mday, wday, hour, min);
+		time_t t = cronspec_next(&cs, now);
+
+		if (t == -1) {
+			// Only impossible dates may never match.
+			if (wday != -1 || mday == -1 || mon == -1 || mday <= (mon == 1 ? 29 : 30) ||
+			    (mday == 31 && (mon == 0 || mon == 2 || mon == 4 || mon == 6 || mon == 7 || mon == 9 || mon == 11))) {
+				printf("FAIL: %d/%d wday %d %02d:%02d never matches after %ld\n", mon, mday, wday, hour, min, (long)now);
+				failures++;
+			}
+			continue;
+		}
+
+		// The clock skips the 2 o'clock hour once a year; mktime(3) moves
+		// those times forward, as cronemu() did.
+		struct tm check;
+		localtime_r(&t, &check);
+		bool skipped = hour == 2 && check.tm_hour == 3;
+
+		if (t <= now || (!skipped && !matches(t, mon, mday, wday, hour, min))) {
+			printf("FAIL: %d/%d wday %d %02d:%02d after %ld gave %ld\n", mon, mday, wday, hour, min, (long)now, (long)t);
+			failures++;
+			continue;
+		}
+
+		// Nothing matches in between, as far as a scan can afford to look.
+		for (time_t m = now - now % 60 + 60; m < t && m < now + 45 * 86400; m += 60) {
+			if (matches(m, mon, mday, wday, hour, min)) {
+				printf("FAIL: %d/%d wday %d %02d:%02d after %ld gave %ld, missed %ld\n", mon, mday, wday, hour, min, (long)now, (long)t, (long)m);
+				failures++;
+				break;
+			}
+		}
+
+		/* cronemu() spilled impossible dates, like the 31st of April, into
+		 * the next month, and could answer with the first pass through the
+		 * hour repeated when clocks go back while in the second. Only
+		 * compare where it found a real match.
+		 */
+		time_t old = cronemu_next(now, mon, mday, wday, hour, min);
+		if (old <= now || (!matches(old, mon, mday, wday, hour, min) && !skipped)) {
+			old_wrong++;
+			continue;
+		}
+
+		/* cronemu() also kept the DST state of the start time across
+		 * months, landing an hour late on the far side of a change. Both are
+		 * real matches then, and the earlier one is right.
+		 */
+		if (t < old) {
+			old_late++;
+			continue;
+		}
+
+		compared++;
+		if (old != t) {
+			printf("FAIL: %d/%d wday %d %02d:%02d after %ld: cronemu %ld, cronspec %ld\n", mon, mday, wday, hour, min, (long)now, (long)old, (long)t);
+			failures++;
+		}
+	}
+
+	printf("%zu schedules: %zu agreed with cronemu, %zu where it misfired, %zu where it was late, %zu failures\n",
+	    count, compared, old_wrong, old_late, failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,240 @@
+//
+//  launchd_hashtable_benchmark.c
+//  Times label, pid and port lookups over many jobs in launchd's resizable
+//  hash tables, against the fixed-size djb2 bucket arrays they replaced,
+//  and checks lookups, iteration and removal while iterating.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "../src/launchd/hashtable.h"
+#include "../src/launchd/hashtable.c"
+
+#include "bench.h"
+
+#define OLD_LABEL_HASH_SIZE 53
+#define OLD_ACTIVE_JOB_HASH_SIZE 32
+
+struct job {
+	char label[64];
+	pid_t p;
+	struct hashlink label_link;
+	struct hashlink pid_link;
+	LIST_ENTRY(job) label_sle;
+	LIST_ENTRY(job) pid_sle;
+	int visits;
+};
+
+static LIST_HEAD(, job) old_labels[OLD_LABEL_HASH_SIZE];
+static LIST_HEAD(, job) old_pids[OLD_ACTIVE_JOB_HASH_SIZE];
+static struct hashtable labels;
+static struct hashtable pids;
+
+static size_t
+djb2(const char *s)
+{
+	size_t c, r = 5381;
+
+	while ((c = *s++)) {
+		r = ((r << 5) + r) + c;
+	}
+
+	return r;
+}
+
+// Every object is visited exactly once, and nothing else is
+static void
+check_visits(struct job *jobs, size_t count, size_t expected)
+{
+	size_t seen = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		CHECK(jobs[i].visits <= 1, "%s visited %d times", jobs[i].label, jobs[i].visits);
+		seen += jobs[i].visits;
+		jobs[i].visits = 0;
+	}
+	CHECK(seen == expected, "visited %zu of %zu", seen, expected);
+}
+
+static void
+check_iteration(size_t count)
+{
+	struct hashtable ht = { 0 };
+	struct job *jobs = calloc(count, sizeof(*jobs));
+	struct job *j, *tj;
+
+	/* A zeroed table is empty */
+	CHECK(hashtable_first(&ht) == NULL, "zeroed table not empty");
+	CHECK(hashtable_lookup(&ht, 42) == NULL, "lookup in a zeroed table");
+	hashtable_remove(&jobs[0].label_link);
+	CHECK(ht.ht_count == 0, "removing an unlinked object changed the count");
+
+	/* A quarter of the objects share one hash */
+	for (size_t i = 0; i < count; i++) {
+		snprintf(jobs[i].label, sizeof(jobs[i].label), "job.%zu", i);
+		hashtable_insert(&ht, &jobs[i].label_link,
+		    i % 4 == 0 ? 42 : hashtable_strhash(jobs[i].label));
+	}
+	CHECK(ht.ht_count == count, "count %zu after %zu inserts", ht.ht_count, count);
+
+	HASHTABLE_FOREACH_ALL(j, &ht, label_link) {
+		j->visits++;
+	}
+	check_visits(jobs, count, count);
+
+	size_t shared = 0;
+	HASHTABLE_FOREACH(j, &ht, 42, label_link) {
+		CHECK((j - jobs) % 4 == 0, "%s has the wrong hash", j->label);
+		j->visits++;
+		shared++;
+	}
+	check_visits(jobs, count, (count + 3) / 4);
+
+	/* Remove every other object that shares the hash, while iterating */
+	size_t removed = 0;
+	HASHTABLE_FOREACH_SAFE(j, &ht, 42, label_link, tj) {
+		if ((j - jobs) % 8 == 0) {
+			hashtable_remove(&j->label_link);
+			removed++;
+		}
+	}
+	CHECK(ht.ht_count == count - removed, "count %zu after removing %zu",
+	    ht.ht_count, removed);
+	HASHTABLE_FOREACH(j, &ht, 42, label_link) {
+		CHECK((j - jobs) % 8 == 4, "%s was not removed", j->label);
+		j->visits++;
+	}
+	check_visits(jobs, count, shared - removed);
+
+	/* Remove the odd ones while walking the whole table */
+	HASHTABLE_FOREACH_ALL_SAFE(j, &ht, label_link, tj) {
+		j->visits++;
+		if ((j - jobs) % 2 == 1) {
+			hashtable_remove(&j->label_link);
+			removed++;
+		}
+	}
+	check_visits(jobs, count, count - (count + 7) / 8);
+	CHECK(ht.ht_count == count - removed, "count %zu after removing %zu",
+	    ht.ht_count, removed);
+
+	HASHTABLE_FOREACH_ALL(j, &ht, label_link) {
+		CHECK((j - jobs) % 2 == 0 && (j - jobs) % 8 != 0, "%s was not removed", j->label);
+		j->visits++;
+	}
+	check_visits(jobs, count, count - removed);
+
+	/* Removal twice is as harmless as removal of an unlinked object */
+	HASHTABLE_FOREACH_ALL_SAFE(j, &ht, label_link, tj) {
+		hashtable_remove(&j->label_link);
+		hashtable_remove(&j->label_link);
+	}
+	CHECK(ht.ht_count == 0 && hashtable_first(&ht) == NULL, "table not empty");
+
+	hashtable_destroy(&ht);
+	free(jobs);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = bench_arg(argc, argv, 1, 20000);
+	size_t iterations = bench_arg(argc, argv, 2, 10);
+
+	check_iteration(1000);
+
+	struct job *jobs = calloc(count, sizeof(*jobs));
+	bench_start();
+	for (size_t i = 0; i < count; i++) {
+		snprintf(jobs[i].label, sizeof(jobs[i].label), "com.example.job.%zu", i);
+		jobs[i].p = (pid_t)(100 + i);
+		hashtable_insert(&labels, &jobs[i].label_link, hashtable_strhash(jobs[i].label));
+		hashtable_insert(&pids, &jobs[i].pid_link, hashtable_inthash(jobs[i].p));
+	}
+	bench_stop("insert, hashtable", count, "job");
+
+	bench_start();
+	for (size_t i = 0; i < count; i++) {
+		LIST_INSERT_HEAD(&old_labels[djb2(jobs[i].label) % OLD_LABEL_HASH_SIZE], &jobs[i], label_sle);
+		LIST_INSERT_HEAD(&old_pids[jobs[i].p & (OLD_ACTIVE_JOB_HASH_SIZE - 1)], &jobs[i], pid_sle);
+	}
+	bench_stop("insert, fixed arrays", count, "job");
+
+	size_t found = 0;
+	struct job *j;
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			const char *label = jobs[(i * 7919) % count].label;
+			HASHTABLE_FOREACH(j, &labels, hashtable_strhash(label), label_link) {
+				if (strcmp(j->label, label) == 0) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	bench_stop("label, hashtable", iterations * count, "lookup");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			const char *label = jobs[(i * 7919) % count].label;
+			LIST_FOREACH(j, &old_labels[djb2(label) % OLD_LABEL_HASH_SIZE], label_sle) {
+				if (strcmp(j->label, label) == 0) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	bench_stop("label, fixed arrays", iterations * count, "lookup");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			pid_t p = jobs[(i * 7919) % count].p;
+			HASHTABLE_FOREACH(j, &pids, hashtable_inthash(p), pid_link) {
+				if (j->p == p) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	bench_stop("pid, hashtable", iterations * count, "lookup");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			pid_t p = jobs[(i * 7919) % count].p;
+			LIST_FOREACH(j, &old_pids[p & (OLD_ACTIVE_JOB_HASH_SIZE - 1)], pid_sle) {
+				if (j->p == p) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	bench_stop("pid, fixed arrays", iterations * count, "lookup");
+
+	CHECK(found == 4 * iterations * count, "found %zu of %zu", found,
+	    4 * iterations * count);
+
+	bench_start();
+	for (size_t i = 0; i < count; i++) {
+		hashtable_remove(&jobs[i].label_link);
+		hashtable_remove(&jobs[i].pid_link);
+	}
+	bench_stop("remove, hashtable", count, "job");
+
+	CHECK(labels.ht_count == 0 && pids.ht_count == 0, "tables not empty");
+
+	hashtable_destroy(&labels);
+	hashtable_destroy(&pids);
+	free(jobs);
+	return 0;
+}
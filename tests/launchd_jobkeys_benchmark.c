@@ -0,0 +1,183 @@
+//
+//  launchd_jobkeys_benchmark.c
+//  Checks that jobkey_lookup()'s hash is still perfect for the current key
+//  set, then times it over the top-level keys of every job plist in a
+//  directory (by default /System/Library/LaunchDaemons), against the
+//  first-letter switch and strcasecmp() chains it replaced. With no job
+//  plists installed it times the known key names instead.
+//
+//  If a new key collides, run with -s to find a seed that separates them
+//  all, and update JOBKEY_SEED.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "../src/launchd/jobkeys.h"
+#include "../src/launchd/jobkeys.c"
+
+#include "bench.h"
+
+#define MAX_KEYS	(64 * 1024)
+
+static const char *keys[MAX_KEYS];
+static size_t nkeys;
+
+// What job_import_bool() and friends used to do for every key
+static enum jobkey
+old_lookup(const char *key)
+{
+	int c = tolower((unsigned char)key[0]);
+
+	for (int k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++) {
+		if (tolower((unsigned char)jobkey_names[k][0]) == c && strcasecmp(key, jobkey_names[k]) == 0) {
+			return (enum jobkey)k;
+		}
+	}
+
+	return JOBKEY_UNKNOWN;
+}
+
+static bool
+seed_is_perfect(uint32_t seed)
+{
+	static uint8_t used[1U << JOBKEY_BITS];
+
+	memset(used, 0, sizeof(used));
+	for (int k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++) {
+		uint32_t h = seed;
+		for (const char *p = jobkey_names[k]; *p; p++) {
+			h = (h ^ ((unsigned char)*p | 0x20)) * 0x01000193U;
+		}
+		h >>= 32 - JOBKEY_BITS;
+		if (used[h]++) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+read_keys(const char *dir)
+{
+	char path[PATH_MAX];
+	DIR *d = opendir(dir);
+	struct dirent *de;
+
+	if (d == NULL) {
+		perror(dir);
+		return;
+	}
+
+	while ((de = readdir(d)) != NULL) {
+		size_t len = strlen(de->d_name);
+		if (len < 6 || strcmp(de->d_name + len - 6, ".plist") != 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+
+		FILE *fp = fopen(path, "r");
+		if (fp == NULL)
+			continue;
+		fseek(fp, 0, SEEK_END);
+		size_t size = ftell(fp);
+		rewind(fp);
+		void *data = malloc(size);
+		bool ok = fread(data, 1, size, fp) == size;
+		fclose(fp);
+
+		xpc_object_t job = ok ? xpc_create_from_plist(data, size) : NULL;
+		free(data);
+		if (job == NULL)
+			continue;
+		if (xpc_get_type(job) == XPC_TYPE_DICTIONARY) {
+			xpc_dictionary_apply(job, ^bool(const char *key, xpc_object_t value __unused) {
+				if (nkeys < MAX_KEYS)
+					keys[nkeys++] = strdup(key);
+				return true;
+			});
+		}
+		xpc_release(job);
+	}
+	closedir(d);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t iterations = 200;
+
+	if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+		for (uint32_t seed = 1; seed != 0; seed++) {
+			if (seed_is_perfect(seed)) {
+				printf("#define JOBKEY_SEED\t0x%xU\n", seed);
+				return 0;
+			}
+		}
+		printf("No seed fits %d keys in %u slots; raise JOBKEY_BITS\n", JOBKEY_COUNT - 1, 1U << JOBKEY_BITS);
+		return 1;
+	}
+
+	// Every key must find itself, in any case, without the fallback scan.
+	jobkey_fill();
+	CHECK(!jobkey_slots_collide, "JOBKEY_SEED no longer separates the keys; run with -s");
+	for (int k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++) {
+		char upper[128];
+		size_t i;
+		for (i = 0; jobkey_names[k][i] && i < sizeof(upper) - 1; i++)
+			upper[i] = toupper((unsigned char)jobkey_names[k][i]);
+		upper[i] = '\0';
+		CHECK(jobkey_lookup(jobkey_names[k]) == k && jobkey_lookup(upper) == k,
+		    "%s does not map to itself", jobkey_names[k]);
+	}
+	CHECK(jobkey_lookup("ServiceDescription") == JOBKEY_UNKNOWN &&
+	    jobkey_lookup("") == JOBKEY_UNKNOWN,
+	    "unknown keys should map to JOBKEY_UNKNOWN");
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++)
+			read_keys(argv[i]);
+	} else {
+		read_keys("/System/Library/LaunchDaemons");
+		read_keys("/System/Library/LaunchAgents");
+		read_keys("/Library/LaunchDaemons");
+		read_keys("/Library/LaunchAgents");
+	}
+
+	// With no jobs installed, time the key names themselves.
+	if (nkeys == 0) {
+		for (int k = JOBKEY_UNKNOWN + 1; k < JOBKEY_COUNT; k++)
+			keys[nkeys++] = jobkey_names[k];
+	}
+
+	size_t known = 0;
+	for (size_t i = 0; i < nkeys; i++) {
+		CHECK(jobkey_lookup(keys[i]) == old_lookup(keys[i]),
+		    "%s maps differently", keys[i]);
+		known += jobkey_lookup(keys[i]) != JOBKEY_UNKNOWN;
+	}
+	printf("%zu keys, %zu known\n", nkeys, known);
+
+	size_t sum = 0;
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < nkeys; i++)
+			sum += jobkey_lookup(keys[i]);
+	}
+	bench_stop("jobkey_lookup", (double)iterations * nkeys, "key");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < nkeys; i++)
+			sum -= old_lookup(keys[i]);
+	}
+	bench_stop("strcasecmp chains", (double)iterations * nkeys, "key");
+	CHECK(sum == 0, "the two lookups disagreed while timed");
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+//
+//  launchd_kevent_benchmark.c
+//  Times registering the timers and sockets of many jobs with one kevent(2)
+//  call each, as kevent_mod() does, against queueing them in the batch that
+//  kevent_mod_defer() and kevent_mod_flush() use and handing them to the
+//  kernel in a single call, as job_import_bulk() now does. Also checks
+//  that a batch keeps its order, that a failed addition is reported
+//  against the job that made it, and that an addition deleted in the same
+//  batch nets out.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+
+#include "../src/launchd/kevent_batch.h"
+#include "../src/launchd/kevent_batch.c"
+
+#include "bench.h"
+
+#define FAILED_MAX	64
+
+struct failures {
+	void *udata[FAILED_MAX];
+	intptr_t data[FAILED_MAX];
+	size_t count;
+};
+
+static void
+record_failure(const struct kevent *kev, void *context)
+{
+	struct failures *f = context;
+
+	CHECK(f->count < FAILED_MAX, "too many failures");
+	f->udata[f->count] = kev->udata;
+	f->data[f->count] = kev->data;
+	f->count++;
+}
+
+static void
+queue(struct kevent_batch *kb, uintptr_t ident, short filter, u_short flags,
+    u_int fflags, intptr_t data, void *udata)
+{
+	struct kevent kev;
+
+	EV_SET(&kev, ident, filter, flags, fflags, data, udata);
+	CHECK(kevent_batch_reserve(kb, 1), "out of memory");
+	kevent_batch_add(kb, &kev, 1);
+}
+
+// The next event to fire within ms, or NULL
+static void *
+next_event(int kq, long ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+	struct kevent kev;
+
+	return kevent(kq, NULL, 0, &kev, 1, &ts) == 1 ? kev.udata : NULL;
+}
+
+// A later change to the same timer wins, and receipts come back in order.
+static void
+check_order(void)
+{
+	struct kevent_batch kb = { 0 };
+	struct failures f = { .count = 0 };
+	int marks[4];
+	int kq = kqueue();
+
+	queue(&kb, 1, EVFILT_TIMER, EV_ADD|EV_ONESHOT, 0, 1, &marks[0]);
+	queue(&kb, 1, EVFILT_TIMER, EV_DELETE, 0, 0, &marks[1]);
+	queue(&kb, 1, EVFILT_TIMER, EV_ADD|EV_ONESHOT, 0, 1, &marks[2]);
+	queue(&kb, 2, EVFILT_TIMER, EV_ADD|EV_ONESHOT, 0, 10 * 1000, &marks[3]);
+	CHECK(kevent_batch_submit(&kb, kq, record_failure, &f) == 4, "missing receipts");
+	CHECK(f.count == 0, "%zu changes failed", f.count);
+	CHECK(kb.kb_count == 0, "batch not emptied");
+
+	for (int i = 0; i < 4; i++) {
+		CHECK(kb.kb_kev[i].udata == &marks[i], "receipt %d out of order", i);
+		CHECK(kb.kb_kev[i].flags & EV_ERROR, "change %d has no receipt", i);
+	}
+
+	CHECK(next_event(kq, 1000) == &marks[2], "the re-added timer did not fire");
+
+	kevent_batch_destroy(&kb);
+	close(kq);
+}
+
+// Every other job asks for a closed descriptor; only those are reported.
+static void
+check_receipts(void)
+{
+	struct kevent_batch kb = { 0 };
+	struct failures f = { .count = 0 };
+	int jobs[16], fds[16];
+	int kq = kqueue();
+
+	for (int i = 0; i < 16; i++) {
+		fds[i] = socket(AF_UNIX, SOCK_STREAM, 0);
+		CHECK(fds[i] != -1, "socket");
+	}
+	// Closed only now, so that no later socket reuses the number
+	for (int i = 1; i < 16; i += 2) {
+		close(fds[i]);
+	}
+	for (int i = 0; i < 16; i++) {
+		queue(&kb, 100 + i, EVFILT_TIMER, EV_ADD, 0, 3600 * 1000, &jobs[i]);
+		queue(&kb, fds[i], EVFILT_READ, EV_ADD, 0, 0, &jobs[i]);
+	}
+	CHECK(kevent_batch_submit(&kb, kq, record_failure, &f) == 32, "missing receipts");
+
+	CHECK(f.count == 8, "%zu failures reported, expected 8", f.count);
+	for (size_t n = 0; n < f.count; n++) {
+		CHECK(f.udata[n] == &jobs[2 * n + 1], "failure %zu put down to the wrong job", n);
+		CHECK(f.data[n] == EBADF, "failure %zu: error %ld", n, (long)f.data[n]);
+	}
+
+	for (int i = 0; i < 16; i += 2) {
+		close(fds[i]);
+	}
+	kevent_batch_destroy(&kb);
+	close(kq);
+}
+
+// An addition deleted in the same batch never fires, and deleting what was
+// never there is not reported.
+static void
+check_cancel(void)
+{
+	struct kevent_batch kb = { 0 };
+	struct failures f = { .count = 0 };
+	int job;
+	int kq = kqueue();
+
+	queue(&kb, 1, EVFILT_TIMER, EV_ADD, 0, 1, &job);
+	queue(&kb, 1, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+	queue(&kb, 2, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+	CHECK(kevent_batch_submit(&kb, kq, record_failure, &f) == 3, "missing receipts");
+	CHECK(kb.kb_kev[2].data == ENOENT, "deleting nothing gave %ld", (long)kb.kb_kev[2].data);
+	CHECK(f.count == 0, "%zu changes reported as failed", f.count);
+	CHECK(next_event(kq, 50) == NULL, "cancelled timer fired");
+
+	CHECK(kevent_batch_submit(&kb, kq, record_failure, &f) == 0, "empty batch sent");
+
+	kevent_batch_destroy(&kb);
+	close(kq);
+}
+
+// A StartInterval timer and a listening socket per job
+static void
+fill(struct kevent *kev, const int *fds, size_t count, u_short flags)
+{
+	for (size_t i = 0; i < count; i++) {
+		EV_SET(&kev[2 * i], i + 1, EVFILT_TIMER, flags|EV_CLEAR|EV_RECEIPT, NOTE_SECONDS, 3600, &kev[2 * i]);
+		EV_SET(&kev[2 * i + 1], fds[i], EVFILT_READ, flags|EV_RECEIPT, 0, 0, &kev[2 * i + 1]);
+	}
+}
+
+static void
+check(const struct kevent *kev, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		CHECK((kev[i].flags & EV_ERROR) && kev[i].data == 0,
+		    "change %zu: error %lld", i, (long long)kev[i].data);
+	}
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = bench_arg(argc, argv, 1, 200);	// stays under the default descriptor limit
+
+	check_order();
+	check_receipts();
+	check_cancel();
+
+	int *fds = calloc(count, sizeof(*fds));
+	struct kevent *kev = calloc(2 * count, sizeof(*kev));
+	for (size_t i = 0; i < count; i++) {
+		fds[i] = socket(AF_UNIX, SOCK_STREAM, 0);
+		CHECK(fds[i] != -1, "socket");
+	}
+
+	int kq = kqueue();
+	fill(kev, fds, count, EV_ADD);
+	bench_start();
+	for (size_t i = 0; i < 2 * count; i++) {
+		CHECK(kevent(kq, &kev[i], 1, &kev[i], 1, NULL) == 1, "kevent");
+	}
+	bench_stop("register, one by one", count, "job");
+	check(kev, 2 * count);
+	close(kq);
+
+	kq = kqueue();
+	struct kevent_batch kb = { 0 };
+	struct failures f = { .count = 0 };
+	fill(kev, fds, count, EV_ADD);
+	bench_start();
+	CHECK(kevent_batch_reserve(&kb, 2 * count), "out of memory");
+	kevent_batch_add(&kb, kev, 2 * count);
+	int r = kevent_batch_submit(&kb, kq, record_failure, &f);
+	bench_stop("register, deferred", count, "job");
+	CHECK(r == (int)(2 * count), "%d of %zu receipts", r, 2 * count);
+	CHECK(f.count == 0, "%zu registrations failed", f.count);
+	check(kb.kb_kev, 2 * count);
+	kevent_batch_destroy(&kb);
+	close(kq);
+
+	for (size_t i = 0; i < count; i++) {
+		close(fds[i]);
+	}
+	free(kev);
+	free(fds);
+	return 0;
+}
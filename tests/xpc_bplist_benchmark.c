@@ -0,0 +1,234 @@
+//
+//  xpc_bplist_benchmark.c
+//  Checks that objects of every type survive xpc_bplist_create() and
+//  xpc_bplist_write_file(), and that a file whose containers share each
+//  other is rejected instead of decoded. Then converts every XML property
+//  list in a directory (by default /System/Library/LaunchDaemons) to
+//  bplist00, checks that it reads back equal, and compares size and parse
+//  time of the two encodings.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define MAX_FILES	4096
+#define BOMB_LEVELS	80
+
+struct plist_file {
+	void *xml;
+	size_t xml_size;
+	void *binary;
+	size_t binary_size;
+};
+
+static xpc_object_t
+make_sample(void)
+{
+	static const uint8_t bytes[] = { 0x00, 0xff, 0x7f, 0x80 };
+
+	xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_bool(dict, "false", false);
+	xpc_dictionary_set_int64(dict, "negative", -1234567890123LL);
+	xpc_dictionary_set_uint64(dict, "large", UINT64_MAX);
+	xpc_dictionary_set_double(dict, "real", -2.5e-300);
+	xpc_dictionary_set_date(dict, "date", 1600000000LL * NSEC_PER_SEC);
+	xpc_dictionary_set_data(dict, "data", bytes, sizeof(bytes));
+	xpc_dictionary_set_string(dict, "ascii", "/usr/libexec/launchd");
+	xpc_dictionary_set_string(dict, "unicode", "na\xc3\xafve \xe2\x82\xac \xf0\x9f\x98\x80");
+
+	xpc_object_t empty = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_value(dict, "empty dictionary", empty);
+	xpc_release(empty);
+	empty = xpc_array_create(NULL, 0);
+	xpc_dictionary_set_value(dict, "empty array", empty);
+	xpc_release(empty);
+
+	/* Leaves that the writer shares, referenced many times over */
+	xpc_object_t array = xpc_array_create(NULL, 0);
+	for (size_t i = 0; i < 1000; i++) {
+		xpc_object_t job = xpc_dictionary_create(NULL, NULL, 0);
+		xpc_dictionary_set_bool(job, "RunAtLoad", true);
+		xpc_dictionary_set_string(job, "Program", "/usr/libexec/a-rather-long-program-path");
+		xpc_dictionary_set_int64(job, "Index", i);
+		xpc_array_append_value(array, job);
+		xpc_release(job);
+	}
+	xpc_dictionary_set_value(dict, "jobs", array);
+	xpc_release(array);
+
+	return dict;
+}
+
+/*
+ * BOMB_LEVELS arrays, each holding the next one twice, ending in true:
+ * under 400 bytes that would decode to 2^BOMB_LEVELS objects.
+ */
+static uint8_t *
+make_bomb(size_t *sizep)
+{
+	uint8_t *buf = calloc(1, 512);
+	uint8_t offsets[BOMB_LEVELS + 1];
+	size_t off = 8, table;
+
+	memcpy(buf, "bplist00", 8);
+	for (int i = 0; i < BOMB_LEVELS; i++) {
+		offsets[i] = (uint8_t)off;
+		buf[off++] = 0xa2;
+		buf[off++] = (uint8_t)(i + 1);
+		buf[off++] = (uint8_t)(i + 1);
+	}
+	offsets[BOMB_LEVELS] = (uint8_t)off;
+	buf[off++] = 0x09;
+
+	table = off;
+	memcpy(buf + off, offsets, sizeof(offsets));
+	off += sizeof(offsets);
+
+	uint8_t *trailer = buf + off;
+	trailer[6] = 1;
+	trailer[7] = 1;
+	trailer[15] = BOMB_LEVELS + 1;
+	trailer[31] = (uint8_t)table;
+	*sizep = off + 32;
+	return buf;
+}
+
+static void
+check_documents(void)
+{
+	size_t size;
+
+	xpc_object_t sample = make_sample();
+	void *binary = xpc_bplist_create(sample, &size);
+	CHECK(binary != NULL, "encoding failed");
+	xpc_object_t back = xpc_create_from_plist(binary, size);
+	CHECK(back != NULL && xpc_equal(sample, back), "round trip differs");
+	xpc_release(back);
+	free(binary);
+
+	char path[] = "/tmp/xpc_bplist_benchmark.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1, "mkstemp: %s", strerror(errno));
+	close(fd);
+	CHECK(xpc_bplist_write_file(sample, path) == 0, "writing %s failed", path);
+	back = xpc_create_from_plist_file(path);
+	CHECK(back != NULL && xpc_equal(sample, back), "file round trip differs");
+	xpc_release(back);
+	unlink(path);
+	xpc_release(sample);
+
+	uint8_t *bomb = make_bomb(&size);
+	bench_start();
+	back = xpc_create_from_plist(bomb, size);
+	bench_stop("reject shared containers", 1, "file");
+	CHECK(back == NULL && errno == EINVAL, "%zu byte bomb was decoded", size);
+	free(bomb);
+}
+
+static bool
+read_file(const char *path, struct plist_file *file)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	file->xml_size = ftell(fp);
+	rewind(fp);
+	file->xml = malloc(file->xml_size);
+	bool ok = fread(file->xml, 1, file->xml_size, fp) == file->xml_size;
+	fclose(fp);
+
+	return ok;
+}
+
+int main(int argc, const char * argv[]) {
+	const char *dir = "/System/Library/LaunchDaemons";
+	size_t iterations = bench_arg(argc, argv, 2, 20);
+	if (argc > 1) {
+		dir = argv[1];
+	}
+
+	check_documents();
+
+	static struct plist_file files[MAX_FILES];
+	size_t count = 0, xml_bytes = 0, binary_bytes = 0;
+	char path[PATH_MAX];
+
+	DIR *d = opendir(dir);
+	CHECK(d != NULL, "%s: cannot open", dir);
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL && count < MAX_FILES) {
+		size_t len = strlen(de->d_name);
+		if (len < 6 || strcmp(de->d_name + len - 6, ".plist") != 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (!read_file(path, &files[count]))
+			continue;
+
+		if (files[count].xml_size >= 8 && memcmp(files[count].xml, "bplist00", 8) == 0) {
+			free(files[count].xml);
+			continue;
+		}
+
+		struct plist_file *f = &files[count];
+		xpc_object_t obj = xpc_create_from_plist(f->xml, f->xml_size);
+		CHECK(obj != NULL, "%s: failed to parse", path);
+
+		f->binary = xpc_bplist_create(obj, &f->binary_size);
+		CHECK(f->binary != NULL, "%s: failed to encode", path);
+
+		xpc_object_t back = xpc_create_from_plist(f->binary, f->binary_size);
+		CHECK(back != NULL && xpc_equal(obj, back), "%s: binary round trip differs", path);
+		xpc_release(back);
+		xpc_release(obj);
+
+		xml_bytes += f->xml_size;
+		binary_bytes += f->binary_size;
+		count++;
+	}
+	closedir(d);
+
+	CHECK(count > 0, "%s: no XML property lists found", dir);
+	printf("%zu files, %zu bytes XML, %zu bytes binary (%.1f%%)\n", count,
+	    xml_bytes, binary_bytes, 100.0 * binary_bytes / xml_bytes);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			xpc_release(xpc_create_from_plist(files[i].xml, files[i].xml_size));
+		}
+	}
+	bench_stop("parse XML", iterations, "corpus");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			xpc_release(xpc_create_from_plist(files[i].binary, files[i].binary_size));
+		}
+	}
+	bench_stop("parse binary", iterations, "corpus");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			xpc_object_t obj = xpc_create_from_plist(files[i].binary, files[i].binary_size);
+			size_t size;
+			free(xpc_bplist_create(obj, &size));
+			xpc_release(obj);
+		}
+	}
+	bench_stop("parse and write binary", iterations, "corpus");
+
+	return 0;
+}
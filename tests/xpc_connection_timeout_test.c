@@ -0,0 +1,230 @@
+//
+//  xpc_connection_timeout_test.c
+//  Plays the server end of a connection by hand to check reply deadlines:
+//  a reply that arrives after its call timed out is dropped rather than
+//  handed to the event handler, a synchronous call made from the target
+//  queue still times out, the error for a dead peer reaches the event
+//  handler after every message the peer sent before it died, and messages
+//  still queued to be sent when the connection is cancelled are dropped.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <mach/mach.h>
+#include <dispatch/dispatch.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+#include <xpc/launchd.h>
+
+#include "bench.h"
+
+// As in src/libxpc/xpc_internal.h
+#define	XPC_SEQID	"XPC sequence number"
+
+#define TIMEOUT_NS	(50 * NSEC_PER_MSEC)
+#define BURST		100
+
+static _Atomic int late;
+static _Atomic int unsolicited;
+static _Atomic int errors;
+static _Atomic int running;
+static _Atomic int overlaps;
+static dispatch_semaphore_t event_sem;
+
+// What the event handler saw, in order: a message's "n", or -1 for an error
+static int64_t order[BURST + 8];
+static size_t order_count;
+
+static boolean_t
+no_demux(mach_msg_header_t *request, mach_msg_header_t *reply)
+{
+	return FALSE;
+}
+
+// Receives one request sent to the server port
+static xpc_object_t
+server_receive(mach_port_t server)
+{
+	xpc_object_t request = NULL;
+	mach_port_t remote;
+
+	CHECK(xpc_pipe_try_receive(server, &request, &remote, no_demux, 0, 0) == 0 &&
+	    request != NULL, "server did not receive the request");
+	return request;
+}
+
+// Sends the client a message that answers nothing it asked
+static void
+server_send_unsolicited(xpc_object_t request, uint64_t id)
+{
+	xpc_object_t message = xpc_dictionary_create_reply(request);
+
+	xpc_dictionary_set_uint64(message, XPC_SEQID, id);
+	xpc_dictionary_set_int64(message, "n", (int64_t)id);
+	xpc_dictionary_set_string(message, "kind", "unsolicited");
+	CHECK(xpc_pipe_routine_reply(message) == 0, "unsolicited send failed");
+	xpc_release(message);
+}
+
+static bool
+wait_ms(dispatch_semaphore_t sem, int64_t ms)
+{
+	return dispatch_semaphore_wait(sem,
+	    dispatch_time(DISPATCH_TIME_NOW, ms * NSEC_PER_MSEC)) == 0;
+}
+
+// Messages sitting unread on a port
+static unsigned int
+queued_at(mach_port_t port)
+{
+	mach_port_status_t status;
+	mach_msg_type_number_t count = MACH_PORT_RECEIVE_STATUS_COUNT;
+
+	CHECK(mach_port_get_attributes(mach_task_self(), port,
+	    MACH_PORT_RECEIVE_STATUS, (mach_port_info_t)&status, &count) == KERN_SUCCESS,
+	    "cannot read the port's status");
+	return status.mps_msgcount;
+}
+
+// Messages queued behind a stalled send queue go nowhere once cancelled.
+static void
+check_cancel_drops_queued(dispatch_queue_t q)
+{
+	mach_port_t port;
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+	mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)port);
+	xpc_connection_set_target_queue(conn, q);
+	xpc_connection_set_event_handler(conn, ^(xpc_object_t object) { });
+	xpc_connection_resume(conn);
+
+	dispatch_semaphore_t stalled = dispatch_semaphore_create(0);
+	dispatch_semaphore_t release = dispatch_semaphore_create(0);
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+		xpc_connection_send_barrier(conn, ^{
+			dispatch_semaphore_signal(stalled);
+			dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+		});
+	});
+	CHECK(wait_ms(stalled, 5000), "send queue never stalled");
+
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(message, "kind", "queued");
+	for (int i = 0; i < BURST; i++) {
+		xpc_message_set_priority(message, i % 2 ? XPC_MESSAGE_PRIORITY_BULK :
+		    XPC_MESSAGE_PRIORITY_INTERACTIVE);
+		xpc_connection_send_message(conn, message);
+	}
+	xpc_release(message);
+
+	xpc_connection_cancel(conn);
+	dispatch_semaphore_signal(release);
+	xpc_connection_send_barrier(conn, ^{ });
+	CHECK(queued_at(port) == 0, "%u messages sent after the cancel", queued_at(port));
+
+	mach_port_mod_refs(mach_task_self(), port, MACH_PORT_RIGHT_RECEIVE, -1);
+}
+
+int main(int argc, const char * argv[]) {
+	mach_port_t server;
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &server);
+	mach_port_insert_right(mach_task_self(), server, server, MACH_MSG_TYPE_MAKE_SEND);
+
+	dispatch_queue_t q = dispatch_queue_create("xpc_connection_timeout_test", NULL);
+	event_sem = dispatch_semaphore_create(0);
+
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)server);
+	xpc_connection_set_target_queue(conn, q);
+	xpc_connection_set_event_handler(conn, ^(xpc_object_t object) {
+		if (atomic_fetch_add(&running, 1) != 0)
+			atomic_fetch_add(&overlaps, 1);
+		usleep(100);
+		if (xpc_get_type(object) == XPC_TYPE_ERROR) {
+			if (order_count < BURST + 8)
+				order[order_count++] = -1;
+			atomic_fetch_add(&errors, 1);
+		} else {
+			const char *kind = xpc_dictionary_get_string(object, "kind");
+			if (strcmp(kind, "late reply") == 0) {
+				atomic_fetch_add(&late, 1);
+			} else {
+				if (order_count < BURST + 8)
+					order[order_count++] = xpc_dictionary_get_int64(object, "n");
+				atomic_fetch_add(&unsolicited, 1);
+			}
+		}
+		atomic_fetch_sub(&running, 1);
+		dispatch_semaphore_signal(event_sem);
+	});
+	xpc_connection_resume(conn);
+
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(message, "kind", "request");
+
+	// The call times out, then its reply comes anyway.
+	dispatch_semaphore_t done = dispatch_semaphore_create(0);
+	__block xpc_object_t result = NULL;
+	xpc_connection_send_message_with_reply_timeout(conn, message, q, TIMEOUT_NS,
+	    ^(xpc_object_t reply) {
+		result = reply;
+		dispatch_semaphore_signal(done);
+	});
+	CHECK(wait_ms(done, 5000), "timed out call never completed");
+	CHECK(result == XPC_ERROR_CONNECTION_INTERRUPTED, "timed out call got %p", result);
+
+	xpc_object_t request = server_receive(server);
+	xpc_object_t reply = xpc_dictionary_create_reply(request);
+	xpc_dictionary_set_string(reply, "kind", "late reply");
+	CHECK(xpc_pipe_routine_reply(reply) == 0, "late reply send failed");
+	xpc_release(reply);
+
+	// Messages from one port are handled in order, so once this one is
+	// the late reply has been dealt with too.
+	server_send_unsolicited(request, 1000000);
+	while (atomic_load(&unsolicited) == 0)
+		CHECK(wait_ms(event_sem, 5000), "unsolicited message never arrived");
+	CHECK(atomic_load(&late) == 0, "late reply reached the event handler");
+	CHECK(atomic_load(&errors) == 0, "unexpected error event");
+
+	// A synchronous call from the target queue, whose reply never comes
+	dispatch_async(q, ^{
+		result = xpc_connection_send_message_with_reply_sync_timeout(conn,
+		    message, TIMEOUT_NS);
+		dispatch_semaphore_signal(done);
+	});
+	CHECK(wait_ms(done, 5000), "synchronous call on the target queue hung");
+	CHECK(result == XPC_ERROR_CONNECTION_INTERRUPTED, "synchronous call got %p", result);
+	xpc_release(server_receive(server));
+
+	// A burst of messages, then the peer dies while they are being handled.
+	for (int i = 0; i < BURST; i++)
+		server_send_unsolicited(request, 2000000 + i);
+	mach_port_mod_refs(mach_task_self(), server, MACH_PORT_RIGHT_RECEIVE, -1);
+
+	while (atomic_load(&errors) == 0 && wait_ms(event_sem, 5000))
+		;
+	CHECK(atomic_load(&errors) == 1, "peer death was not reported");
+	CHECK(atomic_load(&overlaps) == 0, "event handler ran concurrently with itself");
+
+	// Everything the peer sent came first, in order, and the error last.
+	dispatch_sync(q, ^{ });
+	CHECK(order_count == BURST + 2, "%zu events, expected %d", order_count, BURST + 2);
+	CHECK(order[0] == 1000000, "first event was %lld", (long long)order[0]);
+	for (int i = 0; i < BURST; i++) {
+		CHECK(order[1 + i] == 2000000 + i, "burst message %d arrived as event %lld",
+		    i, (long long)order[1 + i]);
+	}
+	CHECK(order[BURST + 1] == -1, "the error came before the burst ended");
+
+	check_cancel_drops_queued(q);
+
+	xpc_release(request);
+	xpc_release(message);
+	return 0;
+}
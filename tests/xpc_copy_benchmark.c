@@ -0,0 +1,114 @@
+//
+//  xpc_copy_benchmark.c
+//  Times xpc_copy() of a launchd-style export dictionary of 1,000 jobs,
+//  once while it is mutable (deep copy) and once after xpc_object_freeze(),
+//  and checks that deep copies are independent of the original while
+//  frozen subtrees are shared.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define JOB_COUNT	1000
+
+static xpc_object_t
+make_job(size_t index)
+{
+	char label[64], path[128];
+
+	snprintf(label, sizeof(label), "org.puredarwin.benchmark.job%zu", index);
+	snprintf(path, sizeof(path), "/usr/libexec/benchmark%zu", index);
+
+	xpc_object_t job = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(job, "Label", label);
+	xpc_dictionary_set_string(job, "Program", path);
+	xpc_dictionary_set_int64(job, "PID", 100 + index);
+	xpc_dictionary_set_int64(job, "LastExitStatus", 0);
+	xpc_dictionary_set_bool(job, "OnDemand", true);
+	xpc_dictionary_set_int64(job, "TimeOut", 30);
+
+	xpc_object_t args = xpc_array_create(NULL, 0);
+	xpc_array_set_string(args, XPC_ARRAY_APPEND, path);
+	xpc_array_set_string(args, XPC_ARRAY_APPEND, "-d");
+	xpc_array_set_string(args, XPC_ARRAY_APPEND, label);
+	xpc_dictionary_set_value(job, "ProgramArguments", args);
+	xpc_release(args);
+
+	xpc_object_t services = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_uint64(services, label, 0);
+	xpc_dictionary_set_value(job, "MachServices", services);
+	xpc_release(services);
+
+	return job;
+}
+
+static void
+time_copies(const char *what, xpc_object_t export, size_t iterations)
+{
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_object_t copy = xpc_copy(export);
+		xpc_release(copy);
+	}
+	bench_stop(what, iterations, "copy");
+}
+
+int main(int argc, const char * argv[]) {
+	size_t iterations = bench_arg(argc, argv, 1, 100);
+
+	xpc_object_t export = xpc_dictionary_create(NULL, NULL, 0);
+	for (size_t i = 0; i < JOB_COUNT; i++) {
+		xpc_object_t job = make_job(i);
+		xpc_dictionary_set_value(export, xpc_dictionary_get_string(job, "Label"), job);
+		xpc_release(job);
+	}
+	const char *label = "org.puredarwin.benchmark.job7";
+	xpc_object_t job = xpc_dictionary_get_value(export, label);
+
+	/* A deep copy is equal, but shares nothing mutable */
+	xpc_object_t copy = xpc_copy(export);
+	CHECK(copy != export && xpc_equal(copy, export), "deep copy differs from the original");
+	xpc_object_t job_copy = xpc_dictionary_get_value(copy, label);
+	CHECK(job_copy != job, "deep copy shares a mutable job");
+	CHECK(xpc_dictionary_get_value(job_copy, "ProgramArguments") !=
+	    xpc_dictionary_get_value(job, "ProgramArguments"),
+	    "deep copy shares a mutable array");
+
+	xpc_dictionary_set_string(job_copy, "Program", "/changed");
+	xpc_array_set_string(xpc_dictionary_get_value(job_copy, "ProgramArguments"), 1, "-x");
+	CHECK(strcmp(xpc_dictionary_get_string(job, "Program"), "/usr/libexec/benchmark7") == 0,
+	    "changing the copy changed the original");
+	CHECK(strcmp(xpc_array_get_string(xpc_dictionary_get_value(job, "ProgramArguments"), 1), "-d") == 0,
+	    "changing the copy's array changed the original");
+	CHECK(!xpc_equal(copy, export), "changed copy still equal");
+	xpc_release(copy);
+
+	time_copies("deep copy (mutable)", export, iterations);
+
+	/* A frozen subtree of a mutable tree is shared */
+	xpc_object_freeze(job);
+	copy = xpc_copy(export);
+	CHECK(xpc_dictionary_get_value(copy, label) == job, "frozen job was copied");
+	CHECK(xpc_dictionary_get_value(copy, "org.puredarwin.benchmark.job8") !=
+	    xpc_dictionary_get_value(export, "org.puredarwin.benchmark.job8"),
+	    "mutable job was shared");
+	CHECK(xpc_equal(copy, export), "partly frozen copy differs");
+	xpc_release(copy);
+
+	/* Copies of a frozen tree are the tree itself */
+	xpc_object_freeze(export);
+	time_copies("shared copy (frozen)", export, iterations);
+	copy = xpc_copy(export);
+	CHECK(copy == export, "copy of a frozen object was not shared");
+	xpc_release(copy);
+
+	xpc_release(export);
+	return 0;
+}
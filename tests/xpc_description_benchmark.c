@@ -0,0 +1,182 @@
+//
+//  xpc_description_benchmark.c
+//  Times xpc_copy_description() on a large dictionary, and raw sbuf_printf()
+//  throughput into an autoextending buffer and into a fixed buffer that
+//  drains to /dev/null. Checks that drained output matches what the
+//  autoextending buffer holds, and that a failing drain is reported.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <xpc/xpc.h>
+
+// libsbuf is linked into libxpc with hidden symbols
+#include "../src/libnv/libsbuf.c"
+
+#include "bench.h"
+
+#define LINE_FORMAT	"    \"%s\": 0x%zX\n"
+
+struct capture {
+	char *data;
+	size_t len;
+	size_t cap;
+	size_t calls;
+};
+
+// A drain that keeps what it is given, a little at a time
+static int
+capture_drain(void *arg, const char *data, int len)
+{
+	struct capture *c = arg;
+
+	if (len > 1000)
+		len = 1000;
+	if (c->len + len > c->cap) {
+		c->cap = (c->len + len) * 2;
+		c->data = realloc(c->data, c->cap);
+	}
+	memcpy(c->data + c->len, data, len);
+	c->len += len;
+	c->calls++;
+
+	return len;
+}
+
+static int
+failing_drain(void *arg, const char *data, int len)
+{
+
+	return -1;
+}
+
+static void
+fill(struct sbuf *sb, size_t lines)
+{
+
+	for (size_t i = 0; i < lines; i++)
+		sbuf_printf(sb, LINE_FORMAT, "key", i);
+}
+
+static void
+check_drains(size_t lines)
+{
+	char buf[4096];
+
+	struct sbuf *sb = sbuf_new_auto();
+	fill(sb, lines);
+	sbuf_finish(sb);
+	CHECK(!sbuf_overflowed(sb), "autoextending buffer overflowed");
+
+	/* Into memory, through a fixed buffer */
+	struct capture c = { NULL, 0, 0, 0 };
+	struct sbuf fixed;
+	sbuf_new(&fixed, buf, sizeof(buf), SBUF_FIXEDLEN);
+	sbuf_set_drain(&fixed, capture_drain, &c);
+	fill(&fixed, lines);
+	sbuf_finish(&fixed);
+	CHECK(!sbuf_overflowed(&fixed), "drained buffer overflowed");
+	CHECK(c.calls > 1, "buffer of %zu bytes was drained %zu times", sizeof(buf), c.calls);
+	CHECK(c.len == (size_t)sbuf_len(sb) && memcmp(c.data, sbuf_data(sb), c.len) == 0,
+	    "drained output differs (%zu of %d bytes)", c.len, sbuf_len(sb));
+	sbuf_delete(&fixed);
+	free(c.data);
+
+	/* Into a file */
+	char path[] = "/tmp/xpc_description_benchmark.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1, "mkstemp failed");
+	sbuf_new(&fixed, buf, sizeof(buf), SBUF_FIXEDLEN);
+	sbuf_set_drain(&fixed, sbuf_fd_drain, (void *)(intptr_t)fd);
+	fill(&fixed, lines);
+	sbuf_finish(&fixed);
+	CHECK(!sbuf_overflowed(&fixed), "file drain failed");
+	sbuf_delete(&fixed);
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	char *contents = malloc(size);
+	CHECK(pread(fd, contents, size, 0) == size, "reading %s back failed", path);
+	CHECK(size == sbuf_len(sb) && memcmp(contents, sbuf_data(sb), size) == 0,
+	    "file contents differ (%lld of %d bytes)", (long long)size, sbuf_len(sb));
+	free(contents);
+	close(fd);
+	unlink(path);
+
+	/* A drain that fails */
+	sbuf_new(&fixed, buf, sizeof(buf), SBUF_FIXEDLEN);
+	sbuf_set_drain(&fixed, failing_drain, NULL);
+	fill(&fixed, lines);
+	sbuf_finish(&fixed);
+	CHECK(sbuf_overflowed(&fixed) && sbuf_len(&fixed) == -1,
+	    "failed drain went unnoticed");
+	sbuf_delete(&fixed);
+
+	sbuf_delete(sb);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = bench_arg(argc, argv, 1, 10000);
+	size_t iterations = bench_arg(argc, argv, 2, 10);
+
+	check_drains(count * 4);
+
+	xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+	char key[64];
+	for (size_t i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "com.example.job.%zu", i);
+		xpc_object_t job = xpc_dictionary_create(NULL, NULL, 0);
+		xpc_dictionary_set_string(job, "Label", key);
+		xpc_dictionary_set_int64(job, "PID", i);
+		xpc_dictionary_set_bool(job, "OnDemand", true);
+		xpc_dictionary_set_value(dict, key, job);
+		xpc_release(job);
+	}
+
+	char *first = xpc_copy_description(dict);
+	size_t length = strlen(first);
+	snprintf(key, sizeof(key), "com.example.job.%zu", count - 1);
+	CHECK(strstr(first, key) != NULL, "%s missing from the description", key);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		char *desc = xpc_copy_description(dict);
+		CHECK(strcmp(desc, first) == 0, "description changed between calls");
+		free(desc);
+	}
+	bench_stop("xpc_copy_description", iterations, "call");
+	printf("%zu bytes of description\n", length);
+	free(first);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		struct sbuf *sb = sbuf_new_auto();
+		fill(sb, count * 4);
+		sbuf_finish(sb);
+		sbuf_delete(sb);
+	}
+	bench_stop("sbuf_printf, auto", iterations * count * 4, "call");
+
+	int devnull = open("/dev/null", O_WRONLY);
+	char buf[4096];
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		struct sbuf sb;
+		sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+		sbuf_set_drain(&sb, sbuf_fd_drain, (void *)(intptr_t)devnull);
+		fill(&sb, count * 4);
+		sbuf_finish(&sb);
+		CHECK(!sbuf_overflowed(&sb), "drain failed");
+		sbuf_delete(&sb);
+	}
+	bench_stop("sbuf_printf, drained", iterations * count * 4, "call");
+
+	close(devnull);
+	xpc_release(dict);
+
+	return 0;
+}
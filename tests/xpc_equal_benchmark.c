@@ -0,0 +1,219 @@
+//
+//  xpc_equal_benchmark.c
+//  Times xpc_equal() and xpc_hash() on 10,000-entry dictionaries and
+//  arrays: copies with the same key order, dictionaries built in the
+//  opposite order, and frozen objects whose hashes are cached. Checks the
+//  results, that +0.0 and -0.0 stay equal once their hashes are known, and
+//  that the hash a mutable container caches follows changes to it and to
+//  anything inside it.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define ENTRY_COUNT	10000
+
+// Not in the public headers; as in src/libxpc/xpc_type.c
+void xpc_int64_set_value(xpc_object_t xint, int64_t value);
+
+static xpc_object_t
+make_dictionary(bool reversed, const char *last_value)
+{
+	char key[32], value[32];
+
+	xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+	for (size_t n = 0; n < ENTRY_COUNT; n++) {
+		size_t i = reversed ? ENTRY_COUNT - 1 - n : n;
+		snprintf(key, sizeof(key), "key%zu", i);
+		snprintf(value, sizeof(value), "value%zu", i);
+		if (i == ENTRY_COUNT - 1 && last_value != NULL)
+			xpc_dictionary_set_string(dict, key, last_value);
+		else
+			xpc_dictionary_set_string(dict, key, value);
+	}
+
+	return dict;
+}
+
+static xpc_object_t
+make_array(void)
+{
+	xpc_object_t array = xpc_array_create(NULL, 0);
+	for (size_t i = 0; i < ENTRY_COUNT; i++) {
+		xpc_array_set_uint64(array, XPC_ARRAY_APPEND, i);
+	}
+
+	return array;
+}
+
+static void
+time_equal(const char *what, xpc_object_t a, xpc_object_t b, bool expected,
+    size_t iterations)
+{
+	bool result = false;
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		result = xpc_equal(a, b);
+	}
+	bench_stop(what, iterations, "call");
+	CHECK(result == expected, "%s: xpc_equal() returned %d", what, result);
+}
+
+static xpc_object_t
+make_zero_dictionary(double zero)
+{
+	xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+
+	xpc_dictionary_set_double(dict, "zero", zero);
+	xpc_object_freeze(dict);
+	return dict;
+}
+
+// +0.0 == -0.0, whether or not either hash has been computed yet
+static void
+check_zeros(void)
+{
+	xpc_object_t pos = xpc_double_create(0.0);
+	xpc_object_t neg = xpc_double_create(-0.0);
+
+	CHECK(xpc_equal(pos, neg), "+0.0 and -0.0 differ before hashing");
+	(void)xpc_hash(neg);
+	CHECK(xpc_equal(pos, neg), "+0.0 and -0.0 differ once one is hashed");
+	CHECK(xpc_hash(pos) == xpc_hash(neg), "+0.0 and -0.0 hash differently");
+	CHECK(xpc_equal(pos, neg), "+0.0 and -0.0 differ once both are hashed");
+	xpc_release(pos);
+	xpc_release(neg);
+
+	/* Frozen containers cache their hash too */
+	pos = make_zero_dictionary(0.0);
+	neg = make_zero_dictionary(-0.0);
+	CHECK(xpc_equal(pos, neg), "{+0.0} and {-0.0} differ before hashing");
+	CHECK(xpc_hash(pos) == xpc_hash(neg), "{+0.0} and {-0.0} hash differently");
+	CHECK(xpc_equal(pos, neg), "{+0.0} and {-0.0} differ once hashed");
+	xpc_release(pos);
+	xpc_release(neg);
+
+	/* NaN is never equal, but all NaNs hash alike */
+	pos = xpc_double_create(NAN);
+	neg = xpc_double_create(-NAN);
+	CHECK(!xpc_equal(pos, neg), "two NaNs are equal");
+	CHECK(xpc_hash(pos) == xpc_hash(neg), "NaNs hash differently");
+	xpc_release(pos);
+	xpc_release(neg);
+}
+
+// {"inner": {"n": n, "list": [n]}, "s": "x"}
+static xpc_object_t
+make_nested(int64_t n)
+{
+	xpc_object_t outer = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_object_t inner = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_object_t list = xpc_array_create(NULL, 0);
+
+	xpc_array_set_int64(list, XPC_ARRAY_APPEND, n);
+	xpc_dictionary_set_int64(inner, "n", n);
+	xpc_dictionary_set_value(inner, "list", list);
+	xpc_dictionary_set_value(outer, "inner", inner);
+	xpc_dictionary_set_string(outer, "s", "x");
+	xpc_release(list);
+	xpc_release(inner);
+	return outer;
+}
+
+// Whatever changes, the hash matches that of the same thing built afresh.
+static void
+check_hash_cache(void)
+{
+	xpc_object_t one = make_nested(1), two = make_nested(2);
+	xpc_object_t inner = xpc_dictionary_get_value(two, "inner");
+	xpc_object_t list = xpc_dictionary_get_value(inner, "list");
+	size_t h1 = xpc_hash(one), h2 = xpc_hash(two);
+
+	CHECK(h1 != h2, "different contents hash the same");
+	CHECK(xpc_hash(two) == h2, "hash changed with nothing else");
+
+	// A leaf two levels down, then the array beside it
+	xpc_int64_set_value(xpc_dictionary_get_value(inner, "n"), 1);
+	CHECK(xpc_hash(two) != h2, "hash missed a change to a leaf inside");
+	CHECK(!xpc_equal(one, two), "a stale hash made unequal objects equal");
+	xpc_array_set_int64(list, 0, 1);
+	CHECK(xpc_equal(one, two), "a stale hash made equal objects unequal");
+	CHECK(xpc_hash(two) == h1, "hash missed a change to an array inside");
+
+	// The container's own set and remove
+	xpc_dictionary_set_bool(two, "extra", true);
+	CHECK(xpc_hash(two) != h1, "hash missed an added key");
+	xpc_dictionary_set_value(two, "extra", NULL);
+	CHECK(xpc_hash(two) == h1, "hash missed a removed key");
+	xpc_array_append_value(list, xpc_null_create());
+	CHECK(xpc_hash(two) != h1, "hash missed an appended value");
+
+	// Changing something unrelated keeps both right
+	xpc_object_t other = make_nested(3);
+	(void)xpc_hash(other);
+	xpc_dictionary_set_string(other, "s", "y");
+	CHECK(xpc_hash(one) == h1, "an unrelated change moved the hash");
+
+	xpc_release(other);
+	xpc_release(one);
+	xpc_release(two);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t iterations = bench_arg(argc, argv, 1, 100);
+
+	check_zeros();
+	check_hash_cache();
+
+	xpc_object_t dict = make_dictionary(false, NULL);
+	xpc_object_t same_order = xpc_copy(dict);
+	xpc_object_t reversed = make_dictionary(true, NULL);
+	xpc_object_t last_differs = make_dictionary(false, "different");
+	xpc_object_t array = make_array();
+	xpc_object_t array_copy = xpc_copy(array);
+
+	time_equal("dictionary, same key order", dict, same_order, true, iterations);
+	time_equal("dictionary, reversed key order", dict, reversed, true, iterations);
+	time_equal("dictionary, last value differs", dict, last_differs, false, iterations);
+	time_equal("array", array, array_copy, true, iterations);
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		(void)xpc_hash(dict);
+	}
+	bench_stop("xpc_hash, mutable dictionary", iterations, "call");
+	CHECK(xpc_hash(dict) == xpc_hash(reversed), "key order changed the hash");
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_dictionary_set_string(dict, "key0", i % 2 ? "odd" : "value0");
+		(void)xpc_hash(dict);
+	}
+	bench_stop("xpc_hash, mutable dictionary, changed each time", iterations, "call");
+	xpc_dictionary_set_string(dict, "key0", "value0");
+	CHECK(xpc_hash(dict) == xpc_hash(reversed), "hash wrong after the changes");
+
+	/* Frozen objects cache their hash, so unequal ones are told apart at once */
+	xpc_object_freeze(dict);
+	xpc_object_freeze(last_differs);
+	(void)xpc_hash(dict);
+	(void)xpc_hash(last_differs);
+	time_equal("dictionary, frozen, hashes differ", dict, last_differs, false, iterations);
+	time_equal("dictionary, frozen, one hash known", dict, reversed, true, iterations);
+
+	xpc_release(dict);
+	xpc_release(same_order);
+	xpc_release(reversed);
+	xpc_release(last_differs);
+	xpc_release(array);
+	xpc_release(array_copy);
+	return 0;
+}
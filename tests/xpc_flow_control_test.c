@@ -0,0 +1,177 @@
+//
+//  xpc_flow_control_test.c
+//  Checks a connection's send watermarks and send window against a server
+//  port that is never read: messages queued from the send queue itself are
+//  sent and accounted for, one-way messages are not held up by a full
+//  window, a call that cannot get into the window times out without being
+//  sent, and the window cannot be set once a message with an explicit
+//  sequence number has gone out.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <mach/mach.h>
+#include <dispatch/dispatch.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+// As in src/libxpc/xpc_internal.h
+#define	XPC_SEQID	"XPC sequence number"
+
+static _Atomic int interrupted;
+static _Atomic int invalid;
+
+// Messages sitting unread on the server port
+static unsigned int
+queued_at(mach_port_t port)
+{
+	mach_port_status_t status;
+	mach_msg_type_number_t count = MACH_PORT_RECEIVE_STATUS_COUNT;
+
+	CHECK(mach_port_get_attributes(mach_task_self(), port,
+	    MACH_PORT_RECEIVE_STATUS, (mach_port_info_t)&status, &count) == KERN_SUCCESS,
+	    "cannot read the port's status");
+	return status.mps_msgcount;
+}
+
+static uint64_t
+stat_of(xpc_connection_t conn, const char *key)
+{
+	xpc_object_t stats = xpc_connection_copy_statistics(conn);
+	uint64_t value = xpc_dictionary_get_uint64(stats, key);
+
+	xpc_release(stats);
+	return value;
+}
+
+// Runs block away from the connection's queues and says if it finished in time
+static bool
+finishes_within(int64_t ms, dispatch_block_t block)
+{
+	dispatch_semaphore_t done = dispatch_semaphore_create(0);
+
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+		block();
+		dispatch_semaphore_signal(done);
+	});
+	return dispatch_semaphore_wait(done,
+	    dispatch_time(DISPATCH_TIME_NOW, ms * NSEC_PER_MSEC)) == 0;
+}
+
+static void
+count_result(xpc_object_t result)
+{
+	if (result == XPC_ERROR_CONNECTION_INTERRUPTED)
+		atomic_fetch_add(&interrupted, 1);
+	else if (result == XPC_ERROR_CONNECTION_INVALID)
+		atomic_fetch_add(&invalid, 1);
+}
+
+static mach_port_t
+server_port(void)
+{
+	mach_port_t port;
+	mach_port_limits_t limits = { .mpl_qlimit = MACH_PORT_QLIMIT_MAX };
+
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+	mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+	mach_port_set_attributes(mach_task_self(), port, MACH_PORT_LIMITS_INFO,
+	    (mach_port_info_t)&limits, MACH_PORT_LIMITS_INFO_COUNT);
+	return port;
+}
+
+static xpc_connection_t
+connect_to(mach_port_t port, dispatch_queue_t q)
+{
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)port);
+
+	xpc_connection_set_target_queue(conn, q);
+	xpc_connection_set_event_handler(conn, ^(xpc_object_t object) { });
+	return conn;
+}
+
+int main(int argc, const char * argv[]) {
+	dispatch_queue_t q = dispatch_queue_create("xpc_flow_control_test", NULL);
+	mach_port_t server = server_port();
+	xpc_connection_t conn = connect_to(server, q);
+
+	xpc_connection_set_send_watermarks(conn, 1, 4, 0, 0);
+	xpc_connection_set_send_window(conn, 2);
+	xpc_connection_resume(conn);
+
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(message, "kind", "request");
+
+	// Well past the high watermark, all from the send queue
+	xpc_connection_send_barrier(conn, ^{
+		for (int i = 0; i < 16; i++)
+			xpc_connection_send_message(conn, message);
+		for (int i = 0; i < 2; i++)
+			xpc_connection_send_message_with_reply(conn, message, q,
+			    ^(xpc_object_t reply) { count_result(reply); });
+	});
+	xpc_connection_send_barrier(conn, ^{ });
+
+	CHECK(queued_at(server) == 18, "%u of 18 messages sent from the send queue",
+	    queued_at(server));
+	CHECK(stat_of(conn, "messages sent") == 18, "%llu messages counted as sent",
+	    stat_of(conn, "messages sent"));
+	CHECK(stat_of(conn, "send queue messages") == 0, "send queue count is %llu",
+	    stat_of(conn, "send queue messages"));
+	CHECK(stat_of(conn, "send queue bytes") == 0, "send queue bytes are %llu",
+	    stat_of(conn, "send queue bytes"));
+
+	// Both calls hold the window, which one-way messages do not need
+	CHECK(finishes_within(5000, ^{
+		for (int i = 0; i < 8; i++)
+			xpc_connection_send_message(conn, message);
+		xpc_connection_send_barrier(conn, ^{ });
+	}), "one-way messages held up by a full window");
+	CHECK(queued_at(server) == 26, "%u of 26 messages sent", queued_at(server));
+
+	// A third call cannot get in, and gives up without being sent.
+	xpc_object_t result = xpc_connection_send_message_with_reply_sync_timeout(conn,
+	    message, 50 * NSEC_PER_MSEC);
+	CHECK(result == XPC_ERROR_CONNECTION_INTERRUPTED, "call outside the window got %p",
+	    result);
+	xpc_connection_send_barrier(conn, ^{ });
+	CHECK(queued_at(server) == 26, "call outside the window was sent");
+
+	// Cancelling gives the window back.
+	xpc_connection_cancel(conn);
+	xpc_connection_send_barrier(conn, ^{ });
+	dispatch_sync(q, ^{ });
+	CHECK(atomic_load(&invalid) == 2, "%d of 2 calls told of the cancel",
+	    atomic_load(&invalid));
+	CHECK(atomic_load(&interrupted) == 0, "a call in the window timed out");
+	CHECK(finishes_within(5000, ^{
+		CHECK(xpc_connection_send_message_with_reply_sync(conn, message) ==
+		    XPC_ERROR_CONNECTION_INVALID, "call after the cancel was not refused");
+	}), "window still full after the cancel");
+
+	// An explicit sequence number still counts as a first message.
+	xpc_connection_t numbered = connect_to(server_port(), q);
+	xpc_connection_resume(numbered);
+	xpc_dictionary_set_uint64(message, XPC_SEQID, 7);
+	xpc_connection_send_message(numbered, message);
+	xpc_connection_send_barrier(numbered, ^{ });
+
+	pid_t child = fork();
+	if (child == 0) {
+		xpc_connection_set_send_window(numbered, 2);
+		_exit(0);
+	}
+	int status;
+	CHECK(waitpid(child, &status, 0) == child, "waitpid");
+	CHECK(!WIFEXITED(status), "send window set after the first message");
+
+	xpc_release(message);
+	return 0;
+}
@@ -0,0 +1,294 @@
+//
+//  xpc_json_benchmark.c
+//  Checks the JSON reader and writer on fixed input: every type reads back
+//  as itself, numbers follow the RFC 8259 grammar, strings that are not
+//  UTF-8 are refused, and "$dict" keys nested deep are read only once.
+//  Then builds a launchctl-list-sized dictionary of jobs and times
+//  streaming it as JSON against xpc_copy_description(), parses the JSON
+//  back and checks it reads back equal.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+struct buffer {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+static ssize_t
+append(void *context, const void *buf, size_t len)
+{
+	struct buffer *b = context;
+
+	if (b->len + len > b->cap) {
+		b->cap = (b->len + len) * 2;
+		b->data = realloc(b->data, b->cap);
+	}
+	memcpy(b->data + b->len, buf, len);
+	b->len += len;
+
+	return len;
+}
+
+static xpc_object_t
+make_jobs(size_t count)
+{
+	xpc_object_t jobs = xpc_dictionary_create(NULL, NULL, 0);
+	char label[64];
+	uuid_t uuid;
+
+	for (size_t i = 0; i < count; i++) {
+		snprintf(label, sizeof(label), "com.example.job.%zu", i);
+		xpc_object_t job = xpc_dictionary_create(NULL, NULL, 0);
+		xpc_dictionary_set_string(job, "Label", label);
+		xpc_dictionary_set_int64(job, "PID", 1000 + i);
+		xpc_dictionary_set_int64(job, "LastExitStatus", 0);
+		xpc_dictionary_set_bool(job, "OnDemand", i % 2);
+		xpc_dictionary_set_string(job, "Program", "/usr/libexec/example");
+		xpc_object_t started = xpc_date_create(1588334400000000000LL + i);
+		xpc_dictionary_set_value(job, "Started", started);
+		xpc_release(started);
+		uuid_generate(uuid);
+		xpc_dictionary_set_uuid(job, "Instance", uuid);
+
+		xpc_object_t args = xpc_array_create(NULL, 0);
+		xpc_array_set_string(args, XPC_ARRAY_APPEND, "/usr/libexec/example");
+		xpc_array_set_string(args, XPC_ARRAY_APPEND, "--label");
+		xpc_array_set_string(args, XPC_ARRAY_APPEND, label);
+		xpc_dictionary_set_value(job, "ProgramArguments", args);
+		xpc_release(args);
+
+		xpc_dictionary_set_value(jobs, label, job);
+		xpc_release(job);
+	}
+
+	return jobs;
+}
+
+static xpc_object_t
+parse(const char *json)
+{
+
+	return xpc_create_from_json(json, strlen(json));
+}
+
+// Writes object to a fresh buffer, returning the writer's result
+static int
+write_json(xpc_object_t object, struct buffer *b)
+{
+
+	b->len = 0;
+	return xpc_json_write(object, append, b, 0);
+}
+
+static xpc_object_t
+make_sample(void)
+{
+	static const uint8_t bytes[] = { 0x00, 0xff, 0x10 };
+	uuid_t uuid;
+
+	xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_int64(dict, "min", INT64_MIN);
+	xpc_dictionary_set_uint64(dict, "max", UINT64_MAX);
+	xpc_dictionary_set_double(dict, "tenth", 0.1);
+	xpc_dictionary_set_double(dict, "large", 1e300);
+	xpc_dictionary_set_double(dict, "whole", 3.0);
+	xpc_dictionary_set_double(dict, "infinity", -INFINITY);
+	xpc_dictionary_set_date(dict, "date", 1588334400000000001LL);
+	xpc_dictionary_set_data(dict, "data", bytes, sizeof(bytes));
+	uuid_generate(uuid);
+	xpc_dictionary_set_uuid(dict, "uuid", uuid);
+	xpc_dictionary_set_string(dict, "text", "tab\tquote\" \xe2\x82\xac \xf0\x9f\x98\x80 \x01");
+	xpc_dictionary_set_value(dict, "null", xpc_null_create());
+
+	/* Looks like a tag, so it has to be wrapped */
+	xpc_object_t tagged = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(tagged, "$data", "not base64");
+	xpc_dictionary_set_value(dict, "tagged", tagged);
+
+	/* "$dict" as an ordinary key, holding something that looks like a tag */
+	xpc_object_t untagged = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_value(untagged, "$dict", tagged);
+	xpc_dictionary_set_bool(untagged, "b", true);
+	xpc_dictionary_set_value(dict, "untagged", untagged);
+	xpc_release(untagged);
+	xpc_release(tagged);
+
+	return dict;
+}
+
+static const char *good_numbers[] = {
+	"0", "-0", "7", "-12", "0.5", "-0.5", "10.25", "1e5", "1E-5", "1e+5",
+	"-0.0e+0", "9223372036854775807", "18446744073709551615", "1e-999",
+};
+
+static const char *bad_numbers[] = {
+	"+1", "01", "-01", "00", "1.", ".5", "-.5", "1.e5", "1e", "1e+", "--1",
+	"-", "0x10", "1e999", "-1e999", "1.5e99999", "Infinity", "-Infinity",
+	"NaN", "18446744073709551616", "1,5",
+};
+
+static const char *bad_strings[] = {
+	"\xff", "\x80", "caf\xe9", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80",
+	"\xed\xa0\x80", "\xed\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80",
+	"\xe2\x82", "\xf0\x9f\x98",
+};
+
+// {"$dict":{"k":<same>},"b":1}, levels deep: "$dict" is no tag at any level
+static char *
+make_nested(size_t levels)
+{
+	static const char head[] = "{\"$dict\":{\"k\":", tail[] = "},\"b\":1}";
+	char *json = malloc(levels * (sizeof(head) + sizeof(tail)) + 2);
+	char *p = json;
+
+	for (size_t i = 0; i < levels; i++)
+		p = stpcpy(p, head);
+	p = stpcpy(p, "1");
+	for (size_t i = 0; i < levels; i++)
+		p = stpcpy(p, tail);
+
+	return json;
+}
+
+// Each level used to be read twice, once as a tag and once as a key.
+static void
+check_nested(size_t levels)
+{
+	char *json = make_nested(levels);
+
+	bench_start();
+	xpc_object_t nested = parse(json);
+	bench_stop("nested \"$dict\" keys", levels, "level");
+	CHECK(nested != NULL, "%zu levels of \"$dict\" keys were refused", levels);
+
+	xpc_object_t level = nested;
+	for (size_t i = 0; i < levels; i++) {
+		CHECK(xpc_dictionary_get_int64(level, "b") == 1, "level %zu has no \"b\"", i);
+		level = xpc_dictionary_get_value(level, "$dict");
+		CHECK(level != NULL && xpc_get_type(level) == XPC_TYPE_DICTIONARY,
+		    "level %zu has no \"$dict\" dictionary", i);
+		level = xpc_dictionary_get_value(level, "k");
+	}
+	CHECK(level != NULL && xpc_int64_get_value(level) == 1, "innermost value lost");
+	xpc_release(nested);
+
+	/* One brace short, which has to fail just as quickly */
+	json[strlen(json) - 1] = '\0';
+	bench_start();
+	CHECK(parse(json) == NULL, "%zu levels one brace short were accepted", levels);
+	bench_stop("nested \"$dict\" keys, truncated", levels, "level");
+
+	free(json);
+}
+
+static void
+check_documents(void)
+{
+	struct buffer b = { NULL, 0, 0 };
+	char json[64];
+
+	xpc_object_t sample = make_sample();
+	CHECK(write_json(sample, &b) == 0, "writing the sample failed");
+	xpc_object_t back = xpc_create_from_json(b.data, b.len);
+	CHECK(back != NULL && xpc_equal(sample, back), "sample round trip differs");
+	xpc_release(back);
+	xpc_release(sample);
+
+	/* NaN is never equal to itself */
+	xpc_object_t nan = xpc_double_create(NAN);
+	CHECK(write_json(nan, &b) == 0, "writing NaN failed");
+	back = xpc_create_from_json(b.data, b.len);
+	CHECK(back != NULL && isnan(xpc_double_get_value(back)), "NaN did not read back");
+	xpc_release(back);
+	xpc_release(nan);
+
+	for (size_t i = 0; i < sizeof(good_numbers) / sizeof(good_numbers[0]); i++) {
+		back = parse(good_numbers[i]);
+		CHECK(back != NULL, "%s was refused", good_numbers[i]);
+		xpc_release(back);
+
+		snprintf(json, sizeof(json), "[%s]", good_numbers[i]);
+		back = parse(json);
+		CHECK(back != NULL, "%s was refused", json);
+		xpc_release(back);
+	}
+
+	for (size_t i = 0; i < sizeof(bad_numbers) / sizeof(bad_numbers[0]); i++) {
+		CHECK(parse(bad_numbers[i]) == NULL, "%s was accepted", bad_numbers[i]);
+
+		snprintf(json, sizeof(json), "{\"n\": %s}", bad_numbers[i]);
+		CHECK(parse(json) == NULL, "%s was accepted", json);
+	}
+
+	for (size_t i = 0; i < sizeof(bad_strings) / sizeof(bad_strings[0]); i++) {
+		xpc_object_t string = xpc_string_create(bad_strings[i]);
+		CHECK(write_json(string, &b) == EILSEQ, "string %zu was written", i);
+		xpc_release(string);
+
+		xpc_object_t dict = xpc_dictionary_create(NULL, NULL, 0);
+		xpc_dictionary_set_bool(dict, bad_strings[i], true);
+		CHECK(write_json(dict, &b) == EILSEQ, "key %zu was written", i);
+		xpc_release(dict);
+	}
+
+	free(b.data);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t count = bench_arg(argc, argv, 1, 20000);
+	size_t iterations = bench_arg(argc, argv, 2, 10);
+
+	check_documents();
+	check_nested(200);
+
+	xpc_object_t jobs = make_jobs(count);
+	int devnull = open("/dev/null", O_WRONLY);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		CHECK(xpc_json_write_fd(jobs, devnull, 0) == 0, "xpc_json_write_fd failed");
+	}
+	bench_stop("JSON to fd", iterations, "dump");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		char *desc = xpc_copy_description(jobs);
+		write(devnull, desc, strlen(desc));
+		free(desc);
+	}
+	bench_stop("xpc_copy_description", iterations, "dump");
+
+	struct buffer json = { NULL, 0, 0 };
+	CHECK(xpc_json_write(jobs, append, &json, 0) == 0, "xpc_json_write failed");
+	printf("%zu bytes of JSON\n", json.len);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		xpc_release(xpc_create_from_json(json.data, json.len));
+	}
+	bench_stop("xpc_create_from_json", iterations, "parse");
+
+	xpc_object_t back = xpc_create_from_json(json.data, json.len);
+	CHECK(back != NULL && xpc_equal(jobs, back), "JSON round trip differs");
+
+	xpc_release(back);
+	xpc_release(jobs);
+	free(json.data);
+	close(devnull);
+
+	return 0;
+}
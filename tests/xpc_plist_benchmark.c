@@ -0,0 +1,227 @@
+//
+//  xpc_plist_benchmark.c
+//  Checks xpc_create_from_plist() against fixed documents, well-formed and
+//  not, then parses every XML property list in a directory (by default
+//  /System/Library/LaunchDaemons) with it and with
+//  CFPropertyListCreateWithData(), which launchctl used to go through.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define MAX_FILES	4096
+
+#define PLIST_HEAD \
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" " \
+	"\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n" \
+	"<plist version=\"1.0\">\n"
+#define PLIST_TAIL	"</plist>\n"
+
+struct plist_file {
+	void *data;
+	size_t size;
+};
+
+static const char job_plist[] = PLIST_HEAD
+	"<dict>\n"
+	"\t<key>Label</key>\n"
+	"\t<string>org.puredarwin.test</string>\n"
+	"\t<key>ProgramArguments</key>\n"
+	"\t<array>\n"
+	"\t\t<string>/usr/sbin/test</string>\n"
+	"\t\t<string>&lt;a&gt; &amp; &quot;b&apos; &#65;&#x42;&#x20AC;&#128512;</string>\n"
+	"\t\t<string><![CDATA[<raw> & text]]></string>\n"
+	"\t</array>\n"
+	"\t<key>Nice</key>\n"
+	"\t<integer>-5</integer>\n"
+	"\t<key>Interval</key>\n"
+	"\t<real>1.5</real>\n"
+	"\t<key>RunAtLoad</key>\n"
+	"\t<true/>\n"
+	"\t<key>Data</key>\n"
+	"\t<data>AAEC/w==</data>\n"
+	"\t<key>Sockets</key>\n"
+	"\t<dict/>\n"
+	"</dict>\n"
+	PLIST_TAIL;
+
+static xpc_object_t
+make_job(void)
+{
+	static const uint8_t bytes[] = { 0x00, 0x01, 0x02, 0xff };
+
+	xpc_object_t job = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(job, "Label", "org.puredarwin.test");
+
+	xpc_object_t args = xpc_array_create(NULL, 0);
+	xpc_array_set_string(args, XPC_ARRAY_APPEND, "/usr/sbin/test");
+	xpc_array_set_string(args, XPC_ARRAY_APPEND,
+	    "<a> & \"b' AB\xe2\x82\xac\xf0\x9f\x98\x80");
+	xpc_array_set_string(args, XPC_ARRAY_APPEND, "<raw> & text");
+	xpc_dictionary_set_value(job, "ProgramArguments", args);
+	xpc_release(args);
+
+	xpc_dictionary_set_int64(job, "Nice", -5);
+	xpc_dictionary_set_double(job, "Interval", 1.5);
+	xpc_dictionary_set_bool(job, "RunAtLoad", true);
+	xpc_dictionary_set_data(job, "Data", bytes, sizeof(bytes));
+
+	xpc_object_t sockets = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_value(job, "Sockets", sockets);
+	xpc_release(sockets);
+
+	return job;
+}
+
+static xpc_object_t
+parse(const char *plist)
+{
+
+	return xpc_create_from_plist((void *)plist, strlen(plist));
+}
+
+// Entities that are malformed or name characters XML does not allow
+static const char *bad_entities[] = {
+	"&#-1;", "&# 65;", "&#+65;", "&#X43;", "&#0;", "&#x0;", "&#00;", "&#xD800;",
+	"&#xdfff;", "&#55296;", "&#x110000;", "&#99999999999999999999;",
+	"&#;", "&#x;", "&#65a;", "&#x4g;", "&#x-41;", "&nbsp;", "&amp",
+};
+
+static void
+check_documents(void)
+{
+	char plist[256];
+
+	xpc_object_t expected = make_job();
+	xpc_object_t parsed = parse(job_plist);
+	CHECK(parsed != NULL, "well-formed job failed to parse");
+	CHECK(xpc_equal(parsed, expected), "parsed job differs from the expected one");
+
+	/* Through the binary format and back */
+	size_t size;
+	void *bplist = xpc_bplist_create(parsed, &size);
+	CHECK(bplist != NULL, "binary encoding failed");
+	xpc_object_t decoded = xpc_create_from_plist(bplist, size);
+	CHECK(decoded != NULL && xpc_equal(decoded, expected),
+	    "binary round trip changed the job");
+	xpc_release(decoded);
+	free(bplist);
+	xpc_release(parsed);
+	xpc_release(expected);
+
+	/* The largest code point allowed */
+	parsed = parse(PLIST_HEAD "<string>&#x10FFFF;&#1114111;</string>" PLIST_TAIL);
+	CHECK(parsed != NULL && strcmp(xpc_string_get_string_ptr(parsed),
+	    "\xf4\x8f\xbf\xbf\xf4\x8f\xbf\xbf") == 0, "U+10FFFF not decoded");
+	xpc_release(parsed);
+
+	for (size_t i = 0; i < sizeof(bad_entities) / sizeof(bad_entities[0]); i++) {
+		snprintf(plist, sizeof(plist), PLIST_HEAD "<string>x%sy</string>" PLIST_TAIL,
+		    bad_entities[i]);
+		parsed = parse(plist);
+		CHECK(parsed == NULL, "%s was accepted", bad_entities[i]);
+	}
+
+	CHECK(parse(PLIST_HEAD "<dict><key>a</key></dict>" PLIST_TAIL) == NULL,
+	    "key without a value was accepted");
+	CHECK(parse(PLIST_HEAD "<array><string>a</array>" PLIST_TAIL) == NULL,
+	    "unclosed string was accepted");
+	CHECK(parse(PLIST_HEAD "<integer>12x</integer>" PLIST_TAIL) == NULL,
+	    "malformed integer was accepted");
+}
+
+static bool
+read_file(const char *path, struct plist_file *file)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	file->size = ftell(fp);
+	rewind(fp);
+	file->data = malloc(file->size);
+	bool ok = fread(file->data, 1, file->size, fp) == file->size;
+	fclose(fp);
+
+	return ok;
+}
+
+int main(int argc, const char * argv[]) {
+	const char *dir = "/System/Library/LaunchDaemons";
+	size_t iterations = bench_arg(argc, argv, 2, 20);
+	if (argc > 1) {
+		dir = argv[1];
+	}
+
+	check_documents();
+
+	static struct plist_file files[MAX_FILES];
+	size_t count = 0, bytes = 0;
+	char path[PATH_MAX];
+
+	DIR *d = opendir(dir);
+	CHECK(d != NULL, "%s: cannot open", dir);
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL && count < MAX_FILES) {
+		size_t len = strlen(de->d_name);
+		if (len < 6 || strcmp(de->d_name + len - 6, ".plist") != 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (!read_file(path, &files[count]))
+			continue;
+
+		/* Binary plists are not for this parser */
+		if (files[count].size >= 8 && memcmp(files[count].data, "bplist00", 8) == 0) {
+			free(files[count].data);
+			continue;
+		}
+
+		xpc_object_t obj = xpc_create_from_plist(files[count].data, files[count].size);
+		CHECK(obj != NULL, "%s: failed to parse", path);
+		xpc_release(obj);
+
+		bytes += files[count].size;
+		count++;
+	}
+	closedir(d);
+
+	CHECK(count > 0, "%s: no XML property lists found", dir);
+	printf("%zu files, %zu bytes\n", count, bytes);
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			xpc_release(xpc_create_from_plist(files[i].data, files[i].size));
+		}
+	}
+	double native = bench_stop("xpc_create_from_plist", iterations, "corpus");
+
+	bench_start();
+	for (size_t n = 0; n < iterations; n++) {
+		for (size_t i = 0; i < count; i++) {
+			CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, files[i].data,
+			    files[i].size, kCFAllocatorNull);
+			CFPropertyListRef plist = CFPropertyListCreateWithData(NULL, data,
+			    kCFPropertyListMutableContainersAndLeaves, NULL, NULL);
+			if (plist != NULL)
+				CFRelease(plist);
+			CFRelease(data);
+		}
+	}
+	double cf = bench_stop("CFPropertyListCreateWithData", iterations, "corpus");
+
+	printf("%.1f MB/s against %.1f MB/s\n", bytes / native * 1e3, bytes / cf * 1e3);
+
+	return 0;
+}
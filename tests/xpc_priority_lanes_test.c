@@ -0,0 +1,114 @@
+//
+//  xpc_priority_lanes_test.c
+//  Queues a backlog of bulk and default priority messages behind a stalled
+//  send queue, then one interactive message, and reads what the connection
+//  sent from the server port: the interactive message goes first, each
+//  lane keeps the order its messages were queued in, and the default lane
+//  is not starved by the bulk one.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach/mach.h>
+#include <dispatch/dispatch.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define BULK		64
+#define DEFAULT		16
+#define TOTAL		(BULK + DEFAULT + 1)
+
+static boolean_t
+no_demux(mach_msg_header_t *request, mach_msg_header_t *reply)
+{
+	return FALSE;
+}
+
+static void
+queue(xpc_connection_t conn, xpc_message_priority_t priority, int64_t n)
+{
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+
+	xpc_dictionary_set_int64(message, "priority", priority);
+	xpc_dictionary_set_int64(message, "n", n);
+	xpc_message_set_priority(message, priority);
+	xpc_connection_send_message(conn, message);
+	xpc_release(message);
+}
+
+int main(int argc, const char * argv[]) {
+	mach_port_t server;
+	mach_port_limits_t limits = { .mpl_qlimit = MACH_PORT_QLIMIT_MAX };
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &server);
+	mach_port_insert_right(mach_task_self(), server, server, MACH_MSG_TYPE_MAKE_SEND);
+	mach_port_set_attributes(mach_task_self(), server, MACH_PORT_LIMITS_INFO,
+	    (mach_port_info_t)&limits, MACH_PORT_LIMITS_INFO_COUNT);
+
+	dispatch_queue_t q = dispatch_queue_create("xpc_priority_lanes_test", NULL);
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)server);
+	xpc_connection_set_target_queue(conn, q);
+	xpc_connection_set_event_handler(conn, ^(xpc_object_t object) { });
+	xpc_connection_resume(conn);
+
+	// Hold the send queue so that everything below waits in the lanes.
+	dispatch_semaphore_t stalled = dispatch_semaphore_create(0);
+	dispatch_semaphore_t release = dispatch_semaphore_create(0);
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+		xpc_connection_send_barrier(conn, ^{
+			dispatch_semaphore_signal(stalled);
+			dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+		});
+	});
+	CHECK(dispatch_semaphore_wait(stalled, dispatch_time(DISPATCH_TIME_NOW,
+	    5 * NSEC_PER_SEC)) == 0, "send queue never stalled");
+
+	for (int i = 0; i < BULK; i++)
+		queue(conn, XPC_MESSAGE_PRIORITY_BULK, i);
+	for (int i = 0; i < DEFAULT; i++)
+		queue(conn, XPC_MESSAGE_PRIORITY_DEFAULT, i);
+	queue(conn, XPC_MESSAGE_PRIORITY_INTERACTIVE, 0);
+
+	dispatch_semaphore_signal(release);
+	xpc_connection_send_barrier(conn, ^{ });
+
+	int64_t next_bulk = 0, next_default = 0, bulk_before_last_default = -1;
+	for (int i = 0; i < TOTAL; i++) {
+		xpc_object_t message = NULL;
+		mach_port_t remote;
+
+		CHECK(xpc_pipe_try_receive(server, &message, &remote, no_demux, 0, 0) == 0 &&
+		    message != NULL, "message %d of %d never sent", i, TOTAL);
+
+		int64_t priority = xpc_dictionary_get_int64(message, "priority");
+		int64_t n = xpc_dictionary_get_int64(message, "n");
+		if (i == 0) {
+			CHECK(priority == XPC_MESSAGE_PRIORITY_INTERACTIVE,
+			    "interactive message waited behind the backlog");
+		} else if (priority == XPC_MESSAGE_PRIORITY_BULK) {
+			CHECK(n == next_bulk, "bulk message %lld sent when %lld was due",
+			    (long long)n, (long long)next_bulk);
+			next_bulk++;
+		} else {
+			CHECK(priority == XPC_MESSAGE_PRIORITY_DEFAULT,
+			    "interactive message sent twice");
+			CHECK(n == next_default, "default message %lld sent when %lld was due",
+			    (long long)n, (long long)next_default);
+			if (++next_default == DEFAULT)
+				bulk_before_last_default = next_bulk;
+		}
+		xpc_release(message);
+	}
+	CHECK(next_bulk == BULK && next_default == DEFAULT, "messages lost");
+
+	// The default lane gets four turns to the bulk lane's one.
+	CHECK(bulk_before_last_default <= DEFAULT / 4, "%lld bulk messages went "
+	    "ahead of the default backlog", (long long)bulk_before_last_default);
+
+	xpc_connection_cancel(conn);
+	return 0;
+}
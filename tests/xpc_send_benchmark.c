@@ -0,0 +1,118 @@
+//
+//  xpc_send_benchmark.c
+//  Measures the per-message cost of xpc_connection_send_message() and of
+//  the debug logging done on that path, and checks that every message
+//  sent arrives and is counted.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <mach/mach.h>
+#include <os/log.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define DRAIN_BUFFER_SIZE	65536
+#define DRAIN_TIMEOUT_MS	10000
+
+/* What every debugf() call used to cost: a fresh log handle per message. */
+#define legacy_debugf(msg, ...) \
+	do { \
+		os_log_t logger = os_log_create("org.puredarwin.libxpc", "Debug"); \
+		os_log(logger, msg, ##__VA_ARGS__); \
+		os_release(logger); \
+	} while (0)
+
+struct drain {
+	mach_port_t port;
+	size_t expected;
+	size_t received;
+};
+
+// Receives the expected number of messages, or gives up once none arrive
+static void *
+drain_port(void *context)
+{
+	struct drain *d = context;
+	mach_msg_header_t *msg = malloc(DRAIN_BUFFER_SIZE);
+
+	while (d->received < d->expected) {
+		msg->msgh_size = DRAIN_BUFFER_SIZE;
+		msg->msgh_local_port = d->port;
+		if (mach_msg(msg, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0,
+		    DRAIN_BUFFER_SIZE, d->port, DRAIN_TIMEOUT_MS,
+		    MACH_PORT_NULL) != MACH_MSG_SUCCESS)
+			break;
+		mach_msg_destroy(msg);
+		d->received++;
+	}
+
+	free(msg);
+	return NULL;
+}
+
+int main(int argc, const char * argv[]) {
+	size_t iterations = bench_arg(argc, argv, 1, 100000);
+
+	mach_port_t port;
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+	mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+
+	mach_port_limits_t limits = { .mpl_qlimit = MACH_PORT_QLIMIT_MAX };
+	mach_port_set_attributes(mach_task_self(), port, MACH_PORT_LIMITS_INFO,
+	    (mach_port_info_t)&limits, MACH_PORT_LIMITS_INFO_COUNT);
+
+	struct drain drain = { port, iterations, 0 };
+	pthread_t drainer;
+	pthread_create(&drainer, NULL, drain_port, &drain);
+
+	/* Logging overhead alone, old and new style */
+	os_log_t cached = os_log_create("org.puredarwin.libxpc", "Debug");
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		legacy_debugf("connection=%p, message=%p, id=%zu", &port, &port, i);
+	}
+	bench_stop("legacy debugf", iterations, "call");
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		os_log_debug(cached, "connection=%p, message=%p, id=%zu", &port, &port, i);
+	}
+	bench_stop("cached os_log_debug", iterations, "call");
+
+	/* End-to-end send loop through the library */
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)port);
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(message, "key", "value");
+	xpc_dictionary_set_int64(message, "number", 42);
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_connection_send_message(conn, message);
+	}
+	xpc_connection_send_barrier(conn, ^{ });
+	bench_stop("xpc_connection_send_message", iterations, "message");
+
+	pthread_join(drainer, NULL);
+	CHECK(drain.received == iterations, "%zu of %zu messages arrived",
+	    drain.received, iterations);
+
+	xpc_object_t stats = xpc_connection_copy_statistics(conn);
+	CHECK(xpc_dictionary_get_uint64(stats, "messages sent") == iterations,
+	    "%llu messages counted as sent",
+	    xpc_dictionary_get_uint64(stats, "messages sent"));
+	CHECK(xpc_dictionary_get_uint64(stats, "send errors") == 0,
+	    "send errors counted");
+	CHECK(xpc_dictionary_get_uint64(stats, "send queue messages") == 0,
+	    "send queue not empty after the barrier");
+	xpc_release(stats);
+
+	xpc_release(message);
+	os_release(cached);
+	return 0;
+}
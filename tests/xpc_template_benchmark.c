@@ -0,0 +1,211 @@
+//
+//  xpc_template_benchmark.c
+//  Times building and sending an event-style message of six fields as a
+//  plain dictionary and through a message template, and checks that the
+//  two agree, that slots are updated in place only when that is safe, and
+//  that messages keep a released template alive.
+//
+//  Copyright © 2020 PureDarwin. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <mach/mach.h>
+#include <xpc/xpc.h>
+#include <xpc/private.h>
+
+#include "bench.h"
+
+#define DRAIN_BUFFER_SIZE	65536
+#define DRAIN_TIMEOUT_MS	10000
+
+enum {
+	SLOT_STREAM,
+	SLOT_EVENT,
+	SLOT_TOKEN,
+	SLOT_PID,
+	SLOT_FLAGS,
+	SLOT_ENABLED,
+};
+
+static const xpc_message_field_t event_fields[] = {
+	{ "stream", XPC_TYPE_STRING },
+	{ "event", XPC_TYPE_STRING },
+	{ "token", XPC_TYPE_UINT64 },
+	{ "pid", XPC_TYPE_INT64 },
+	{ "flags", XPC_TYPE_UINT64 },
+	{ "enabled", XPC_TYPE_BOOL },
+};
+
+struct drain {
+	mach_port_t port;
+	size_t expected;
+	size_t received;
+};
+
+// Receives the expected number of messages, or gives up once none arrive
+static void *
+drain_port(void *context)
+{
+	struct drain *d = context;
+	mach_msg_header_t *msg = malloc(DRAIN_BUFFER_SIZE);
+
+	while (d->received < d->expected) {
+		msg->msgh_size = DRAIN_BUFFER_SIZE;
+		msg->msgh_local_port = d->port;
+		if (mach_msg(msg, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0,
+		    DRAIN_BUFFER_SIZE, d->port, DRAIN_TIMEOUT_MS,
+		    MACH_PORT_NULL) != MACH_MSG_SUCCESS)
+			break;
+		mach_msg_destroy(msg);
+		d->received++;
+	}
+
+	free(msg);
+	return NULL;
+}
+
+static xpc_object_t
+make_plain(size_t i)
+{
+	xpc_object_t message = xpc_dictionary_create(NULL, NULL, 0);
+	xpc_dictionary_set_string(message, "stream", "com.apple.iokit.matching");
+	xpc_dictionary_set_string(message, "event", "IOServicePublish");
+	xpc_dictionary_set_uint64(message, "token", i);
+	xpc_dictionary_set_int64(message, "pid", 100);
+	xpc_dictionary_set_uint64(message, "flags", 0x2);
+	xpc_dictionary_set_bool(message, "enabled", true);
+
+	return message;
+}
+
+static xpc_object_t
+make_templated(xpc_message_template_t tmpl, size_t i)
+{
+	xpc_object_t message = xpc_message_template_create_message(tmpl);
+	xpc_message_set_string(message, SLOT_STREAM, "com.apple.iokit.matching");
+	xpc_message_set_string(message, SLOT_EVENT, "IOServicePublish");
+	xpc_message_set_uint64(message, SLOT_TOKEN, i);
+	xpc_message_set_int64(message, SLOT_PID, 100);
+	xpc_message_set_uint64(message, SLOT_FLAGS, 0x2);
+	xpc_message_set_bool(message, SLOT_ENABLED, true);
+
+	return message;
+}
+
+// Scalar slots are reused unless the old value is held elsewhere
+static void
+check_in_place(xpc_message_template_t tmpl)
+{
+	xpc_object_t message = xpc_message_template_create_message(tmpl);
+	CHECK(message != NULL, "no message from the template");
+
+	xpc_object_t token = xpc_message_get_value(message, SLOT_TOKEN);
+	xpc_message_set_uint64(message, SLOT_TOKEN, 1);
+	CHECK(xpc_message_get_value(message, SLOT_TOKEN) == token,
+	    "owned token was replaced");
+	CHECK(xpc_dictionary_get_uint64(message, "token") == 1, "token not set");
+
+	xpc_retain(token);
+	xpc_message_set_uint64(message, SLOT_TOKEN, 2);
+	CHECK(xpc_message_get_value(message, SLOT_TOKEN) != token,
+	    "shared token was changed in place");
+	CHECK(xpc_uint64_get_value(token) == 1, "shared token changed to %llu",
+	    xpc_uint64_get_value(token));
+	CHECK(xpc_dictionary_get_uint64(message, "token") == 2, "token not set");
+	xpc_release(token);
+
+	/* A cached hash must not survive an in-place update */
+	xpc_object_t pid = xpc_message_get_value(message, SLOT_PID);
+	xpc_message_set_int64(message, SLOT_PID, 1);
+	size_t hash = xpc_hash(pid);
+	xpc_message_set_int64(message, SLOT_PID, 2);
+	CHECK(xpc_message_get_value(message, SLOT_PID) == pid, "owned pid was replaced");
+	xpc_object_t two = xpc_int64_create(2);
+	CHECK(xpc_hash(pid) == xpc_hash(two) && xpc_hash(pid) != hash,
+	    "stale hash after an in-place update");
+	xpc_release(two);
+
+	/* A value of another type set by key is replaced, not written through */
+	xpc_dictionary_set_string(message, "pid", "none");
+	xpc_message_set_int64(message, SLOT_PID, 3);
+	CHECK(xpc_dictionary_get_int64(message, "pid") == 3, "pid not set back");
+
+	xpc_release(message);
+}
+
+int main(int argc, const char * argv[]) {
+	size_t iterations = bench_arg(argc, argv, 1, 100000);
+
+	xpc_message_template_t tmpl = xpc_message_template_create(event_fields,
+	    sizeof(event_fields) / sizeof(event_fields[0]));
+	CHECK(tmpl != NULL, "template creation failed");
+
+	/* A templated message is an ordinary dictionary */
+	xpc_object_t plain = make_plain(7);
+	xpc_object_t templated = make_templated(tmpl, 7);
+	CHECK(xpc_equal(plain, templated), "templated message differs from the plain one");
+	xpc_release(plain);
+
+	check_in_place(tmpl);
+
+	mach_port_t port;
+	mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+	mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+
+	mach_port_limits_t limits = { .mpl_qlimit = MACH_PORT_QLIMIT_MAX };
+	mach_port_set_attributes(mach_task_self(), port, MACH_PORT_LIMITS_INFO,
+	    (mach_port_info_t)&limits, MACH_PORT_LIMITS_INFO_COUNT);
+
+	struct drain drain = { port, 2 * iterations + 1, 0 };
+	pthread_t drainer;
+	pthread_create(&drainer, NULL, drain_port, &drain);
+
+	xpc_connection_t conn = xpc_connection_create_from_endpoint((xpc_endpoint_t)(uintptr_t)port);
+
+	/* Building alone */
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_release(make_plain(i));
+	}
+	bench_stop("build, dictionary", iterations, "message");
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_release(make_templated(tmpl, i));
+	}
+	bench_stop("build, template", iterations, "message");
+
+	/* Building and sending */
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_object_t message = make_plain(i);
+		xpc_connection_send_message(conn, message);
+		xpc_release(message);
+	}
+	xpc_connection_send_barrier(conn, ^{ });
+	bench_stop("send, dictionary", iterations, "message");
+
+	bench_start();
+	for (size_t i = 0; i < iterations; i++) {
+		xpc_object_t message = make_templated(tmpl, i);
+		xpc_connection_send_message(conn, message);
+		xpc_release(message);
+	}
+	xpc_connection_send_barrier(conn, ^{ });
+	bench_stop("send, template", iterations, "message");
+
+	/* Messages keep their template alive after it is released */
+	xpc_message_template_release(tmpl);
+	xpc_message_set_uint64(templated, SLOT_TOKEN, 8);
+	CHECK(xpc_dictionary_get_uint64(templated, "token") == 8, "token not set");
+	xpc_connection_send_message(conn, templated);
+	xpc_release(templated);
+
+	pthread_join(drainer, NULL);
+	CHECK(drain.received == drain.expected, "%zu of %zu messages arrived",
+	    drain.received, drain.expected);
+
+	return 0;
+}